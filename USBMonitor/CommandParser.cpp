@@ -0,0 +1,170 @@
+#include "StdAfx.h"
+#include "CommandParser.h"
+
+CommandParser::CommandParser(void)
+	: m_pBuffer(NULL)
+	, m_nCapacity(0)
+	, m_nInitialCapacity(DEFAULT_BUFFER_SIZE)
+	, m_nMaxCapacity(DEFAULT_MAX_BUFFER_SIZE)
+{
+	Reset();
+}
+
+CommandParser::~CommandParser(void)
+{
+	delete[] m_pBuffer;
+}
+
+void CommandParser::SetBufferSize(int nInitialSize, int nMaxSize)
+{
+	// Room for the longest pending line and a read after it
+	m_nInitialCapacity = max(nInitialSize, MAX_COMMAND_LENGTH + MIN_READ_SIZE);
+	m_nMaxCapacity = max(nMaxSize, m_nInitialCapacity);
+	Reset();
+}
+
+void CommandParser::Reset()
+{
+	m_state = STATE_COMMAND;
+	m_nStart = 0;
+	m_nLength = 0;
+	m_bFull = false;
+	if (m_nCapacity != m_nInitialCapacity)
+	{
+		Resize(m_nInitialCapacity);
+	}
+}
+
+void CommandParser::Resize(int nCapacity)
+{
+	char* pBuffer = new char[nCapacity];
+	if (m_nLength > 0)
+	{
+		memcpy(pBuffer, m_pBuffer + m_nStart, m_nLength);
+	}
+	delete[] m_pBuffer;
+	m_pBuffer = pBuffer;
+	m_nCapacity = nCapacity;
+	m_nStart = 0;
+}
+
+char* CommandParser::GetWriteBuffer(DWORD &dwSize)
+{
+	if (m_bFull)
+	{
+		// The client sends faster than it is read, give it more room.
+		m_bFull = false;
+		if (m_nCapacity < m_nMaxCapacity)
+		{
+			Resize(min(m_nCapacity * 2, m_nMaxCapacity));
+		}
+	}
+
+	if (m_nLength == 0)
+	{
+		m_nStart = 0;
+	}
+	else if (m_nCapacity - (m_nStart + m_nLength) < MIN_READ_SIZE)
+	{
+		// Wrap around, carrying the pending line along
+		memmove(m_pBuffer, m_pBuffer + m_nStart, m_nLength);
+		m_nStart = 0;
+	}
+	dwSize = m_nCapacity - (m_nStart + m_nLength);
+	return m_pBuffer + m_nStart + m_nLength;
+}
+
+int CommandParser::Feed(const char* lpData, DWORD dwCount, CommandParserCallback* pCallback)
+{
+	int nCommands = 0;
+	while (dwCount > 0)
+	{
+		DWORD dwSize = 0;
+		char* lpBuffer = GetWriteBuffer(dwSize);
+		DWORD dwChunk = min(dwCount, dwSize);
+		if (lpData != lpBuffer)
+		{
+			// Received somewhere else, e.g. unwrapped from a WebSocket frame
+			memcpy(lpBuffer, lpData, dwChunk);
+		}
+		m_bFull = (dwChunk == dwSize);
+		nCommands += Parse(dwChunk, pCallback);
+		lpData += dwChunk;
+		dwCount -= dwChunk;
+	}
+	return nCommands;
+}
+
+int CommandParser::Parse(DWORD dwCount, CommandParserCallback* pCallback)
+{
+	int nCommands = 0;
+	char* pLine = m_pBuffer + m_nStart;
+	char* p = pLine + m_nLength;
+	char* pEnd = p + dwCount;
+
+	while (p < pEnd)
+	{
+		char ch = *p++;
+
+		if (m_state == STATE_CR)
+		{
+			m_state = STATE_COMMAND;
+			if (ch == '\n')
+			{
+				// "\r\n" ends a single line
+				continue;
+			}
+		}
+
+		switch (ch)
+		{
+		case '\r':
+		case '\n':
+			{
+				if (m_state == STATE_COMMAND && m_nLength > 0)
+				{
+					// The terminator, or a byte dropped before it, makes room for the null.
+					pLine[m_nLength] = '\0';
+					pCallback->OnCommand(pLine, m_nLength);
+					nCommands++;
+				}
+				pLine = p;
+				m_nLength = 0;
+				m_state = (ch == '\r') ? STATE_CR : STATE_COMMAND;
+			}
+			break;
+		case '\b':
+			{
+				if (m_state == STATE_COMMAND && m_nLength > 0)
+				{
+					m_nLength--;
+				}
+			}
+			break;
+		case '\0':
+			// Ignore the padding sent by some clients.
+			break;
+		default:
+			{
+				if (m_state != STATE_COMMAND)
+				{
+					break;
+				}
+				if (m_nLength >= MAX_COMMAND_LENGTH)
+				{
+					TRACE(_T("Socket command is too long, discarded\n"));
+					m_nLength = 0;
+					m_state = STATE_OVERFLOW;
+					break;
+				}
+				// Only moves the character if something before it was dropped
+				pLine[m_nLength++] = ch;
+			}
+			break;
+		}
+	}
+
+	// Keep the pending line only, the space of the dropped characters is free again.
+	m_nStart = static_cast<int>(pLine - m_pBuffer);
+	return nCommands;
+}
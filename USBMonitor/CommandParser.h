@@ -0,0 +1,109 @@
+#pragma once
+
+/**
+ * Receives the commands extracted by CommandParser.
+ */
+class CommandParserCallback
+{
+public:
+	/**
+	 * A complete command line has been received.
+	 * @param utf8Command The null-terminated command line, without the line terminator.
+	 *                    It points into the receive buffer and is only valid during the
+	 *                    call. It may be modified in place, e.g. to split the arguments.
+	 * @param nLength The length of the command line in bytes.
+	 */
+	virtual void OnCommand(char* utf8Command, int nLength) = 0;
+};
+
+/**
+ * Streaming tokenizer for the line based socket protocol.
+ * Each connection owns a parser. The received data is fed in chunks of any size and
+ * every complete command line in the chunk is reported. Incomplete lines are kept in
+ * the buffer until the rest arrives, so no memory is allocated while parsing.
+ *
+ * The parser owns the receive buffer of the connection: the socket reads straight into
+ * GetWriteBuffer(), and the command lines are reported in place, terminated where their
+ * line terminator was, without being copied. The buffer is used as a ring: when the
+ * space left at its end runs short, the pending incomplete line, at most
+ * MAX_COMMAND_LENGTH bytes, moves back to the start.
+ *
+ * The buffer adapts to the client: each time a chunk fills all the space given, it
+ * doubles up to the maximum size, so that a client sending commands in bulk needs fewer
+ * reads. Reset() brings it back to its initial size for the next client.
+ *
+ * A command line is terminated by "\r", "\n" or "\r\n". Empty lines are ignored.
+ * A backspace removes the last character of the pending line, so that the daemon can
+ * be driven from a telnet client.
+ */
+class CommandParser
+{
+public:
+	// Longer command lines are discarded up to the next line terminator.
+	static const int MAX_COMMAND_LENGTH = 1024;
+	// The least space GetWriteBuffer returns
+	static const int MIN_READ_SIZE = 1024;
+	// Default initial and maximum size of the receive buffer
+	static const int DEFAULT_BUFFER_SIZE = 4 * 1024;
+	static const int DEFAULT_MAX_BUFFER_SIZE = 64 * 1024;
+
+	CommandParser(void);
+	~CommandParser(void);
+
+	// Set the initial and the maximum size of the receive buffer, before any data is fed.
+	void SetBufferSize(int nInitialSize, int nMaxSize);
+
+	int GetBufferSize() const
+	{
+		return m_nCapacity;
+	}
+
+	// Drop any pending data and shrink the buffer, e.g. when a new client is accepted.
+	void Reset();
+
+	/**
+	 * Get the space to receive the next chunk into, so that Feed doesn't copy it.
+	 * @param dwSize Receives the size of the space, at least MIN_READ_SIZE.
+	 */
+	char* GetWriteBuffer(DWORD &dwSize);
+
+	/**
+	 * Parse a chunk of received data.
+	 * @param lpData The received data, either read into GetWriteBuffer() or copied there.
+	 * @param dwCount The number of bytes received.
+	 * @param pCallback Called for every complete command line.
+	 * @return The number of command lines reported.
+	 */
+	int Feed(const char* lpData, DWORD dwCount, CommandParserCallback* pCallback);
+
+private:
+	// Not copyable
+	CommandParser(const CommandParser&);
+	CommandParser& operator=(const CommandParser&);
+
+	// Parse dwCount bytes received at the end of the pending line.
+	int Parse(DWORD dwCount, CommandParserCallback* pCallback);
+
+	// Reallocate the buffer, keeping the pending line.
+	void Resize(int nCapacity);
+
+	enum State
+	{
+		STATE_COMMAND,		// Collecting the characters of a command line
+		STATE_CR,			// A "\r" has just ended a line, a following "\n" belongs to it
+		STATE_OVERFLOW		// The line is too long, skip to the next line terminator
+	};
+
+	State m_state;
+	// The pending line starts at m_pBuffer[m_nStart], its m_nLength characters so far are
+	// followed by the free space. A backspace or a padding byte makes the characters
+	// after it move back in place.
+	int m_nStart;
+	int m_nLength;
+	char* m_pBuffer;
+	int m_nCapacity;
+	int m_nInitialCapacity;
+	int m_nMaxCapacity;
+	// The last chunk filled all the space GetWriteBuffer gave, the buffer grows next time.
+	bool m_bFull;
+};
@@ -0,0 +1,156 @@
+#include "StdAfx.h"
+#include "CommandRegistry.h"
+#include "SocketService.h"
+
+CommandCall::CommandCall(SocketService* pService, int nClientId, const SocketRequest& request)
+	: m_pService(pService)
+	, m_nClientId(nClientId)
+	, m_nSession(0)
+	, m_bDeferred(false)
+	, m_pRequest(&request)
+{
+}
+
+void CommandCall::Complete(const Json::Value &result)
+{
+	Answer(m_pRequest->MakeResponse(result));
+}
+
+void CommandCall::Fail(const char* utf8Message)
+{
+	Answer(m_pRequest->MakeError(utf8Message));
+}
+
+CommandCall* CommandCall::Defer()
+{
+	if (m_bDeferred)
+	{
+		return this;
+	}
+	CommandCall* pCall = new CommandCall(m_pService, m_nClientId, *m_pRequest);
+	pCall->m_nSession = m_pService->GetClientSession(m_nClientId);
+	pCall->m_bDeferred = true;
+	m_pRequest->CopyTo(pCall->m_storage, pCall->m_request);
+	pCall->m_pRequest = &pCall->m_request;
+	return pCall;
+}
+
+void CommandCall::Answer(const Json::Value &response)
+{
+	if (!m_bDeferred)
+	{
+		// On the I/O thread of the client, which can't have changed.
+		m_pService->SendTo(m_nClientId, response);
+		return;
+	}
+	m_pService->SendTo(m_nClientId, m_nSession, response);
+	delete this;
+}
+
+CommandRegistry::CommandRegistry(SocketService* pService, WorkerPool* pWorkers)
+	: m_pService(pService)
+	, m_pWorkers(pWorkers)
+	, m_dwSeed(0)
+	, m_dwMask(0)
+{
+}
+
+CommandRegistry::~CommandRegistry(void)
+{
+	for (size_t i = 0; i < m_aCommands.size(); i++)
+	{
+		delete m_aCommands[i];
+	}
+}
+
+void CommandRegistry::Register(const char* szName, const CommandHandler& handler, CommandThread thread)
+{
+	Command* pCommand = new Command;
+	pCommand->m_strName = szName;
+	pCommand->m_handler = handler;
+	pCommand->m_thread = thread;
+	pCommand->m_lCount = 0;
+	m_aCommands.push_back(pCommand);
+	BuildTable();
+}
+
+bool CommandRegistry::Dispatch(int nClientId, const SocketRequest& request)
+{
+	if (m_aTable.empty())
+	{
+		return false;
+	}
+	int nIndex = m_aTable[Hash(request.m_szName, m_dwSeed) & m_dwMask];
+	if (nIndex < 0 || strcmp(m_aCommands[nIndex]->m_strName, request.m_szName) != 0)
+	{
+		return false;
+	}
+
+	Command* pCommand = m_aCommands[nIndex];
+	::InterlockedIncrement(&pCommand->m_lCount);
+	CommandCall call(m_pService, nClientId, request);
+	if (pCommand->m_thread == COMMAND_THREAD_IO)
+	{
+		pCommand->m_handler(call);
+		return true;
+	}
+
+	CommandCall* pCall = call.Defer();
+	const CommandHandler* pHandler = &pCommand->m_handler;
+	m_pWorkers->Submit([pHandler, pCall]()
+	{
+		(*pHandler)(*pCall);
+	});
+	return true;
+}
+
+void CommandRegistry::GetStats(Json::Value &stats) const
+{
+	for (size_t i = 0; i < m_aCommands.size(); i++)
+	{
+		stats[static_cast<const char*>(m_aCommands[i]->m_strName)] = static_cast<int>(m_aCommands[i]->m_lCount);
+	}
+}
+
+DWORD CommandRegistry::Hash(const char* szName, DWORD dwSeed)
+{
+	DWORD dwHash = 2166136261U ^ dwSeed;
+	for (const unsigned char* p = reinterpret_cast<const unsigned char*>(szName); *p != '\0'; p++)
+	{
+		dwHash ^= *p;
+		dwHash *= 16777619U;
+	}
+	// The low bits, which index the table, only depend on the low bits of the seed and
+	// of the characters without this.
+	return dwHash ^ (dwHash >> 16);
+}
+
+void CommandRegistry::BuildTable()
+{
+	// A table twice as large as the number of names takes a few seeds at most.
+	size_t nSize = 8;
+	while (nSize < m_aCommands.size() * 2)
+	{
+		nSize *= 2;
+	}
+	for (;; nSize *= 2)
+	{
+		for (DWORD dwSeed = 0; dwSeed < 1000; dwSeed++)
+		{
+			m_aTable.assign(nSize, -1);
+			bool bCollision = false;
+			for (size_t i = 0; i < m_aCommands.size() && !bCollision; i++)
+			{
+				int& nSlot = m_aTable[Hash(m_aCommands[i]->m_strName, dwSeed) & (nSize - 1)];
+				bCollision = nSlot >= 0;
+				nSlot = static_cast<int>(i);
+			}
+			if (!bCollision)
+			{
+				m_dwSeed = dwSeed;
+				m_dwMask = static_cast<DWORD>(nSize - 1);
+				return;
+			}
+		}
+	}
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "SocketProtocol.h"
+#include "WorkerPool.h"
+
+class SocketService;
+class CommandCall;
+
+// Handles a socket command and answers the call
+typedef std::function<void(CommandCall& call)> CommandHandler;
+
+/**
+ * A socket request being handled. The handler answers it once with Complete or Fail,
+ * or with a message it sends itself. To answer after it has returned, e.g. when some
+ * other work is done, the handler calls Defer and answers the deferred call from any
+ * thread.
+ */
+class CommandCall
+{
+public:
+	CommandCall(SocketService* pService, int nClientId, const SocketRequest& request);
+
+	int GetClientId() const { return m_nClientId; }
+
+	const SocketRequest& GetRequest() const { return *m_pRequest; }
+
+	// Send the response of the request. A deferred call is deleted then.
+	void Complete(const Json::Value &result);
+
+	// Send the error of the request. A deferred call is deleted then.
+	void Fail(const char* utf8Message);
+
+	/**
+	 * Keep the call to answer it after the handler returns. The request is copied, the
+	 * one handled points into the receive buffer of the client.
+	 * @return The deferred call, deleted once it is answered.
+	 */
+	CommandCall* Defer();
+
+private:
+	// Not copyable
+	CommandCall(const CommandCall&);
+	CommandCall& operator=(const CommandCall&);
+
+	// Send the answer, and delete the call if it is deferred.
+	void Answer(const Json::Value &response);
+
+	SocketService* m_pService;
+	int m_nClientId;
+	// Set for a deferred call, so that a late answer can't reach the next client of the slot.
+	UINT m_nSession;
+	bool m_bDeferred;
+	const SocketRequest* m_pRequest;
+
+	// The copy of the request of a deferred call
+	SocketRequest m_request;
+	std::vector<char> m_storage;
+};
+
+// Where a command handler runs
+enum CommandThread
+{
+	COMMAND_THREAD_IO,		// On the I/O thread of the client, for quick answers
+	COMMAND_THREAD_POOL		// On the worker pool, for work which may block. The
+							// call is deferred already, the handler must answer it.
+};
+
+/**
+ * The socket commands the daemon answers, by name.
+ *
+ * The names are looked up in a table indexed by a perfect hash: the hash function is
+ * seeded so that no two names registered collide, and a lookup is a hash of the name,
+ * one slot and one string comparison, however many commands there are. The table is
+ * rebuilt by Register, and is only read afterwards, by any number of I/O threads.
+ */
+class CommandRegistry
+{
+public:
+	// The COMMAND_THREAD_POOL handlers run on pWorkers.
+	CommandRegistry(SocketService* pService, WorkerPool* pWorkers);
+	~CommandRegistry(void);
+
+	/**
+	 * Add a command, before the socket service starts.
+	 * @param szName The name of the command, several names may share a handler.
+	 */
+	void Register(const char* szName, const CommandHandler& handler, CommandThread thread = COMMAND_THREAD_IO);
+
+	/**
+	 * Run the handler of a request.
+	 * @return false if there is no such command.
+	 */
+	bool Dispatch(int nClientId, const SocketRequest& request);
+
+	// The number of requests dispatched, by command: {"<name>":<count>...}
+	void GetStats(Json::Value &stats) const;
+
+private:
+	// Not copyable
+	CommandRegistry(const CommandRegistry&);
+	CommandRegistry& operator=(const CommandRegistry&);
+
+	struct Command
+	{
+		CStringA m_strName;
+		CommandHandler m_handler;
+		CommandThread m_thread;
+		volatile LONG m_lCount;
+	};
+
+	// FNV-1a of the name from a seeded basis, folded
+	static DWORD Hash(const char* szName, DWORD dwSeed);
+
+	// Find a seed and a table size without collisions.
+	void BuildTable();
+
+	SocketService* m_pService;
+	WorkerPool* m_pWorkers;
+	// Pointers, so that the counters don't move when a command is added
+	std::vector<Command*> m_aCommands;
+	// Index into m_aCommands by hash, -1 for a free slot. Its size is a power of 2.
+	std::vector<int> m_aTable;
+	DWORD m_dwSeed;
+	DWORD m_dwMask;
+};
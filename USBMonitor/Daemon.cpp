@@ -0,0 +1,397 @@
+#include "StdAfx.h"
+#include "Daemon.h"
+#include "App.h"
+#include "FirefoxLoader.h"
+#include "SocketProtocol.h"
+#include "MessageEncoder.h"
+
+#define NOTIFY_WINDOW_CLASS		_T("FirefoxOS-USB-Daemon-Notify")
+#define SHOW_MESSAGE_NAME		_T("FirefoxOS-USB-Daemon-Show")
+
+// The key of the timer of a device arrival
+static CStringA GetSettleTimerKey(const char* szInstanceId)
+{
+	return CStringA("settle:") + szInstanceId;
+}
+
+Daemon::Daemon(Reactor* pReactor)
+	: m_pReactor(pReactor)
+	, m_hNotifyWnd(NULL)
+	, m_pObserver(NULL)
+	, m_nSocketStatsTimer(0)
+	, m_lCommandCount(0)
+	, m_dwStartupTime(0)
+	, m_bHeadless(false)
+{
+	m_pDeviceMonitor = new DeviceMonitor();
+	m_pSocketService = new SocketService(this);
+
+	// [pool] workers, 0 for one per processor
+	CString fileName = CPaintManagerUI::GetInstancePath() + DRIVER_MANAGER_INI_FILE;
+	int nWorkers = ::GetPrivateProfileInt(_T("pool"), _T("workers"), 0, static_cast<LPCTSTR>(fileName));
+	m_pWorkers = new WorkerPool(nWorkers);
+	m_pCommands = new CommandRegistry(m_pSocketService, m_pWorkers);
+	RegisterCommands();
+}
+
+Daemon::~Daemon(void)
+{
+	// The tasks still queued on the workers use the device monitor and the socket service.
+	delete m_pWorkers;
+	delete m_pCommands;
+	delete m_pDeviceMonitor;
+	delete m_pSocketService;
+}
+
+bool Daemon::Start()
+{
+	if (!CreateNotifyWindow())
+	{
+		return false;
+	}
+
+	// Register the device change notification so that we can get 
+	// the WM_DEVICECHANGE notification even if a device doesn't 
+	// have hardware driver installed.
+	m_pDeviceMonitor->RegisterToWindow(m_hNotifyWnd);
+
+	// Register to get notification when the supported devices are changed.
+	m_pDeviceMonitor->AddObserver(this);
+
+	m_pSocketService->Start();
+
+	CString fileName = CPaintManagerUI::GetInstancePath() + DRIVER_MANAGER_INI_FILE;
+	UINT statsInterval = ::GetPrivateProfileInt(_T("socket"), _T("stats_interval"), 0, static_cast<LPCTSTR>(fileName));
+	if (statsInterval > 0)
+	{
+		m_nSocketStatsTimer = m_pReactor->AddTimer(statsInterval * 1000, statsInterval * 1000, [this]()
+		{
+			m_pSocketService->LogStats();
+		});
+	}
+
+	// Load firefox if there exits firefox OS devices
+	if (m_pDeviceMonitor->m_aDeviceList.size() > 0)
+	{
+		FirefoxLoader::TryLoad();
+	}
+	return true;
+}
+
+void Daemon::Stop()
+{
+	// Unregister the device monitor notification.
+	m_pDeviceMonitor->RemoveObserver(this);
+	
+	// Unregister the device change notification.
+	m_pDeviceMonitor->Unregister();
+
+	Json::Value deviceList = m_pDeviceMonitor->GetDeviceListSnapshot();
+	for (Json::Value::ArrayIndex i = 0; i < deviceList.size(); i++)
+	{
+		m_pReactor->CancelKeyedTimer(GetSettleTimerKey(deviceList[i]["InstanceId"].asCString()));
+	}
+	m_pReactor->CancelTimer(m_nSocketStatsTimer);
+	m_nSocketStatsTimer = 0;
+
+	m_pSocketService->Stop();
+
+	if (m_hNotifyWnd != NULL)
+	{
+		::DestroyWindow(m_hNotifyWnd);
+		m_hNotifyWnd = NULL;
+	}
+}
+
+void Daemon::SetStartupTime(DWORD dwMilliseconds, bool bHeadless)
+{
+	m_dwStartupTime = dwMilliseconds;
+	m_bHeadless = bHeadless;
+
+	// In release builds too, to compare the startup of the modes.
+	char szMessage[128];
+	_snprintf_s(szMessage, _countof(szMessage), _TRUNCATE, "USBMonitor: started in %lu ms (%s)\n",
+		dwMilliseconds, bHeadless ? "headless" : "windowed");
+	::OutputDebugStringA(szMessage);
+}
+
+bool Daemon::CreateNotifyWindow()
+{
+	HINSTANCE hInstance = ::GetModuleHandle(NULL);
+	WNDCLASSEX wc = { sizeof(WNDCLASSEX) };
+	wc.lpfnWndProc = NotifyWindowProc;
+	wc.hInstance = hInstance;
+	wc.lpszClassName = NOTIFY_WINDOW_CLASS;
+	if (!::RegisterClassEx(&wc) && ::GetLastError() != ERROR_CLASS_ALREADY_EXISTS)
+	{
+		return false;
+	}
+
+	// A message-only window: never shown, but it gets the notifications registered for it.
+	m_hNotifyWnd = ::CreateWindowEx(0, NOTIFY_WINDOW_CLASS, NULL, 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, hInstance, this);
+	return m_hNotifyWnd != NULL;
+}
+
+bool Daemon::RequestShow()
+{
+	HWND hNotifyWnd = ::FindWindowEx(HWND_MESSAGE, NULL, NOTIFY_WINDOW_CLASS, NULL);
+	if (hNotifyWnd == NULL)
+	{
+		return false;
+	}
+	// The running daemon can't bring its window to the front without our leave.
+	::AllowSetForegroundWindow(ASFW_ANY);
+	return ::PostMessage(hNotifyWnd, ::RegisterWindowMessage(SHOW_MESSAGE_NAME), 0, 0) != FALSE;
+}
+
+LRESULT CALLBACK Daemon::NotifyWindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+	static const UINT WM_SHOW_DAEMON = ::RegisterWindowMessage(SHOW_MESSAGE_NAME);
+
+	if (uMsg == WM_NCCREATE)
+	{
+		LPCREATESTRUCT pCreate = reinterpret_cast<LPCREATESTRUCT>(lParam);
+		::SetWindowLongPtr(hWnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(pCreate->lpCreateParams));
+	}
+	else if (uMsg == WM_DEVICECHANGE)
+	{
+		Daemon* pDaemon = reinterpret_cast<Daemon*>(::GetWindowLongPtr(hWnd, GWLP_USERDATA));
+		if (pDaemon && lParam &&
+			pDaemon->m_pDeviceMonitor->OnDeviceChange(static_cast<UINT>(wParam), reinterpret_cast<PDEV_BROADCAST_HDR>(lParam)))
+		{
+			return TRUE;
+		}
+	}
+	else if (uMsg == WM_SHOW_DAEMON)
+	{
+		Daemon* pDaemon = reinterpret_cast<Daemon*>(::GetWindowLongPtr(hWnd, GWLP_USERDATA));
+		if (pDaemon && pDaemon->m_showHandler)
+		{
+			pDaemon->m_showHandler();
+		}
+		return 0;
+	}
+	return ::DefWindowProc(hWnd, uMsg, wParam, lParam);
+}
+
+// A supported device has been changed.
+void Daemon::OnDeviceChanged(Json::Value &deviceList, const Json::Value &delta, bool bInsert)
+{
+	SendSocketMessageDevicesList(deviceList);
+	m_pSocketService->SendToSubscribers(MakeSocketEvent("devices", delta));
+
+	if(bInsert)
+	{
+		// Each arrival of a device postpones its timer, whatever the other devices do.
+		static const char* MEMBERS[] = { "added", "changed" };
+		for (size_t i = 0; i < _countof(MEMBERS); i++)
+		{
+			const Json::Value& devices = delta[MEMBERS[i]];
+			for (Json::Value::ArrayIndex j = 0; j < devices.size(); j++)
+			{
+				CStringA strInstanceId = devices[j]["InstanceId"].asCString();
+				m_pReactor->AddKeyedTimer(GetSettleTimerKey(strInstanceId), DEVICE_ARRIVAL_EVENT_DELAY, 0, [this, strInstanceId]()
+				{
+					OnDeviceSettled(strInstanceId);
+				});
+			}
+		}
+	}
+	// A device removed before it has settled doesn't launch Firefox.
+	const Json::Value& removed = delta["removed"];
+	for (Json::Value::ArrayIndex i = 0; i < removed.size(); i++)
+	{
+		m_pReactor->CancelKeyedTimer(GetSettleTimerKey(removed[i].asCString()));
+	}
+	if (m_pObserver)
+	{
+		m_pObserver->OnDevicesChanged();
+	}
+}
+
+// Called on the socket I/O thread
+void Daemon::OnConnect()
+{
+	NotifyClientsChanged();
+
+	Json::Value deviceList = m_pDeviceMonitor->GetDeviceListSnapshot();
+	if(deviceList.size() > 0)
+	{
+		SendSocketMessageDevicesList(deviceList);
+	}
+}
+
+// Called on the socket I/O thread
+void Daemon::OnDisconnect()
+{
+	NotifyClientsChanged();
+}
+
+// Called on the socket I/O thread
+void Daemon::OnCommandReceived(int nClientId, char* utf8Command)
+{
+	SocketRequest request;
+	if (!request.Parse(utf8Command))
+	{
+		return;
+	}
+	::InterlockedIncrement(&m_lCommandCount);
+	if (!m_pCommands->Dispatch(nClientId, request))
+	{
+		m_pSocketService->SendTo(nClientId, request.MakeError("unknown command"));
+	}
+}
+
+void Daemon::OnDeviceSettled(const CStringA& strInstanceId)
+{
+	// Load firefox if the firefox OS device is still there
+	Json::Value device;
+	if (m_pDeviceMonitor->GetDeviceSnapshot(strInstanceId, device))
+	{
+		FirefoxLoader::TryLoad();
+	}
+
+	if (m_pObserver)
+	{
+		m_pObserver->OnDevicesChanged();
+	}
+}
+
+void Daemon::NotifyClientsChanged()
+{
+	m_pReactor->Post([this]()
+	{
+		if (m_pObserver)
+		{
+			m_pObserver->OnClientsChanged();
+		}
+	});
+}
+
+void Daemon::RegisterCommands()
+{
+	using namespace std::placeholders;
+	m_pCommands->Register("devices", std::bind(&Daemon::HandleCommandDevices, this, _1));
+	m_pCommands->Register("device", std::bind(&Daemon::HandleCommandDevice, this, _1));
+	// The catalog is scanned under the lock of the device monitor, which a device scan holds.
+	m_pCommands->Register("catalog", std::bind(&Daemon::HandleCommandCatalog, this, _1), COMMAND_THREAD_POOL);
+	m_pCommands->Register("subscribe", std::bind(&Daemon::HandleCommandSubscribe, this, _1));
+	m_pCommands->Register("resync", std::bind(&Daemon::HandleCommandSubscribe, this, _1));
+	m_pCommands->Register("unsubscribe", std::bind(&Daemon::HandleCommandUnsubscribe, this, _1));
+	m_pCommands->Register("format", std::bind(&Daemon::HandleCommandFormat, this, _1));
+	m_pCommands->Register("stats", std::bind(&Daemon::HandleCommandStats, this, _1));
+	m_pCommands->Register("shutdown", std::bind(&Daemon::HandleCommandShutdown, this, _1));
+}
+
+void Daemon::HandleCommandDevices(CommandCall& call)
+{
+	Json::Value deviceList = m_pDeviceMonitor->GetDeviceListSnapshot();
+	call.Complete(deviceList);
+}
+
+// device <InstanceId>
+void Daemon::HandleCommandDevice(CommandCall& call)
+{
+	Json::Value device;
+	if (call.GetRequest().GetArgCount() < 1)
+	{
+		call.Fail("missing device instance ID");
+	}
+	else if (!m_pDeviceMonitor->GetDeviceSnapshot(call.GetRequest().GetArg(0), device))
+	{
+		call.Fail("device not connected");
+	}
+	else
+	{
+		call.Complete(device);
+	}
+}
+
+// catalog <HardwareId>
+void Daemon::HandleCommandCatalog(CommandCall& call)
+{
+	Json::Value entry;
+	if (call.GetRequest().GetArgCount() < 1)
+	{
+		call.Fail("missing hardware ID");
+	}
+	else if (!m_pDeviceMonitor->FindCatalogEntry(call.GetRequest().GetArg(0), entry))
+	{
+		call.Fail("device not supported");
+	}
+	else
+	{
+		call.Complete(entry);
+	}
+}
+
+// Both "subscribe" and "resync" reply with a snapshot of the device list.
+void Daemon::HandleCommandSubscribe(CommandCall& call)
+{
+	m_pSocketService->Subscribe(call.GetClientId(), [this, &call]() -> Json::Value
+	{
+		int nVersion = 0;
+		Json::Value result;
+		result["devices"] = m_pDeviceMonitor->GetDeviceListSnapshot(&nVersion);
+		result["version"] = nVersion;
+		return call.GetRequest().MakeResponse(result);
+	});
+}
+
+void Daemon::HandleCommandUnsubscribe(CommandCall& call)
+{
+	m_pSocketService->Unsubscribe(call.GetClientId());
+	call.Complete(Json::Value());
+}
+
+// format <json|msgpack>
+void Daemon::HandleCommandFormat(CommandCall& call)
+{
+	MessageFormat format;
+	if (call.GetRequest().GetArgCount() < 1)
+	{
+		call.Fail("missing format");
+	}
+	else if (!MessageEncoder::ParseFormat(call.GetRequest().GetArg(0), format))
+	{
+		call.Fail("unknown format");
+	}
+	else
+	{
+		// The response is already sent in the new format.
+		m_pSocketService->SetClientFormat(call.GetClientId(), format);
+		call.Complete(Json::Value());
+	}
+}
+
+void Daemon::HandleCommandStats(CommandCall& call)
+{
+	Json::Value stats;
+	stats["clients"] = m_pSocketService->GetClientCount();
+	stats["devices"] = m_pDeviceMonitor->GetDeviceListSnapshot().size();
+	stats["commands"] = static_cast<int>(m_lCommandCount);
+	m_pSocketService->GetSerializationStats(stats["serialization"]);
+	m_pSocketService->GetStats(stats["socket"]);
+	m_pCommands->GetStats(stats["dispatch"]);
+	m_pWorkers->GetStats(stats["pool"]);
+	m_pReactor->GetStats(stats["reactor"]);
+	stats["startup_ms"] = static_cast<int>(m_dwStartupTime);
+	stats["headless"] = m_bHeadless;
+	call.Complete(stats);
+}
+
+void Daemon::HandleCommandShutdown(CommandCall& call)
+{
+	// Reply before the socket service is stopped.
+	call.Complete(Json::Value());
+
+	// The reactor thread stops the daemon and closes the window, if any, once Run returns.
+	m_pReactor->Quit();
+}
+
+void Daemon::SendSocketMessageDevicesList(Json::Value &deviceList)
+{
+	// The list is serialized only if there are clients which haven't subscribed to the deltas.
+	m_pSocketService->SendToAll(deviceList);
+}
+
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "DeviceMonitor.h"
+#include "SocketService.h"
+#include "Reactor.h"
+#include "CommandRegistry.h"
+
+/**
+ * Observes the daemon on the reactor thread, e.g. to show its state in a window.
+ */
+class DaemonObserver
+{
+public:
+	// The list of connected devices has changed.
+	virtual void OnDevicesChanged() = 0;
+
+	// A socket client has connected or disconnected.
+	virtual void OnClientsChanged() = 0;
+};
+
+/**
+ * The work of the daemon: detecting the Firefox OS devices, serving the socket clients
+ * and launching Firefox. It runs on the reactor of the main thread and receives the
+ * device notifications through a message-only window, so it doesn't need any UI:
+ * MainFrame only shows its state, and the daemon runs without it in headless mode.
+ */
+class Daemon
+	: public DeviceMonitorObserver
+	, public SocketServiceCallback
+{
+public:
+	Daemon(Reactor* pReactor);
+	~Daemon(void);
+
+	/**
+	 * Register for the device notifications, list the devices and start serving the
+	 * socket clients. Called on the reactor thread before it runs.
+	 * @return false if the notification window can't be created.
+	 */
+	bool Start();
+
+	// Tell the clients that the daemon is going away and stop. Called on the reactor thread.
+	void Stop();
+
+	// The observer, NULL for none. Called on the reactor thread.
+	void SetObserver(DaemonObserver* pObserver) { m_pObserver = pObserver; }
+
+	// Called on the reactor thread when the user asks to see the running daemon, by
+	// starting it once more. An empty handler, e.g. in headless mode, ignores the requests.
+	void SetShowHandler(const ReactorCallback& handler) { m_showHandler = handler; }
+
+	/**
+	 * Ask the daemon running in another process to show itself.
+	 * @return false if no daemon is running.
+	 */
+	static bool RequestShow();
+
+	/**
+	 * Account the time from the process creation until the daemon was ready, which
+	 * the "stats" command reports.
+	 */
+	void SetStartupTime(DWORD dwMilliseconds, bool bHeadless);
+
+	DeviceMonitor* GetDeviceMonitor() const { return m_pDeviceMonitor; }
+
+	int GetClientCount() const { return m_pSocketService->GetClientCount(); }
+
+	//
+	// Overrides DeviceMonitorObserver
+	//
+
+	// A supported device has been changed.
+	virtual void OnDeviceChanged(Json::Value &deviceList, const Json::Value &delta, bool bInsert) override;
+
+	//
+	// Overrides SocketServiceCallback
+	// Note: these are called on the socket I/O threads.
+	//
+	virtual void OnConnect() override;
+	virtual void OnDisconnect() override;
+	virtual void OnCommandReceived(int nClientId, char* utf8Command) override;
+
+private:
+	// Not copyable
+	Daemon(const Daemon&);
+	Daemon& operator=(const Daemon&);
+
+	// The message-only window receiving WM_DEVICECHANGE
+	static LRESULT CALLBACK NotifyWindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
+	bool CreateNotifyWindow();
+
+	// Called DEVICE_ARRIVAL_EVENT_DELAY after the last arrival of a device
+	void OnDeviceSettled(const CStringA& strInstanceId);
+
+	// Tell the observer on the reactor thread that the clients have changed.
+	void NotifyClientsChanged();
+
+	// Add the socket commands to m_pCommands.
+	void RegisterCommands();
+
+	// Socket request handlers, called on the socket I/O thread or the thread pool, see
+	// RegisterCommands. Each handler answers the call.
+	void HandleCommandDevices(CommandCall& call);
+	void HandleCommandDevice(CommandCall& call);
+	void HandleCommandCatalog(CommandCall& call);
+	void HandleCommandSubscribe(CommandCall& call);
+	void HandleCommandUnsubscribe(CommandCall& call);
+	void HandleCommandFormat(CommandCall& call);
+	void HandleCommandStats(CommandCall& call);
+	void HandleCommandShutdown(CommandCall& call);
+
+	void SendSocketMessageDevicesList(Json::Value &deviceList);
+
+	Reactor* m_pReactor;
+	HWND m_hNotifyWnd;
+	DeviceMonitor* m_pDeviceMonitor;
+	SocketService* m_pSocketService;
+	// Runs the background work, e.g. the commands registered with COMMAND_THREAD_POOL
+	WorkerPool* m_pWorkers;
+	CommandRegistry* m_pCommands;
+	DaemonObserver* m_pObserver;
+	ReactorCallback m_showHandler;
+
+	// Firefox is launched for a device after a short delay, to ensure the device has settled: each
+	// device has a timer keyed by its instance ID, reset by its arrivals and cancelled by its removal.
+	static const DWORD DEVICE_ARRIVAL_EVENT_DELAY = 500;
+
+	// Logs the socket metrics every [socket] stats_interval seconds, if it is not 0.
+	UINT_PTR m_nSocketStatsTimer;
+
+	// Number of socket requests received
+	volatile LONG m_lCommandCount;
+
+	// Written once, when the reactor starts running
+	DWORD m_dwStartupTime;
+	bool m_bHeadless;
+};
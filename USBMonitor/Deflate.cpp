@@ -0,0 +1,512 @@
+#include "StdAfx.h"
+#include "Deflate.h"
+
+// Base lengths and extra bits of the length symbols 257..285
+static const short LENGTH_BASE[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const short LENGTH_EXTRA[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+// Base distances and extra bits of the distance symbols 0..29
+static const short DISTANCE_BASE[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const short DISTANCE_EXTRA[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static const int MIN_MATCH = 3;
+static const int MAX_MATCH = 258;
+static const int WINDOW_SIZE = 32768;
+static const int HASH_BITS = 12;
+static const int HASH_SIZE = 1 << HASH_BITS;
+// How many earlier occurrences are tried for each position
+static const int MAX_CHAIN = 32;
+
+//
+// DeflateEncoder
+//
+
+DeflateEncoder::DeflateEncoder(void)
+	: m_bitBuffer(0)
+	, m_nBitCount(0)
+	, m_pHead(new int[HASH_SIZE])
+	, m_pPrev(new int[WINDOW_SIZE])
+{
+}
+
+DeflateEncoder::~DeflateEncoder(void)
+{
+	delete[] m_pHead;
+	delete[] m_pPrev;
+}
+
+void DeflateEncoder::Compress(const char* lpData, int nLength, MessageBuffer &buffer)
+{
+	const unsigned char* data = reinterpret_cast<const unsigned char*>(lpData);
+	memset(m_pHead, -1, HASH_SIZE * sizeof(int));
+	m_bitBuffer = 0;
+	m_nBitCount = 0;
+
+	// BFINAL = 0, BTYPE = 01 (fixed Huffman codes)
+	WriteBits(0, 1, buffer);
+	WriteBits(1, 2, buffer);
+
+	int pos = 0;
+	while (pos < nLength)
+	{
+		int nBestLength = 0;
+		int nBestDistance = 0;
+		if (pos + MIN_MATCH <= nLength)
+		{
+			int nMaxLength = min(MAX_MATCH, nLength - pos);
+			int hash = ((data[pos] << 8) ^ (data[pos + 1] << 4) ^ data[pos + 2]) & (HASH_SIZE - 1);
+			int candidate = m_pHead[hash];
+			for (int chain = 0; candidate >= 0 && chain < MAX_CHAIN; chain++)
+			{
+				int nDistance = pos - candidate;
+				if (nDistance <= 0 || nDistance > WINDOW_SIZE)
+				{
+					break;
+				}
+				// Only a longer match is of interest, so check its last byte first.
+				if (data[candidate + nBestLength] == data[pos + nBestLength])
+				{
+					int nMatch = 0;
+					while (nMatch < nMaxLength && data[candidate + nMatch] == data[pos + nMatch])
+					{
+						nMatch++;
+					}
+					if (nMatch > nBestLength)
+					{
+						nBestLength = nMatch;
+						nBestDistance = nDistance;
+						if (nMatch == nMaxLength)
+						{
+							break;
+						}
+					}
+				}
+				candidate = m_pPrev[candidate & (WINDOW_SIZE - 1)];
+			}
+			m_pPrev[pos & (WINDOW_SIZE - 1)] = m_pHead[hash];
+			m_pHead[hash] = pos;
+		}
+
+		if (nBestLength >= MIN_MATCH)
+		{
+			WriteMatch(nBestLength, nBestDistance, buffer);
+			// Make the positions inside the match available to later matches.
+			for (int i = 1; i < nBestLength && pos + i + MIN_MATCH <= nLength; i++)
+			{
+				int p = pos + i;
+				int hash = ((data[p] << 8) ^ (data[p + 1] << 4) ^ data[p + 2]) & (HASH_SIZE - 1);
+				m_pPrev[p & (WINDOW_SIZE - 1)] = m_pHead[hash];
+				m_pHead[hash] = p;
+			}
+			pos += nBestLength;
+		}
+		else
+		{
+			WriteLiteral(data[pos], buffer);
+			pos++;
+		}
+	}
+
+	// End of block
+	WriteLiteral(256, buffer);
+	// Empty stored block: BFINAL = 0, BTYPE = 00, padded to a byte. LEN and NLEN are left out.
+	WriteBits(0, 3, buffer);
+	FlushBits(buffer);
+}
+
+void DeflateEncoder::WriteBits(unsigned int value, int nBits, MessageBuffer &buffer)
+{
+	m_bitBuffer |= value << m_nBitCount;
+	m_nBitCount += nBits;
+	while (m_nBitCount >= 8)
+	{
+		buffer.Append(static_cast<char>(m_bitBuffer & 0xff));
+		m_bitBuffer >>= 8;
+		m_nBitCount -= 8;
+	}
+}
+
+void DeflateEncoder::WriteCode(unsigned int code, int nBits, MessageBuffer &buffer)
+{
+	unsigned int reversed = 0;
+	for (int i = 0; i < nBits; i++)
+	{
+		reversed = (reversed << 1) | ((code >> i) & 1);
+	}
+	WriteBits(reversed, nBits, buffer);
+}
+
+void DeflateEncoder::WriteLiteral(int symbol, MessageBuffer &buffer)
+{
+	// The fixed literal/length code (RFC 1951 3.2.6)
+	if (symbol < 144)
+	{
+		WriteCode(0x30 + symbol, 8, buffer);
+	}
+	else if (symbol < 256)
+	{
+		WriteCode(0x190 + symbol - 144, 9, buffer);
+	}
+	else if (symbol < 280)
+	{
+		WriteCode(symbol - 256, 7, buffer);
+	}
+	else
+	{
+		WriteCode(0xc0 + symbol - 280, 8, buffer);
+	}
+}
+
+void DeflateEncoder::WriteMatch(int nLength, int nDistance, MessageBuffer &buffer)
+{
+	int code = 28;
+	while (LENGTH_BASE[code] > nLength)
+	{
+		code--;
+	}
+	WriteLiteral(257 + code, buffer);
+	WriteBits(nLength - LENGTH_BASE[code], LENGTH_EXTRA[code], buffer);
+
+	code = 29;
+	while (DISTANCE_BASE[code] > nDistance)
+	{
+		code--;
+	}
+	// The fixed distance codes are the 5-bit symbol numbers.
+	WriteCode(code, 5, buffer);
+	WriteBits(nDistance - DISTANCE_BASE[code], DISTANCE_EXTRA[code], buffer);
+}
+
+void DeflateEncoder::FlushBits(MessageBuffer &buffer)
+{
+	if (m_nBitCount > 0)
+	{
+		buffer.Append(static_cast<char>(m_bitBuffer & 0xff));
+	}
+	m_bitBuffer = 0;
+	m_nBitCount = 0;
+}
+
+//
+// Inflater
+//
+
+Inflater::Inflater(const unsigned char* lpData, int nLength)
+	: m_pData(lpData)
+	, m_nLength(nLength)
+	, m_nPos(0)
+	, m_bitBuffer(0)
+	, m_nBitCount(0)
+	, m_bEndOfData(false)
+	, m_nStart(0)
+{
+}
+
+bool Inflater::Inflate(MessageBuffer &buffer, int nMaxLength)
+{
+	m_nStart = buffer.GetLength();
+	nMaxLength += m_nStart;
+
+	int last;
+	do
+	{
+		last = GetBits(1);
+		int type = GetBits(2);
+		if (m_bEndOfData)
+		{
+			return false;
+		}
+
+		bool bResult;
+		switch (type)
+		{
+		case 0:
+			bResult = InflateStored(buffer, nMaxLength);
+			break;
+		case 1:
+			bResult = InflateFixed(buffer, nMaxLength);
+			break;
+		case 2:
+			bResult = InflateDynamic(buffer, nMaxLength);
+			break;
+		default:
+			bResult = false;
+			break;
+		}
+		if (!bResult || m_bEndOfData)
+		{
+			return false;
+		}
+	} while (!last && m_nPos < m_nLength);
+	return true;
+}
+
+int Inflater::GetBits(int nBits)
+{
+	unsigned int value = m_bitBuffer;
+	while (m_nBitCount < nBits)
+	{
+		if (m_nPos >= m_nLength)
+		{
+			m_bEndOfData = true;
+			return 0;
+		}
+		value |= static_cast<unsigned int>(m_pData[m_nPos++]) << m_nBitCount;
+		m_nBitCount += 8;
+	}
+	m_bitBuffer = value >> nBits;
+	m_nBitCount -= nBits;
+	return static_cast<int>(value & ((1u << nBits) - 1));
+}
+
+int Inflater::Decode(const Huffman &huffman)
+{
+	// Codes are stored starting with their most significant bit, read them bit by bit.
+	int code = 0;
+	int first = 0;
+	int index = 0;
+	for (int len = 1; len < 16; len++)
+	{
+		code |= GetBits(1);
+		if (m_bEndOfData)
+		{
+			return -1;
+		}
+		int count = huffman.counts[len];
+		if (code - count < first)
+		{
+			return huffman.symbols[index + (code - first)];
+		}
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+bool Inflater::Build(Huffman &huffman, const short* lengths, int count)
+{
+	memset(huffman.counts, 0, sizeof(huffman.counts));
+	for (int symbol = 0; symbol < count; symbol++)
+	{
+		huffman.counts[lengths[symbol]]++;
+	}
+	if (huffman.counts[0] == count)
+	{
+		// No codes, only valid for an unused distance code
+		return true;
+	}
+
+	// Check for an over-subscribed set of lengths. Incomplete sets are allowed.
+	int left = 1;
+	for (int len = 1; len < 16; len++)
+	{
+		left <<= 1;
+		left -= huffman.counts[len];
+		if (left < 0)
+		{
+			return false;
+		}
+	}
+
+	short offsets[16];
+	offsets[1] = 0;
+	for (int len = 1; len < 15; len++)
+	{
+		offsets[len + 1] = offsets[len] + huffman.counts[len];
+	}
+	for (int symbol = 0; symbol < count; symbol++)
+	{
+		if (lengths[symbol] != 0)
+		{
+			huffman.symbols[offsets[lengths[symbol]]++] = static_cast<short>(symbol);
+		}
+	}
+	return true;
+}
+
+bool Inflater::InflateStored(MessageBuffer &buffer, int nMaxLength)
+{
+	// Skip to the byte boundary
+	m_bitBuffer = 0;
+	m_nBitCount = 0;
+
+	if (m_nPos + 4 > m_nLength)
+	{
+		return false;
+	}
+	int len = m_pData[m_nPos] | (m_pData[m_nPos + 1] << 8);
+	int nlen = m_pData[m_nPos + 2] | (m_pData[m_nPos + 3] << 8);
+	m_nPos += 4;
+	if (len != (~nlen & 0xffff) || m_nPos + len > m_nLength || buffer.GetLength() + len > nMaxLength)
+	{
+		return false;
+	}
+	buffer.Append(reinterpret_cast<const char*>(m_pData + m_nPos), len);
+	m_nPos += len;
+	return true;
+}
+
+Inflater::FixedCodes::FixedCodes(void)
+{
+	short lengths[288];
+	int symbol = 0;
+	for (; symbol < 144; symbol++) lengths[symbol] = 8;
+	for (; symbol < 256; symbol++) lengths[symbol] = 9;
+	for (; symbol < 280; symbol++) lengths[symbol] = 7;
+	for (; symbol < 288; symbol++) lengths[symbol] = 8;
+	Build(lengthCode, lengths, 288);
+	for (symbol = 0; symbol < 30; symbol++) lengths[symbol] = 5;
+	Build(distanceCode, lengths, 30);
+}
+
+const Inflater::FixedCodes Inflater::s_fixedCodes;
+
+bool Inflater::InflateFixed(MessageBuffer &buffer, int nMaxLength)
+{
+	return InflateCodes(s_fixedCodes.lengthCode, s_fixedCodes.distanceCode, buffer, nMaxLength);
+}
+
+bool Inflater::InflateDynamic(MessageBuffer &buffer, int nMaxLength)
+{
+	static const short ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	int nLengthCodes = GetBits(5) + 257;
+	int nDistanceCodes = GetBits(5) + 1;
+	int nCodeLengthCodes = GetBits(4) + 4;
+	if (m_bEndOfData || nLengthCodes > 286 || nDistanceCodes > 30)
+	{
+		return false;
+	}
+
+	// The code lengths are themselves Huffman coded.
+	short lengths[286 + 30];
+	int index;
+	for (index = 0; index < nCodeLengthCodes; index++)
+	{
+		lengths[ORDER[index]] = static_cast<short>(GetBits(3));
+	}
+	for (; index < 19; index++)
+	{
+		lengths[ORDER[index]] = 0;
+	}
+	Huffman lengthCode;
+	Huffman distanceCode;
+	if (m_bEndOfData || !Build(lengthCode, lengths, 19))
+	{
+		return false;
+	}
+
+	index = 0;
+	while (index < nLengthCodes + nDistanceCodes)
+	{
+		int symbol = Decode(lengthCode);
+		if (symbol < 0)
+		{
+			return false;
+		}
+		if (symbol < 16)
+		{
+			lengths[index++] = static_cast<short>(symbol);
+			continue;
+		}
+
+		short len = 0;
+		int repeat;
+		if (symbol == 16)
+		{
+			if (index == 0)
+			{
+				return false;
+			}
+			len = lengths[index - 1];
+			repeat = 3 + GetBits(2);
+		}
+		else if (symbol == 17)
+		{
+			repeat = 3 + GetBits(3);
+		}
+		else
+		{
+			repeat = 11 + GetBits(7);
+		}
+		if (m_bEndOfData || index + repeat > nLengthCodes + nDistanceCodes)
+		{
+			return false;
+		}
+		while (repeat--)
+		{
+			lengths[index++] = len;
+		}
+	}
+
+	// The end of block code is required.
+	if (lengths[256] == 0)
+	{
+		return false;
+	}
+	if (!Build(lengthCode, lengths, nLengthCodes) || !Build(distanceCode, lengths + nLengthCodes, nDistanceCodes))
+	{
+		return false;
+	}
+	return InflateCodes(lengthCode, distanceCode, buffer, nMaxLength);
+}
+
+bool Inflater::InflateCodes(const Huffman &lengthCode, const Huffman &distanceCode, MessageBuffer &buffer, int nMaxLength)
+{
+	for (;;)
+	{
+		int symbol = Decode(lengthCode);
+		if (symbol < 0)
+		{
+			return false;
+		}
+		if (symbol < 256)
+		{
+			if (buffer.GetLength() >= nMaxLength)
+			{
+				return false;
+			}
+			buffer.Append(static_cast<char>(symbol));
+			continue;
+		}
+		if (symbol == 256)
+		{
+			return true;
+		}
+
+		symbol -= 257;
+		if (symbol >= 29)
+		{
+			return false;
+		}
+		int nLength = LENGTH_BASE[symbol] + GetBits(LENGTH_EXTRA[symbol]);
+
+		symbol = Decode(distanceCode);
+		if (symbol < 0 || symbol >= 30)
+		{
+			return false;
+		}
+		int nDistance = DISTANCE_BASE[symbol] + GetBits(DISTANCE_EXTRA[symbol]);
+		if (m_bEndOfData || nDistance > buffer.GetLength() - m_nStart || buffer.GetLength() + nLength > nMaxLength)
+		{
+			return false;
+		}
+
+		// The source may overlap the bytes being copied, so copy byte by byte.
+		buffer.Reserve(buffer.GetLength() + nLength);
+		for (int i = 0; i < nLength; i++)
+		{
+			buffer.Append(buffer.GetData()[buffer.GetLength() - nDistance]);
+		}
+	}
+}
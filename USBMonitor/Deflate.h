@@ -0,0 +1,96 @@
+#pragma once
+
+#include "MessageEncoder.h"
+
+/**
+ * Raw DEFLATE (RFC 1951) compression for the permessage-deflate WebSocket extension.
+ * Every message is compressed on its own ("no context takeover") into one block with
+ * the fixed Huffman codes. That needs no code tables to be built or sent, and the
+ * repetitive JSON of the device lists still shrinks to a fraction of its size.
+ */
+class DeflateEncoder
+{
+public:
+	DeflateEncoder(void);
+	~DeflateEncoder(void);
+
+	/**
+	 * Append the compressed data to the buffer.
+	 * As permessage-deflate requires, the block is not final and is followed by an empty
+	 * stored block whose LEN and NLEN (0x00 0x00 0xff 0xff) are left out (RFC 7692 7.2.1).
+	 */
+	void Compress(const char* lpData, int nLength, MessageBuffer &buffer);
+
+private:
+	// Not copyable
+	DeflateEncoder(const DeflateEncoder&);
+	DeflateEncoder& operator=(const DeflateEncoder&);
+
+	void WriteBits(unsigned int value, int nBits, MessageBuffer &buffer);
+	// Huffman codes are stored starting with their most significant bit.
+	void WriteCode(unsigned int code, int nBits, MessageBuffer &buffer);
+	void WriteLiteral(int symbol, MessageBuffer &buffer);
+	void WriteMatch(int nLength, int nDistance, MessageBuffer &buffer);
+	void FlushBits(MessageBuffer &buffer);
+
+	unsigned int m_bitBuffer;
+	int m_nBitCount;
+	// Hash chains of the 3-byte sequences: the last position of each hash, and the
+	// previous position with the same hash of each position in the window.
+	int* m_pHead;
+	int* m_pPrev;
+};
+
+/**
+ * Raw DEFLATE decompression of a single message.
+ * Handles stored, fixed and dynamic Huffman blocks. Without context takeover the
+ * back references never reach before the start of the message.
+ */
+class Inflater
+{
+public:
+	Inflater(const unsigned char* lpData, int nLength);
+
+	/**
+	 * Decompress up to the final block or the end of the data and append the result.
+	 * @return false if the data is corrupt or the result would exceed nMaxLength bytes.
+	 */
+	bool Inflate(MessageBuffer &buffer, int nMaxLength);
+
+private:
+	// Canonical Huffman code: number of codes of each length and the symbols ordered by code.
+	struct Huffman
+	{
+		short counts[16];
+		short symbols[288];
+	};
+
+	// The codes of the fixed Huffman blocks, built during static initialization so that
+	// no thread ever sees them half built.
+	struct FixedCodes
+	{
+		FixedCodes(void);
+		Huffman lengthCode;
+		Huffman distanceCode;
+	};
+	static const FixedCodes s_fixedCodes;
+
+	int GetBits(int nBits);
+	int Decode(const Huffman &huffman);
+	static bool Build(Huffman &huffman, const short* lengths, int count);
+
+	bool InflateStored(MessageBuffer &buffer, int nMaxLength);
+	bool InflateFixed(MessageBuffer &buffer, int nMaxLength);
+	bool InflateDynamic(MessageBuffer &buffer, int nMaxLength);
+	bool InflateCodes(const Huffman &lengthCode, const Huffman &distanceCode, MessageBuffer &buffer, int nMaxLength);
+
+	const unsigned char* m_pData;
+	int m_nLength;
+	int m_nPos;
+	unsigned int m_bitBuffer;
+	int m_nBitCount;
+	// Set when the data ends in the middle of a block
+	bool m_bEndOfData;
+	// Length of the output before this message, back references must not reach before it
+	int m_nStart;
+};
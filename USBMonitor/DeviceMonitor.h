@@ -1,94 +1,130 @@
-#pragma once
-
-
-/**
- * Observer interface used to observe the device change form DeviceMonitor
- */
-class DeviceMonitorObserver
-{
-public:
-	/**
-	 * A supported device has been changed.
-	 * @param deviceList The current devices list.
-	 */
-	virtual void OnDeviceChanged(Json::Value &deviceList, bool bInsert) = 0;
-};
-
-/**
- * Register, receive and handle the device change events.
- * Note: you shold call RegisterToWindow before getting the list
- * of connected devices.
- */
-class DeviceMonitor
-{
-public:
-	DeviceMonitor(void);
-	~DeviceMonitor(void);
-
-	void Lock()
-	{
-		m_cs.Enter();
-	}
-
-	void Unlock()
-	{
-		m_cs.Leave();
-	}
-
-	/**
-	 * Add an oberver to monitor the device change
-	 */
-	void AddObserver(DeviceMonitorObserver* pObserver);
-
-	/**
-	 * Remove an oberver monitoring the device change
-	 */
-	void RemoveObserver(DeviceMonitorObserver* pObserver);
-
-	/**
-	 * Register device notification to the main window.
-	 */
-	void RegisterToWindow(HWND hWnd);
-
-	/**
-	 * Unregister device notification
-	 */
-	void Unregister();
-
-	// Update the list of current connected devices
-	Json::Value GetDevicesList();
-
-	/**
-	 * WM_DEVICECHANGE Handler, called to when there is a change to the hardware configuration of a device or the computer.
-	 * @param nEventType An event type, which can be one of the two values:
-	 *                   1. DBT_DEVICEARRIVAL   A device has been inserted and is now available.
-	 *                   2. DBT_DEVICEREMOVECOMPLETE   Device has been removed.
-	 * @param pHdr The address of a DEV_BROADCAST_HDR structure that contains event-specific data. It should not be NULL.
-	 * @return true if the changed device needs to be monitored.
-	 */
-	bool OnDeviceChange (UINT nEventType, PDEV_BROADCAST_HDR pHdr);
-
-	// Connected devices list
-	Json::Value m_aDeviceList;
-private:
-	// Get the index of the observer in the oberver list
-	int FindObserver(DeviceMonitorObserver* pObserver);
-
-	// Enumerates the sub-devices to find the Firefox OS sub-device and get its device info.
-	bool DeviceMonitor::GetFirefoxOSSubDeviceInfo(DEVINST dnDevInst, Json::Value &deviceInfo);
-
-	bool isLoaded;
-
-	bool Load(LPCTSTR strFileName);
-
-	Json::Value m_aDevices;
-
-	// The observer list
-	vector<DeviceMonitorObserver*> m_aObservers;
-
-	// Device notification handle
-	HDEVNOTIFY m_hDevNotify;
-
-	CCriticalSection m_cs;
-};
-
+#pragma once
+
+
+/**
+ * Observer interface used to observe the device change form DeviceMonitor
+ */
+class DeviceMonitorObserver
+{
+public:
+	/**
+	 * A supported device has been changed.
+	 * @param deviceList The current devices list.
+	 * @param delta The changes against the previous list, see DeviceMonitor::MakeDelta.
+	 *              "base" and "version" are the versions of the previous and current lists.
+	 */
+	virtual void OnDeviceChanged(Json::Value &deviceList, const Json::Value &delta, bool bInsert) = 0;
+};
+
+/**
+ * Register, receive and handle the device change events.
+ * Note: you shold call RegisterToWindow before getting the list
+ * of connected devices.
+ */
+class DeviceMonitor
+{
+public:
+	DeviceMonitor(void);
+	~DeviceMonitor(void);
+
+	void Lock()
+	{
+		m_cs.Enter();
+	}
+
+	void Unlock()
+	{
+		m_cs.Leave();
+	}
+
+	/**
+	 * Add an oberver to monitor the device change
+	 */
+	void AddObserver(DeviceMonitorObserver* pObserver);
+
+	/**
+	 * Remove an oberver monitoring the device change
+	 */
+	void RemoveObserver(DeviceMonitorObserver* pObserver);
+
+	/**
+	 * Register device notification to the main window.
+	 */
+	void RegisterToWindow(HWND hWnd);
+
+	/**
+	 * Unregister device notification
+	 */
+	void Unregister();
+
+	// Update the list of current connected devices
+	Json::Value GetDevicesList();
+
+	/**
+	 * Get a copy of the connected devices list.
+	 * It is safe to call from any thread, e.g. the socket I/O threads.
+	 * @param pVersion If not NULL, receives the version of the list.
+	 */
+	Json::Value GetDeviceListSnapshot(int* pVersion = NULL);
+
+	/**
+	 * Compare two device lists by the "InstanceId" of the devices.
+	 * @return An object with three arrays: "added" and "changed" contain the device infos
+	 *         of the new list, "removed" contains the instance IDs of the removed devices.
+	 */
+	static Json::Value MakeDelta(const Json::Value &oldList, const Json::Value &newList);
+
+	/**
+	 * Get the state of a connected device. It is safe to call from any thread.
+	 * @param szInstanceId The device instance ID, i.e. the "InstanceId" of the device.
+	 * @param device Receives a copy of the device info.
+	 * @return true if the device is connected.
+	 */
+	bool GetDeviceSnapshot(const char* szInstanceId, Json::Value &device);
+
+	/**
+	 * Look up the supported devices catalog (devices.json) by hardware ID.
+	 * It is safe to call from any thread.
+	 * @param szHardwareId One of the hardware IDs of the device, case insensitive.
+	 * @param entry Receives a copy of the catalog entry.
+	 * @return true if the device is supported.
+	 */
+	bool FindCatalogEntry(const char* szHardwareId, Json::Value &entry);
+
+	/**
+	 * WM_DEVICECHANGE Handler, called to when there is a change to the hardware configuration of a device or the computer.
+	 * @param nEventType An event type, which can be one of the two values:
+	 *                   1. DBT_DEVICEARRIVAL   A device has been inserted and is now available.
+	 *                   2. DBT_DEVICEREMOVECOMPLETE   Device has been removed.
+	 * @param pHdr The address of a DEV_BROADCAST_HDR structure that contains event-specific data. It should not be NULL.
+	 * @return true if the changed device needs to be monitored.
+	 */
+	bool OnDeviceChange (UINT nEventType, PDEV_BROADCAST_HDR pHdr);
+
+	// Connected devices list
+	Json::Value m_aDeviceList;
+private:
+	// Get the index of the observer in the oberver list
+	int FindObserver(DeviceMonitorObserver* pObserver);
+
+	// Enumerates the sub-devices to find the Firefox OS sub-device and get its device info.
+	bool DeviceMonitor::GetFirefoxOSSubDeviceInfo(DEVINST dnDevInst, Json::Value &deviceInfo);
+
+	bool isLoaded;
+
+	bool Load(LPCTSTR strFileName);
+
+	Json::Value m_aDevices;
+
+	// The observer list
+	vector<DeviceMonitorObserver*> m_aObservers;
+
+	// Device notification handle
+	HDEVNOTIFY m_hDevNotify;
+
+	// Incremented every time m_aDeviceList changes
+	int m_nVersion;
+
+	CCriticalSection m_cs;
+};
+
@@ -0,0 +1,188 @@
+#include "StdAfx.h"
+#include "ImageRegion.h"
+#include <emmintrin.h>
+
+ImageRegion::Cache ImageRegion::s_cache;
+
+// Compares 4 pixels at once with the color key and, for an image with an alpha channel,
+// with a fully transparent pixel.
+class TransparentPixels
+{
+public:
+	TransparentPixels(COLORREF crTransparent, bool bAlphaChannel)
+		// The DIB bits are blue, green, red, alpha from the low byte.
+		: m_dwKey(GetRValue(crTransparent) << 16 | GetGValue(crTransparent) << 8 | GetBValue(crTransparent))
+		, m_bAlphaChannel(bAlphaChannel)
+	{
+		m_key = _mm_set1_epi32(static_cast<int>(m_dwKey));
+		m_colorMask = _mm_set1_epi32(0x00FFFFFF);
+		m_alphaMask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+		m_zero = _mm_setzero_si128();
+	}
+
+	bool IsTransparent(DWORD dwPixel) const
+	{
+		return (dwPixel & 0x00FFFFFF) == m_dwKey || (m_bAlphaChannel && (dwPixel & 0xFF000000) == 0);
+	}
+
+	// Whether the 4 pixels at pPixels are all transparent
+	bool AreTransparent(const DWORD* pPixels) const
+	{
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pPixels));
+		__m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(pixels, m_colorMask), m_key);
+		if (m_bAlphaChannel)
+		{
+			transparent = _mm_or_si128(transparent, _mm_cmpeq_epi32(_mm_and_si128(pixels, m_alphaMask), m_zero));
+		}
+		return _mm_movemask_epi8(transparent) == 0xFFFF;
+	}
+
+	// The first opaque pixel of a row, nWidth if there is none
+	int FindFirstOpaque(const DWORD* pRow, int nWidth) const
+	{
+		int x = 0;
+		while (x + 4 <= nWidth && AreTransparent(pRow + x))
+		{
+			x += 4;
+		}
+		while (x < nWidth && IsTransparent(pRow[x]))
+		{
+			x++;
+		}
+		return x;
+	}
+
+	// The last opaque pixel of a row which has one at nFirst
+	int FindLastOpaque(const DWORD* pRow, int nFirst, int nWidth) const
+	{
+		int x = nWidth - 1;
+		while (x - 3 > nFirst && AreTransparent(pRow + x - 3))
+		{
+			x -= 4;
+		}
+		while (x > nFirst && IsTransparent(pRow[x]))
+		{
+			x--;
+		}
+		return x;
+	}
+
+private:
+	DWORD m_dwKey;
+	bool m_bAlphaChannel;
+	__m128i m_key;
+	__m128i m_colorMask;
+	__m128i m_alphaMask;
+	__m128i m_zero;
+};
+
+ImageRegion::ImageRegion(void)
+	: m_nWidth(0)
+	, m_nHeight(0)
+{
+}
+
+void ImageRegion::Scan(const DWORD* pBits, int nWidth, int nHeight, int nStride, COLORREF crTransparent, bool bAlphaChannel)
+{
+	TransparentPixels transparent(crTransparent, bAlphaChannel);
+
+	m_nWidth = nWidth;
+	m_nHeight = nHeight;
+	m_aRects.clear();
+	for (int y = 0; y < nHeight; y++)
+	{
+		const DWORD* pRow = pBits + y * nStride;
+		int left = transparent.FindFirstOpaque(pRow, nWidth);
+		if (left == nWidth)
+		{
+			continue;
+		}
+		int right = transparent.FindLastOpaque(pRow, left, nWidth) + 1;
+
+		// Extend the rectangle of the row above if it has the same span.
+		if (!m_aRects.empty())
+		{
+			RECT& last = m_aRects.back();
+			if (last.bottom == y && last.left == left && last.right == right)
+			{
+				last.bottom = y + 1;
+				continue;
+			}
+		}
+		RECT rect = { left, y, right, y + 1 };
+		m_aRects.push_back(rect);
+	}
+}
+
+bool ImageRegion::Scan(HBITMAP hBitmap, COLORREF crTransparent, bool bAlphaChannel)
+{
+	DIBSECTION dib;
+	if (::GetObject(hBitmap, sizeof(dib), &dib) != sizeof(dib) ||
+		dib.dsBm.bmBits == NULL || dib.dsBm.bmBitsPixel != 32)
+	{
+		return false;
+	}
+	// Make sure GDI is done drawing in the bits.
+	::GdiFlush();
+
+	int nWidth = dib.dsBm.bmWidth;
+	int nHeight = dib.dsBm.bmHeight;
+	int nStride = dib.dsBm.bmWidthBytes / 4;
+	const DWORD* pBits = static_cast<const DWORD*>(dib.dsBm.bmBits);
+	if (dib.dsBmih.biHeight > 0)
+	{
+		// Bottom-up, start from the last row in memory.
+		pBits += (nHeight - 1) * nStride;
+		nStride = -nStride;
+	}
+	Scan(pBits, nWidth, nHeight, nStride, crTransparent, bAlphaChannel);
+	return true;
+}
+
+HRGN ImageRegion::CreateRegion() const
+{
+	DWORD nCount = static_cast<DWORD>(m_aRects.size());
+	std::vector<BYTE> buffer(sizeof(RGNDATAHEADER) + nCount * sizeof(RECT));
+	RGNDATA* pData = reinterpret_cast<RGNDATA*>(&buffer[0]);
+	pData->rdh.dwSize = sizeof(RGNDATAHEADER);
+	pData->rdh.iType = RDH_RECTANGLES;
+	pData->rdh.nCount = nCount;
+	pData->rdh.nRgnSize = nCount * sizeof(RECT);
+	::SetRect(&pData->rdh.rcBound, 0, 0, m_nWidth, m_nHeight);
+	if (nCount > 0)
+	{
+		memcpy(pData->Buffer, &m_aRects[0], nCount * sizeof(RECT));
+	}
+	return ::ExtCreateRegion(NULL, static_cast<DWORD>(buffer.size()), pData);
+}
+
+const ImageRegion* ImageRegion::Find(LPCTSTR szKey)
+{
+	ImageRegion* pRegion = NULL;
+	return s_cache.Lookup(szKey, pRegion) ? pRegion : NULL;
+}
+
+const ImageRegion* ImageRegion::Add(LPCTSTR szKey, const ImageRegion& region)
+{
+	ImageRegion* pRegion = NULL;
+	if (s_cache.Lookup(szKey, pRegion))
+	{
+		*pRegion = region;
+	}
+	else
+	{
+		pRegion = new ImageRegion(region);
+		s_cache.SetAt(szKey, pRegion);
+	}
+	return pRegion;
+}
+
+void ImageRegion::ClearCache()
+{
+	POSITION pos = s_cache.GetStartPosition();
+	while (pos != NULL)
+	{
+		delete s_cache.GetNextValue(pos);
+	}
+	s_cache.RemoveAll();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+/**
+ * The shape of a window cut out of its background image: each row spans from its first
+ * to its last opaque pixel. A pixel is transparent if it has the color key, or if the
+ * image has an alpha channel and the pixel is fully transparent.
+ *
+ * The pixels are read from the bits of the DIB section, several at once, and the rows
+ * with the same span are merged into one rectangle. The region is then created in one
+ * ExtCreateRegion call, and a scanned image is kept by key, e.g. its skin path, so that
+ * a window created again doesn't scan it again.
+ */
+class ImageRegion
+{
+public:
+	ImageRegion(void);
+
+	/**
+	 * Scan the rows of 32 bits pixels, 0x00RRGGBB in the low bits of each.
+	 * @param nStride The distance between the rows, in pixels.
+	 */
+	void Scan(const DWORD* pBits, int nWidth, int nHeight, int nStride, COLORREF crTransparent, bool bAlphaChannel);
+
+	/**
+	 * Scan a 32 bits DIB section, such as the images loaded by DuiLib.
+	 * @return false if the bitmap isn't one.
+	 */
+	bool Scan(HBITMAP hBitmap, COLORREF crTransparent, bool bAlphaChannel);
+
+	// A new region, to be given to SetWindowRgn or deleted. NULL if the scan failed.
+	HRGN CreateRegion() const;
+
+	// The size of the image
+	int GetWidth() const { return m_nWidth; }
+	int GetHeight() const { return m_nHeight; }
+
+	// The rectangles of the region
+	const std::vector<RECT>& GetRects() const { return m_aRects; }
+
+	// The region scanned for a key, NULL if it hasn't been yet. Called on the UI thread.
+	static const ImageRegion* Find(LPCTSTR szKey);
+
+	// Keep a scanned region for a key. Called on the UI thread.
+	static const ImageRegion* Add(LPCTSTR szKey, const ImageRegion& region);
+
+	// Free the regions kept, e.g. before the application exits.
+	static void ClearCache();
+
+private:
+	int m_nWidth;
+	int m_nHeight;
+	std::vector<RECT> m_aRects;
+
+	typedef CAtlMap<CString, ImageRegion*, CStringElementTraits<CString> > Cache;
+	static Cache s_cache;
+};
@@ -0,0 +1,93 @@
+#include "StdAfx.h"
+#include "MainFrameHost.h"
+#include "MainFrame.h"
+#include "App.h"
+
+MainFrameHost::MainFrameHost(Reactor* pReactor, Daemon* pDaemon, const CString& strTitle, DWORD dwIdleTimeout)
+	: m_pReactor(pReactor)
+	, m_pDaemon(pDaemon)
+	, m_strTitle(strTitle)
+	, m_dwIdleTimeout(dwIdleTimeout)
+	, m_pFrame(NULL)
+	, m_bReleasing(false)
+	, m_nIdleTimer(0)
+{
+}
+
+MainFrameHost::~MainFrameHost(void)
+{
+	Release();
+}
+
+void MainFrameHost::Show()
+{
+	m_pReactor->CancelTimer(m_nIdleTimer);
+	m_nIdleTimer = 0;
+
+	if (m_pFrame == NULL)
+	{
+		// Parses the skin and builds the control tree, the images are decoded when the
+		// window is painted first.
+		m_pFrame = new MainFrame(m_pDaemon, this);
+		m_pFrame->Create(NULL, m_strTitle, UI_WNDSTYLE_FRAME, 0L, 0, 0, 190, 341);
+		m_pFrame->CenterWindow();
+		m_pFrame->SetIcon(IDI_USBMONITOR);
+	}
+	m_pFrame->ShowWindow(true, true);
+	::SetForegroundWindow(m_pFrame->GetHWND());
+}
+
+void MainFrameHost::Release()
+{
+	m_pReactor->CancelTimer(m_nIdleTimer);
+	m_nIdleTimer = 0;
+
+	if (m_pFrame != NULL)
+	{
+		// The window deletes itself and calls OnFrameDestroyed.
+		m_bReleasing = true;
+		::DestroyWindow(m_pFrame->GetHWND());
+		m_bReleasing = false;
+	}
+}
+
+void MainFrameHost::OnFrameMinimized()
+{
+	if (m_dwIdleTimeout == 0)
+	{
+		// Not from the window procedure of the window being minimized, and only if it
+		// hasn't been restored meanwhile.
+		m_pReactor->Post([this]()
+		{
+			if (m_pFrame != NULL && ::IsIconic(m_pFrame->GetHWND()))
+			{
+				Release();
+			}
+		});
+		return;
+	}
+	m_pReactor->CancelTimer(m_nIdleTimer);
+	m_nIdleTimer = m_pReactor->AddTimer(m_dwIdleTimeout, 0, [this]()
+	{
+		m_nIdleTimer = 0;
+		Release();
+	});
+}
+
+void MainFrameHost::OnFrameRestored()
+{
+	m_pReactor->CancelTimer(m_nIdleTimer);
+	m_nIdleTimer = 0;
+}
+
+void MainFrameHost::OnFrameDestroyed()
+{
+	m_pFrame = NULL;
+	if (!m_bReleasing)
+	{
+		// Closed by the user: the close button, Alt+F4 or the taskbar.
+		m_pReactor->CancelTimer(m_nIdleTimer);
+		m_nIdleTimer = 0;
+		m_pReactor->Quit();
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Daemon.h"
+
+class MainFrame;
+
+/**
+ * Creates the window of the daemon when it is first shown and releases it once it has
+ * been minimized for a while, so that the skin, the control tree and the images only take
+ * memory while someone looks at them. Closing the window ends the daemon, as it always
+ * did. Runs on the reactor thread.
+ */
+class MainFrameHost
+{
+public:
+	/**
+	 * @param strTitle The window title.
+	 * @param dwIdleTimeout Milliseconds the minimized window is kept for, to restore it
+	 *   quickly. 0 releases it as soon as it is minimized.
+	 */
+	MainFrameHost(Reactor* pReactor, Daemon* pDaemon, const CString& strTitle, DWORD dwIdleTimeout);
+	~MainFrameHost(void);
+
+	// Show the window, creating it if it has been released.
+	void Show();
+
+	// Release the window without ending the daemon, e.g. before the reactor thread exits.
+	void Release();
+
+	bool IsCreated() const { return m_pFrame != NULL; }
+
+private:
+	// Not copyable
+	MainFrameHost(const MainFrameHost&);
+	MainFrameHost& operator=(const MainFrameHost&);
+
+	friend class MainFrame;
+
+	// Called by the window when the user minimizes it, and when it is shown again.
+	void OnFrameMinimized();
+	void OnFrameRestored();
+
+	// Called by the window when it is destroyed, just before it deletes itself.
+	// Unless Release destroyed it, the user closed it and the daemon quits.
+	void OnFrameDestroyed();
+
+	Reactor* m_pReactor;
+	Daemon* m_pDaemon;
+	CString m_strTitle;
+	DWORD m_dwIdleTimeout;
+
+	// NULL while the window is released
+	MainFrame* m_pFrame;
+	// Set while Release destroys the window
+	bool m_bReleasing;
+
+	// Releases the window m_dwIdleTimeout after it has been hidden
+	UINT_PTR m_nIdleTimer;
+};
@@ -0,0 +1,380 @@
+#include "StdAfx.h"
+#include "MessageEncoder.h"
+#include <float.h>
+
+//
+// MessageBuffer
+//
+
+MessageBuffer::MessageBuffer(void)
+	: m_pData(NULL)
+	, m_nLength(0)
+	, m_nCapacity(0)
+{
+}
+
+MessageBuffer::~MessageBuffer(void)
+{
+	free(m_pData);
+}
+
+void MessageBuffer::Append(const char* lpData, int nLength)
+{
+	if (nLength <= 0)
+	{
+		return;
+	}
+	if (m_nLength + nLength > m_nCapacity)
+	{
+		Reserve(m_nLength + nLength);
+	}
+	memcpy(m_pData + m_nLength, lpData, nLength);
+	m_nLength += nLength;
+}
+
+void MessageBuffer::Reserve(int nCapacity)
+{
+	if (nCapacity <= m_nCapacity)
+	{
+		return;
+	}
+
+	// Grow geometrically so that appending byte by byte stays linear.
+	int nNewCapacity = max(nCapacity, max(m_nCapacity * 2, 256));
+	char* pData = static_cast<char*>(realloc(m_pData, nNewCapacity));
+	if (pData == NULL)
+	{
+		throw std::bad_alloc();
+	}
+	m_pData = pData;
+	m_nCapacity = nNewCapacity;
+}
+
+//
+// MessageEncoder
+//
+
+void MessageEncoder::Encode(const Json::Value &value, MessageFormat format, MessageBuffer &buffer)
+{
+	switch (format)
+	{
+	case MESSAGE_FORMAT_MSGPACK:
+		{
+			WriteMsgPack(value, buffer);
+		}
+		break;
+	case MESSAGE_FORMAT_JSON:
+	default:
+		{
+			WriteJson(value, buffer);
+			buffer.Append("\r\n", 2);
+		}
+		break;
+	}
+}
+
+bool MessageEncoder::ParseFormat(const char* szName, MessageFormat &format)
+{
+	if (!_stricmp(szName, "json"))
+	{
+		format = MESSAGE_FORMAT_JSON;
+		return true;
+	}
+	if (!_stricmp(szName, "msgpack"))
+	{
+		format = MESSAGE_FORMAT_MSGPACK;
+		return true;
+	}
+	return false;
+}
+
+void MessageEncoder::WriteJson(const Json::Value &value, MessageBuffer &buffer)
+{
+	char szNumber[32];
+	switch (value.type())
+	{
+	case Json::nullValue:
+		{
+			buffer.Append("null", 4);
+		}
+		break;
+	case Json::intValue:
+		{
+			_i64toa_s(value.asLargestInt(), szNumber, sizeof(szNumber), 10);
+			buffer.Append(szNumber, static_cast<int>(strlen(szNumber)));
+		}
+		break;
+	case Json::uintValue:
+		{
+			_ui64toa_s(value.asLargestUInt(), szNumber, sizeof(szNumber), 10);
+			buffer.Append(szNumber, static_cast<int>(strlen(szNumber)));
+		}
+		break;
+	case Json::realValue:
+		{
+			double d = value.asDouble();
+			if (!_finite(d))
+			{
+				// JSON has no representation of NaN and infinity.
+				buffer.Append("null", 4);
+				break;
+			}
+			int nLength = _snprintf_s(szNumber, sizeof(szNumber), _TRUNCATE, "%.17g", d);
+			buffer.Append(szNumber, nLength);
+		}
+		break;
+	case Json::stringValue:
+		{
+			WriteJsonString(value.asCString(), buffer);
+		}
+		break;
+	case Json::booleanValue:
+		{
+			if (value.asBool())
+			{
+				buffer.Append("true", 4);
+			}
+			else
+			{
+				buffer.Append("false", 5);
+			}
+		}
+		break;
+	case Json::arrayValue:
+		{
+			buffer.Append('[');
+			int count = value.size();
+			for (int i = 0; i < count; i++)
+			{
+				if (i > 0)
+				{
+					buffer.Append(',');
+				}
+				WriteJson(value[i], buffer);
+			}
+			buffer.Append(']');
+		}
+		break;
+	case Json::objectValue:
+		{
+			buffer.Append('{');
+			bool bFirst = true;
+			for (Json::Value::const_iterator it = value.begin(); it != value.end(); ++it)
+			{
+				if (!bFirst)
+				{
+					buffer.Append(',');
+				}
+				bFirst = false;
+				WriteJsonString(it.memberName(), buffer);
+				buffer.Append(':');
+				WriteJson(*it, buffer);
+			}
+			buffer.Append('}');
+		}
+		break;
+	}
+}
+
+void MessageEncoder::WriteJsonString(const char* str, MessageBuffer &buffer)
+{
+	static const char HEX[] = "0123456789abcdef";
+
+	buffer.Append('"');
+	// Copy the runs of characters which need no escaping in one go.
+	const char* pRun = str;
+	const char* p = str;
+	for (; *p != '\0'; p++)
+	{
+		unsigned char ch = static_cast<unsigned char>(*p);
+		if (ch >= 0x20 && ch != '"' && ch != '\\')
+		{
+			continue;
+		}
+
+		buffer.Append(pRun, static_cast<int>(p - pRun));
+		pRun = p + 1;
+		switch (ch)
+		{
+		case '"':	buffer.Append("\\\"", 2); break;
+		case '\\':	buffer.Append("\\\\", 2); break;
+		case '\b':	buffer.Append("\\b", 2); break;
+		case '\f':	buffer.Append("\\f", 2); break;
+		case '\n':	buffer.Append("\\n", 2); break;
+		case '\r':	buffer.Append("\\r", 2); break;
+		case '\t':	buffer.Append("\\t", 2); break;
+		default:
+			{
+				char szEscape[6] = { '\\', 'u', '0', '0', HEX[ch >> 4], HEX[ch & 0x0F] };
+				buffer.Append(szEscape, 6);
+			}
+			break;
+		}
+	}
+	buffer.Append(pRun, static_cast<int>(p - pRun));
+	buffer.Append('"');
+}
+
+void MessageEncoder::WriteMsgPack(const Json::Value &value, MessageBuffer &buffer)
+{
+	switch (value.type())
+	{
+	case Json::nullValue:
+		{
+			buffer.Append(static_cast<char>(0xc0));
+		}
+		break;
+	case Json::intValue:
+		{
+			Json::LargestInt n = value.asLargestInt();
+			if (n >= 0)
+			{
+				// Positive numbers use the unsigned formats
+				Json::Value positive(static_cast<Json::LargestUInt>(n));
+				WriteMsgPack(positive, buffer);
+			}
+			else if (n >= -32)
+			{
+				// negative fixint
+				buffer.Append(static_cast<char>(n));
+			}
+			else if (n >= _I8_MIN)
+			{
+				buffer.Append(static_cast<char>(0xd0));
+				WriteBigEndian(static_cast<unsigned __int64>(n), 1, buffer);
+			}
+			else if (n >= _I16_MIN)
+			{
+				buffer.Append(static_cast<char>(0xd1));
+				WriteBigEndian(static_cast<unsigned __int64>(n), 2, buffer);
+			}
+			else if (n >= _I32_MIN)
+			{
+				buffer.Append(static_cast<char>(0xd2));
+				WriteBigEndian(static_cast<unsigned __int64>(n), 4, buffer);
+			}
+			else
+			{
+				buffer.Append(static_cast<char>(0xd3));
+				WriteBigEndian(static_cast<unsigned __int64>(n), 8, buffer);
+			}
+		}
+		break;
+	case Json::uintValue:
+		{
+			Json::LargestUInt n = value.asLargestUInt();
+			if (n <= 0x7f)
+			{
+				// positive fixint
+				buffer.Append(static_cast<char>(n));
+			}
+			else if (n <= _UI8_MAX)
+			{
+				buffer.Append(static_cast<char>(0xcc));
+				WriteBigEndian(n, 1, buffer);
+			}
+			else if (n <= _UI16_MAX)
+			{
+				buffer.Append(static_cast<char>(0xcd));
+				WriteBigEndian(n, 2, buffer);
+			}
+			else if (n <= _UI32_MAX)
+			{
+				buffer.Append(static_cast<char>(0xce));
+				WriteBigEndian(n, 4, buffer);
+			}
+			else
+			{
+				buffer.Append(static_cast<char>(0xcf));
+				WriteBigEndian(n, 8, buffer);
+			}
+		}
+		break;
+	case Json::realValue:
+		{
+			double d = value.asDouble();
+			unsigned __int64 bits;
+			memcpy(&bits, &d, sizeof(bits));
+			buffer.Append(static_cast<char>(0xcb));
+			WriteBigEndian(bits, 8, buffer);
+		}
+		break;
+	case Json::stringValue:
+		{
+			WriteMsgPackString(value.asCString(), buffer);
+		}
+		break;
+	case Json::booleanValue:
+		{
+			buffer.Append(static_cast<char>(value.asBool() ? 0xc3 : 0xc2));
+		}
+		break;
+	case Json::arrayValue:
+		{
+			int count = value.size();
+			WriteMsgPackHeader(0x90, 0xdc, 0xdd, count, 15, buffer);
+			for (int i = 0; i < count; i++)
+			{
+				WriteMsgPack(value[i], buffer);
+			}
+		}
+		break;
+	case Json::objectValue:
+		{
+			WriteMsgPackHeader(0x80, 0xde, 0xdf, value.size(), 15, buffer);
+			for (Json::Value::const_iterator it = value.begin(); it != value.end(); ++it)
+			{
+				WriteMsgPackString(it.memberName(), buffer);
+				WriteMsgPack(*it, buffer);
+			}
+		}
+		break;
+	}
+}
+
+void MessageEncoder::WriteMsgPackString(const char* str, MessageBuffer &buffer)
+{
+	unsigned int nLength = static_cast<unsigned int>(strlen(str));
+	if (nLength <= 31)
+	{
+		// fixstr
+		buffer.Append(static_cast<char>(0xa0 | nLength));
+	}
+	else if (nLength <= _UI8_MAX)
+	{
+		buffer.Append(static_cast<char>(0xd9));
+		WriteBigEndian(nLength, 1, buffer);
+	}
+	else
+	{
+		WriteMsgPackHeader(0, 0xda, 0xdb, nLength, 0, buffer);
+	}
+	buffer.Append(str, nLength);
+}
+
+void MessageEncoder::WriteMsgPackHeader(unsigned char fixType, unsigned char type16, unsigned char type32,
+	unsigned int count, unsigned int fixLimit, MessageBuffer &buffer)
+{
+	if (count <= fixLimit && fixType != 0)
+	{
+		buffer.Append(static_cast<char>(fixType | count));
+	}
+	else if (count <= _UI16_MAX)
+	{
+		buffer.Append(static_cast<char>(type16));
+		WriteBigEndian(count, 2, buffer);
+	}
+	else
+	{
+		buffer.Append(static_cast<char>(type32));
+		WriteBigEndian(count, 4, buffer);
+	}
+}
+
+void MessageEncoder::WriteBigEndian(unsigned __int64 value, int nBytes, MessageBuffer &buffer)
+{
+	for (int i = nBytes - 1; i >= 0; i--)
+	{
+		buffer.Append(static_cast<char>((value >> (i * 8)) & 0xff));
+	}
+}
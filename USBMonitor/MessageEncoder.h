@@ -0,0 +1,89 @@
+#pragma once
+
+/**
+ * A growable byte buffer for outgoing socket messages.
+ * The memory is kept when the buffer is cleared, so a buffer which is reused for
+ * every message stops allocating once it has grown to the size of the largest one.
+ */
+class MessageBuffer
+{
+public:
+	MessageBuffer(void);
+	~MessageBuffer(void);
+
+	void Clear()
+	{
+		m_nLength = 0;
+	}
+
+	const char* GetData() const
+	{
+		return m_pData;
+	}
+
+	int GetLength() const
+	{
+		return m_nLength;
+	}
+
+	void Append(const char* lpData, int nLength);
+
+	void Append(char ch)
+	{
+		if (m_nLength == m_nCapacity)
+		{
+			Reserve(m_nLength + 1);
+		}
+		m_pData[m_nLength++] = ch;
+	}
+
+	void Reserve(int nCapacity);
+
+private:
+	// Not copyable
+	MessageBuffer(const MessageBuffer&);
+	MessageBuffer& operator=(const MessageBuffer&);
+
+	char* m_pData;
+	int m_nLength;
+	int m_nCapacity;
+};
+
+// Encodings of the messages sent to the socket clients
+enum MessageFormat
+{
+	MESSAGE_FORMAT_JSON,		// Compact JSON, one message per line
+	MESSAGE_FORMAT_MSGPACK,		// MessagePack, the messages are self-delimiting
+	MESSAGE_FORMAT_COUNT
+};
+
+/**
+ * Serializes Json::Value messages in a single pass straight into a MessageBuffer.
+ * Unlike Json::StyledWriter it doesn't indent, doesn't measure the children of arrays
+ * and doesn't build intermediate strings.
+ */
+class MessageEncoder
+{
+public:
+	/**
+	 * Append a message to the buffer.
+	 * JSON messages are terminated by "\r\n" and never contain a line break otherwise.
+	 */
+	static void Encode(const Json::Value &value, MessageFormat format, MessageBuffer &buffer);
+
+	// Append the compact JSON text of the value
+	static void WriteJson(const Json::Value &value, MessageBuffer &buffer);
+
+	// Append the MessagePack encoding of the value
+	static void WriteMsgPack(const Json::Value &value, MessageBuffer &buffer);
+
+	// Get the format by its name, "json" or "msgpack". Returns false if the name is unknown.
+	static bool ParseFormat(const char* szName, MessageFormat &format);
+
+private:
+	static void WriteJsonString(const char* str, MessageBuffer &buffer);
+	static void WriteMsgPackString(const char* str, MessageBuffer &buffer);
+	static void WriteMsgPackHeader(unsigned char fixType, unsigned char type16, unsigned char type32,
+		unsigned int count, unsigned int fixLimit, MessageBuffer &buffer);
+	static void WriteBigEndian(unsigned __int64 value, int nBytes, MessageBuffer &buffer);
+};
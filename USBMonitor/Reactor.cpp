@@ -0,0 +1,248 @@
+#include "StdAfx.h"
+#include "Reactor.h"
+
+Reactor::Reactor(void)
+	: m_dwThreadId(::GetCurrentThreadId())
+	, m_lQuit(0)
+	, m_nExitCode(0)
+	, m_hWakeEvent(::CreateEvent(NULL, FALSE, FALSE, NULL))
+	, m_nHandles(1)
+	, m_llWaits(0)
+{
+	m_aHandles[0] = m_hWakeEvent;
+
+	LARGE_INTEGER frequency;
+	::QueryPerformanceFrequency(&frequency);
+	m_llFrequency = frequency.QuadPart;
+	memset(m_aCounts, 0, sizeof(m_aCounts));
+	memset(m_aTotalTicks, 0, sizeof(m_aTotalTicks));
+	memset(m_aMaxTicks, 0, sizeof(m_aMaxTicks));
+}
+
+Reactor::~Reactor(void)
+{
+	::CloseHandle(m_hWakeEvent);
+}
+
+int Reactor::Run()
+{
+	ASSERT(IsReactorThread());
+	while (m_lQuit == 0)
+	{
+		// The lowest signaled handle wins, the wake event is first so that the tasks
+		// posted by the I/O threads don't wait for a burst of messages.
+		DWORD dwResult = ::MsgWaitForMultipleObjectsEx(m_nHandles, m_aHandles, m_timers.GetTimeout(),
+			QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+		m_csStats.Enter();
+		m_llWaits++;
+		m_csStats.Leave();
+
+		if (dwResult == WAIT_OBJECT_0)
+		{
+			RunTasks();
+		}
+		else if (dwResult > WAIT_OBJECT_0 && dwResult < WAIT_OBJECT_0 + m_nHandles)
+		{
+			RunHandler(dwResult - WAIT_OBJECT_0);
+		}
+		else if (dwResult == WAIT_OBJECT_0 + m_nHandles)
+		{
+			DispatchMessages();
+		}
+		else if (dwResult == WAIT_FAILED)
+		{
+			// A handle was closed before it was removed.
+			::OutputDebugStringA("Reactor: MsgWaitForMultipleObjectsEx failed\n");
+			return -1;
+		}
+		// The timers are checked after every event, a busy source doesn't delay them.
+		RunTimers();
+	}
+	return m_nExitCode;
+}
+
+void Reactor::Quit(int nExitCode)
+{
+	m_nExitCode = nExitCode;
+	::InterlockedExchange(&m_lQuit, 1);
+	::SetEvent(m_hWakeEvent);
+}
+
+void Reactor::Post(Task task)
+{
+	if (m_tasks.Push(std::move(task)))
+	{
+		::SetEvent(m_hWakeEvent);
+	}
+}
+
+UINT_PTR Reactor::AddTimer(DWORD dwDelay, DWORD dwPeriod, const ReactorCallback& func)
+{
+	UINT_PTR nTimerId = m_timers.Add(dwDelay, dwPeriod, func);
+	WakeForTimers();
+	return nTimerId;
+}
+
+bool Reactor::CancelTimer(UINT_PTR nTimerId)
+{
+	// A cancelled timer only makes the reactor wake up early, it needn't be woken.
+	return m_timers.Cancel(nTimerId);
+}
+
+UINT_PTR Reactor::AddKeyedTimer(const CStringA& strKey, DWORD dwDelay, DWORD dwPeriod, const ReactorCallback& func)
+{
+	UINT_PTR nTimerId = m_timers.AddKeyed(strKey, dwDelay, dwPeriod, func);
+	WakeForTimers();
+	return nTimerId;
+}
+
+bool Reactor::CancelKeyedTimer(const CStringA& strKey)
+{
+	return m_timers.CancelKeyed(strKey);
+}
+
+bool Reactor::AddHandle(HANDLE hHandle, const ReactorCallback& handler)
+{
+	ASSERT(IsReactorThread());
+	if (m_nHandles >= MAXIMUM_WAIT_OBJECTS)
+	{
+		return false;
+	}
+	m_aHandles[m_nHandles] = hHandle;
+	m_aHandlers[m_nHandles] = handler;
+	m_nHandles++;
+	return true;
+}
+
+void Reactor::RemoveHandle(HANDLE hHandle)
+{
+	ASSERT(IsReactorThread());
+	for (int i = 1; i < m_nHandles; i++)
+	{
+		if (m_aHandles[i] != hHandle)
+		{
+			continue;
+		}
+		// Keep the order, which is the priority of the handles.
+		for (int j = i + 1; j < m_nHandles; j++)
+		{
+			m_aHandles[j - 1] = m_aHandles[j];
+			m_aHandlers[j - 1].swap(m_aHandlers[j]);
+		}
+		m_nHandles--;
+		m_aHandles[m_nHandles] = NULL;
+		m_aHandlers[m_nHandles] = ReactorCallback();
+		return;
+	}
+}
+
+void Reactor::GetStats(Json::Value &stats)
+{
+	static const char* SOURCE_NAMES[REACTOR_SOURCE_COUNT] = { "messages", "tasks", "timers", "handles" };
+
+	m_csStats.Enter();
+	stats["waits"] = static_cast<Json::Int64>(m_llWaits);
+	for (int i = 0; i < REACTOR_SOURCE_COUNT; i++)
+	{
+		Json::Value& source = stats[SOURCE_NAMES[i]];
+		source["count"] = static_cast<Json::Int64>(m_aCounts[i]);
+		source["total_us"] = static_cast<Json::Int64>(m_aTotalTicks[i] * 1000000 / m_llFrequency);
+		source["max_us"] = static_cast<Json::Int64>(m_aMaxTicks[i] * 1000000 / m_llFrequency);
+	}
+	m_csStats.Leave();
+
+	// The pools only allocate until they are warm, or for unusually large functors.
+	stats["tasks"]["allocations"] = static_cast<int>(Task::GetHeapAllocations() + TaskQueue::GetHeapAllocations());
+}
+
+void Reactor::DispatchMessages()
+{
+	MSG msg;
+	while (::PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+	{
+		if (msg.message == WM_QUIT)
+		{
+			Quit(static_cast<int>(msg.wParam));
+			return;
+		}
+		LARGE_INTEGER start;
+		::QueryPerformanceCounter(&start);
+		if (!m_messageFilter || !m_messageFilter(&msg))
+		{
+			::TranslateMessage(&msg);
+			::DispatchMessage(&msg);
+		}
+		Count(REACTOR_SOURCE_MESSAGE, start.QuadPart);
+	}
+}
+
+void Reactor::RunTasks()
+{
+	// The tasks posted while the batch runs, by the batch too, wait for the next wakeup
+	// so that they can't keep the messages and timers waiting.
+	m_tasks.BeginBatch();
+	Task task;
+	while (m_lQuit == 0 && m_tasks.Pop(task))
+	{
+		LARGE_INTEGER start;
+		::QueryPerformanceCounter(&start);
+		task();
+		Count(REACTOR_SOURCE_TASK, start.QuadPart);
+	}
+}
+
+void Reactor::RunTimers()
+{
+	LARGE_INTEGER start;
+	::QueryPerformanceCounter(&start);
+	int nRun = m_timers.Expire();
+	if (nRun > 0)
+	{
+		Count(REACTOR_SOURCE_TIMER, start.QuadPart, nRun);
+	}
+}
+
+void Reactor::RunHandler(int nIndex)
+{
+	LARGE_INTEGER start;
+	::QueryPerformanceCounter(&start);
+	HANDLE hHandle = m_aHandles[nIndex];
+	// The handler may remove its handle, which moves the handlers.
+	ReactorCallback handler;
+	handler.swap(m_aHandlers[nIndex]);
+	handler();
+	for (int i = 1; i < m_nHandles; i++)
+	{
+		if (m_aHandles[i] == hHandle && !m_aHandlers[i])
+		{
+			m_aHandlers[i].swap(handler);
+			break;
+		}
+	}
+	Count(REACTOR_SOURCE_HANDLE, start.QuadPart);
+}
+
+void Reactor::WakeForTimers()
+{
+	// The reactor thread computes its timeout before it waits again.
+	if (!IsReactorThread())
+	{
+		::SetEvent(m_hWakeEvent);
+	}
+}
+
+void Reactor::Count(ReactorSource source, LONGLONG llStart, int nEvents)
+{
+	LARGE_INTEGER end;
+	::QueryPerformanceCounter(&end);
+	LONGLONG llTicks = end.QuadPart - llStart;
+
+	m_csStats.Enter();
+	m_aCounts[source] += nEvents;
+	m_aTotalTicks[source] += llTicks;
+	if (llTicks > m_aMaxTicks[source])
+	{
+		m_aMaxTicks[source] = llTicks;
+	}
+	m_csStats.Leave();
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "TimerWheel.h"
+#include "TaskQueue.h"
+
+typedef std::function<void()> ReactorCallback;
+
+// The kinds of events a reactor dispatches
+enum ReactorSource
+{
+	REACTOR_SOURCE_MESSAGE,		// Window messages, e.g. WM_DEVICECHANGE
+	REACTOR_SOURCE_TASK,		// Tasks posted from any thread
+	REACTOR_SOURCE_TIMER,		// Timers of the timer wheel
+	REACTOR_SOURCE_HANDLE,		// Signaled handles, e.g. a socket event of WSAEventSelect
+	REACTOR_SOURCE_COUNT
+};
+
+/**
+ * The event loop of the core thread. It multiplexes the window messages of the thread,
+ * the tasks posted by the other threads, a timer wheel and waitable handles in a single
+ * MsgWaitForMultipleObjectsEx, so that every event is scheduled and measured at one
+ * point.
+ *
+ * The reactor belongs to the thread which creates it. Only Post, Quit, GetStats and the
+ * timer functions may be called from other threads. The tasks and timers wait while a modal loop of the
+ * thread runs, e.g. while a window is dragged.
+ */
+class Reactor
+{
+public:
+	// Handles besides the wake event
+	static const int MAX_HANDLES = MAXIMUM_WAIT_OBJECTS - 1;
+
+	Reactor(void);
+	~Reactor(void);
+
+	/**
+	 * Dispatch the events until Quit is called or WM_QUIT is received.
+	 * @return The exit code.
+	 */
+	int Run();
+
+	// Make Run return after the current event.
+	void Quit(int nExitCode = 0);
+
+	// Run a task on the reactor thread, after the tasks posted before it by the same
+	// thread. It never waits for the reactor or the other threads posting.
+	void Post(Task task);
+
+	/**
+	 * Run a function on the reactor thread after a delay, see TimerWheel::Add. Any
+	 * thread may add and cancel the timers.
+	 * @return The timer ID, to cancel it.
+	 */
+	UINT_PTR AddTimer(DWORD dwDelay, DWORD dwPeriod, const ReactorCallback& func);
+
+	// Cancel a timer, false if it has already fired.
+	bool CancelTimer(UINT_PTR nTimerId);
+
+	/**
+	 * Add a timer replacing the timer with the same key, e.g. one per device, see
+	 * TimerWheel::AddKeyed.
+	 */
+	UINT_PTR AddKeyedTimer(const CStringA& strKey, DWORD dwDelay, DWORD dwPeriod, const ReactorCallback& func);
+	bool CancelKeyedTimer(const CStringA& strKey);
+
+	/**
+	 * Call handler each time the handle is signaled, until it is removed. An auto-reset
+	 * event should be used, a manual reset one must be reset by the handler.
+	 * @return false if MAX_HANDLES handles are already added.
+	 */
+	bool AddHandle(HANDLE hHandle, const ReactorCallback& handler);
+	void RemoveHandle(HANDLE hHandle);
+
+	/**
+	 * Give the messages to a filter before they are dispatched, e.g. for the keyboard
+	 * handling of a UI library. The message isn't dispatched if the filter returns true.
+	 */
+	void SetMessageFilter(const std::function<bool(MSG*)>& filter) { m_messageFilter = filter; }
+
+	// {"waits", "<source>":{"count", "total_us", "max_us"}...}, and the heap allocations
+	// made posting the tasks in "tasks":{"allocations"}, which should stay near 0.
+	void GetStats(Json::Value &stats);
+
+private:
+	// Not copyable
+	Reactor(const Reactor&);
+	Reactor& operator=(const Reactor&);
+
+	void DispatchMessages();
+	void RunTasks();
+	void RunTimers();
+	void RunHandler(int nIndex);
+
+	// Account an event dispatched since llStart.
+	void Count(ReactorSource source, LONGLONG llStart, int nEvents = 1);
+
+	bool IsReactorThread() const { return ::GetCurrentThreadId() == m_dwThreadId; }
+
+	// Make the reactor wait for the timers again, after they were changed by another thread.
+	void WakeForTimers();
+
+	DWORD m_dwThreadId;
+	volatile LONG m_lQuit;
+	int m_nExitCode;
+
+	// Set by the first Post of a batch, the first handle waited for
+	HANDLE m_hWakeEvent;
+	TaskQueue m_tasks;
+
+	TimerWheel m_timers;
+
+	// The wake event, then the added handles, with their handlers at the same index
+	HANDLE m_aHandles[MAXIMUM_WAIT_OBJECTS];
+	ReactorCallback m_aHandlers[MAXIMUM_WAIT_OBJECTS];
+	int m_nHandles;
+
+	std::function<bool(MSG*)> m_messageFilter;
+
+	// Dispatch statistics, protected by m_csStats
+	CCriticalSection m_csStats;
+	LONGLONG m_llFrequency;
+	LONGLONG m_llWaits;
+	LONGLONG m_aCounts[REACTOR_SOURCE_COUNT];
+	LONGLONG m_aTotalTicks[REACTOR_SOURCE_COUNT];
+	LONGLONG m_aMaxTicks[REACTOR_SOURCE_COUNT];
+};
@@ -1,1101 +1,1945 @@
-///////////////////////////////////////////////////////////////////////////////
-//  File:       SocketComm.cpp
-//  Version:    1.4
-//
-//  Author:     Ernest Laurentin
-//  E-mail:     elaurentin@netzero.net
-//
-//  Implementation of the CSocketComm and associated classes.
-//
-//  This code may be used in compiled form in any way you desire. This
-//  file may be redistributed unmodified by any means PROVIDING it is
-//  not sold for profit without the authors written consent, and
-//  providing that this notice and the authors name and all copyright
-//  notices remains intact.
-//
-//  This file is provided "as is" with no expressed or implied warranty.
-//  The author accepts no liability for any damage/loss of business that
-//  this c++ class may cause.
-//
-//  Version history
-//
-//  1.0 - Initial release.
-//  1.1 - Add support for Smart Addressing mode
-//  1.2 - Fix various issues with address list (in UDP mode)
-//  1.3 - Fix bug when sending message to broadcast address
-//  1.4 - Add UDP multicast support
-///////////////////////////////////////////////////////////////////////////////
-
-#include "stdafx.h"
-#include <stdio.h>
-#include <tchar.h>
-#include <process.h>
-#include <crtdbg.h>
-#include "SocketComm.h"
-
-const DWORD DEFAULT_TIMEOUT = 100L;
-
-///////////////////////////////////////////////////////////////////////////////
-// SockAddrIn Struct
-
-///////////////////////////////////////////////////////////////////////////////
-// Copy
-SockAddrIn& SockAddrIn::Copy(const SockAddrIn& sin)
-{
-    memcpy(this, &sin, Size());
-    return *this;
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// IsEqual
-bool SockAddrIn::IsEqual(const SockAddrIn& sin) const
-{
-    // Is it Equal? - ignore 'sin_zero'
-    return (memcmp(this, &sin, Size()-sizeof(sin_zero)) == 0);
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// IsGreater
-bool SockAddrIn::IsGreater(const SockAddrIn& sin) const
-{
-    // Is it Greater? - ignore 'sin_zero'
-    return (memcmp(this, &sin, Size()-sizeof(sin_zero)) > 0);
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// IsLower
-bool SockAddrIn::IsLower(const SockAddrIn& sin) const
-{
-    // Is it Lower? - ignore 'sin_zero'
-    return (memcmp(this, &sin, Size()-sizeof(sin_zero)) < 0);
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// CreateFrom
-bool SockAddrIn::CreateFrom(LPCTSTR sAddr, LPCTSTR sService, int nFamily /*=AF_INET*/)
-{
-    Clear();
-    sin_addr.s_addr = htonl( CSocketComm::GetIPAddress(sAddr) );
-    sin_port = htons( CSocketComm::GetPortNumber( sService ) );
-    sin_family = nFamily;
-    return !IsNull();
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// Construct & Destruct
-CSocketComm::CSocketComm() :
-    m_bServer(false), m_bSmartAddressing(false), m_bBroadcast(false),
-    m_hComm(INVALID_HANDLE_VALUE), m_hThread(NULL), m_hMutex(NULL)
-{
-
-}
-
-CSocketComm::~CSocketComm()
-{
-    StopComm();
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// Members
-///////////////////////////////////////////////////////////////////////////////
-
-///////////////////////////////////////////////////////////////////////////////
-// IsOpen
-bool CSocketComm::IsOpen() const
-{
-    return ( INVALID_HANDLE_VALUE != m_hComm );
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// IsStart
-bool CSocketComm::IsStart() const
-{
-    return ( NULL != m_hThread );
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// IsServer
-bool CSocketComm::IsServer() const
-{
-    return m_bServer;
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// IsBroadcast
-bool CSocketComm::IsBroadcast() const
-{
-    return m_bBroadcast;
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// IsSmartAddressing
-bool CSocketComm::IsSmartAddressing() const
-{
-    return m_bSmartAddressing;
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// GetSocket
-SOCKET CSocketComm::GetSocket() const
-{
-    return (SOCKET) m_hComm;
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// LockList
-void CSocketComm::LockList()
-{
-    if (NULL != m_hMutex)
-        WaitForSingleObject(m_hMutex, INFINITE);
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// UnlockList
-void CSocketComm::UnlockList()
-{
-    if (NULL != m_hMutex)
-        ReleaseMutex(m_hMutex);
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// AddToList
-void CSocketComm::AddToList(const SockAddrIn& saddr_in)
-{
-    LockList();
-    m_AddrList.insert( m_AddrList.end(), saddr_in );
-    UnlockList();
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// RemoveFromList
-void CSocketComm::RemoveFromList(const SockAddrIn& saddr_in)
-{
-    LockList();
-    m_AddrList.remove( saddr_in );
-    UnlockList();
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// SetServerState
-void CSocketComm::SetServerState(bool bServer)
-{
-    if (!IsStart())
-        m_bServer = bServer;
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// SetSmartAddressing : Address is included with message
-void CSocketComm::SetSmartAddressing(bool bSmartAddressing)
-{
-    if (!IsStart())
-        m_bSmartAddressing = bSmartAddressing;
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// OnDataReceived
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//              This function is PURE Virtual, you MUST overwrite it.  This is
-//              called every time new data is available.
-// PARAMETERS:
-///////////////////////////////////////////////////////////////////////////////
-void CSocketComm::OnDataReceived(const LPBYTE lpBuffer, DWORD dwCount)
-{
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// OnEvent
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//              This function reports events & errors
-// PARAMETERS:
-//      UINT uEvent: can be one of the event value EVT_(events)
-//      LPVOID lpvData: Event data if any
-///////////////////////////////////////////////////////////////////////////////
-void CSocketComm::OnEvent(UINT uEvent, LPVOID lpvData)
-{
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// GetPortNumber
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//              Returns a port number based on service name or port number string
-// PARAMETERS:
-//  LPCTSTR strServiceName: Service name or port string
-///////////////////////////////////////////////////////////////////////////////
-USHORT CSocketComm::GetPortNumber( LPCTSTR strServiceName )
-{
-    LPSERVENT   lpservent;
-    USHORT      nPortNumber = 0;
-
-    if ( _istdigit( strServiceName[0] ) ) {
-        nPortNumber = (USHORT) _ttoi( strServiceName );
-    }
-    else {
-#ifdef _UNICODE
-        char pstrService[HOSTNAME_SIZE];
-        WideCharToMultiByte(CP_ACP, 0, strServiceName, -1, pstrService, sizeof(pstrService), NULL, NULL );
-#else
-        LPCTSTR pstrService = strServiceName;
-#endif
-        // Convert network byte order to host byte order
-        if ( (lpservent = getservbyname( pstrService, NULL )) != NULL )
-            nPortNumber = ntohs( lpservent->s_port );
-    }
-
-    return nPortNumber;
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// GetIPAddress
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//      Returns an IP address.
-//          - It tries to convert the string directly
-//          - If that fails, it tries to resolve it as a hostname
-// PARAMETERS:
-//  LPCTSTR strHostName: host name to get IP address
-///////////////////////////////////////////////////////////////////////////////
-ULONG CSocketComm::GetIPAddress( LPCTSTR strHostName )
-{
-    LPHOSTENT   lphostent;
-    ULONG       uAddr = INADDR_NONE;
-    TCHAR       strLocal[HOSTNAME_SIZE] = { 0 };
-
-    // if no name specified, get local
-    if ( NULL == strHostName )
-    {
-        GetLocalName(strLocal, sizeof(strLocal));
-        strHostName = strLocal;
-    }
-
-#ifdef _UNICODE
-    char strHost[HOSTNAME_SIZE] = { 0 };
-    WideCharToMultiByte(CP_ACP, 0, strHostName, -1, strHost, sizeof(strHost), NULL, NULL );
-#else
-    LPCTSTR strHost = strHostName;
-#endif
-
-    // Check for an Internet Protocol dotted address string
-    uAddr = inet_addr( strHost );
-
-    if ( (INADDR_NONE == uAddr) && (strcmp( strHost, "255.255.255.255" )) )
-    {
-        // It's not an address, then try to resolve it as a hostname
-        if ( lphostent = gethostbyname( strHost ) )
-            uAddr = *((ULONG *) lphostent->h_addr_list[0]);
-    }
-    
-    return ntohl( uAddr );
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// GetLocalName
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//              Get local computer name.  Something like: "mycomputer.myserver.net"
-// PARAMETERS:
-//  LPTSTR strName: name of the computer is returned here
-//  UINT nSize: size max of buffer "strName"
-///////////////////////////////////////////////////////////////////////////////
-bool CSocketComm::GetLocalName(LPTSTR strName, UINT nSize)
-{
-    if (strName != NULL && nSize > 0)
-    {
-        char strHost[HOSTNAME_SIZE] = { 0 };
-
-        // get host name, if fail, SetLastError is set
-        if (SOCKET_ERROR != gethostname(strHost, sizeof(strHost)))
-        {
-            struct hostent* hp;
-            hp = gethostbyname(strHost);
-            if (hp != NULL) {
-                strncpy(strHost, hp->h_name, HOSTNAME_SIZE);
-            }
-
-            // check if user provide enough buffer
-            if (strlen(strHost) > nSize)
-            {
-                SetLastError(ERROR_INSUFFICIENT_BUFFER);
-                return false;
-            }
-
-            // Unicode conversion
-#ifdef _UNICODE
-            return (0 != MultiByteToWideChar(CP_ACP, 0, strHost, -1, strName, nSize ));
-#else
-            _tcscpy(strName, strHost);
-            return true;
-#endif
-        }
-    }
-    else
-        SetLastError(ERROR_INVALID_PARAMETER);
-    return false;
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// GetLocalAddress
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//              Get TCP address of local computer in dot format ex: "127.0.0.0"
-// PARAMETERS:
-//  LPTSTR strAddress: pointer to hold address string, must be long enough
-//  UINT nSize: maximum size of this buffer
-///////////////////////////////////////////////////////////////////////////////
-bool CSocketComm::GetLocalAddress(LPTSTR strAddress, UINT nSize)
-{
-    // Get computer local address
-    if (strAddress != NULL && nSize > 0)
-    {
-        char strHost[HOSTNAME_SIZE] = { 0 };
-
-        // get host name, if fail, SetLastError is called
-        if (SOCKET_ERROR != gethostname(strHost, sizeof(strHost)))
-        {
-            struct hostent* hp;
-            hp = gethostbyname(strHost);
-            if (hp != NULL && hp->h_addr_list[0] != NULL)
-            {
-                // IPv4: Address is four bytes (32-bit)
-                if ( hp->h_length < 4)
-                    return false;
-
-                // Convert address to . format
-                strHost[0] = 0;
-
-                // IPv4: Create Address string
-                sprintf(strHost, "%u.%u.%u.%u",
-                    (UINT)(((PBYTE) hp->h_addr_list[0])[0]),
-                    (UINT)(((PBYTE) hp->h_addr_list[0])[1]),
-                    (UINT)(((PBYTE) hp->h_addr_list[0])[2]),
-                    (UINT)(((PBYTE) hp->h_addr_list[0])[3]));
-
-                // check if user provide enough buffer
-                if (strlen(strHost) > nSize)
-                {
-                    SetLastError(ERROR_INSUFFICIENT_BUFFER);
-                    return false;
-                }
-
-            // Unicode conversion
-#ifdef _UNICODE
-                return (0 != MultiByteToWideChar(CP_ACP, 0, strHost, -1, strAddress,nSize ));
-#else
-                _tcscpy(strAddress, strHost);
-                return true;
-#endif
-            }
-        }
-    }
-    else
-        SetLastError(ERROR_INVALID_PARAMETER);
-    return false;
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// WaitForConnection
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//              Wait for a network connection.  Only for connection type of socket
-//              This function may fail, in this case it returns "INVALID_SOCKET"
-// PARAMETERS:
-//  SOCKET sock: a socket capable of receiving new connection (TCP: SOCK_STREAM)
-///////////////////////////////////////////////////////////////////////////////
-SOCKET CSocketComm::WaitForConnection(SOCKET sock)
-{
-    // Accept an incoming connection - blocking
-    // no information about remote address is returned
-    return accept(sock, 0, 0);
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// ShutdownConnection
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//              Shutdown a connection and close socket.  This will force all
-//              transmission/reception to fail.
-// PARAMETERS:
-//  SOCKET sock: Socket to close
-///////////////////////////////////////////////////////////////////////////////
-bool CSocketComm::ShutdownConnection(SOCKET sock)
-{
-    shutdown(sock, SD_BOTH);
-    return ( 0 == closesocket( sock ));
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// GetSockName
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//              retrieves the local name for a socket
-// PARAMETERS:
-//  SockAddrIn& saddr_in: object to store address
-///////////////////////////////////////////////////////////////////////////////
-bool CSocketComm::GetSockName(SockAddrIn& saddr_in)
-{
-    if (IsOpen())
-    {
-        int namelen = saddr_in.Size();
-        return (SOCKET_ERROR != getsockname(GetSocket(), saddr_in, &namelen));
-    }
-
-    return false;
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// GetPeerName
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//              retrieves the name of the peer to which a socket is connected
-// PARAMETERS:
-//  SockAddrIn& saddr_in: object to store address
-///////////////////////////////////////////////////////////////////////////////
-bool CSocketComm::GetPeerName(SockAddrIn& saddr_in)
-{
-    if (IsOpen())
-    {
-        int namelen = saddr_in.Size();
-        return (SOCKET_ERROR != getpeername(GetSocket(), saddr_in, &namelen));  
-    }
-
-    return false;
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// AddMembership
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//              Add membership to a multicast address
-// PARAMETERS:
-//  LPCTSTR strAddress: ip address for membership
-///////////////////////////////////////////////////////////////////////////////
-bool CSocketComm::AddMembership(LPCTSTR strAddress)
-{
-    if ( IsOpen() )
-    {
-        int nType = 0;
-        int nOptLen = sizeof(int);
-        SOCKET sock = (SOCKET) m_hComm;
-        if ( SOCKET_ERROR != getsockopt(sock, SOL_SOCKET, SO_TYPE, (char*)&nType, &nOptLen))
-        {
-            if ( nType == SOCK_DGRAM )
-            {
-                int nTTL = 5;
-                if ( SOCKET_ERROR != setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&nTTL, sizeof(nTTL)))
-                {
-                    ip_mreq mreq;
-                    mreq.imr_multiaddr.s_addr = htonl( CSocketComm::GetIPAddress( strAddress ) );
-                    mreq.imr_interface.s_addr = htonl( INADDR_ANY );
-                    return ( SOCKET_ERROR != setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&mreq, sizeof(mreq)));
-                }
-            }
-        }
-    }
-    return false;
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// DropMembership
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//              Remove membership from a multicast address
-// PARAMETERS:
-//  LPCTSTR strAddress: ip address for membership
-///////////////////////////////////////////////////////////////////////////////
-bool CSocketComm::DropMembership(LPCTSTR strAddress)
-{
-    if ( IsOpen() )
-    {
-        int nType = 0;
-        int nOptLen = sizeof(int);
-        SOCKET sock = (SOCKET) m_hComm;
-        if ( SOCKET_ERROR != getsockopt(sock, SOL_SOCKET, SO_TYPE, (char*)&nType, &nOptLen))
-        {
-            if ( nType == SOCK_DGRAM )
-            {
-                ip_mreq mreq;
-                mreq.imr_multiaddr.s_addr = htonl( CSocketComm::GetIPAddress( strAddress ) );
-                mreq.imr_interface.s_addr = htonl( INADDR_ANY );
-                return ( SOCKET_ERROR != setsockopt(sock, IPPROTO_IP, IP_DROP_MEMBERSHIP, (const char*)&mreq, sizeof(mreq)));
-            }
-        }
-    }
-    return false;
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// CreateSocketEx
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//              This function creates a new socket for connection (SOCK_STREAM)
-//              or an connectionless socket (SOCK_DGRAM).  A connectionless
-//              socket should not call "accept()" since it cannot receive new
-//              connection.  This is used as SERVER socket
-// PARAMETERS:
-//  LPCTSTR strHost: Hostname or adapter IP address
-//  LPCTSTR strServiceName: Service name or port number
-//  int nFamily: address family to use (set to AF_INET)
-//  int nType: type of socket to create (SOCK_STREAM, SOCK_DGRAM)
-//  UINT uOptions: other options to use
-///////////////////////////////////////////////////////////////////////////////
-bool CSocketComm::CreateSocketEx(LPCTSTR strHost, LPCTSTR strServiceName, int nFamily, int nType, UINT uOptions /* = 0 */)
-{
-    // Socket is already opened
-    if ( IsOpen() )
-        return false;
-
-    // Create a Socket that is bound to a specific service provide
-    // nFamily: (AF_INET)
-    // nType: (SOCK_STREAM, SOCK_DGRAM)
-    SOCKET sock = socket(nFamily, nType, IPPROTO_IP);
-    if (INVALID_SOCKET != sock)
-    {
-        if (uOptions & SO_REUSEADDR)
-        {
-            // Inform Windows Sockets provider that a bind on a socket should not be disallowed
-            // because the desired address is already in use by another socket
-            BOOL optval = TRUE;
-            if ( SOCKET_ERROR == setsockopt( sock, SOL_SOCKET, SO_REUSEADDR, (char *) &optval, sizeof( BOOL ) ) )
-            {
-                closesocket( sock );
-                return false;
-            }
-        }
-
-        if (nType == SOCK_DGRAM)
-        {
-            if (uOptions & SO_BROADCAST)
-            {
-                // Inform Windows Sockets provider that broadcast messages are allowed
-                BOOL optval = TRUE;
-                if ( SOCKET_ERROR == setsockopt( sock, SOL_SOCKET, SO_BROADCAST, (char *) &optval, sizeof( BOOL ) ) )
-                {
-                    closesocket( sock );
-                    return false;
-                }
-            }
-        }
-
-        // Associate a local address with the socket
-        SockAddrIn sockAddr;
-        sockAddr.CreateFrom(strHost, strServiceName, nFamily);
-
-        if ( SOCKET_ERROR == ::bind(sock, sockAddr, sockAddr.Size()))
-        {
-            closesocket( sock );
-            return false;
-        }
-
-        // Listen to the socket, only valid for connection socket
-        if (SOCK_STREAM == nType)
-        {
-            if ( SOCKET_ERROR == listen(sock, SOMAXCONN))
-            {
-                closesocket( sock );
-                return false;
-            }
-        }
-
-        // Success, now we may save this socket
-        m_hComm = (HANDLE) sock;
-    }
-
-    return (INVALID_SOCKET != sock);
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// CreateSocket
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//              This function creates a new socket for connection (SOCK_STREAM)
-//              or an connectionless socket (SOCK_DGRAM).  A connectionless
-//              socket should not call "accept()" since it cannot receive new
-//              connection.  This is used as SERVER socket
-// PARAMETERS:
-//  LPCTSTR strServiceName: Service name or port number
-//  int nFamily: address family to use (set to AF_INET)
-//  int nType: type of socket to create (SOCK_STREAM, SOCK_DGRAM)
-//  UINT uOptions: other options to use
-///////////////////////////////////////////////////////////////////////////////
-bool CSocketComm::CreateSocket(LPCTSTR strServiceName, int nFamily, int nType, UINT uOptions /* = 0 */)
-{
-    return CreateSocketEx(NULL, strServiceName, nFamily, nType, uOptions);
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// ConnectTo
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//              Establish connection with a server service or port
-// PARAMETERS:
-//  LPCTSTR strDestination: hostname or address to connect (in .dot format)
-//  LPCTSTR strServiceName: Service name or port number
-//  int nFamily: address family to use (set to AF_INET)
-//  int nType: type of socket to create (SOCK_STREAM, SOCK_DGRAM)
-///////////////////////////////////////////////////////////////////////////////
-bool CSocketComm::ConnectTo(LPCTSTR strDestination, LPCTSTR strServiceName, int nFamily, int nType)
-{
-    // Socket is already opened
-    if ( IsOpen() )
-        return false;
-
-    // Create a Socket that is bound to a specific service provide
-    // nFamily: (AF_INET)
-    // nType: (SOCK_STREAM, SOCK_DGRAM)
-    SOCKET sock = socket(nFamily, nType, 0);
-    if (INVALID_SOCKET != sock)
-    {
-        // Associate a local address with the socket
-        SockAddrIn sockAddr;
-        if (false == sockAddr.CreateFrom(NULL, TEXT("0"), nFamily))
-        {
-            closesocket( sock );
-            return false;
-        }
-
-        if ( SOCKET_ERROR == ::bind(sock, sockAddr, sockAddr.Size() ))
-        {
-            closesocket( sock );
-            return false;
-        }
-
-        // Now get destination address & port
-        sockAddr.CreateFrom( strDestination, strServiceName );
-
-        // try to connect - if fail, server not ready
-        if (SOCKET_ERROR == connect( sock, sockAddr, sockAddr.Size()))
-        {
-            closesocket( sock );
-            return false;
-        }
-
-        // Success, now we may save this socket
-        m_hComm = (HANDLE) sock;
-    }
-    return (INVALID_SOCKET != sock);
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// CloseComm
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//      Close Socket Communication
-// PARAMETERS:
-//      None
-///////////////////////////////////////////////////////////////////////////////
-void CSocketComm::CloseComm()
-{
-    if (IsOpen())
-    {
-        ShutdownConnection((SOCKET)m_hComm);
-        m_hComm = INVALID_HANDLE_VALUE;
-        m_bBroadcast = false;
-    }
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// WatchComm
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//      Starts Socket Communication Working thread
-// PARAMETERS:
-//      None
-///////////////////////////////////////////////////////////////////////////////
-bool CSocketComm::WatchComm()
-{
-    if (!IsStart())
-    {
-        if (IsOpen())
-        {
-            HANDLE hThread;
-            UINT uiThreadId = 0;
-            hThread = (HANDLE)_beginthreadex(NULL,  // Security attributes
-                                      0,    // stack
-                        SocketThreadProc,   // Thread proc
-                                    this,   // Thread param
-                        CREATE_SUSPENDED,   // creation mode
-                            &uiThreadId);   // Thread ID
-
-            if ( NULL != hThread)
-            {
-                //SetThreadPriority(hThread, THREAD_PRIORITY_ABOVE_NORMAL);
-                ResumeThread( hThread );
-                m_hThread = hThread;
-                return true;
-            }
-        }
-    }
-    return false;
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// StopComm
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//      Close Socket and Stop Communication thread
-// PARAMETERS:
-//      None
-///////////////////////////////////////////////////////////////////////////////
-void CSocketComm::StopComm()
-{
-    // Close Socket
-    if (IsOpen())
-    {
-        CloseComm();
-    }
-
-    // Kill Thread
-    if (IsStart())
-    {
-        SleepEx(DEFAULT_TIMEOUT, TRUE);
-        if (WaitForSingleObject(m_hThread, 1000L) == WAIT_TIMEOUT)
-            TerminateThread(m_hThread, 1L);
-        CloseHandle(m_hThread);
-        m_hThread = NULL;
-    }
-
-    // Clear Address list
-    if (!m_AddrList.empty())
-    {
-        m_AddrList.clear();
-    }
-
-    // Destroy Synchronization objects
-    if (NULL != m_hMutex)
-    {
-        CloseHandle( m_hMutex );
-        m_hMutex = NULL;
-    }
-
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// ReadComm
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//      Reads the Socket Communication
-// PARAMETERS:
-//      LPBYTE lpBuffer: buffer to place new data
-//      DWORD dwSize: maximum size of buffer
-//      DWORD dwTimeout: timeout to use in millisecond
-///////////////////////////////////////////////////////////////////////////////
-DWORD CSocketComm::ReadComm(LPBYTE lpBuffer, DWORD dwSize, DWORD dwTimeout)
-{
-    _ASSERTE( IsOpen() );
-    _ASSERTE( lpBuffer != NULL );
-
-    if (lpBuffer == NULL || dwSize < 1L)
-        return 0L;
-
-    fd_set  fdRead  = { 0 };
-    TIMEVAL stTime;
-    TIMEVAL *pstTime = NULL;
-
-    if ( INFINITE != dwTimeout ) {
-        stTime.tv_sec = dwTimeout/1000;
-        stTime.tv_usec = (dwTimeout%1000)*1000;
-        pstTime = &stTime;
-    }
-
-    SOCKET s = (SOCKET) m_hComm;
-    // Set Descriptor
-    if ( !FD_ISSET( s, &fdRead ) )
-        FD_SET( s, &fdRead );
-
-    // Select function set read timeout
-    DWORD dwBytesRead = 0L;
-    int res = select( s+1, &fdRead, NULL, NULL, pstTime );
-    if ( res > 0)
-    {
-        if (IsBroadcast() || IsSmartAddressing())
-        {
-            SockAddrIn sockAddr;
-            sockAddr.sin_addr.S_un.S_addr = htonl(INADDR_ANY);
-            int nLen = sockAddr.Size();
-            int nOffset = IsSmartAddressing() ? nLen : 0; // use offset for Smart addressing
-            if ( dwSize < (DWORD) nOffset)  // error - buffer to small
-            {
-                SetLastError( ERROR_INVALID_USER_BUFFER );
-                return -1L;
-            }
-            LPSTR lpszData = (LPSTR)(lpBuffer + nOffset);
-            res = recvfrom( s, lpszData, dwSize-nOffset, 0, sockAddr, &nLen);
-
-            // clear 'sin_zero', we will ignore them with 'SockAddrIn' anyway!
-            memset(&sockAddr.sin_zero, 0, sizeof(sockAddr.sin_zero));
-
-            // Lock the list...
-            LockList();
-            m_AddrList.remove( sockAddr );
-
-            if ( res >= 0)
-            {
-                // insert unique address
-                m_AddrList.insert(m_AddrList.end(), sockAddr);
-
-                if (IsSmartAddressing())
-                {
-                    memcpy(lpBuffer, &sockAddr, sockAddr.Size());
-                    res += sockAddr.Size();
-                }
-            }
-            else if (WSAGetLastError() == WSAECONNRESET && m_AddrList.size() == 1)
-            {
-                // recvfrom doesn't always return the connection address for last connection
-                m_AddrList.clear();
-            }
-
-            UnlockList(); // unlock this object addresses-list
-        }
-        else
-        {
-            res = recv( s, (LPSTR)lpBuffer, dwSize, 0);
-        }
-    }
-    dwBytesRead = (DWORD)((res > 0)?(res) : (-1L));
-
-    return dwBytesRead;
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// WriteComm
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//      Writes data to the Socket Communication
-// PARAMETERS:
-//      const LPBYTE lpBuffer: data to write
-//      DWORD dwCount: maximum characters to write
-//      DWORD dwTimeout: timeout to use in millisecond
-///////////////////////////////////////////////////////////////////////////////
-DWORD CSocketComm::WriteComm(const LPBYTE lpBuffer, DWORD dwCount, DWORD dwTimeout)
-{
-    _ASSERTE( IsOpen() );
-    _ASSERTE( NULL != lpBuffer );
-
-    // Accept 0 bytes message
-    if (!IsOpen() || NULL == lpBuffer)
-        return 0L;
-
-    fd_set  fdWrite  = { 0 };
-    TIMEVAL stTime;
-    TIMEVAL *pstTime = NULL;
-
-    if ( INFINITE != dwTimeout ) {
-        stTime.tv_sec = dwTimeout/1000;
-        stTime.tv_usec = (dwTimeout%1000)*1000;
-        pstTime = &stTime;
-    }
-
-    SOCKET s = (SOCKET) m_hComm;
-    // Set Descriptor
-    if ( !FD_ISSET( s, &fdWrite ) )
-        FD_SET( s, &fdWrite );
-
-    // Select function set write timeout
-    DWORD dwBytesWritten = 0L;
-    int res = select( s+1, NULL, &fdWrite, NULL, pstTime );
-    if ( res > 0)
-    {
-        // Send message to peer or broadcast it
-        bool bSmartAddressing = IsSmartAddressing();
-        if (IsBroadcast() || bSmartAddressing )
-        {
-            // use offset for Smart addressing
-            int nOffset = bSmartAddressing ? sizeof(SOCKADDR_IN) : 0;
-            if (bSmartAddressing)
-            {
-                if ( dwCount < sizeof(SOCKADDR_IN)) // error - buffer to small
-                {
-                    SetLastError( ERROR_INVALID_USER_BUFFER );
-                    return -1L;
-                }
-
-                // read socket address from buffer
-                SockAddrIn sockAddr;
-                sockAddr.SetAddr((PSOCKADDR_IN) lpBuffer);
-
-                // Get Address and send data
-                if (sockAddr.sin_addr.s_addr != htonl(INADDR_BROADCAST))
-                {
-                    LPSTR lpszData = (LPSTR)(lpBuffer + nOffset);
-                    res = sendto( s, lpszData, dwCount-nOffset, 0, sockAddr, sockAddr.Size());
-                    dwBytesWritten = (DWORD)((res >= 0)?(res) : (-1));
-                    return dwBytesWritten;
-                }
-                else
-                {   // NOTE: broadcast will broadcast only to our peers
-                    // Broadcast send to all connected-peers
-                    LockList(); // Lock this object addresses-list
-
-                    CSockAddrList::iterator iter = m_AddrList.begin();
-                    for( ; iter != m_AddrList.end(); )
-                    {
-                        // Fix v1.3 - nOffset was missing
-                        sockAddr = (*iter);
-                        res = sendto( s, (LPCSTR)&lpBuffer[nOffset], dwCount-nOffset, 0, sockAddr, iter->Size());
-                        if (res < 0)
-                        {
-                            CSockAddrList::iterator deladdr = iter;
-                            ++iter; // get next
-                            m_AddrList.erase( deladdr );
-                        }
-                        else
-                            ++iter; // get next
-                    }
-                    UnlockList(); // unlock this object addresses-list
-                }
-            }
-            // always return success - UDP
-            res = (int) dwCount - nOffset;
-        }
-        else // Send to peer-connection
-            res = send( s, (LPCSTR)lpBuffer, dwCount, 0);
-    }
-    dwBytesWritten = (DWORD)((res >= 0)?(res) : (-1L));
-
-    return dwBytesWritten;
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// Run
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//      This function runs the main thread loop
-//      this implementation can be overloaded.
-//      This function calls CSocketComm::OnDataReceived() (Virtual Function)
-// PARAMETERS:
-// NOTES:
-//      You should not wait on the thread to end in this function or overloads
-///////////////////////////////////////////////////////////////////////////////
-void CSocketComm::Run()
-{
-    stMessageProxy stMsgProxy;
-    DWORD   dwBytes  = 0L;
-    DWORD   dwTimeout = INFINITE;
-    LPBYTE  lpData  = (LPBYTE)&stMsgProxy;
-    DWORD   dwSize  = sizeof(stMsgProxy);
-
-    bool bSmartAddressing = IsSmartAddressing();
-    if ( !bSmartAddressing )
-    {
-        lpData = stMsgProxy.byData;
-        dwSize = sizeof(stMsgProxy.byData);
-    }
-
-    // Should we run as server mode
-    if (IsServer() && !bSmartAddressing)
-    {
-        if (!IsBroadcast())
-        {
-            SOCKET sock = (SOCKET) m_hComm;
-            sock = WaitForConnection( sock );
-
-            // Get new connection socket
-            if (sock != INVALID_SOCKET)
-            {
-                ShutdownConnection( (SOCKET) m_hComm);
-                m_hComm = (HANDLE) sock;
-                OnEvent( EVT_CONSUCCESS, NULL ); // connect
-            }
-            else
-            {
-                // Do not send event if we are closing
-                if (IsOpen())
-                    OnEvent( EVT_CONFAILURE, NULL ); // wait fail
-                return;
-            }
-        }
-    }
-    else
-    {
-        GetPeerName( stMsgProxy.address );
-    }
-
-    while( IsOpen() )
-    {
-        // Blocking mode: Wait for event
-        dwBytes = ReadComm(lpData, dwSize, dwTimeout);
-
-        // Error? - need to signal error
-        if (dwBytes == (DWORD)-1L)
-        {
-            // Do not send event if we are closing
-            if (IsOpen())
-            {
-                if ( bSmartAddressing )
-                {
-                    RemoveFromList( stMsgProxy.address );
-                }
-                OnEvent( EVT_CONDROP, &stMsgProxy.address ); // lost connection
-            }
-
-            // special case for UDP, alert about the event but do not stop
-            if ( bSmartAddressing )
-                continue;
-            else
-                break;
-        }
-
-        // Chars received?
-        if ( bSmartAddressing && dwBytes == sizeof(SOCKADDR_IN))
-        {
-            OnEvent( EVT_ZEROLENGTH, NULL );
-        }
-        else if (dwBytes > 0L)
-        {
-            OnDataReceived( lpData, dwBytes);
-        }
-
-        //Sleep(0);
-    }
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// SocketThreadProc
-///////////////////////////////////////////////////////////////////////////////
-// DESCRIPTION:
-//     Socket Thread function.  This function is the main thread for socket
-//     communication - Asynchronous mode.
-// PARAMETERS:
-//     LPVOID pParam : Thread parameter - a CSocketComm pointer
-// NOTES:
-///////////////////////////////////////////////////////////////////////////////
-UINT WINAPI CSocketComm::SocketThreadProc(LPVOID pParam)
-{
-    CSocketComm* pThis = reinterpret_cast<CSocketComm*>( pParam );
-    _ASSERTE( pThis != NULL );
-
-    pThis->Run();
-
-    return 1L;
-} // end SocketThreadProc
+///////////////////////////////////////////////////////////////////////////////
+//  File:       SocketComm.cpp
+//  Version:    1.4
+//
+//  Author:     Ernest Laurentin
+//  E-mail:     elaurentin@netzero.net
+//
+//  Implementation of the CSocketComm and associated classes.
+//
+//  This code may be used in compiled form in any way you desire. This
+//  file may be redistributed unmodified by any means PROVIDING it is
+//  not sold for profit without the authors written consent, and
+//  providing that this notice and the authors name and all copyright
+//  notices remains intact.
+//
+//  This file is provided "as is" with no expressed or implied warranty.
+//  The author accepts no liability for any damage/loss of business that
+//  this c++ class may cause.
+//
+//  Version history
+//
+//  1.0 - Initial release.
+//  1.1 - Add support for Smart Addressing mode
+//  1.2 - Fix various issues with address list (in UDP mode)
+//  1.3 - Fix bug when sending message to broadcast address
+//  1.4 - Add UDP multicast support
+//  1.5 - Add Unix domain socket and named pipe server support
+//  1.6 - Stop the thread cooperatively instead of terminating it
+//  1.7 - Add IPv6 support, resolve with getaddrinfo and listen on several addresses
+//  1.8 - Let the derived class provide the read buffer
+//  1.9 - Drain the socket after full reads, grow the read buffer for bulk peers
+//  1.10 - Restrict the named pipe to the current user, keep a running Unix socket
+///////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include <stdio.h>
+#include <tchar.h>
+#include <process.h>
+#include <crtdbg.h>
+#include <sddl.h>
+#include "SocketComm.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// SockAddrIn Struct
+
+///////////////////////////////////////////////////////////////////////////////
+// Copy
+SockAddrIn& SockAddrIn::Copy(const SockAddrIn& sin)
+{
+    memcpy(this, &sin, sizeof(SOCKADDR_STORAGE));
+    return *this;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Compare
+//      Orders by family, port and address - ignores 'sin_zero' and the IPv6
+//      flow info, so that the addresses returned by recvfrom compare equal
+int SockAddrIn::Compare(const SockAddrIn& sin) const
+{
+    if (ss_family != sin.ss_family)
+        return (ss_family < sin.ss_family) ? -1 : 1;
+
+    USHORT nPort = GetPort(), nOtherPort = sin.GetPort();
+    if (nPort != nOtherPort)
+        return (nPort < nOtherPort) ? -1 : 1;
+
+    if (AF_INET6 == ss_family)
+    {
+        const SOCKADDR_IN6* psin6 = (const SOCKADDR_IN6*) this;
+        const SOCKADDR_IN6* pOther6 = (const SOCKADDR_IN6*) &sin;
+        int nResult = memcmp(&psin6->sin6_addr, &pOther6->sin6_addr, sizeof(IN6_ADDR));
+        if (nResult != 0)
+            return nResult;
+        if (psin6->sin6_scope_id != pOther6->sin6_scope_id)
+            return (psin6->sin6_scope_id < pOther6->sin6_scope_id) ? -1 : 1;
+        return 0;
+    }
+    if (AF_INET == ss_family)
+    {
+        return memcmp(&((const SOCKADDR_IN*) this)->sin_addr,
+                      &((const SOCKADDR_IN*) &sin)->sin_addr, sizeof(IN_ADDR));
+    }
+    return memcmp(this, &sin, sizeof(SOCKADDR_STORAGE));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// IsNull
+bool SockAddrIn::IsNull() const
+{
+    if (AF_INET6 == ss_family)
+    {
+        const SOCKADDR_IN6* psin6 = (const SOCKADDR_IN6*) this;
+        return (IN6_IS_ADDR_UNSPECIFIED(&psin6->sin6_addr) && psin6->sin6_port == 0);
+    }
+    const SOCKADDR_IN* psin = (const SOCKADDR_IN*) this;
+    return ((psin->sin_addr.s_addr==0L)&&(psin->sin_port==0));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// IsBroadcast
+bool SockAddrIn::IsBroadcast() const
+{
+    // IPv6 has no broadcast address
+    return (AF_INET == ss_family && GetIPAddr() == htonl(INADDR_BROADCAST));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// GetIPAddr
+ULONG SockAddrIn::GetIPAddr() const
+{
+    return (AF_INET == ss_family) ? ((const SOCKADDR_IN*) this)->sin_addr.s_addr : 0L;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// GetPort
+USHORT SockAddrIn::GetPort() const
+{
+    // sin_port and sin6_port are at the same offset
+    return ((const SOCKADDR_IN*) this)->sin_port;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// SetPort
+void SockAddrIn::SetPort(USHORT nPort)
+{
+    ((SOCKADDR_IN*) this)->sin_port = nPort;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Size
+int SockAddrIn::Size() const
+{
+    switch (ss_family)
+    {
+    case AF_INET:   return sizeof(SOCKADDR_IN);
+    case AF_INET6:  return sizeof(SOCKADDR_IN6);
+    default:        return sizeof(SOCKADDR_STORAGE);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// SetAddr
+void SockAddrIn::SetAddr(const SOCKADDR* psa, int nLen)
+{
+    Clear();
+    memcpy(this, psa, min(nLen, (int) sizeof(SOCKADDR_STORAGE)));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CreateFrom
+//      Takes the first address the host resolves to.  AF_UNSPEC picks the
+//      family the system prefers
+bool SockAddrIn::CreateFrom(LPCTSTR sAddr, LPCTSTR sService, int nFamily /*=AF_INET*/)
+{
+    Clear();
+    ADDRINFOT* pResult = CSocketComm::GetAddressInfo(sAddr, sService, nFamily, 0, NULL == sAddr);
+    if (NULL == pResult)
+        return false;
+    SetAddr(pResult->ai_addr, (int) pResult->ai_addrlen);
+    FreeAddrInfo(pResult);
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Construct & Destruct
+CSocketComm::CSocketComm() :
+    m_bServer(false), m_bSmartAddressing(false), m_bBroadcast(false), m_bPipe(false),
+    m_hComm(INVALID_HANDLE_VALUE), m_hThread(NULL), m_hMutex(NULL),
+    m_hReadEvent(NULL), m_hWriteEvent(NULL), m_hStopEvent(NULL), m_wakeSocket(INVALID_SOCKET), m_nListenSockets(0),
+    m_bNonBlocking(false), m_bReadPending(false), m_nDrainReads(0), m_lpReadBuffer(NULL),
+    m_dwReadBufferSize(BUFFER_SIZE), m_dwInitialReadBufferSize(BUFFER_SIZE), m_dwMaxReadBufferSize(MAX_READ_BUFFER_SIZE)
+{
+
+}
+
+CSocketComm::~CSocketComm()
+{
+    StopComm();
+    FreeThreadBuffer();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Members
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+// IsOpen
+bool CSocketComm::IsOpen() const
+{
+    return ( INVALID_HANDLE_VALUE != m_hComm );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IsStart
+bool CSocketComm::IsStart() const
+{
+    return ( NULL != m_hThread );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IsServer
+bool CSocketComm::IsServer() const
+{
+    return m_bServer;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IsBroadcast
+bool CSocketComm::IsBroadcast() const
+{
+    return m_bBroadcast;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IsSmartAddressing
+bool CSocketComm::IsSmartAddressing() const
+{
+    return m_bSmartAddressing;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IsPipe
+bool CSocketComm::IsPipe() const
+{
+    return m_bPipe;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IsStopping
+bool CSocketComm::IsStopping() const
+{
+    return ( NULL != m_hStopEvent && WaitForSingleObject(m_hStopEvent, 0) == WAIT_OBJECT_0 );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetSocket
+SOCKET CSocketComm::GetSocket() const
+{
+    return (SOCKET) m_hComm;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// LockList
+void CSocketComm::LockList()
+{
+    if (NULL != m_hMutex)
+        WaitForSingleObject(m_hMutex, INFINITE);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// UnlockList
+void CSocketComm::UnlockList()
+{
+    if (NULL != m_hMutex)
+        ReleaseMutex(m_hMutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AddToList
+void CSocketComm::AddToList(const SockAddrIn& saddr_in)
+{
+    LockList();
+    m_AddrList.insert( m_AddrList.end(), saddr_in );
+    UnlockList();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// RemoveFromList
+void CSocketComm::RemoveFromList(const SockAddrIn& saddr_in)
+{
+    LockList();
+    m_AddrList.remove( saddr_in );
+    UnlockList();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// SetServerState
+void CSocketComm::SetServerState(bool bServer)
+{
+    if (!IsStart())
+        m_bServer = bServer;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SetSmartAddressing : Address is included with message
+void CSocketComm::SetSmartAddressing(bool bSmartAddressing)
+{
+    if (!IsStart())
+        m_bSmartAddressing = bSmartAddressing;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// GetReadBuffer
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              Override to receive the data in place instead of in the buffer
+//              of the thread.  Called before each read, OnDataReceived is then
+//              given the same buffer.  Not used in Smart Addressing mode
+// PARAMETERS:
+//  DWORD& dwSize: size of the buffer returned
+// RETURN:
+//              The buffer to read into, NULL to use the buffer of the thread
+///////////////////////////////////////////////////////////////////////////////
+LPBYTE CSocketComm::GetReadBuffer(DWORD& dwSize)
+{
+    return NULL;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// OnDataReceived
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              This function is PURE Virtual, you MUST overwrite it.  This is
+//              called every time new data is available.
+// PARAMETERS:
+///////////////////////////////////////////////////////////////////////////////
+void CSocketComm::OnDataReceived(const LPBYTE lpBuffer, DWORD dwCount)
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// OnEvent
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              This function reports events & errors
+// PARAMETERS:
+//      UINT uEvent: can be one of the event value EVT_(events)
+//      LPVOID lpvData: Event data if any
+///////////////////////////////////////////////////////////////////////////////
+void CSocketComm::OnEvent(UINT uEvent, LPVOID lpvData)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// GetPortNumber
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              Returns a port number based on service name or port number string
+// PARAMETERS:
+//  LPCTSTR strServiceName: Service name or port string
+///////////////////////////////////////////////////////////////////////////////
+USHORT CSocketComm::GetPortNumber( LPCTSTR strServiceName )
+{
+    USHORT      nPortNumber = 0;
+
+    if ( _istdigit( strServiceName[0] ) ) {
+        nPortNumber = (USHORT) _ttoi( strServiceName );
+    }
+    else {
+        // Look the service up, the port is in network byte order
+        ADDRINFOT* pResult = GetAddressInfo( NULL, strServiceName, AF_UNSPEC, 0, true );
+        if ( pResult != NULL ) {
+            SockAddrIn sockAddr;
+            sockAddr.SetAddr( pResult->ai_addr, (int) pResult->ai_addrlen );
+            nPortNumber = ntohs( sockAddr.GetPort() );
+            FreeAddrInfo( pResult );
+        }
+    }
+
+    return nPortNumber;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetIPAddress
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Returns an IPv4 address.
+//          - It tries to convert the string directly
+//          - If that fails, it tries to resolve it as a hostname
+// PARAMETERS:
+//  LPCTSTR strHostName: host name to get IP address
+///////////////////////////////////////////////////////////////////////////////
+ULONG CSocketComm::GetIPAddress( LPCTSTR strHostName )
+{
+    ULONG       uAddr = INADDR_NONE;
+    TCHAR       strLocal[HOSTNAME_SIZE] = { 0 };
+
+    // if no name specified, get local
+    if ( NULL == strHostName )
+    {
+        GetLocalName(strLocal, HOSTNAME_SIZE);
+        strHostName = strLocal;
+    }
+
+    ADDRINFOT* pResult = GetAddressInfo( strHostName, NULL, AF_INET, 0, false );
+    if ( pResult != NULL )
+    {
+        uAddr = ((SOCKADDR_IN*) pResult->ai_addr)->sin_addr.s_addr;
+        FreeAddrInfo( pResult );
+    }
+
+    return ntohl( uAddr );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetAddressInfo
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Resolves a host and a service to socket addresses with getaddrinfo,
+//      which unlike gethostbyname is safe to call from several threads.
+//          - It tries to convert a numeric address first, without any
+//            name resolution, so that "127.0.0.1" or "::1" never waits on
+//            the resolver
+//          - If that fails, it resolves the host name
+//      Free the result with FreeAddrInfo
+// PARAMETERS:
+//  LPCTSTR strHost: host name or address, NULL for a wildcard or loopback address
+//  LPCTSTR strServiceName: Service name or port number, may be NULL
+//  int nFamily: AF_INET, AF_INET6 or AF_UNSPEC for both
+//  int nType: type of socket (SOCK_STREAM, SOCK_DGRAM), 0 for any
+//  bool bPassive: wildcard address for bind if strHost is NULL, else loopback
+///////////////////////////////////////////////////////////////////////////////
+ADDRINFOT* CSocketComm::GetAddressInfo(LPCTSTR strHost, LPCTSTR strServiceName, int nFamily, int nType, bool bPassive)
+{
+    ADDRINFOT hints = { 0 };
+    hints.ai_family = nFamily;
+    hints.ai_socktype = nType;
+    hints.ai_flags = bPassive ? AI_PASSIVE : 0;
+    if ( nType == 0 )
+        hints.ai_socktype = SOCK_STREAM; // one entry per address, not per type
+
+    ADDRINFOT* pResult = NULL;
+    if ( strHost != NULL )
+    {
+        hints.ai_flags |= AI_NUMERICHOST;
+        if ( 0 == GetAddrInfo( strHost, strServiceName, &hints, &pResult ) )
+            return pResult;
+        hints.ai_flags &= ~AI_NUMERICHOST;
+        pResult = NULL;
+    }
+
+    if ( 0 != GetAddrInfo( strHost, strServiceName, &hints, &pResult ) )
+        return NULL;
+    return pResult;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetLocalName
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              Get local computer name.  Something like: "mycomputer.myserver.net"
+// PARAMETERS:
+//  LPTSTR strName: name of the computer is returned here
+//  UINT nSize: size max of buffer "strName"
+///////////////////////////////////////////////////////////////////////////////
+bool CSocketComm::GetLocalName(LPTSTR strName, UINT nSize)
+{
+    if (strName != NULL && nSize > 0)
+    {
+        char strHost[HOSTNAME_SIZE] = { 0 };
+
+        // get host name, if fail, SetLastError is set
+        if (SOCKET_ERROR != gethostname(strHost, sizeof(strHost)))
+        {
+            // get the fully qualified name
+            ADDRINFOA hints = { 0 };
+            hints.ai_flags = AI_CANONNAME;
+            hints.ai_socktype = SOCK_STREAM;
+            ADDRINFOA* pResult = NULL;
+            if (0 == getaddrinfo(strHost, NULL, &hints, &pResult)) {
+                if (pResult->ai_canonname != NULL)
+                    strncpy_s(strHost, sizeof(strHost), pResult->ai_canonname, _TRUNCATE);
+                freeaddrinfo(pResult);
+            }
+
+            // check if user provide enough buffer
+            if (strlen(strHost) >= nSize)
+            {
+                SetLastError(ERROR_INSUFFICIENT_BUFFER);
+                return false;
+            }
+
+            // Unicode conversion
+#ifdef _UNICODE
+            return (0 != MultiByteToWideChar(CP_ACP, 0, strHost, -1, strName, nSize ));
+#else
+            _tcscpy(strName, strHost);
+            return true;
+#endif
+        }
+    }
+    else
+        SetLastError(ERROR_INVALID_PARAMETER);
+    return false;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetLocalAddress
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              Get the address of local computer in numeric format, ex:
+//              "192.168.0.2" or "fe80::1%4", whichever family the system
+//              prefers
+// PARAMETERS:
+//  LPTSTR strAddress: pointer to hold address string, must be long enough
+//  UINT nSize: maximum size of this buffer
+///////////////////////////////////////////////////////////////////////////////
+bool CSocketComm::GetLocalAddress(LPTSTR strAddress, UINT nSize)
+{
+    // Get computer local address
+    if (strAddress != NULL && nSize > 0)
+    {
+        char strHost[HOSTNAME_SIZE] = { 0 };
+
+        // get host name, if fail, SetLastError is called
+        if (SOCKET_ERROR != gethostname(strHost, sizeof(strHost)))
+        {
+            ADDRINFOA hints = { 0 };
+            hints.ai_socktype = SOCK_STREAM;
+            ADDRINFOA* pResult = NULL;
+            if (0 == getaddrinfo(strHost, NULL, &hints, &pResult))
+            {
+                // Convert address to numeric format
+                int res = getnameinfo(pResult->ai_addr, (int) pResult->ai_addrlen,
+                                      strHost, sizeof(strHost), NULL, 0, NI_NUMERICHOST);
+                freeaddrinfo(pResult);
+                if (0 != res)
+                    return false;
+
+                // check if user provide enough buffer
+                if (strlen(strHost) >= nSize)
+                {
+                    SetLastError(ERROR_INSUFFICIENT_BUFFER);
+                    return false;
+                }
+
+            // Unicode conversion
+#ifdef _UNICODE
+                return (0 != MultiByteToWideChar(CP_ACP, 0, strHost, -1, strAddress,nSize ));
+#else
+                _tcscpy(strAddress, strHost);
+                return true;
+#endif
+            }
+        }
+    }
+    else
+        SetLastError(ERROR_INVALID_PARAMETER);
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// WaitForConnection
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              Wait for a network connection.  Only for connection type of socket
+//              This function may fail, in this case it returns "INVALID_SOCKET"
+// PARAMETERS:
+//  SOCKET sock: a socket capable of receiving new connection (TCP: SOCK_STREAM)
+///////////////////////////////////////////////////////////////////////////////
+SOCKET CSocketComm::WaitForConnection(SOCKET sock)
+{
+    // Accept an incoming connection - blocking
+    // no information about remote address is returned
+    return accept(sock, 0, 0);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ShutdownConnection
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              Shutdown a connection and close socket.  This will force all
+//              transmission/reception to fail.
+// PARAMETERS:
+//  SOCKET sock: Socket to close
+///////////////////////////////////////////////////////////////////////////////
+bool CSocketComm::ShutdownConnection(SOCKET sock)
+{
+    shutdown(sock, SD_BOTH);
+    return ( 0 == closesocket( sock ));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetSockName
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              retrieves the local name for a socket
+// PARAMETERS:
+//  SockAddrIn& saddr_in: object to store address
+///////////////////////////////////////////////////////////////////////////////
+bool CSocketComm::GetSockName(SockAddrIn& saddr_in)
+{
+    if (IsOpen())
+    {
+        int namelen = sizeof(SOCKADDR_STORAGE);
+        return (SOCKET_ERROR != getsockname(GetSocket(), saddr_in, &namelen));
+    }
+
+    return false;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetPeerName
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              retrieves the name of the peer to which a socket is connected
+// PARAMETERS:
+//  SockAddrIn& saddr_in: object to store address
+///////////////////////////////////////////////////////////////////////////////
+bool CSocketComm::GetPeerName(SockAddrIn& saddr_in)
+{
+    if (IsOpen())
+    {
+        int namelen = sizeof(SOCKADDR_STORAGE);
+        return (SOCKET_ERROR != getpeername(GetSocket(), saddr_in, &namelen));  
+    }
+
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// AddMembership
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              Add membership to a multicast address
+// PARAMETERS:
+//  LPCTSTR strAddress: ip address for membership
+///////////////////////////////////////////////////////////////////////////////
+bool CSocketComm::AddMembership(LPCTSTR strAddress)
+{
+    if ( IsOpen() )
+    {
+        int nType = 0;
+        int nOptLen = sizeof(int);
+        SOCKET sock = (SOCKET) m_hComm;
+        if ( SOCKET_ERROR != getsockopt(sock, SOL_SOCKET, SO_TYPE, (char*)&nType, &nOptLen))
+        {
+            if ( nType == SOCK_DGRAM )
+            {
+                int nTTL = 5;
+                if ( SOCKET_ERROR != setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&nTTL, sizeof(nTTL)))
+                {
+                    ip_mreq mreq;
+                    mreq.imr_multiaddr.s_addr = htonl( CSocketComm::GetIPAddress( strAddress ) );
+                    mreq.imr_interface.s_addr = htonl( INADDR_ANY );
+                    return ( SOCKET_ERROR != setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&mreq, sizeof(mreq)));
+                }
+            }
+        }
+    }
+    return false;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// DropMembership
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              Remove membership from a multicast address
+// PARAMETERS:
+//  LPCTSTR strAddress: ip address for membership
+///////////////////////////////////////////////////////////////////////////////
+bool CSocketComm::DropMembership(LPCTSTR strAddress)
+{
+    if ( IsOpen() )
+    {
+        int nType = 0;
+        int nOptLen = sizeof(int);
+        SOCKET sock = (SOCKET) m_hComm;
+        if ( SOCKET_ERROR != getsockopt(sock, SOL_SOCKET, SO_TYPE, (char*)&nType, &nOptLen))
+        {
+            if ( nType == SOCK_DGRAM )
+            {
+                ip_mreq mreq;
+                mreq.imr_multiaddr.s_addr = htonl( CSocketComm::GetIPAddress( strAddress ) );
+                mreq.imr_interface.s_addr = htonl( INADDR_ANY );
+                return ( SOCKET_ERROR != setsockopt(sock, IPPROTO_IP, IP_DROP_MEMBERSHIP, (const char*)&mreq, sizeof(mreq)));
+            }
+        }
+    }
+    return false;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CreateSocketEx
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              This function creates a new socket for connection (SOCK_STREAM)
+//              or an connectionless socket (SOCK_DGRAM).  A connectionless
+//              socket should not call "accept()" since it cannot receive new
+//              connection.  This is used as SERVER socket
+//              A connection socket listens on every address the host resolves
+//              to (up to MAX_LISTEN_SOCKETS), ex: "localhost" listens on both
+//              ::1 and 127.0.0.1, and the thread accepts from all of them.
+//              A connectionless socket binds the first address only
+// PARAMETERS:
+//  LPCTSTR strHost: Hostname or adapter IP address, NULL for any address
+//  LPCTSTR strServiceName: Service name or port number
+//  int nFamily: address family to use (AF_INET, AF_INET6 or AF_UNSPEC
+//               for both).  AF_INET6 also accepts IPv4 clients on the
+//               IPv6 wildcard address (dual-stack)
+//  int nType: type of socket to create (SOCK_STREAM, SOCK_DGRAM)
+//  UINT uOptions: other options to use
+///////////////////////////////////////////////////////////////////////////////
+bool CSocketComm::CreateSocketEx(LPCTSTR strHost, LPCTSTR strServiceName, int nFamily, int nType, UINT uOptions /* = 0 */)
+{
+    // Socket is already opened
+    if ( IsOpen() )
+        return false;
+
+    ADDRINFOT* pResult = GetAddressInfo(strHost, strServiceName, nFamily, nType, true);
+    if (NULL == pResult)
+        return false;
+
+    SOCKET aSockets[MAX_LISTEN_SOCKETS];
+    int nSockets = 0;
+    USHORT nPort = 0;
+    bool bSuccess = true;
+    for (ADDRINFOT* pInfo = pResult; pInfo != NULL && nSockets < MAX_LISTEN_SOCKETS; pInfo = pInfo->ai_next)
+    {
+        if (pInfo->ai_family != AF_INET && pInfo->ai_family != AF_INET6)
+            continue;
+
+        // Associate a local address with the socket
+        SockAddrIn sockAddr;
+        sockAddr.SetAddr(pInfo->ai_addr, (int) pInfo->ai_addrlen);
+
+        // Port 0: all the addresses use the port the system picked for the first one
+        if (nSockets > 0 && sockAddr.GetPort() == 0)
+            sockAddr.SetPort(nPort);
+
+        SOCKET sock = CreateBoundSocket(sockAddr, nType, uOptions, (AF_INET6 == nFamily));
+        if (INVALID_SOCKET == sock)
+        {
+            // The system may not support this family, ex: IPv6 is disabled
+            if (WSAEAFNOSUPPORT == WSAGetLastError())
+                continue;
+            bSuccess = false;
+            break;
+        }
+        aSockets[nSockets++] = sock;
+
+        if (1 == nSockets)
+        {
+            SockAddrIn boundAddr;
+            int nLen = sizeof(SOCKADDR_STORAGE);
+            if (SOCKET_ERROR != getsockname(sock, (LPSOCKADDR) &boundAddr, &nLen))
+                nPort = boundAddr.GetPort();
+        }
+
+        // A connectionless socket receives on one address only
+        if (SOCK_DGRAM == nType)
+            break;
+    }
+    FreeAddrInfo(pResult);
+
+    if (!bSuccess || 0 == nSockets)
+    {
+        for (int i = 0; i < nSockets; i++)
+            closesocket( aSockets[i] );
+        return false;
+    }
+
+    // Success, now we may save these sockets
+    m_hComm = (HANDLE) aSockets[0];
+    for (int i = 1; i < nSockets; i++)
+        m_aListenSockets[m_nListenSockets++] = aSockets[i];
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CreateBoundSocket
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              Create a socket bound to an address, and listening if it is a
+//              connection socket.  Returns INVALID_SOCKET on failure, with the
+//              error in WSAGetLastError
+// PARAMETERS:
+//  const SockAddrIn& sockAddr: Local address
+//  int nType: type of socket to create (SOCK_STREAM, SOCK_DGRAM)
+//  UINT uOptions: other options to use
+//  bool bDualStack: accept IPv4 on an IPv6 socket as well
+///////////////////////////////////////////////////////////////////////////////
+SOCKET CSocketComm::CreateBoundSocket(const SockAddrIn& sockAddr, int nType, UINT uOptions, bool bDualStack)
+{
+    // Create a Socket that is bound to a specific service provide
+    // nType: (SOCK_STREAM, SOCK_DGRAM)
+    SOCKET sock = socket(sockAddr.GetFamily(), nType, 0);
+    if (INVALID_SOCKET == sock)
+        return INVALID_SOCKET;
+
+    bool bSuccess = true;
+    if (uOptions & SO_REUSEADDR)
+    {
+        // Inform Windows Sockets provider that a bind on a socket should not be disallowed
+        // because the desired address is already in use by another socket
+        BOOL optval = TRUE;
+        bSuccess = ( SOCKET_ERROR != setsockopt( sock, SOL_SOCKET, SO_REUSEADDR, (char *) &optval, sizeof( BOOL ) ) );
+    }
+
+    if (bSuccess && nType == SOCK_DGRAM && (uOptions & SO_BROADCAST))
+    {
+        // Inform Windows Sockets provider that broadcast messages are allowed
+        BOOL optval = TRUE;
+        bSuccess = ( SOCKET_ERROR != setsockopt( sock, SOL_SOCKET, SO_BROADCAST, (char *) &optval, sizeof( BOOL ) ) );
+    }
+
+    if (bSuccess && AF_INET6 == sockAddr.GetFamily())
+    {
+        // Windows defaults to IPv6 only, set it either way since other systems don't
+        DWORD optval = bDualStack ? 0 : 1;
+        bSuccess = ( SOCKET_ERROR != setsockopt( sock, IPPROTO_IPV6, IPV6_V6ONLY, (char *) &optval, sizeof( DWORD ) ) );
+    }
+
+    if (bSuccess)
+        bSuccess = ( SOCKET_ERROR != ::bind(sock, sockAddr, sockAddr.Size()) );
+
+    // Listen to the socket, only valid for connection socket
+    if (bSuccess && SOCK_STREAM == nType)
+        bSuccess = ( SOCKET_ERROR != listen(sock, SOMAXCONN) );
+
+    if (!bSuccess)
+    {
+        // Keep the error of the call which failed
+        int nError = WSAGetLastError();
+        closesocket( sock );
+        WSASetLastError( nError );
+        return INVALID_SOCKET;
+    }
+    return sock;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CreateSocket
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              This function creates a new socket for connection (SOCK_STREAM)
+//              or an connectionless socket (SOCK_DGRAM).  A connectionless
+//              socket should not call "accept()" since it cannot receive new
+//              connection.  This is used as SERVER socket
+// PARAMETERS:
+//  LPCTSTR strServiceName: Service name or port number
+//  int nFamily: address family to use (set to AF_INET)
+//  int nType: type of socket to create (SOCK_STREAM, SOCK_DGRAM)
+//  UINT uOptions: other options to use
+///////////////////////////////////////////////////////////////////////////////
+bool CSocketComm::CreateSocket(LPCTSTR strServiceName, int nFamily, int nType, UINT uOptions /* = 0 */)
+{
+    return CreateSocketEx(NULL, strServiceName, nFamily, nType, uOptions);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CreateUnixSocket
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              This function creates a Unix domain stream socket bound to a
+//              file system path.  A socket file nobody listens on any more
+//              is removed first, while the socket of a running server is
+//              left alone and makes this function fail.  This is used as
+//              SERVER socket
+// PARAMETERS:
+//  LPCTSTR strPath: Path of the socket file
+///////////////////////////////////////////////////////////////////////////////
+bool CSocketComm::CreateUnixSocket(LPCTSTR strPath)
+{
+    // Socket is already opened
+    if ( IsOpen() )
+        return false;
+
+    SOCKADDR_UN sockAddr = { 0 };
+    sockAddr.sun_family = AF_UNIX;
+#ifdef _UNICODE
+    if (0 == WideCharToMultiByte(CP_UTF8, 0, strPath, -1, sockAddr.sun_path, sizeof(sockAddr.sun_path), NULL, NULL))
+        return false;
+#else
+    if (strlen(strPath) >= sizeof(sockAddr.sun_path))
+        return false;
+    strcpy_s(sockAddr.sun_path, sizeof(sockAddr.sun_path), strPath);
+#endif
+
+    // Fails on systems without AF_UNIX support
+    SOCKET sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (INVALID_SOCKET != sock)
+    {
+        // bind fails if the socket file already exists.  Only a refused
+        // connection proves that the file is stale.
+        SOCKET probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (INVALID_SOCKET != probe)
+        {
+            if (SOCKET_ERROR == connect(probe, (LPSOCKADDR)&sockAddr, sizeof(sockAddr)) &&
+                WSAECONNREFUSED == WSAGetLastError())
+            {
+                DeleteFile( strPath );
+            }
+            closesocket( probe );
+        }
+        if ( SOCKET_ERROR == ::bind(sock, (LPSOCKADDR)&sockAddr, sizeof(sockAddr)) ||
+             SOCKET_ERROR == listen(sock, SOMAXCONN) )
+        {
+            closesocket( sock );
+            return false;
+        }
+
+        // Success, now we may save this socket
+        m_hComm = (HANDLE) sock;
+    }
+
+    return (INVALID_SOCKET != sock);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CreatePipeServer
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              This function creates a new instance of a byte mode named pipe.
+//              The thread waits for a client to connect to the instance, so
+//              each connection needs its own CSocketComm.  The pipe is opened
+//              for overlapped I/O, so that writes from other threads are not
+//              blocked by the pending read of the thread.  Only the current
+//              user and SYSTEM may open the pipe
+// PARAMETERS:
+//  LPCTSTR strPipeName: Name of the pipe (\\.\pipe\name)
+//  bool bFirstInstance: No other instance of this server exists - fail if
+//                       another process created the pipe first
+///////////////////////////////////////////////////////////////////////////////
+bool CSocketComm::CreatePipeServer(LPCTSTR strPipeName, bool bFirstInstance)
+{
+    // Pipe is already opened
+    if ( IsOpen() )
+        return false;
+
+    // Manual reset events, as required by overlapped I/O
+    if (NULL == m_hReadEvent)
+        m_hReadEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (NULL == m_hWriteEvent)
+        m_hWriteEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (NULL == m_hReadEvent || NULL == m_hWriteEvent)
+        return false;
+
+    // The default security descriptor lets Everyone and anonymous logons
+    // read from the pipe, so give an explicit DACL
+    SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), NULL, FALSE };
+    sa.lpSecurityDescriptor = CreatePipeSecurity();
+    if (NULL == sa.lpSecurityDescriptor)
+        return false;
+
+    DWORD dwOpenMode = PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED;
+    if (bFirstInstance)
+        dwOpenMode |= FILE_FLAG_FIRST_PIPE_INSTANCE;
+    HANDLE hPipe = CreateNamedPipe(strPipeName,
+                        dwOpenMode,
+                        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                        PIPE_UNLIMITED_INSTANCES,
+                        BUFFER_SIZE,    // out buffer
+                        BUFFER_SIZE,    // in buffer
+                        0,              // default timeout
+                        &sa);
+    LocalFree(sa.lpSecurityDescriptor);
+    if (INVALID_HANDLE_VALUE == hPipe)
+        return false;
+
+    // Success, now we may save this pipe
+    m_bPipe = true;
+    m_hComm = hPipe;
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CreatePipeSecurity
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              This function builds a security descriptor whose protected
+//              DACL grants full access to SYSTEM and to the user of the
+//              process token, and to nobody else.  Returns NULL on failure,
+//              the result must be freed with LocalFree
+// PARAMETERS:
+//      None
+///////////////////////////////////////////////////////////////////////////////
+PSECURITY_DESCRIPTOR CSocketComm::CreatePipeSecurity()
+{
+    HANDLE hToken = NULL;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &hToken))
+        return NULL;
+
+    // TOKEN_USER is followed by the SID it points to
+    struct
+    {
+        TOKEN_USER  user;
+        BYTE        sid[SECURITY_MAX_SID_SIZE];
+    } tokenUser;
+    DWORD dwSize = 0;
+    LPTSTR strSid = NULL;
+    BOOL bResult = GetTokenInformation(hToken, TokenUser, &tokenUser, sizeof(tokenUser), &dwSize) &&
+                   ConvertSidToStringSid(tokenUser.user.User.Sid, &strSid);
+    CloseHandle(hToken);
+    if (!bResult)
+        return NULL;
+
+    TCHAR strSddl[256];
+    _stprintf_s(strSddl, _countof(strSddl), _T("D:P(A;;GA;;;SY)(A;;GA;;;%s)"), strSid);
+    LocalFree(strSid);
+
+    PSECURITY_DESCRIPTOR pSecurity = NULL;
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptor(strSddl, SDDL_REVISION_1, &pSecurity, NULL))
+        return NULL;
+    return pSecurity;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ConnectTo
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//              Establish connection with a server service or port.  Tries
+//              each address of the destination in the order the system
+//              prefers, until one of them accepts the connection
+// PARAMETERS:
+//  LPCTSTR strDestination: hostname or address to connect (IPv4 or IPv6)
+//  LPCTSTR strServiceName: Service name or port number
+//  int nFamily: address family to use (AF_INET, AF_INET6 or AF_UNSPEC)
+//  int nType: type of socket to create (SOCK_STREAM, SOCK_DGRAM)
+///////////////////////////////////////////////////////////////////////////////
+bool CSocketComm::ConnectTo(LPCTSTR strDestination, LPCTSTR strServiceName, int nFamily, int nType)
+{
+    // Socket is already opened
+    if ( IsOpen() )
+        return false;
+
+    // Get destination addresses & port
+    ADDRINFOT* pResult = GetAddressInfo(strDestination, strServiceName, nFamily, nType, false);
+    if (NULL == pResult)
+        return false;
+
+    // The local address is picked by connect
+    SOCKET sock = INVALID_SOCKET;
+    for (ADDRINFOT* pInfo = pResult; pInfo != NULL; pInfo = pInfo->ai_next)
+    {
+        sock = socket(pInfo->ai_family, nType, 0);
+        if (INVALID_SOCKET == sock)
+            continue;
+
+        // try to connect - if fail, server not ready
+        if (SOCKET_ERROR != connect( sock, pInfo->ai_addr, (int) pInfo->ai_addrlen))
+            break;
+
+        closesocket( sock );
+        sock = INVALID_SOCKET;
+    }
+    FreeAddrInfo(pResult);
+
+    // Success, now we may save this socket
+    if (INVALID_SOCKET != sock)
+        m_hComm = (HANDLE) sock;
+    return (INVALID_SOCKET != sock);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CloseComm
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Close Socket Communication
+// PARAMETERS:
+//      None
+///////////////////////////////////////////////////////////////////////////////
+void CSocketComm::CloseComm()
+{
+    if (IsOpen())
+    {
+        if (IsPipe())
+        {
+            // Wake up the thread from a pending ConnectNamedPipe or ReadFile
+            HANDLE hPipe = m_hComm;
+            m_hComm = INVALID_HANDLE_VALUE;
+            CancelIoEx(hPipe, NULL);
+            DisconnectNamedPipe(hPipe);
+            CloseHandle(hPipe);
+        }
+        else
+        {
+            ShutdownConnection((SOCKET)m_hComm);
+            m_hComm = INVALID_HANDLE_VALUE;
+        }
+        CloseListenSockets();
+        m_bBroadcast = false;
+        m_bPipe = false;
+        m_bNonBlocking = false;
+        m_bReadPending = false;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// WatchComm
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Starts Socket Communication Working thread
+// PARAMETERS:
+//      None
+///////////////////////////////////////////////////////////////////////////////
+bool CSocketComm::WatchComm()
+{
+    if (!IsStart())
+    {
+        if (IsOpen())
+        {
+            // Objects to wake up the thread with
+            if (NULL == m_hStopEvent)
+                m_hStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+            else
+                ResetEvent(m_hStopEvent);
+            if (NULL == m_hStopEvent)
+                return false;
+            if (!IsPipe() && INVALID_SOCKET == m_wakeSocket && !CreateWakeSocket())
+                return false;
+
+            HANDLE hThread;
+            UINT uiThreadId = 0;
+            hThread = (HANDLE)_beginthreadex(NULL,  // Security attributes
+                                      0,    // stack
+                        SocketThreadProc,   // Thread proc
+                                    this,   // Thread param
+                        CREATE_SUSPENDED,   // creation mode
+                            &uiThreadId);   // Thread ID
+
+            if ( NULL != hThread)
+            {
+                //SetThreadPriority(hThread, THREAD_PRIORITY_ABOVE_NORMAL);
+                ResumeThread( hThread );
+                m_hThread = hThread;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// StopComm
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Close Socket and Stop Communication thread
+// PARAMETERS:
+//      None
+///////////////////////////////////////////////////////////////////////////////
+void CSocketComm::StopComm()
+{
+    // Wake the thread up and wait for it to leave its loop.  Every wait of
+    // the thread also waits for the wake up, so it can't take long
+    if (IsStart())
+    {
+        WakeComm();
+        if (GetThreadId(m_hThread) != GetCurrentThreadId())
+            WaitForSingleObject(m_hThread, INFINITE);
+        CloseHandle(m_hThread);
+        m_hThread = NULL;
+    }
+
+    // Close Socket - nobody uses it anymore
+    if (IsOpen())
+    {
+        CloseComm();
+    }
+
+    // Clear Address list
+    if (!m_AddrList.empty())
+    {
+        m_AddrList.clear();
+    }
+
+    // Destroy Synchronization objects
+    if (NULL != m_hMutex)
+    {
+        CloseHandle( m_hMutex );
+        m_hMutex = NULL;
+    }
+
+    // The thread is gone, nobody waits on the pipe events anymore
+    if (NULL != m_hReadEvent)
+    {
+        CloseHandle( m_hReadEvent );
+        m_hReadEvent = NULL;
+    }
+    if (NULL != m_hWriteEvent)
+    {
+        CloseHandle( m_hWriteEvent );
+        m_hWriteEvent = NULL;
+    }
+    if (NULL != m_hStopEvent)
+    {
+        CloseHandle( m_hStopEvent );
+        m_hStopEvent = NULL;
+    }
+    if (INVALID_SOCKET != m_wakeSocket)
+    {
+        closesocket( m_wakeSocket );
+        m_wakeSocket = INVALID_SOCKET;
+    }
+
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// WakeComm
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Ask the Communication thread to stop.  Pending waits of the thread
+//      and of writers to this socket are aborted.  Does not wait for the
+//      thread, use WaitComm or StopComm for that
+// PARAMETERS:
+//      None
+///////////////////////////////////////////////////////////////////////////////
+void CSocketComm::WakeComm()
+{
+    if (NULL != m_hStopEvent)
+        SetEvent( m_hStopEvent );
+
+    // The datagram keeps the wake socket readable for every select
+    if (INVALID_SOCKET != m_wakeSocket)
+    {
+        char ch = 0;
+        send( m_wakeSocket, &ch, 1, 0 );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// WaitComm
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Wait for the Communication thread to end by itself, e.g. once the
+//      peer has closed the connection
+// PARAMETERS:
+//      DWORD dwTimeout: timeout to use in millisecond
+///////////////////////////////////////////////////////////////////////////////
+bool CSocketComm::WaitComm(DWORD dwTimeout)
+{
+    if (!IsStart())
+        return true;
+    return (WaitForSingleObject(m_hThread, dwTimeout) == WAIT_OBJECT_0);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ShutdownComm
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Shutdown the connection but keep the socket.  With SD_SEND the peer
+//      gets the data sent so far followed by the end of the stream.  With
+//      SD_BOTH the thread notices it and reports EVT_CONDROP
+// PARAMETERS:
+//      int nHow: SD_SEND or SD_BOTH
+///////////////////////////////////////////////////////////////////////////////
+void CSocketComm::ShutdownComm(int nHow)
+{
+    if (!IsOpen())
+        return;
+
+    if (IsPipe())
+    {
+        // A pipe can only be closed in both directions
+        if (SD_BOTH == nHow)
+            DisconnectNamedPipe( m_hComm );
+    }
+    else
+    {
+        shutdown( (SOCKET) m_hComm, nHow );
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CreateWakeSocket
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Create a loopback UDP socket connected to itself.  Sending a datagram
+//      to it makes it readable, which wakes up any select it is part of
+// PARAMETERS:
+//      None
+///////////////////////////////////////////////////////////////////////////////
+bool CSocketComm::CreateWakeSocket()
+{
+    SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (INVALID_SOCKET == sock)
+        return false;
+
+    SOCKADDR_IN sockAddr = { 0 };
+    sockAddr.sin_family = AF_INET;
+    sockAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int nLen = sizeof(sockAddr);
+    if ( SOCKET_ERROR == ::bind(sock, (LPSOCKADDR)&sockAddr, sizeof(sockAddr)) ||
+         SOCKET_ERROR == getsockname(sock, (LPSOCKADDR)&sockAddr, &nLen) ||
+         SOCKET_ERROR == connect(sock, (LPSOCKADDR)&sockAddr, sizeof(sockAddr)) )
+    {
+        closesocket( sock );
+        return false;
+    }
+
+    m_wakeSocket = sock;
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// WaitForSocket
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Wait until the socket is readable, or writable, or the thread has
+//      been asked to stop
+// PARAMETERS:
+//      bool bWrite: wait to write instead of read
+//      DWORD dwTimeout: timeout to use in millisecond
+// RETURN:
+//      1 if the socket is ready, 0 on timeout, -1 if stopping or on error
+///////////////////////////////////////////////////////////////////////////////
+int CSocketComm::WaitForSocket(bool bWrite, DWORD dwTimeout)
+{
+    fd_set  fdRead  = { 0 };
+    fd_set  fdWrite = { 0 };
+    TIMEVAL stTime;
+    TIMEVAL *pstTime = NULL;
+
+    if ( INFINITE != dwTimeout ) {
+        stTime.tv_sec = dwTimeout/1000;
+        stTime.tv_usec = (dwTimeout%1000)*1000;
+        pstTime = &stTime;
+    }
+
+    SOCKET s = (SOCKET) m_hComm;
+    // Set Descriptor
+    if (bWrite)
+        FD_SET( s, &fdWrite );
+    else
+        FD_SET( s, &fdRead );
+    if (INVALID_SOCKET != m_wakeSocket)
+        FD_SET( m_wakeSocket, &fdRead );
+
+    int res = select( 0, &fdRead, bWrite ? &fdWrite : NULL, NULL, pstTime );
+    if (res <= 0)
+        return (res == 0) ? 0 : -1;
+    if (INVALID_SOCKET != m_wakeSocket && FD_ISSET( m_wakeSocket, &fdRead ))
+        return -1;
+    return 1;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AcceptConnection
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Wait until a connection arrives on any listening socket, or the
+//      thread has been asked to stop, and accept it.  accept() can't be
+//      woken up, so all the sockets are waited on with one select first
+// PARAMETERS:
+//      None
+// RETURN:
+//      The connection socket, INVALID_SOCKET if stopping or on error
+///////////////////////////////////////////////////////////////////////////////
+SOCKET CSocketComm::AcceptConnection()
+{
+    fd_set  fdRead  = { 0 };
+
+    FD_SET( (SOCKET) m_hComm, &fdRead );
+    for (int i = 0; i < m_nListenSockets; i++)
+        FD_SET( m_aListenSockets[i], &fdRead );
+    if (INVALID_SOCKET != m_wakeSocket)
+        FD_SET( m_wakeSocket, &fdRead );
+
+    if (select( 0, &fdRead, NULL, NULL, NULL ) <= 0)
+        return INVALID_SOCKET;
+    if (INVALID_SOCKET != m_wakeSocket && FD_ISSET( m_wakeSocket, &fdRead ))
+        return INVALID_SOCKET;
+
+    SOCKET sock = (SOCKET) m_hComm;
+    for (int i = 0; i < m_nListenSockets && !FD_ISSET( sock, &fdRead ); i++)
+        sock = m_aListenSockets[i];
+    return WaitForConnection( sock );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CloseListenSockets
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Close the listening sockets of the other addresses, m_hComm is closed
+//      by the caller
+// PARAMETERS:
+//      None
+///////////////////////////////////////////////////////////////////////////////
+void CSocketComm::CloseListenSockets()
+{
+    for (int i = 0; i < m_nListenSockets; i++)
+        closesocket( m_aListenSockets[i] );
+    m_nListenSockets = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SetNonBlocking
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Put the connection socket in non-blocking mode, so that ReadComm can
+//      read what is left after a full read without waiting in select first
+// PARAMETERS:
+//      None
+///////////////////////////////////////////////////////////////////////////////
+void CSocketComm::SetNonBlocking()
+{
+    u_long nNonBlocking = 1;
+    m_bNonBlocking = ( SOCKET_ERROR != ioctlsocket( (SOCKET) m_hComm, FIONBIO, &nNonBlocking ) );
+    m_bReadPending = false;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SetReadBufferSize
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Set the size of the buffer the thread reads into, when the derived
+//      class doesn't provide one.  It starts at the initial size and doubles
+//      each time a read fills it, up to the maximum size.  Call it before
+//      starting the thread
+// PARAMETERS:
+//      DWORD dwInitialSize: size for each new connection
+//      DWORD dwMaxSize: size the buffer grows up to
+///////////////////////////////////////////////////////////////////////////////
+void CSocketComm::SetReadBufferSize(DWORD dwInitialSize, DWORD dwMaxSize)
+{
+    _ASSERTE( !IsStart() );
+    FreeThreadBuffer();
+    m_dwInitialReadBufferSize = max( dwInitialSize, (DWORD) 1 );
+    m_dwMaxReadBufferSize = max( dwMaxSize, m_dwInitialReadBufferSize );
+    m_dwReadBufferSize = m_dwInitialReadBufferSize;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GetThreadBuffer
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Get the read buffer of the thread, allocated on the first read
+// PARAMETERS:
+//      DWORD& dwSize: size of the buffer
+///////////////////////////////////////////////////////////////////////////////
+LPBYTE CSocketComm::GetThreadBuffer(DWORD& dwSize)
+{
+    if ( NULL == m_lpReadBuffer )
+        m_lpReadBuffer = new BYTE[m_dwReadBufferSize];
+    dwSize = m_dwReadBufferSize;
+    return m_lpReadBuffer;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// FreeThreadBuffer
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Free the read buffer of the thread, the next read allocates it again
+// PARAMETERS:
+//      None
+///////////////////////////////////////////////////////////////////////////////
+void CSocketComm::FreeThreadBuffer()
+{
+    delete[] m_lpReadBuffer;
+    m_lpReadBuffer = NULL;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ReadComm
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Reads the Socket Communication
+// PARAMETERS:
+//      LPBYTE lpBuffer: buffer to place new data
+//      DWORD dwSize: maximum size of buffer
+//      DWORD dwTimeout: timeout to use in millisecond
+///////////////////////////////////////////////////////////////////////////////
+DWORD CSocketComm::ReadComm(LPBYTE lpBuffer, DWORD dwSize, DWORD dwTimeout)
+{
+    _ASSERTE( IsOpen() );
+    _ASSERTE( lpBuffer != NULL );
+
+    if (lpBuffer == NULL || dwSize < 1L)
+        return 0L;
+
+    if (IsPipe())
+        return ReadPipe(lpBuffer, dwSize, dwTimeout);
+
+    SOCKET s = (SOCKET) m_hComm;
+
+    // Wait for data, a timeout or a wake up.  If the last read filled the
+    // buffer, more data is likely waiting: read it without waiting first,
+    // but still wait now and then so that a stop request is noticed
+    DWORD dwBytesRead = 0L;
+    bool bDrain = m_bNonBlocking && m_bReadPending && m_nDrainReads < MAX_DRAIN_READS;
+    int res = 1;
+    if ( bDrain )
+        m_nDrainReads++;
+    else
+    {
+        m_nDrainReads = 0;
+        res = WaitForSocket( false, dwTimeout );
+    }
+    m_bReadPending = false;
+    if ( res > 0)
+    {
+        if (IsBroadcast() || IsSmartAddressing())
+        {
+            SockAddrIn sockAddr;
+            int nLen = sizeof(SOCKADDR_STORAGE);
+            int nOffset = IsSmartAddressing() ? sizeof(SockAddrIn) : 0; // use offset for Smart addressing
+            if ( dwSize < (DWORD) nOffset)  // error - buffer to small
+            {
+                SetLastError( ERROR_INVALID_USER_BUFFER );
+                return -1L;
+            }
+            LPSTR lpszData = (LPSTR)(lpBuffer + nOffset);
+            res = recvfrom( s, lpszData, dwSize-nOffset, 0, (LPSOCKADDR) &sockAddr, &nLen);
+
+            // Lock the list...
+            LockList();
+            m_AddrList.remove( sockAddr );
+
+            if ( res >= 0)
+            {
+                // insert unique address
+                m_AddrList.insert(m_AddrList.end(), sockAddr);
+
+                if (IsSmartAddressing())
+                {
+                    memcpy(lpBuffer, &sockAddr, sizeof(SockAddrIn));
+                    res += sizeof(SockAddrIn);
+                }
+            }
+            else if (WSAGetLastError() == WSAECONNRESET && m_AddrList.size() == 1)
+            {
+                // recvfrom doesn't always return the connection address for last connection
+                m_AddrList.clear();
+            }
+
+            UnlockList(); // unlock this object addresses-list
+        }
+        else
+        {
+            for (;;)
+            {
+                res = recv( s, (LPSTR)lpBuffer, dwSize, 0);
+                if ( res >= 0 || WSAGetLastError() != WSAEWOULDBLOCK )
+                    break;
+                // Drained - non-blocking mode, wait for more
+                res = WaitForSocket( false, dwTimeout );
+                if ( res <= 0 )
+                    break;
+            }
+            m_bReadPending = ( res == (int) dwSize );
+        }
+    }
+    dwBytesRead = (DWORD)((res > 0)?(res) : (-1L));
+
+    return dwBytesRead;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// WriteComm
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Writes data to the Socket Communication
+// PARAMETERS:
+//      const LPBYTE lpBuffer: data to write
+//      DWORD dwCount: maximum characters to write
+//      DWORD dwTimeout: timeout to use in millisecond
+///////////////////////////////////////////////////////////////////////////////
+DWORD CSocketComm::WriteComm(const LPBYTE lpBuffer, DWORD dwCount, DWORD dwTimeout)
+{
+    _ASSERTE( IsOpen() );
+    _ASSERTE( NULL != lpBuffer );
+
+    // Accept 0 bytes message
+    if (!IsOpen() || NULL == lpBuffer)
+        return 0L;
+
+    if (IsPipe())
+        return WritePipe(lpBuffer, dwCount, dwTimeout);
+
+    SOCKET s = (SOCKET) m_hComm;
+
+    // Wait for room in the send buffer, a timeout or a wake up
+    DWORD dwBytesWritten = 0L;
+    int res = WaitForSocket( true, dwTimeout );
+    if ( res > 0)
+    {
+        // Send message to peer or broadcast it
+        bool bSmartAddressing = IsSmartAddressing();
+        if (IsBroadcast() || bSmartAddressing )
+        {
+            // use offset for Smart addressing
+            int nOffset = bSmartAddressing ? sizeof(SockAddrIn) : 0;
+            if (bSmartAddressing)
+            {
+                if ( dwCount < sizeof(SockAddrIn)) // error - buffer to small
+                {
+                    SetLastError( ERROR_INVALID_USER_BUFFER );
+                    return -1L;
+                }
+
+                // read socket address from buffer
+                SockAddrIn sockAddr;
+                sockAddr.SetAddr((const SOCKADDR*) lpBuffer, sizeof(SockAddrIn));
+
+                // Get Address and send data
+                if (!sockAddr.IsBroadcast())
+                {
+                    LPSTR lpszData = (LPSTR)(lpBuffer + nOffset);
+                    res = sendto( s, lpszData, dwCount-nOffset, 0, sockAddr, sockAddr.Size());
+                    dwBytesWritten = (DWORD)((res >= 0)?(res) : (-1));
+                    return dwBytesWritten;
+                }
+                else
+                {   // NOTE: broadcast will broadcast only to our peers
+                    // Broadcast send to all connected-peers
+                    LockList(); // Lock this object addresses-list
+
+                    CSockAddrList::iterator iter = m_AddrList.begin();
+                    for( ; iter != m_AddrList.end(); )
+                    {
+                        // Fix v1.3 - nOffset was missing
+                        sockAddr = (*iter);
+                        res = sendto( s, (LPCSTR)&lpBuffer[nOffset], dwCount-nOffset, 0, sockAddr, iter->Size());
+                        if (res < 0)
+                        {
+                            CSockAddrList::iterator deladdr = iter;
+                            ++iter; // get next
+                            m_AddrList.erase( deladdr );
+                        }
+                        else
+                            ++iter; // get next
+                    }
+                    UnlockList(); // unlock this object addresses-list
+                }
+            }
+            // always return success - UDP
+            res = (int) dwCount - nOffset;
+        }
+        else // Send to peer-connection
+        {
+            res = send( s, (LPCSTR)lpBuffer, dwCount, 0);
+            // Non-blocking mode: the send buffer filled up since the wait
+            while ( res < 0 && WSAGetLastError() == WSAEWOULDBLOCK &&
+                    WaitForSocket( true, dwTimeout ) > 0 )
+                res = send( s, (LPCSTR)lpBuffer, dwCount, 0);
+        }
+    }
+    dwBytesWritten = (DWORD)((res >= 0)?(res) : (-1L));
+
+    return dwBytesWritten;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// WaitForPipeClient
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Wait for a client to connect to the named pipe instance.  The wait is
+//      aborted by CloseComm
+// PARAMETERS:
+//      None
+///////////////////////////////////////////////////////////////////////////////
+bool CSocketComm::WaitForPipeClient()
+{
+    HANDLE hPipe = m_hComm;
+    OVERLAPPED ov = { 0 };
+    ov.hEvent = m_hReadEvent;
+
+    if (ConnectNamedPipe(hPipe, &ov))
+        return true;
+
+    switch (GetLastError())
+    {
+    case ERROR_PIPE_CONNECTED:  // client connected between CreateNamedPipe and ConnectNamedPipe
+        return true;
+    case ERROR_IO_PENDING:
+        {
+            DWORD dwDummy = 0L;
+            HANDLE aHandles[2] = { ov.hEvent, m_hStopEvent };
+            if (WaitForMultipleObjects(2, aHandles, FALSE, INFINITE) != WAIT_OBJECT_0)
+            {
+                // Stopping - ov must stay valid until the wait is cancelled
+                CancelIoEx(hPipe, &ov);
+                GetOverlappedResult(hPipe, &ov, &dwDummy, TRUE);
+                return false;
+            }
+            return (GetOverlappedResult(hPipe, &ov, &dwDummy, FALSE) != FALSE);
+        }
+    default:
+        return false;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// ReadPipe
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Reads the named pipe - same semantic as ReadComm
+// PARAMETERS:
+//      LPBYTE lpBuffer: buffer to place new data
+//      DWORD dwSize: maximum size of buffer
+//      DWORD dwTimeout: timeout to use in millisecond
+///////////////////////////////////////////////////////////////////////////////
+DWORD CSocketComm::ReadPipe(LPBYTE lpBuffer, DWORD dwSize, DWORD dwTimeout)
+{
+    HANDLE hPipe = m_hComm;
+    OVERLAPPED ov = { 0 };
+    ov.hEvent = m_hReadEvent;
+
+    DWORD dwBytesRead = 0L;
+    if (!ReadFile(hPipe, lpBuffer, dwSize, &dwBytesRead, &ov))
+    {
+        if (GetLastError() != ERROR_IO_PENDING)
+            return (DWORD)-1L;    // ERROR_BROKEN_PIPE: client is gone
+
+        HANDLE aHandles[2] = { ov.hEvent, m_hStopEvent };
+        if (WaitForMultipleObjects((NULL != m_hStopEvent) ? 2 : 1, aHandles, FALSE, dwTimeout) != WAIT_OBJECT_0)
+        {
+            // Timeout or stopping - cancel and wait, ov must stay valid until the read completes
+            CancelIoEx(hPipe, &ov);
+            GetOverlappedResult(hPipe, &ov, &dwBytesRead, TRUE);
+            return (DWORD)-1L;
+        }
+        if (!GetOverlappedResult(hPipe, &ov, &dwBytesRead, FALSE))
+            return (DWORD)-1L;
+    }
+    return (dwBytesRead > 0L) ? dwBytesRead : (DWORD)-1L;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// WritePipe
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      Writes data to the named pipe - same semantic as WriteComm
+// PARAMETERS:
+//      const LPBYTE lpBuffer: data to write
+//      DWORD dwCount: maximum characters to write
+//      DWORD dwTimeout: timeout to use in millisecond
+///////////////////////////////////////////////////////////////////////////////
+DWORD CSocketComm::WritePipe(const LPBYTE lpBuffer, DWORD dwCount, DWORD dwTimeout)
+{
+    HANDLE hPipe = m_hComm;
+    OVERLAPPED ov = { 0 };
+    ov.hEvent = m_hWriteEvent;
+
+    DWORD dwBytesWritten = 0L;
+    if (!WriteFile(hPipe, lpBuffer, dwCount, &dwBytesWritten, &ov))
+    {
+        if (GetLastError() != ERROR_IO_PENDING)
+            return (DWORD)-1L;
+
+        HANDLE aHandles[2] = { ov.hEvent, m_hStopEvent };
+        if (WaitForMultipleObjects((NULL != m_hStopEvent) ? 2 : 1, aHandles, FALSE, dwTimeout) != WAIT_OBJECT_0)
+        {
+            // Timeout or stopping - keep what has been written so far
+            CancelIoEx(hPipe, &ov);
+            if (!GetOverlappedResult(hPipe, &ov, &dwBytesWritten, TRUE) && dwBytesWritten == 0L)
+                return (DWORD)-1L;
+            return dwBytesWritten;
+        }
+        if (!GetOverlappedResult(hPipe, &ov, &dwBytesWritten, FALSE))
+            return (DWORD)-1L;
+    }
+    return dwBytesWritten;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Run
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//      This function runs the main thread loop
+//      this implementation can be overloaded.
+//      This function calls CSocketComm::OnDataReceived() (Virtual Function)
+// PARAMETERS:
+// NOTES:
+//      You should not wait on the thread to end in this function or overloads
+///////////////////////////////////////////////////////////////////////////////
+void CSocketComm::Run()
+{
+    stMessageProxy stMsgProxy;
+    DWORD   dwBytes  = 0L;
+    DWORD   dwTimeout = INFINITE;
+    LPBYTE  lpData  = (LPBYTE)&stMsgProxy;
+    DWORD   dwSize  = sizeof(stMsgProxy);
+
+    bool bSmartAddressing = IsSmartAddressing();
+    if ( !bSmartAddressing )
+    {
+        lpData = stMsgProxy.byData;
+        dwSize = sizeof(stMsgProxy.byData);
+    }
+
+    // Should we run as server mode
+    if (IsServer() && !bSmartAddressing)
+    {
+        if (IsPipe())
+        {
+            // The pipe instance becomes the connection, nothing to replace
+            if (WaitForPipeClient())
+            {
+                OnEvent( EVT_CONSUCCESS, NULL ); // connect
+            }
+            else
+            {
+                // Do not send event if we are closing
+                if (IsOpen() && !IsStopping())
+                    OnEvent( EVT_CONFAILURE, NULL ); // wait fail
+                return;
+            }
+        }
+        else if (!IsBroadcast())
+        {
+            // Get new connection socket, from any address listened on
+            SOCKET sock = AcceptConnection();
+            if (sock != INVALID_SOCKET)
+            {
+                ShutdownConnection( (SOCKET) m_hComm);
+                CloseListenSockets();
+                m_hComm = (HANDLE) sock;
+                SetNonBlocking();
+                OnEvent( EVT_CONSUCCESS, NULL ); // connect
+            }
+            else
+            {
+                // Do not send event if we are closing
+                if (IsOpen() && !IsStopping())
+                    OnEvent( EVT_CONFAILURE, NULL ); // wait fail
+                return;
+            }
+        }
+    }
+    else
+    {
+        GetPeerName( stMsgProxy.address );
+        if ( !bSmartAddressing && !IsBroadcast() && !IsPipe() )
+            SetNonBlocking();
+    }
+
+    while( IsOpen() )
+    {
+        if ( !bSmartAddressing )
+        {
+            // Read in place if the derived class has room for it
+            lpData = GetReadBuffer( dwSize );
+            if ( NULL == lpData )
+                lpData = GetThreadBuffer( dwSize );
+        }
+
+        // Blocking mode: Wait for event
+        dwBytes = ReadComm(lpData, dwSize, dwTimeout);
+
+        // Error? - need to signal error
+        if (dwBytes == (DWORD)-1L)
+        {
+            // Do not send event if we are closing
+            bool bStopping = IsStopping();
+            if (IsOpen() && !bStopping)
+            {
+                if ( bSmartAddressing )
+                {
+                    RemoveFromList( stMsgProxy.address );
+                }
+                OnEvent( EVT_CONDROP, &stMsgProxy.address ); // lost connection
+            }
+
+            // special case for UDP, alert about the event but do not stop
+            if ( bSmartAddressing && !bStopping )
+                continue;
+            else
+                break;
+        }
+
+        // Chars received?
+        if ( bSmartAddressing && dwBytes == sizeof(SockAddrIn))
+        {
+            OnEvent( EVT_ZEROLENGTH, NULL );
+        }
+        else if (dwBytes > 0L)
+        {
+            OnDataReceived( lpData, dwBytes);
+
+            // The read filled the buffer: the peer sends in bulk, give it more room
+            if ( lpData == m_lpReadBuffer && dwBytes == dwSize &&
+                 m_dwReadBufferSize < m_dwMaxReadBufferSize )
+            {
+                FreeThreadBuffer();
+                m_dwReadBufferSize = min( m_dwReadBufferSize * 2, m_dwMaxReadBufferSize );
+            }
+        }
+
+        //Sleep(0);
+    }
+
+    // Back to the initial size for the next connection
+    FreeThreadBuffer();
+    m_dwReadBufferSize = m_dwInitialReadBufferSize;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SocketThreadProc
+///////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION:
+//     Socket Thread function.  This function is the main thread for socket
+//     communication - Asynchronous mode.
+// PARAMETERS:
+//     LPVOID pParam : Thread parameter - a CSocketComm pointer
+// NOTES:
+///////////////////////////////////////////////////////////////////////////////
+UINT WINAPI CSocketComm::SocketThreadProc(LPVOID pParam)
+{
+    CSocketComm* pThis = reinterpret_cast<CSocketComm*>( pParam );
+    _ASSERTE( pThis != NULL );
+
+    pThis->Run();
+
+    return 1L;
+} // end SocketThreadProc
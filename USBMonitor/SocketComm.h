@@ -1,132 +1,204 @@
-///////////////////////////////////////////////////////////////////////////////
-// FILE : SocketComm.h
-// Header file for CSocketComm class
-// CSocketComm
-//     Generic class for Socket Communication
-///////////////////////////////////////////////////////////////////////////////
-
-#ifndef _SOCKETCOMM_H_
-#define _SOCKETCOMM_H_
-#include <list>
-
-#include <stdlib.h>
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#pragma comment(lib, "ws2_32")
-
-// Event value
-#define EVT_CONSUCCESS      0x0000  // Connection established
-#define EVT_CONFAILURE      0x0001  // General failure - Wait Connection failed
-#define EVT_CONDROP         0x0002  // Connection dropped
-#define EVT_ZEROLENGTH      0x0003  // Zero length message
-
-#ifndef BUFFER_SIZE
-#define BUFFER_SIZE     2000
-#endif
-#define HOSTNAME_SIZE   MAX_PATH
-#define STRING_LENGTH   40
-
-
-struct SockAddrIn : public SOCKADDR_IN {
-public:
-    SockAddrIn() { Clear(); }
-    SockAddrIn(const SockAddrIn& sin) { Copy( sin ); }
-    ~SockAddrIn() { }
-    SockAddrIn& Copy(const SockAddrIn& sin);
-    void    Clear() { memset(this, 0, sizeof(SOCKADDR_IN)); }
-    bool    IsEqual(const SockAddrIn& sin) const;
-    bool    IsGreater(const SockAddrIn& sin) const;
-    bool    IsLower(const SockAddrIn& pm) const;
-    bool    IsNull() const { return ((sin_addr.s_addr==0L)&&(sin_port==0)); }
-    ULONG   GetIPAddr() const { return sin_addr.s_addr; }
-    short   GetPort() const { return sin_port; }
-    bool    CreateFrom(LPCTSTR sAddr, LPCTSTR sService, int nFamily = AF_INET);
-    SockAddrIn& operator=(const SockAddrIn& sin) { return Copy( sin ); }
-    bool    operator==(const SockAddrIn& sin) { return IsEqual( sin ); }
-    bool    operator!=(const SockAddrIn& sin) { return !IsEqual( sin ); }
-    bool    operator<(const SockAddrIn& sin)  { return IsLower( sin ); }
-    bool    operator>(const SockAddrIn& sin)  { return IsGreater( sin ); }
-    bool    operator<=(const SockAddrIn& sin) { return !IsGreater( sin ); }
-    bool    operator>=(const SockAddrIn& sin) { return !IsLower( sin ); }
-    operator LPSOCKADDR() { return (LPSOCKADDR)(this); }
-    size_t  Size() const { return sizeof(SOCKADDR_IN); }
-    void    SetAddr(SOCKADDR_IN* psin) { memcpy(this, psin, Size()); }
-};
-
-typedef std::list<SockAddrIn> CSockAddrList;
-
-struct stMessageProxy
-{
-  SockAddrIn address;
-  BYTE byData[BUFFER_SIZE];
-};
-
-class CSocketComm
-{
-public:
-    CSocketComm();
-    virtual ~CSocketComm();
-
-    bool IsOpen() const;    // Is Socket valid?
-    bool IsStart() const;   // Is Thread started?
-    bool IsServer() const;  // Is running in server mode
-    bool IsBroadcast() const; // Is UDP Broadcast active
-    bool IsSmartAddressing() const; // Is Smart Addressing mode support
-    SOCKET GetSocket() const;   // return socket handle
-    void SetServerState(bool bServer);  // Run as server mode if true
-    void SetSmartAddressing(bool bSmartAddressing); // Set Smart addressing mode
-    bool GetSockName(SockAddrIn& saddr_in); // Get Socket name - address
-    bool GetPeerName(SockAddrIn& saddr_in); // Get Peer Socket name - address
-    bool AddMembership(LPCTSTR strAddress);
-    bool DropMembership(LPCTSTR strAddress);
-    void AddToList(const SockAddrIn& saddr_in); // Add an address to the list
-    void RemoveFromList(const SockAddrIn& saddr_in);    // Remove an address from the list
-    void CloseComm();       // Close Socket
-    bool WatchComm();       // Start Socket thread
-    void StopComm();        // Stop Socket thread
-
-    // Create a socket - Server side (support for multiple adapters)
-    bool CreateSocketEx(LPCTSTR strHost, LPCTSTR strServiceName, int nFamily, int nType, UINT uOptions /* = 0 */);
-    // Create a Socket - Server side
-    bool CreateSocket(LPCTSTR strServiceName, int nProtocol, int nType, UINT uOptions = 0);
-    // Create a socket, connect to (Client side)
-    bool ConnectTo(LPCTSTR strDestination, LPCTSTR strServiceName, int nProtocol, int nType);
-
-// Event function - override to get data
-    virtual void OnDataReceived(const LPBYTE lpBuffer, DWORD dwCount);
-    virtual void OnEvent(UINT uEvent, LPVOID lpvData);
-// Run function - override to implement a new behaviour
-    virtual void Run();
-
-// Data function
-    DWORD ReadComm(LPBYTE lpBuffer, DWORD dwSize, DWORD dwTimeout);
-    DWORD WriteComm(const LPBYTE lpBuffer, DWORD dwCount, DWORD dwTimeout);
-
-    // Utility functions
-    static SOCKET WaitForConnection(SOCKET sock); // Wait For a new connection (Server side)
-    static bool ShutdownConnection(SOCKET sock);  // Shutdown a connection
-    static USHORT GetPortNumber( LPCTSTR strServiceName );  // Get service port number
-    static ULONG GetIPAddress( LPCTSTR strHostName );   // Get IP address of a host
-    static bool GetLocalName(LPTSTR strName, UINT nSize);   // GetLocalName
-    static bool GetLocalAddress(LPTSTR strAddress, UINT nSize); // GetLocalAddress
-// SocketComm - data
-protected:
-    HANDLE      m_hComm;        // Serial Comm handle
-    HANDLE      m_hThread;      // Thread Comm handle
-    bool        m_bServer;      // Server mode (true)
-    bool        m_bSmartAddressing; // Smart Addressing mode (true) - many listeners
-    bool        m_bBroadcast;   // Broadcast mode
-    CSockAddrList m_AddrList;   // Connection address list for broadcast
-    HANDLE      m_hMutex;       // Mutex object
-// SocketComm - function
-protected:
-    // Synchronization function
-    void LockList();            // Lock the object
-    void UnlockList();          // Unlock the object
-
-    static UINT WINAPI SocketThreadProc(LPVOID pParam);
-
-private:
-};
-
-#endif // _SOCKETCOMM_H_
+///////////////////////////////////////////////////////////////////////////////
+// FILE : SocketComm.h
+// Header file for CSocketComm class
+// CSocketComm
+//     Generic class for Socket Communication
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _SOCKETCOMM_H_
+#define _SOCKETCOMM_H_
+#include <list>
+
+#include <stdlib.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32")
+
+// Event value
+#define EVT_CONSUCCESS      0x0000  // Connection established
+#define EVT_CONFAILURE      0x0001  // General failure - Wait Connection failed
+#define EVT_CONDROP         0x0002  // Connection dropped
+#define EVT_ZEROLENGTH      0x0003  // Zero length message
+
+#ifndef BUFFER_SIZE
+#define BUFFER_SIZE     2000
+#endif
+#define HOSTNAME_SIZE   MAX_PATH
+#define STRING_LENGTH   40
+#define MAX_LISTEN_SOCKETS  4   // Addresses a server socket listens on at most
+#define MAX_READ_BUFFER_SIZE    (64*1024)   // Default maximum size of the read buffer
+#define MAX_DRAIN_READS     16  // Reads without waiting while data keeps arriving
+
+#ifndef UNIX_PATH_MAX
+// Unix domain socket address - from afunix.h, which older SDKs do not provide.
+// AF_UNIX stream sockets are supported since Windows 10 1803.
+#define UNIX_PATH_MAX   108
+typedef struct sockaddr_un {
+    ADDRESS_FAMILY sun_family;
+    char sun_path[UNIX_PATH_MAX];
+} SOCKADDR_UN, *PSOCKADDR_UN;
+#endif
+
+#ifndef PIPE_REJECT_REMOTE_CLIENTS
+#define PIPE_REJECT_REMOTE_CLIENTS  0x00000008
+#endif
+
+
+// IPv4 or IPv6 socket address
+struct SockAddrIn : public SOCKADDR_STORAGE {
+public:
+    SockAddrIn() { Clear(); }
+    SockAddrIn(const SockAddrIn& sin) { Copy( sin ); }
+    ~SockAddrIn() { }
+    SockAddrIn& Copy(const SockAddrIn& sin);
+    void    Clear() { memset(this, 0, sizeof(SOCKADDR_STORAGE)); }
+    int     Compare(const SockAddrIn& sin) const;
+    bool    IsEqual(const SockAddrIn& sin) const { return Compare( sin ) == 0; }
+    bool    IsGreater(const SockAddrIn& sin) const { return Compare( sin ) > 0; }
+    bool    IsLower(const SockAddrIn& sin) const { return Compare( sin ) < 0; }
+    bool    IsNull() const;
+    bool    IsBroadcast() const;
+    int     GetFamily() const { return ss_family; }
+    ULONG   GetIPAddr() const;  // IPv4 only, network byte order
+    USHORT  GetPort() const;    // network byte order
+    void    SetPort(USHORT nPort);  // network byte order
+    bool    CreateFrom(LPCTSTR sAddr, LPCTSTR sService, int nFamily = AF_INET);
+    SockAddrIn& operator=(const SockAddrIn& sin) { return Copy( sin ); }
+    bool    operator==(const SockAddrIn& sin) { return IsEqual( sin ); }
+    bool    operator!=(const SockAddrIn& sin) { return !IsEqual( sin ); }
+    bool    operator<(const SockAddrIn& sin)  { return IsLower( sin ); }
+    bool    operator>(const SockAddrIn& sin)  { return IsGreater( sin ); }
+    bool    operator<=(const SockAddrIn& sin) { return !IsGreater( sin ); }
+    bool    operator>=(const SockAddrIn& sin) { return !IsLower( sin ); }
+    operator LPSOCKADDR() { return (LPSOCKADDR)(this); }
+    operator const SOCKADDR*() const { return (const SOCKADDR*)(this); }
+    int     Size() const;       // Length of the address of the family
+    void    SetAddr(const SOCKADDR* psa, int nLen);
+};
+
+typedef std::list<SockAddrIn> CSockAddrList;
+
+struct stMessageProxy
+{
+  SockAddrIn address;
+  BYTE byData[BUFFER_SIZE];
+};
+
+class CSocketComm
+{
+public:
+    CSocketComm();
+    virtual ~CSocketComm();
+
+    bool IsOpen() const;    // Is Socket valid?
+    bool IsStart() const;   // Is Thread started?
+    bool IsServer() const;  // Is running in server mode
+    bool IsBroadcast() const; // Is UDP Broadcast active
+    bool IsSmartAddressing() const; // Is Smart Addressing mode support
+    bool IsPipe() const;    // Is running on a named pipe
+    bool IsStopping() const;    // Has the thread been asked to stop
+    SOCKET GetSocket() const;   // return socket handle
+    void SetServerState(bool bServer);  // Run as server mode if true
+    void SetSmartAddressing(bool bSmartAddressing); // Set Smart addressing mode
+    bool GetSockName(SockAddrIn& saddr_in); // Get Socket name - address
+    bool GetPeerName(SockAddrIn& saddr_in); // Get Peer Socket name - address
+    bool AddMembership(LPCTSTR strAddress);
+    bool DropMembership(LPCTSTR strAddress);
+    void AddToList(const SockAddrIn& saddr_in); // Add an address to the list
+    void RemoveFromList(const SockAddrIn& saddr_in);    // Remove an address from the list
+    void CloseComm();       // Close Socket
+    bool WatchComm();       // Start Socket thread
+    void StopComm();        // Stop Socket thread
+    void WakeComm();        // Ask the thread to stop, without waiting
+    bool WaitComm(DWORD dwTimeout); // Wait for the thread to stop by itself
+    void ShutdownComm(int nHow);    // Shutdown the connection (SD_SEND, SD_BOTH), keep the handle
+    void SetReadBufferSize(DWORD dwInitialSize, DWORD dwMaxSize);   // Adaptive read buffer of the thread
+
+    // Create a socket - Server side (support for multiple adapters)
+    bool CreateSocketEx(LPCTSTR strHost, LPCTSTR strServiceName, int nFamily, int nType, UINT uOptions /* = 0 */);
+    // Create a Socket - Server side
+    bool CreateSocket(LPCTSTR strServiceName, int nProtocol, int nType, UINT uOptions = 0);
+    // Create a Unix domain socket - Server side
+    bool CreateUnixSocket(LPCTSTR strPath);
+    // Create a named pipe instance - Server side
+    // The first instance fails if another process already owns the pipe name
+    bool CreatePipeServer(LPCTSTR strPipeName, bool bFirstInstance);
+    // Create a socket, connect to (Client side)
+    bool ConnectTo(LPCTSTR strDestination, LPCTSTR strServiceName, int nProtocol, int nType);
+
+// Event function - override to get data
+    virtual LPBYTE GetReadBuffer(DWORD& dwSize);
+    virtual void OnDataReceived(const LPBYTE lpBuffer, DWORD dwCount);
+    virtual void OnEvent(UINT uEvent, LPVOID lpvData);
+// Run function - override to implement a new behaviour
+    virtual void Run();
+
+// Data function
+    DWORD ReadComm(LPBYTE lpBuffer, DWORD dwSize, DWORD dwTimeout);
+    DWORD WriteComm(const LPBYTE lpBuffer, DWORD dwCount, DWORD dwTimeout);
+
+    // Utility functions
+    static SOCKET WaitForConnection(SOCKET sock); // Wait For a new connection (Server side)
+    static bool ShutdownConnection(SOCKET sock);  // Shutdown a connection
+    static USHORT GetPortNumber( LPCTSTR strServiceName );  // Get service port number
+    static ULONG GetIPAddress( LPCTSTR strHostName );   // Get IPv4 address of a host
+    // Resolve a host and service with getaddrinfo, free the result with FreeAddrInfo
+    static ADDRINFOT* GetAddressInfo(LPCTSTR strHost, LPCTSTR strServiceName, int nFamily, int nType, bool bPassive);
+    static bool GetLocalName(LPTSTR strName, UINT nSize);   // GetLocalName
+    static bool GetLocalAddress(LPTSTR strAddress, UINT nSize); // GetLocalAddress
+// SocketComm - data
+protected:
+    HANDLE      m_hComm;        // Serial Comm handle
+    HANDLE      m_hThread;      // Thread Comm handle
+    bool        m_bServer;      // Server mode (true)
+    bool        m_bSmartAddressing; // Smart Addressing mode (true) - many listeners
+    bool        m_bBroadcast;   // Broadcast mode
+    bool        m_bPipe;        // Named pipe mode (m_hComm is a pipe handle)
+    HANDLE      m_hReadEvent;   // Overlapped read event - named pipe mode
+    HANDLE      m_hWriteEvent;  // Overlapped write event - named pipe mode
+    HANDLE      m_hStopEvent;   // Signaled when the thread should stop
+    SOCKET      m_wakeSocket;   // Readable when the thread should stop - wakes up select
+    SOCKET      m_aListenSockets[MAX_LISTEN_SOCKETS-1]; // Listening sockets besides m_hComm
+    int         m_nListenSockets;   // Number of sockets in m_aListenSockets
+    bool        m_bNonBlocking; // Connection socket in non-blocking mode - reads drain it
+    bool        m_bReadPending; // Last read filled the buffer - more data is likely waiting
+    int         m_nDrainReads;  // Reads done since the last wait
+    LPBYTE      m_lpReadBuffer; // Read buffer of the thread, grows while reads fill it
+    DWORD       m_dwReadBufferSize; // Current, initial and maximum size of m_lpReadBuffer
+    DWORD       m_dwInitialReadBufferSize;
+    DWORD       m_dwMaxReadBufferSize;
+    CSockAddrList m_AddrList;   // Connection address list for broadcast
+    HANDLE      m_hMutex;       // Mutex object
+// SocketComm - function
+protected:
+    // Synchronization function
+    void LockList();            // Lock the object
+    void UnlockList();          // Unlock the object
+
+    // Wait until the socket is readable (or writable) or the thread should stop
+    // Returns 1 if ready, 0 on timeout, -1 if stopping or on error
+    int WaitForSocket(bool bWrite, DWORD dwTimeout);
+    bool CreateWakeSocket();
+
+    // Server socket functions
+    static SOCKET CreateBoundSocket(const SockAddrIn& sockAddr, int nType, UINT uOptions, bool bDualStack);
+    SOCKET AcceptConnection();  // Accept a connection on any listening socket
+    void CloseListenSockets();  // Close the listening sockets besides m_hComm
+
+    // Connection socket functions
+    void SetNonBlocking();      // Let reads drain the socket without waiting
+    LPBYTE GetThreadBuffer(DWORD& dwSize);  // Read buffer of the thread, allocated on demand
+    void FreeThreadBuffer();
+
+    // Named pipe functions
+    static PSECURITY_DESCRIPTOR CreatePipeSecurity();   // Free with LocalFree
+    bool WaitForPipeClient();
+    DWORD ReadPipe(LPBYTE lpBuffer, DWORD dwSize, DWORD dwTimeout);
+    DWORD WritePipe(const LPBYTE lpBuffer, DWORD dwCount, DWORD dwTimeout);
+
+    static UINT WINAPI SocketThreadProc(LPVOID pParam);
+
+private:
+};
+
+#endif // _SOCKETCOMM_H_
@@ -0,0 +1,216 @@
+#include "StdAfx.h"
+#include "SocketMetrics.h"
+
+const char* GetDisconnectReasonName(DisconnectReason reason)
+{
+	static const char* NAMES[DISCONNECT_REASON_COUNT] = { "client", "send_failed", "protocol_error", "handshake_refused", "unauthenticated", "shutdown" };
+	return (reason >= 0 && reason < DISCONNECT_REASON_COUNT) ? NAMES[reason] : "unknown";
+}
+
+//
+// TrafficCounters
+//
+
+TrafficCounters::TrafficCounters(void)
+{
+	Clear();
+}
+
+void TrafficCounters::Clear()
+{
+	m_llBytesIn = 0;
+	m_llBytesOut = 0;
+	m_llMessagesIn = 0;
+	m_llMessagesOut = 0;
+	m_llSendTicks = 0;
+}
+
+void TrafficCounters::Add(const TrafficCounters &other)
+{
+	m_llBytesIn += other.m_llBytesIn;
+	m_llBytesOut += other.m_llBytesOut;
+	m_llMessagesIn += other.m_llMessagesIn;
+	m_llMessagesOut += other.m_llMessagesOut;
+	m_llSendTicks += other.m_llSendTicks;
+}
+
+void TrafficCounters::ToJson(Json::Value &value, LONGLONG llFrequency) const
+{
+	value["bytes_in"] = static_cast<Json::Int64>(m_llBytesIn);
+	value["bytes_out"] = static_cast<Json::Int64>(m_llBytesOut);
+	value["messages_in"] = static_cast<Json::Int64>(m_llMessagesIn);
+	value["messages_out"] = static_cast<Json::Int64>(m_llMessagesOut);
+	value["send_blocked_us"] = static_cast<Json::Int64>(m_llSendTicks * 1000000 / llFrequency);
+}
+
+//
+// LatencyHistogram
+//
+
+LatencyHistogram::LatencyHistogram(void)
+	: m_nCount(0)
+	, m_llSum(0)
+	, m_llMax(0)
+{
+	memset(m_aBuckets, 0, sizeof(m_aBuckets));
+}
+
+void LatencyHistogram::Add(LONGLONG llMicroseconds)
+{
+	if (llMicroseconds < 0)
+	{
+		llMicroseconds = 0;
+	}
+
+	// Bucket i holds [2^(i-1), 2^i) microseconds, bucket 0 holds less than one.
+	int nBucket = 0;
+	for (LONGLONG ll = llMicroseconds; ll > 0 && nBucket < BUCKET_COUNT - 1; ll >>= 1)
+	{
+		nBucket++;
+	}
+	m_aBuckets[nBucket]++;
+	m_nCount++;
+	m_llSum += llMicroseconds;
+	if (llMicroseconds > m_llMax)
+	{
+		m_llMax = llMicroseconds;
+	}
+}
+
+LONGLONG LatencyHistogram::GetPercentile(int nPercent) const
+{
+	if (m_nCount == 0)
+	{
+		return 0;
+	}
+
+	// The rank of the percentile, rounded up
+	unsigned int nRank = static_cast<unsigned int>((static_cast<LONGLONG>(m_nCount) * nPercent + 99) / 100);
+	unsigned int nSeen = 0;
+	for (int i = 0; i < BUCKET_COUNT; i++)
+	{
+		nSeen += m_aBuckets[i];
+		if (nSeen >= nRank)
+		{
+			// No bucket bound is above the largest value seen.
+			LONGLONG llBound = (static_cast<LONGLONG>(1) << i) - 1;
+			return (llBound < m_llMax) ? llBound : m_llMax;
+		}
+	}
+	return m_llMax;
+}
+
+void LatencyHistogram::ToJson(Json::Value &value) const
+{
+	value["count"] = m_nCount;
+	value["mean_us"] = static_cast<Json::Int64>(m_nCount ? m_llSum / m_nCount : 0);
+	value["max_us"] = static_cast<Json::Int64>(m_llMax);
+	value["p50_us"] = static_cast<Json::Int64>(GetPercentile(50));
+	value["p90_us"] = static_cast<Json::Int64>(GetPercentile(90));
+	value["p99_us"] = static_cast<Json::Int64>(GetPercentile(99));
+}
+
+//
+// RateCounter
+//
+
+RateCounter::RateCounter(void)
+	: m_nTotal(0)
+{
+	for (int i = 0; i < SECONDS; i++)
+	{
+		// Never the current second, GetTickCount would have to wrap first.
+		m_aSeconds[i] = static_cast<DWORD>(-1L);
+		m_aCounts[i] = 0;
+	}
+}
+
+void RateCounter::Add(DWORD dwNow)
+{
+	DWORD dwSecond = dwNow / 1000;
+	int nBucket = dwSecond % SECONDS;
+	if (m_aSeconds[nBucket] != dwSecond)
+	{
+		// The bucket was last used a minute ago or more.
+		m_aSeconds[nBucket] = dwSecond;
+		m_aCounts[nBucket] = 0;
+	}
+	m_aCounts[nBucket]++;
+	m_nTotal++;
+}
+
+unsigned int RateCounter::GetCount(DWORD dwNow) const
+{
+	DWORD dwSecond = dwNow / 1000;
+	unsigned int nCount = 0;
+	for (int i = 0; i < SECONDS; i++)
+	{
+		if (dwSecond - m_aSeconds[i] < SECONDS)
+		{
+			nCount += m_aCounts[i];
+		}
+	}
+	return nCount;
+}
+
+//
+// AllocationCounter
+//
+
+#ifdef _DEBUG
+static __declspec(thread) bool t_bCountAllocations = false;
+static __declspec(thread) LONGLONG t_llAllocations = 0;
+static _CRT_ALLOC_HOOK s_pfnPreviousHook = NULL;
+static bool s_bInstalled = false;
+
+// Must not allocate, and must not call the CRT which may.
+static int __cdecl CountAllocation(int nAllocType, void* pvData, size_t nSize, int nBlockUse,
+	long lRequest, const unsigned char* szFileName, int nLine)
+{
+	if (t_bCountAllocations && (nAllocType == _HOOK_ALLOC || nAllocType == _HOOK_REALLOC))
+	{
+		t_llAllocations++;
+	}
+	return s_pfnPreviousHook ? s_pfnPreviousHook(nAllocType, pvData, nSize, nBlockUse, lRequest, szFileName, nLine) : TRUE;
+}
+#endif
+
+void AllocationCounter::Install()
+{
+#ifdef _DEBUG
+	if (!s_bInstalled)
+	{
+		s_pfnPreviousHook = _CrtSetAllocHook(CountAllocation);
+		s_bInstalled = true;
+	}
+#endif
+}
+
+bool AllocationCounter::IsAvailable()
+{
+#ifdef _DEBUG
+	return s_bInstalled;
+#else
+	return false;
+#endif
+}
+
+bool AllocationCounter::Enable(bool bEnable)
+{
+#ifdef _DEBUG
+	bool bPrevious = t_bCountAllocations;
+	t_bCountAllocations = bEnable;
+	return bPrevious;
+#else
+	return false;
+#endif
+}
+
+LONGLONG AllocationCounter::GetThreadCount()
+{
+#ifdef _DEBUG
+	return t_llAllocations;
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "json/json.h"
+
+// Why a client connection ended
+enum DisconnectReason
+{
+	DISCONNECT_CLIENT,				// The client hung up or the connection broke
+	DISCONNECT_SEND_FAILED,			// The client didn't take a message within the send timeout
+	DISCONNECT_PROTOCOL_ERROR,		// The client broke the WebSocket protocol
+	DISCONNECT_HANDSHAKE_REFUSED,	// The WebSocket handshake was refused
+	DISCONNECT_UNAUTHENTICATED,		// The client didn't present the token
+	DISCONNECT_SHUTDOWN,			// The daemon stopped
+	DISCONNECT_REASON_COUNT
+};
+
+// The name of the reason in the stats
+const char* GetDisconnectReasonName(DisconnectReason reason);
+
+/**
+ * Bytes and messages sent and received, and the time spent blocked in send.
+ * It is kept for each connection and for all the connections together.
+ */
+class TrafficCounters
+{
+public:
+	TrafficCounters(void);
+
+	void Clear();
+	void Add(const TrafficCounters &other);
+
+	// {"bytes_in", "bytes_out", "messages_in", "messages_out", "send_blocked_us"}
+	void ToJson(Json::Value &value, LONGLONG llFrequency) const;
+
+	LONGLONG m_llBytesIn;
+	LONGLONG m_llBytesOut;
+	LONGLONG m_llMessagesIn;
+	LONGLONG m_llMessagesOut;
+	// Performance counter ticks spent in send, including the waits for a full socket buffer
+	LONGLONG m_llSendTicks;
+};
+
+/**
+ * Histogram of durations in power of two microsecond buckets, so that recording
+ * is a few instructions and the memory is fixed. The percentiles are reported as
+ * the upper bound of their bucket, which is within a factor of two.
+ */
+class LatencyHistogram
+{
+public:
+	static const int BUCKET_COUNT = 32;
+
+	LatencyHistogram(void);
+
+	void Add(LONGLONG llMicroseconds);
+
+	unsigned int GetCount() const { return m_nCount; }
+	LONGLONG GetMax() const { return m_llMax; }
+
+	// The upper bound of the bucket holding the given percentile, 0 if empty.
+	LONGLONG GetPercentile(int nPercent) const;
+
+	// {"count", "mean_us", "max_us", "p50_us", "p90_us", "p99_us"}
+	void ToJson(Json::Value &value) const;
+
+private:
+	unsigned int m_aBuckets[BUCKET_COUNT];
+	unsigned int m_nCount;
+	LONGLONG m_llSum;
+	LONGLONG m_llMax;
+};
+
+/**
+ * Counts events over the last minute in one second buckets.
+ */
+class RateCounter
+{
+public:
+	static const int SECONDS = 60;
+
+	RateCounter(void);
+
+	void Add(DWORD dwNow);
+
+	// Number of events in the last SECONDS seconds
+	unsigned int GetCount(DWORD dwNow) const;
+
+	// Number of events ever
+	unsigned int GetTotal() const { return m_nTotal; }
+
+private:
+	// The second each bucket was last used for, and its count
+	DWORD m_aSeconds[SECONDS];
+	unsigned int m_aCounts[SECONDS];
+	unsigned int m_nTotal;
+};
+
+/**
+ * Counts the heap allocations of the calling thread, to check that the receive path
+ * doesn't allocate. It hooks the allocations of the debug CRT, so it only counts in
+ * debug builds.
+ */
+class AllocationCounter
+{
+public:
+	// Install the allocation hook, once before the I/O threads start.
+	static void Install();
+
+	// False in release builds, the counts are always 0 then.
+	static bool IsAvailable();
+
+	// Count the allocations of this thread or not. Returns the previous setting, to restore it.
+	static bool Enable(bool bEnable);
+
+	// The allocations counted on this thread so far
+	static LONGLONG GetThreadCount();
+};
@@ -0,0 +1,122 @@
+#include "StdAfx.h"
+#include "SocketProtocol.h"
+
+Json::Value MakeSocketEvent(const char* utf8Event, const Json::Value &body)
+{
+	Json::Value message = body;
+	message["event"] = utf8Event;
+	return message;
+}
+
+// Split the next token off the command line, NULL at its end. Like CStringA::Tokenize,
+// a run of tabs separates two tokens.
+static char* NextToken(char* &pNext)
+{
+	while (*pNext == '\t')
+	{
+		pNext++;
+	}
+	if (*pNext == '\0')
+	{
+		return NULL;
+	}
+	char* pToken = pNext;
+	while (*pNext != '\0' && *pNext != '\t')
+	{
+		pNext++;
+	}
+	if (*pNext == '\t')
+	{
+		*pNext++ = '\0';
+	}
+	return pToken;
+}
+
+SocketRequest::SocketRequest(void)
+	: m_szId("")
+	, m_szName("")
+	, m_nArgs(0)
+{
+}
+
+bool SocketRequest::Parse(char* utf8Command)
+{
+	m_szId = "";
+	m_szName = "";
+	m_nArgs = 0;
+
+	char* pNext = utf8Command;
+	char* pToken = NextToken(pNext);
+	if (pToken != NULL && pToken[0] == '#')
+	{
+		m_szId = pToken + 1;
+		pToken = NextToken(pNext);
+	}
+	if (pToken == NULL)
+	{
+		return false;
+	}
+	m_szName = pToken;
+
+	while ((pToken = NextToken(pNext)) != NULL && m_nArgs < MAX_ARGS)
+	{
+		m_aArgs[m_nArgs++] = pToken;
+	}
+	return true;
+}
+
+const char* SocketRequest::GetArg(int index) const
+{
+	if (index < 0 || index >= GetArgCount())
+	{
+		return "";
+	}
+	return m_aArgs[index];
+}
+
+void SocketRequest::CopyTo(std::vector<char> &storage, SocketRequest &copy) const
+{
+	// Join the tokens back into a command line and parse it again.
+	storage.clear();
+	if (m_szId[0] != '\0')
+	{
+		storage.push_back('#');
+		storage.insert(storage.end(), m_szId, m_szId + strlen(m_szId));
+		storage.push_back('\t');
+	}
+	storage.insert(storage.end(), m_szName, m_szName + strlen(m_szName));
+	for (int i = 0; i < m_nArgs; i++)
+	{
+		storage.push_back('\t');
+		storage.insert(storage.end(), m_aArgs[i], m_aArgs[i] + strlen(m_aArgs[i]));
+	}
+	storage.push_back('\0');
+	copy.Parse(&storage[0]);
+}
+
+Json::Value SocketRequest::MakeResponse(const Json::Value &result) const
+{
+	Json::Value response;
+	AddRequestInfo(response);
+	response["status"] = "ok";
+	response["result"] = result;
+	return response;
+}
+
+Json::Value SocketRequest::MakeError(const char* utf8Message) const
+{
+	Json::Value response;
+	AddRequestInfo(response);
+	response["status"] = "error";
+	response["error"] = utf8Message;
+	return response;
+}
+
+void SocketRequest::AddRequestInfo(Json::Value &response) const
+{
+	if (m_szId[0] != '\0')
+	{
+		response["id"] = m_szId;
+	}
+	response["command"] = m_szName;
+}
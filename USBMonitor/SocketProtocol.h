@@ -0,0 +1,97 @@
+#pragma once
+
+/**
+ * A request received from a socket client.
+ *
+ * Request format, one request per line, fields separated by tabs:
+ *     [#<id>\t]<command>[\t<argument>]...
+ *
+ * The optional request ID is echoed back in the response, so that a client can send
+ * several requests at once and match the responses by ID. The responses are objects
+ * sent as a single line of JSON, or in MessagePack after a "format\tmsgpack" request:
+ *     {"id":"<id>","command":"<command>","status":"ok","result":<result>}
+ *     {"id":"<id>","command":"<command>","status":"error","error":"<message>"}
+ *
+ * The "subscribe" command switches a client from the full device list broadcasts to
+ * device deltas. The result contains the device list and its version:
+ *     {"version":<version>,"devices":[...]}
+ * and each change of the device list is then pushed as:
+ *     {"event":"devices","base":<version>,"version":<version>,"added":[...],"removed":[...],"changed":[...]}
+ * A delta applies to the list of version "base". A delta whose "version" is not greater
+ * than that of the client's list is already included and should be ignored. If "base"
+ * is greater, the client has missed a delta and should send "resync" to get a new snapshot.
+ *
+ * When [socket] token or token_file is set in driver_manager.ini, the first line of a
+ * client must present the token:
+ *     auth\t<token>
+ * It is answered with {"command":"auth","status":"ok"}, and the client gets the device
+ * lists and its requests are taken from then on. A client which sends anything else is
+ * disconnected without an answer.
+ *
+ * When the daemon exits, each client receives {"event":"shutdown"} followed by the end of
+ * the stream, and should close its side of the connection.
+ *
+ * WebSocket clients send the command lines as text or binary messages, the line terminator
+ * may be left out. Each response and event is sent as one message: a text message for
+ * JSON, a binary message for MessagePack. Large messages are compressed if the client
+ * offers permessage-deflate.
+ */
+/**
+ * Build a message pushed to the clients without a request:
+ *     {"event":"<event>",<members of body>}
+ */
+Json::Value MakeSocketEvent(const char* utf8Event, const Json::Value &body);
+
+class SocketRequest
+{
+public:
+	// The arguments past this many are ignored.
+	static const int MAX_ARGS = 8;
+
+	SocketRequest(void);
+
+	/**
+	 * Parse a command line. It is split in place, nothing is copied: the ID, the name
+	 * and the arguments point into the command line, which must outlive the request.
+	 * @return false if the command line doesn't contain a command.
+	 */
+	bool Parse(char* utf8Command);
+
+	// Whether the command name is utf8Name
+	bool IsCommand(const char* utf8Name) const
+	{
+		return strcmp(m_szName, utf8Name) == 0;
+	}
+
+	// Get an argument of the request, or "" if there are not enough arguments.
+	const char* GetArg(int index) const;
+
+	int GetArgCount() const
+	{
+		return m_nArgs;
+	}
+
+	/**
+	 * Copy the request and its command line into storage, e.g. to answer it after the
+	 * command line is gone.
+	 */
+	void CopyTo(std::vector<char> &storage, SocketRequest &copy) const;
+
+	// Build the response of a succeeded request.
+	Json::Value MakeResponse(const Json::Value &result) const;
+
+	// Build the response of a failed request.
+	Json::Value MakeError(const char* utf8Message) const;
+
+	// The request ID, "" if the client didn't specify one.
+	const char* m_szId;
+
+	// The command name
+	const char* m_szName;
+
+private:
+	void AddRequestInfo(Json::Value &response) const;
+
+	const char* m_aArgs[MAX_ARGS];
+	int m_nArgs;
+};
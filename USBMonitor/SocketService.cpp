@@ -1,229 +1,1076 @@
-// SocketManager.cpp: implementation of the SocketService class.
-//
-//////////////////////////////////////////////////////////////////////
-
-#include "stdafx.h"
-#include <atlconv.h>
-#include "SocketService.h"
-#include "MainFrame.h"
-#include "App.h"
-
-#define WSA_VERSION  MAKEWORD(2,0)
-
-void SocketService::Start()
-{
-	if (m_bStarted)
-	{
-		return;
-	}
-
-	WSADATA WSAData = {0};
-	if (0 != WSAStartup(WSA_VERSION, &WSAData))
-	{
-		// Tell the user that we could not find a usable
-		// WinSock DLL.
-		if (LOBYTE(WSAData.wVersion) != LOBYTE(WSA_VERSION) ||
-			HIBYTE(WSAData.wVersion) != HIBYTE(WSA_VERSION))
-		{
-			::MessageBox(NULL, _T("Incorrect version of WS2_32.dll found"), _T("Error"), MB_OK);
-		}
-
-		WSACleanup( );
-		return;
-	}
-
-	for(int i=0; i<MAX_CONNECTION; i++)
-	{
-		m_SocketManager[i].SetParent(this);
-		m_SocketManager[i].SetServerState(true);	// run as server
-	}
-
-	if (!StartNewServer())
-	{
-		WSACleanup( );
-		return;
-	}
-
-	m_bStarted = true;
-}
-
-void SocketService::Stop()
-{
-	if (!m_bStarted)
-	{
-		return;
-	}
-
-	// Disconnect all clients
-	for(int i=0; i<MAX_CONNECTION; i++)
-	{
-		if (m_SocketManager[i].IsOpen())
-		{
-			m_SocketManager[i].StopComm();
-		}
-	}
-	m_pCurServer = NULL;
-
-	// Terminate use of the WS2_32.DLL
-	WSACleanup();
-}
-
-bool SocketService::StartNewServer() 
-{
-	m_pCurServer = NULL;
-	for(int i=0; i<MAX_CONNECTION; i++)
-	{
-		if (!m_SocketManager[i].IsOpen())
-		{
-			m_pCurServer = &m_SocketManager[i];
-			break;
-		}
-	}
-	if (m_pCurServer == NULL)
-	{
-		_T("Conection limit exceeded. Cannot create new server connection!\n");
-		return false;
-	}
-
-	// no smart addressing - we use connection oriented
-	m_pCurServer->SetSmartAddressing(false);
-
-	// Find an available port to start server
-	int port;
-	CString strPort;
-	for (port = 8000; port < 9000; port += 23)
-	{
-		// create TCP socket
-		strPort.Format(_T("%d"), port);
-		if (m_pCurServer->CreateSocketEx(_T("127.0.0.1"), strPort, AF_INET, SOCK_STREAM, 0))
-		{
-			break;
-		}
-	}
-	if (port >= 9000) 
-	{
-		// No availalbe port found.
-		TRACE(_T("Failed to start server. No availalbe port found\n"));
-		m_pCurServer = NULL;
-		return false;
-	}
-	if (!m_pCurServer->WatchComm())
-	{
-		TRACE(_T("Failed to start server.\n"));
-		m_pCurServer->CloseComm();
-		m_pCurServer = NULL;
-		return false;
-	}
-	TRACE(_T("Server started. Port=%s\n"), strPort);
-	SavePortNum(strPort);
-	return true;
-}
-
-void SocketService::SavePortNum(const CString& strPort) const
-{
-	CString fileName = CPaintManagerUI::GetInstancePath() + DRIVER_MANAGER_INI_FILE;
-	::WritePrivateProfileString(_T("socket"), _T("port"), strPort, static_cast<LPCTSTR>(fileName));
-}
-
-void SocketService::SendString(const char* utf8String)
-{
-	CStringA str = utf8String;
-	if (str.GetLength() <= 0)
-	{
-		return;
-	}
-
-	str.Replace("\n", "\r\n");
-
-	stMessageProxy msgProxy;
-	int nLen = str.GetLength();
-	nLen = min(sizeof(msgProxy.byData) - 1, nLen);
-	memcpy(msgProxy.byData, (LPCSTR)str, nLen + 1);
-
-	m_csSendString.Enter();
-	// Send to all clients
-	for(int i=0; i<MAX_CONNECTION; i++)
-	{
-		if (m_SocketManager[i].IsOpen() && m_pCurServer != &m_SocketManager[i])
-		{
-			m_SocketManager[i].WriteComm(msgProxy.byData, nLen, INFINITE);
-		}
-	}
-	m_csSendString.Leave();
-}
-
-int SocketService::GetClientCount() const
-{
-	int count = 0;
-	for(int i=0; i<MAX_CONNECTION; i++)
-	{
-		if (m_SocketManager[i].IsOpen() && m_pCurServer != &m_SocketManager[i])
-		{
-			++count;
-		}
-	}
-	return count;
-}
-
-void SocketService::OnStringReceived(const char* utf8String)
-{
-	m_pCallback->OnStringReceived(utf8String);
-}
-
-void SocketService::OnEvent(UINT uEvent, CSocketManager* pManager)
-{
-	switch(uEvent)
-	{
-	case EVT_CONSUCCESS:
-		// When a new connection is accepted, the server will be closed. So we need to start a new server.
-		StartNewServer();
-		m_pCallback->OnConnect();
-		break;
-	case EVT_CONFAILURE: // Fall through
-	case EVT_CONDROP:
-		TRACE(_T("Connection failed or abandoned\n"));
-		pManager->StopComm();
-		if (m_pCurServer == NULL)
-		{
-			StartNewServer();
-		}
-		m_pCallback->OnDisconnect();
-		break;
-	case EVT_ZEROLENGTH:
-		TRACE( _T("Zero Length Message\n") );
-		break;
-	default:
-		TRACE(_T("Unknown Socket event\n"));
-		break;
-	}
-}
-
-// 
-// SocketService::CSocketManager
-//
-
-void SocketService::CSocketManager::OnDataReceived(const LPBYTE lpBuffer, DWORD dwCount)
-{
-	if (dwCount <= 0)
-	{
-		return;
-	}
-
-	char* utf8String = new char[dwCount + 1];
-	memcpy(utf8String, lpBuffer, dwCount);
-	utf8String[dwCount] = '\0';
-	CStringA received = utf8String;
-	delete[] utf8String;
-	MainFrame::GetInstance()->ExecuteOnUIThread([received, this]()
-	{
-		m_pParent->OnStringReceived(received);
-	});
-}
-
-void SocketService::CSocketManager::OnEvent(UINT uEvent, LPVOID lpvData)
-{
-	MainFrame::GetInstance()->ExecuteOnUIThread([this, uEvent]()
-	{
-		m_pParent->OnEvent(uEvent, this);
-	});
+// SocketManager.cpp: implementation of the SocketService class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include <atlconv.h>
+#include "SocketService.h"
+#include "SocketProtocol.h"
+#include "App.h"
+
+#define WSA_VERSION  MAKEWORD(2,0)
+
+#define PIPE_NAME			_T("\\\\.\\pipe\\FirefoxOS-USB-Daemon")
+#define UNIX_SOCKET_FILE	_T("usb-daemon.sock")
+
+// The line a client presents the token with, see SocketProtocol.h
+#define AUTH_COMMAND		"auth\t"
+
+// Milliseconds left of dwTimeout since dwStart
+static DWORD GetRemainingTime(DWORD dwStart, DWORD dwTimeout)
+{
+	DWORD dwElapsed = ::GetTickCount() - dwStart;
+	return (dwElapsed >= dwTimeout) ? 0 : dwTimeout - dwElapsed;
+}
+
+// Compare a token in a time which only depends on the length of the expected one, so
+// that a client can't learn how much of its guess was right.
+static bool IsSameToken(const char* lpToken, int nLength, const char* lpExpected, int nExpectedLength)
+{
+	unsigned char diff = (nLength == nExpectedLength) ? 0 : 1;
+	for (int i = 0; i < nExpectedLength; i++)
+	{
+		unsigned char ch = static_cast<unsigned char>(lpToken[(i < nLength) ? i : 0]);
+		diff |= ch ^ static_cast<unsigned char>(lpExpected[i]);
+	}
+	return diff == 0;
+}
+
+void SocketService::Start()
+{
+	if (m_bStarted)
+	{
+		return;
+	}
+
+	WSADATA WSAData = {0};
+	if (0 != WSAStartup(WSA_VERSION, &WSAData))
+	{
+		// Tell the user that we could not find a usable
+		// WinSock DLL.
+		if (LOBYTE(WSAData.wVersion) != LOBYTE(WSA_VERSION) ||
+			HIBYTE(WSAData.wVersion) != HIBYTE(WSA_VERSION))
+		{
+			::MessageBox(NULL, _T("Incorrect version of WS2_32.dll found"), _T("Error"), MB_OK);
+		}
+
+		WSACleanup( );
+		return;
+	}
+
+	// Check that the receive path doesn't allocate, in debug builds
+	AllocationCounter::Install();
+
+	for(int i=0; i<MAX_CONNECTION; i++)
+	{
+		m_SocketManager[i].SetParent(this, i);
+		m_SocketManager[i].SetServerState(true);	// run as server
+	}
+
+	LoadTransports();
+
+	m_csServer.Enter();
+	bool bListening = false;
+	for (int i = 0; i < TRANSPORT_COUNT; i++)
+	{
+		if (m_aTransportEnabled[i] && StartNewServer(static_cast<SocketTransport>(i)))
+		{
+			bListening = true;
+		}
+		else
+		{
+			m_aTransportEnabled[i] = false;
+		}
+	}
+	if (!bListening)
+	{
+		// Fall back to TCP, which works everywhere.
+		bListening = m_aTransportEnabled[TRANSPORT_TCP] = StartNewServer(TRANSPORT_TCP);
+	}
+	if (!bListening)
+	{
+		m_csServer.Leave();
+		WSACleanup( );
+		return;
+	}
+
+	m_bStarted = true;
+	m_csServer.Leave();
+}
+
+void SocketService::Stop()
+{
+	// The I/O threads check m_bStarted before touching the slots, so we must not
+	// hold m_csServer while waiting for them to exit.
+	m_csServer.Enter();
+	if (!m_bStarted)
+	{
+		m_csServer.Leave();
+		return;
+	}
+	m_bStarted = false;
+	bool aListener[MAX_CONNECTION];
+	for(int i=0; i<MAX_CONNECTION; i++)
+	{
+		aListener[i] = IsListener(&m_SocketManager[i]);
+	}
+	for (int i = 0; i < TRANSPORT_COUNT; i++)
+	{
+		m_pCurServer[i] = NULL;
+	}
+	m_csServer.Leave();
+
+	m_csMetrics.Enter();
+	for(int i=0; i<MAX_CONNECTION; i++)
+	{
+		if (m_aConnections[i].m_bConnected)
+		{
+			m_aConnections[i].m_bConnected = false;
+			m_aDisconnects[DISCONNECT_SHUTDOWN]++;
+		}
+	}
+	m_csMetrics.Leave();
+
+	DWORD dwStart = ::GetTickCount();
+
+	// Tell the clients that we are going away and close our side, after everything
+	// queued for them. A client which doesn't take it in time is cut off.
+	Json::Value notice = MakeSocketEvent("shutdown", Json::Value(Json::objectValue));
+	bool aEncoded[MESSAGE_FORMAT_COUNT][FRAMING_COUNT] = { { false } };
+	LockSend();
+	for(int i=0; i<MAX_CONNECTION; i++)
+	{
+		CSocketManager& client = m_SocketManager[i];
+		if (!client.IsOpen())
+		{
+			continue;
+		}
+		if (aListener[i] || !client.IsReady())
+		{
+			// Nothing to say, just stop waiting.
+			client.WakeComm();
+			continue;
+		}
+
+		const MessageBuffer& buffer = Encode(notice, client.GetFormat(), client.GetFraming(), aEncoded);
+		bool bSent = WriteAll(client, buffer.GetData(), buffer.GetLength(), GetRemainingTime(dwStart, STOP_TIMEOUT));
+		if (bSent && client.GetFraming() != FRAMING_NONE)
+		{
+			MessageBuffer frame;
+			WebSocket::WriteClose(WebSocket::STATUS_GOING_AWAY, frame);
+			WriteAll(client, frame.GetData(), frame.GetLength(), GetRemainingTime(dwStart, STOP_TIMEOUT));
+		}
+		client.ShutdownComm(SD_SEND);
+	}
+	UnlockSend();
+
+	// Let the clients hang up first, so that they get all the data.
+	for(int i=0; i<MAX_CONNECTION; i++)
+	{
+		m_SocketManager[i].WaitComm(GetRemainingTime(dwStart, STOP_TIMEOUT));
+	}
+
+	// Wake up the threads of the clients which are still connected and join them all.
+	for(int i=0; i<MAX_CONNECTION; i++)
+	{
+		if (m_SocketManager[i].IsOpen() || m_SocketManager[i].IsStart())
+		{
+			m_SocketManager[i].StopComm();
+		}
+	}
+
+	if (m_aTransportEnabled[TRANSPORT_UNIX])
+	{
+		::DeleteFile(GetUnixSocketPath());
+	}
+
+	// Terminate use of the WS2_32.DLL
+	WSACleanup();
+}
+
+void SocketService::LoadTransports()
+{
+	CString fileName = CPaintManagerUI::GetInstancePath() + DRIVER_MANAGER_INI_FILE;
+	TCHAR szTransports[MAX_PATH] = {0};
+	::GetPrivateProfileString(_T("socket"), _T("transports"), _T("tcp,unix,pipe"),
+		szTransports, MAX_PATH, static_cast<LPCTSTR>(fileName));
+
+	static const LPCTSTR TRANSPORT_NAMES[TRANSPORT_COUNT] = { _T("tcp"), _T("unix"), _T("pipe"), _T("ws") };
+	CString strTransports = szTransports;
+	int curPos = 0;
+	CString token = strTransports.Tokenize(_T(", "), curPos);
+	while (!token.IsEmpty())
+	{
+		for (int i = 0; i < TRANSPORT_COUNT; i++)
+		{
+			if (token.CompareNoCase(TRANSPORT_NAMES[i]) == 0)
+			{
+				m_aTransportEnabled[i] = true;
+			}
+		}
+		token = strTransports.Tokenize(_T(", "), curPos);
+	}
+
+	TCHAR szOrigins[MAX_PATH * 4] = {0};
+	::GetPrivateProfileString(_T("socket"), _T("ws_origins"), _T(""),
+		szOrigins, MAX_PATH * 4, static_cast<LPCTSTR>(fileName));
+	m_strAllowedOrigins = CT2A(szOrigins, CP_UTF8);
+
+	// Each connection starts with a small receive buffer, which grows while the client
+	// sends faster than a read takes it, e.g. a batch of catalog requests.
+	int nBufferSize = ::GetPrivateProfileInt(_T("socket"), _T("receive_buffer"),
+		CommandParser::DEFAULT_BUFFER_SIZE, static_cast<LPCTSTR>(fileName));
+	int nMaxBufferSize = ::GetPrivateProfileInt(_T("socket"), _T("receive_buffer_max"),
+		CommandParser::DEFAULT_MAX_BUFFER_SIZE, static_cast<LPCTSTR>(fileName));
+	for(int i=0; i<MAX_CONNECTION; i++)
+	{
+		m_SocketManager[i].SetReceiveBufferSize(nBufferSize, nMaxBufferSize);
+	}
+
+	// Anything on the host can connect, so a shared secret can be required of the
+	// clients. token_file names a per user file, e.g. %LOCALAPPDATA%\usb-daemon.token,
+	// else the token is kept next to the port.
+	TCHAR szTokenFile[MAX_PATH] = {0};
+	::GetPrivateProfileString(_T("socket"), _T("token_file"), _T(""),
+		szTokenFile, MAX_PATH, static_cast<LPCTSTR>(fileName));
+	if (szTokenFile[0])
+	{
+		TCHAR szPath[MAX_PATH] = {0};
+		::ExpandEnvironmentStrings(szTokenFile, szPath, MAX_PATH);
+		m_bAuthRequired = true;
+		m_strToken = ReadTokenFile(szPath);
+		if (m_strToken.IsEmpty())
+		{
+			::OutputDebugStringA("USBMonitor: no token in the token file, the socket clients will be refused\n");
+		}
+	}
+	else
+	{
+		TCHAR szToken[MAX_PATH] = {0};
+		::GetPrivateProfileString(_T("socket"), _T("token"), _T(""),
+			szToken, MAX_PATH, static_cast<LPCTSTR>(fileName));
+		m_strToken = CT2A(szToken, CP_UTF8);
+		m_bAuthRequired = !m_strToken.IsEmpty();
+	}
+}
+
+CStringA SocketService::ReadTokenFile(LPCTSTR szFileName)
+{
+	std::ifstream fs(szFileName);
+	std::string line;
+	if (!fs.is_open() || !std::getline(fs, line))
+	{
+		return CStringA();
+	}
+	CStringA strToken(line.c_str());
+	strToken.Trim();
+	return strToken;
+}
+
+bool SocketService::StartNewServer(SocketTransport transport, CSocketManager* pExclude) 
+{
+	m_pCurServer[transport] = NULL;
+	CSocketManager* pServer = NULL;
+	for(int i=0; i<MAX_CONNECTION; i++)
+	{
+		// The excluded slot belongs to the calling I/O thread, which can't wait for itself.
+		if (!m_SocketManager[i].IsOpen() && &m_SocketManager[i] != pExclude)
+		{
+			pServer = &m_SocketManager[i];
+			break;
+		}
+	}
+	if (pServer == NULL)
+	{
+		TRACE(_T("Conection limit exceeded. Cannot create new server connection!\n"));
+		return false;
+	}
+
+	// Reap the thread of the connection which was dropped earlier on this slot.
+	if (pServer->IsStart())
+	{
+		pServer->StopComm();
+	}
+
+	// no smart addressing - we use connection oriented
+	pServer->SetSmartAddressing(false);
+	pServer->SetTransport(transport);
+
+	bool bCreated = false;
+	switch (transport)
+	{
+	case TRANSPORT_UNIX:
+		bCreated = pServer->CreateUnixSocket(GetUnixSocketPath());
+		break;
+	case TRANSPORT_PIPE:
+		{
+			// The instance which becomes a connection stays open, so the pipe is ours
+			// as long as any of the slots has it. Otherwise, make sure that no other
+			// process has taken the name.
+			bool bFirstInstance = true;
+			for(int i=0; i<MAX_CONNECTION; i++)
+			{
+				if (m_SocketManager[i].IsPipe())
+				{
+					bFirstInstance = false;
+					break;
+				}
+			}
+			bCreated = pServer->CreatePipeServer(PIPE_NAME, bFirstInstance);
+		}
+		break;
+	case TRANSPORT_TCP:
+	case TRANSPORT_WEBSOCKET:
+	default:
+		bCreated = CreateTcpServer(transport, pServer);
+		break;
+	}
+	if (!bCreated)
+	{
+		TRACE(_T("Failed to create server. Transport=%d\n"), transport);
+		return false;
+	}
+	if (!pServer->WatchComm())
+	{
+		TRACE(_T("Failed to start server.\n"));
+		pServer->CloseComm();
+		return false;
+	}
+	m_pCurServer[transport] = pServer;
+	return true;
+}
+
+bool SocketService::CreateTcpServer(SocketTransport transport, CSocketManager* pServer)
+{
+	// Find an available port to start server. The WebSocket server uses its own range,
+	// so that the two never take each other's port while one is restarting.
+	int firstPort = (transport == TRANSPORT_WEBSOCKET) ? 9000 : 8000;
+	int port;
+	CString strPort;
+	for (port = firstPort; port < firstPort + 1000; port += 23)
+	{
+		// create TCP sockets on both ::1 and 127.0.0.1, so that clients resolving
+		// localhost to either address reach the daemon. A port taken on one of
+		// them is skipped.
+		strPort.Format(_T("%d"), port);
+		if (pServer->CreateSocketEx(_T("localhost"), strPort, AF_UNSPEC, SOCK_STREAM, 0))
+		{
+			break;
+		}
+	}
+	if (port >= firstPort + 1000) 
+	{
+		// No availalbe port found.
+		TRACE(_T("Failed to start server. No availalbe port found\n"));
+		return false;
+	}
+	TRACE(_T("Server started. Port=%s\n"), strPort);
+	SavePortNum(transport, strPort);
+	return true;
+}
+
+bool SocketService::IsListener(const CSocketManager* pManager) const
+{
+	for (int i = 0; i < TRANSPORT_COUNT; i++)
+	{
+		if (m_pCurServer[i] == pManager)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+CString SocketService::GetUnixSocketPath()
+{
+	return CPaintManagerUI::GetInstancePath() + UNIX_SOCKET_FILE;
+}
+
+void SocketService::SavePortNum(SocketTransport transport, const CString& strPort)
+{
+	// A new server is started for every client, usually on the same port.
+	if (strPort == m_strPort[transport])
+	{
+		return;
+	}
+	m_strPort[transport] = strPort;
+	CString fileName = CPaintManagerUI::GetInstancePath() + DRIVER_MANAGER_INI_FILE;
+	LPCTSTR szKey = (transport == TRANSPORT_WEBSOCKET) ? _T("ws_port") : _T("port");
+	::WritePrivateProfileString(_T("socket"), szKey, strPort, static_cast<LPCTSTR>(fileName));
+}
+
+void SocketService::SendToAll(const Json::Value &message)
+{
+	SendToClients(message, false);
+}
+
+void SocketService::SendToSubscribers(const Json::Value &message)
+{
+	SendToClients(message, true);
+}
+
+void SocketService::SendToClients(const Json::Value &message, bool bSubscribers)
+{
+	// Each format is serialized and framed at most once, no matter how many clients use it.
+	bool aEncoded[MESSAGE_FORMAT_COUNT][FRAMING_COUNT] = { { false } };
+
+	LockSend();
+	for(int i=0; i<MAX_CONNECTION; i++)
+	{
+		CSocketManager& client = m_SocketManager[i];
+		if (client.IsOpen() && !IsListener(&client) && client.IsReady() && client.IsSubscribed() == bSubscribers)
+		{
+			const MessageBuffer& buffer = Encode(message, client.GetFormat(), client.GetFraming(), aEncoded);
+			WriteAll(client, buffer.GetData(), buffer.GetLength());
+		}
+	}
+	UnlockSend();
+}
+
+bool SocketService::SendTo(int nClientId, const Json::Value &message)
+{
+	return SendToClient(nClientId, NULL, message);
+}
+
+bool SocketService::SendTo(int nClientId, UINT nSession, const Json::Value &message)
+{
+	return SendToClient(nClientId, &nSession, message);
+}
+
+UINT SocketService::GetClientSession(int nClientId)
+{
+	if (nClientId < 0 || nClientId >= MAX_CONNECTION)
+	{
+		return 0;
+	}
+	LockSend();
+	UINT nSession = m_SocketManager[nClientId].GetSession();
+	UnlockSend();
+	return nSession;
+}
+
+bool SocketService::SendToClient(int nClientId, const UINT* pnSession, const Json::Value &message)
+{
+	if (nClientId < 0 || nClientId >= MAX_CONNECTION)
+	{
+		return false;
+	}
+
+	bool aEncoded[MESSAGE_FORMAT_COUNT][FRAMING_COUNT] = { { false } };
+	bool bSent = false;
+	LockSend();
+	CSocketManager& client = m_SocketManager[nClientId];
+	if (client.IsOpen() && !IsListener(&client) && client.IsReady() &&
+		(pnSession == NULL || client.GetSession() == *pnSession))
+	{
+		const MessageBuffer& buffer = Encode(message, client.GetFormat(), client.GetFraming(), aEncoded);
+		bSent = WriteAll(client, buffer.GetData(), buffer.GetLength());
+	}
+	UnlockSend();
+	return bSent;
+}
+
+bool SocketService::Subscribe(int nClientId, const std::function<Json::Value()>& makeSnapshot)
+{
+	if (nClientId < 0 || nClientId >= MAX_CONNECTION)
+	{
+		return false;
+	}
+
+	bool aEncoded[MESSAGE_FORMAT_COUNT][FRAMING_COUNT] = { { false } };
+	bool bSent = false;
+	LockSend();
+	CSocketManager& client = m_SocketManager[nClientId];
+	if (client.IsOpen() && !IsListener(&client) && client.IsReady())
+	{
+		client.SetSubscribed(true);
+		const MessageBuffer& buffer = Encode(makeSnapshot(), client.GetFormat(), client.GetFraming(), aEncoded);
+		bSent = WriteAll(client, buffer.GetData(), buffer.GetLength());
+	}
+	UnlockSend();
+	return bSent;
+}
+
+void SocketService::Unsubscribe(int nClientId)
+{
+	if (nClientId < 0 || nClientId >= MAX_CONNECTION)
+	{
+		return;
+	}
+
+	LockSend();
+	m_SocketManager[nClientId].SetSubscribed(false);
+	UnlockSend();
+}
+
+bool SocketService::SetClientFormat(int nClientId, MessageFormat format)
+{
+	if (nClientId < 0 || nClientId >= MAX_CONNECTION)
+	{
+		return false;
+	}
+
+	LockSend();
+	m_SocketManager[nClientId].SetFormat(format);
+	UnlockSend();
+	return true;
+}
+
+const MessageBuffer& SocketService::Encode(const Json::Value &message, MessageFormat format, MessageFraming framing,
+	bool aEncoded[][FRAMING_COUNT])
+{
+	MessageBuffer& buffer = m_buffers[format][framing];
+	if (aEncoded[format][framing])
+	{
+		return buffer;
+	}
+
+	if (framing != FRAMING_NONE)
+	{
+		// A frame delimits the message, so JSON doesn't need its line terminator.
+		const MessageBuffer& plain = Encode(message, format, FRAMING_NONE, aEncoded);
+		int nLength = plain.GetLength();
+		if (format == MESSAGE_FORMAT_JSON)
+		{
+			nLength -= 2;
+		}
+		buffer.Clear();
+		WebSocket::WriteMessage(plain.GetData(), nLength, format != MESSAGE_FORMAT_JSON,
+			framing == FRAMING_WEBSOCKET_DEFLATE, m_deflateEncoder, m_scratchBuffer, buffer);
+		aEncoded[format][framing] = true;
+		return buffer;
+	}
+
+	LARGE_INTEGER start, end;
+	::QueryPerformanceCounter(&start);
+	buffer.Clear();
+	MessageEncoder::Encode(message, format, buffer);
+	::QueryPerformanceCounter(&end);
+
+	aEncoded[format][framing] = true;
+	m_nEncodedMessages++;
+	m_llEncodedBytes += buffer.GetLength();
+	m_llEncodeTicks += end.QuadPart - start.QuadPart;
+	return buffer;
+}
+
+void SocketService::GetSerializationStats(Json::Value &stats)
+{
+	LARGE_INTEGER frequency;
+	::QueryPerformanceFrequency(&frequency);
+
+	LockSend();
+	stats["messages"] = m_nEncodedMessages;
+	stats["bytes"] = static_cast<Json::Int64>(m_llEncodedBytes);
+	stats["microseconds"] = static_cast<Json::Int64>(m_llEncodeTicks * 1000000 / frequency.QuadPart);
+	UnlockSend();
+}
+
+void SocketService::GetStats(Json::Value &stats)
+{
+	LARGE_INTEGER frequency;
+	::QueryPerformanceFrequency(&frequency);
+	DWORD dwNow = ::GetTickCount();
+
+	stats["send_queue"] = static_cast<int>(m_lSendWaiting);
+	stats["send_queue_max"] = static_cast<int>(m_lMaxSendWaiting);
+
+	m_csMetrics.Enter();
+	stats["accepts"] = m_accepts.GetTotal();
+	stats["accepts_per_minute"] = m_accepts.GetCount(dwNow);
+	m_totalTraffic.ToJson(stats["traffic"], frequency.QuadPart);
+	m_commandLatency.ToJson(stats["command_latency"]);
+	Json::Value& receive = stats["receive"];
+	receive["reads"] = static_cast<Json::Int64>(m_llReads);
+	if (AllocationCounter::IsAvailable())
+	{
+		receive["allocations"] = static_cast<Json::Int64>(m_llReadAllocations);
+	}
+	Json::Value& disconnects = stats["disconnects"];
+	for (int i = 0; i < DISCONNECT_REASON_COUNT; i++)
+	{
+		disconnects[GetDisconnectReasonName(static_cast<DisconnectReason>(i))] = m_aDisconnects[i];
+	}
+	Json::Value& connections = stats["connections"];
+	connections = Json::Value(Json::arrayValue);
+	for(int i=0; i<MAX_CONNECTION; i++)
+	{
+		const ConnectionMetrics& metrics = m_aConnections[i];
+		if (!metrics.m_bConnected)
+		{
+			continue;
+		}
+		Json::Value connection;
+		connection["id"] = i;
+		connection["connected_ms"] = static_cast<Json::UInt>(dwNow - metrics.m_dwConnectTime);
+		metrics.m_traffic.ToJson(connection, frequency.QuadPart);
+		connections.append(connection);
+	}
+	m_csMetrics.Leave();
+}
+
+void SocketService::LogStats()
+{
+	LARGE_INTEGER frequency;
+	::QueryPerformanceFrequency(&frequency);
+
+	CStringA strLine;
+	m_csMetrics.Enter();
+	int nClients = 0;
+	for(int i=0; i<MAX_CONNECTION; i++)
+	{
+		if (m_aConnections[i].m_bConnected)
+		{
+			nClients++;
+		}
+	}
+	strLine.Format("USBMonitor socket: clients=%d accepts=%u/min in=%I64d/%I64dB out=%I64d/%I64dB send_blocked=%I64dus "
+		"send_queue_max=%d commands=%u p50=%I64dus p99=%I64dus max=%I64dus reads=%I64d read_allocs=%I64d disconnects",
+		nClients, m_accepts.GetCount(::GetTickCount()),
+		m_totalTraffic.m_llMessagesIn, m_totalTraffic.m_llBytesIn,
+		m_totalTraffic.m_llMessagesOut, m_totalTraffic.m_llBytesOut,
+		m_totalTraffic.m_llSendTicks * 1000000 / frequency.QuadPart,
+		static_cast<int>(m_lMaxSendWaiting), m_commandLatency.GetCount(),
+		m_commandLatency.GetPercentile(50), m_commandLatency.GetPercentile(99), m_commandLatency.GetMax(),
+		m_llReads, m_llReadAllocations);
+	for (int i = 0; i < DISCONNECT_REASON_COUNT; i++)
+	{
+		strLine.AppendFormat(" %s=%u", GetDisconnectReasonName(static_cast<DisconnectReason>(i)), m_aDisconnects[i]);
+	}
+	m_csMetrics.Leave();
+
+	strLine.Append("\n");
+	::OutputDebugStringA(strLine);
+}
+
+void SocketService::LockSend()
+{
+	LONG lWaiting = ::InterlockedIncrement(&m_lSendWaiting);
+	m_csSendString.Enter();
+	::InterlockedDecrement(&m_lSendWaiting);
+	if (lWaiting > m_lMaxSendWaiting)
+	{
+		m_lMaxSendWaiting = lWaiting;
+	}
+}
+
+void SocketService::UnlockSend()
+{
+	m_csSendString.Leave();
+}
+
+void SocketService::CountReceived(CSocketManager* pClient, DWORD dwCount)
+{
+	m_csMetrics.Enter();
+	m_aConnections[pClient->GetId()].m_traffic.m_llBytesIn += dwCount;
+	m_totalTraffic.m_llBytesIn += dwCount;
+	m_llReads++;
+	m_csMetrics.Leave();
+}
+
+void SocketService::CountReadAllocations(LONGLONG llAllocations)
+{
+	m_csMetrics.Enter();
+	m_llReadAllocations += llAllocations;
+	m_csMetrics.Leave();
+}
+
+void SocketService::SetDisconnectReason(CSocketManager* pClient, DisconnectReason reason)
+{
+	m_csMetrics.Enter();
+	ConnectionMetrics& metrics = m_aConnections[pClient->GetId()];
+	if (metrics.m_reason == DISCONNECT_REASON_COUNT)
+	{
+		metrics.m_reason = reason;
+	}
+	m_csMetrics.Leave();
+}
+
+void SocketService::CompleteHandshake(CSocketManager* pClient, const CStringA& strResponse, bool bDeflate)
+{
+	LockSend();
+	WriteAll(*pClient, strResponse, strResponse.GetLength());
+	pClient->SetHandshakeComplete(bDeflate);
+	UnlockSend();
+
+	if (pClient->IsAuthenticated())
+	{
+		m_pCallback->OnConnect();
+	}
+}
+
+bool SocketService::Authenticate(CSocketManager* pClient, const char* utf8Line, int nLength)
+{
+	static const int AUTH_COMMAND_LENGTH = sizeof(AUTH_COMMAND) - 1;
+	bool bValid = !m_strToken.IsEmpty() && nLength >= AUTH_COMMAND_LENGTH &&
+		memcmp(utf8Line, AUTH_COMMAND, AUTH_COMMAND_LENGTH) == 0 &&
+		IsSameToken(utf8Line + AUTH_COMMAND_LENGTH, nLength - AUTH_COMMAND_LENGTH, m_strToken, m_strToken.GetLength());
+	if (!bValid)
+	{
+		SetDisconnectReason(pClient, DISCONNECT_UNAUTHENTICATED);
+		return false;
+	}
+
+	LockSend();
+	pClient->SetAuthenticated(true);
+	UnlockSend();
+
+	Json::Value response(Json::objectValue);
+	response["command"] = "auth";
+	response["status"] = "ok";
+	SendTo(pClient->GetId(), response);
+	m_pCallback->OnConnect();
+	return true;
+}
+
+bool SocketService::SendRaw(CSocketManager* pClient, const char* lpData, int nLength)
+{
+	LockSend();
+	bool bSent = WriteAll(*pClient, lpData, nLength);
+	UnlockSend();
+	return bSent;
+}
+
+bool SocketService::WriteAll(CSocketManager& client, const char* lpData, int nLength, DWORD dwTimeout)
+{
+	LARGE_INTEGER start, end;
+	::QueryPerformanceCounter(&start);
+	DWORD dwStart = ::GetTickCount();
+	TrafficCounters sent;
+	bool bSent = true;
+	// send() may accept only a part of the buffer.
+	while (nLength > 0)
+	{
+		DWORD dwWritten = client.WriteComm(reinterpret_cast<LPBYTE>(const_cast<char*>(lpData)), nLength,
+			GetRemainingTime(dwStart, dwTimeout));
+		if (dwWritten == static_cast<DWORD>(-1L) || dwWritten == 0)
+		{
+			bSent = false;
+			break;
+		}
+		lpData += dwWritten;
+		nLength -= dwWritten;
+		sent.m_llBytesOut += dwWritten;
+	}
+	::QueryPerformanceCounter(&end);
+	sent.m_llMessagesOut = bSent ? 1 : 0;
+	sent.m_llSendTicks = end.QuadPart - start.QuadPart;
+
+	m_csMetrics.Enter();
+	m_aConnections[client.GetId()].m_traffic.Add(sent);
+	m_totalTraffic.Add(sent);
+	m_csMetrics.Leave();
+
+	if (!bSent)
+	{
+		// The client would get a truncated message, drop it. Its I/O thread notices
+		// and reports the disconnection.
+		SetDisconnectReason(&client, DISCONNECT_SEND_FAILED);
+		client.ShutdownComm(SD_BOTH);
+	}
+	return bSent;
+}
+
+int SocketService::GetClientCount() const
+{
+	int count = 0;
+	for(int i=0; i<MAX_CONNECTION; i++)
+	{
+		if (m_SocketManager[i].IsOpen() && !IsListener(&m_SocketManager[i]))
+		{
+			++count;
+		}
+	}
+	return count;
+}
+
+void SocketService::OnCommandReceived(int nClientId, char* utf8Command)
+{
+	// What the command allocates belongs to the command, not to the read.
+	bool bCountAllocations = AllocationCounter::Enable(false);
+	LARGE_INTEGER start, end, frequency;
+	::QueryPerformanceCounter(&start);
+	m_pCallback->OnCommandReceived(nClientId, utf8Command);
+	::QueryPerformanceCounter(&end);
+	AllocationCounter::Enable(bCountAllocations);
+	::QueryPerformanceFrequency(&frequency);
+
+	// The latency of the commands answered on the I/O thread, which most are.
+	m_csMetrics.Enter();
+	m_aConnections[nClientId].m_traffic.m_llMessagesIn++;
+	m_totalTraffic.m_llMessagesIn++;
+	m_commandLatency.Add((end.QuadPart - start.QuadPart) * 1000000 / frequency.QuadPart);
+	m_csMetrics.Leave();
+}
+
+void SocketService::OnEvent(UINT uEvent, CSocketManager* pManager)
+{
+	switch(uEvent)
+	{
+	case EVT_CONSUCCESS:
+		m_csServer.Enter();
+		if (!m_bStarted)
+		{
+			m_csServer.Leave();
+			break;
+		}
+		// When a new connection is accepted, the server will be closed. So we need to start a new server.
+		StartNewServer(pManager->GetTransport(), pManager);
+		m_csServer.Leave();
+
+		m_csMetrics.Enter();
+		{
+			ConnectionMetrics& metrics = m_aConnections[pManager->GetId()];
+			metrics.m_bConnected = true;
+			metrics.m_dwConnectTime = ::GetTickCount();
+			metrics.m_reason = DISCONNECT_REASON_COUNT;
+			metrics.m_traffic.Clear();
+			m_accepts.Add(metrics.m_dwConnectTime);
+		}
+		m_csMetrics.Leave();
+
+		// A new client gets the full device list broadcasts in JSON until it asks for others.
+		LockSend();
+		pManager->NewSession();
+		pManager->SetSubscribed(false);
+		pManager->SetFormat(MESSAGE_FORMAT_JSON);
+		pManager->SetWebSocket(pManager->GetTransport() == TRANSPORT_WEBSOCKET);
+		pManager->SetAuthenticated(!m_bAuthRequired);
+		UnlockSend();
+		// A client is connected once its WebSocket handshake is complete and it has
+		// presented the token.
+		if (pManager->IsReady())
+		{
+			m_pCallback->OnConnect();
+		}
+		break;
+	case EVT_CONFAILURE: // Fall through
+	case EVT_CONDROP:
+		TRACE(_T("Connection failed or abandoned\n"));
+		m_csServer.Enter();
+		if (!m_bStarted)
+		{
+			m_csServer.Leave();
+			break;
+		}
+		// We are running on the I/O thread of pManager, so only close the socket here. 
+		// The thread will be reaped by StartNewServer when the slot is reused, or by Stop.
+		pManager->CloseComm();
+
+		m_csMetrics.Enter();
+		{
+			ConnectionMetrics& metrics = m_aConnections[pManager->GetId()];
+			if (metrics.m_bConnected)
+			{
+				metrics.m_bConnected = false;
+				m_aDisconnects[(metrics.m_reason == DISCONNECT_REASON_COUNT) ? DISCONNECT_CLIENT : metrics.m_reason]++;
+			}
+		}
+		m_csMetrics.Leave();
+
+		if (m_pCurServer[pManager->GetTransport()] == pManager)
+		{
+			m_pCurServer[pManager->GetTransport()] = NULL;
+		}
+		// A slot has been freed, restart the servers which had none left.
+		for (int i = 0; i < TRANSPORT_COUNT; i++)
+		{
+			if (m_aTransportEnabled[i] && m_pCurServer[i] == NULL)
+			{
+				StartNewServer(static_cast<SocketTransport>(i), pManager);
+			}
+		}
+		m_csServer.Leave();
+		m_pCallback->OnDisconnect();
+		break;
+	case EVT_ZEROLENGTH:
+		TRACE( _T("Zero Length Message\n") );
+		break;
+	default:
+		TRACE(_T("Unknown Socket event\n"));
+		break;
+	}
+}
+
+// 
+// SocketService::CSocketManager
+//
+
+void SocketService::CSocketManager::SetReceiveBufferSize(int nInitialSize, int nMaxSize)
+{
+	// The parser takes the command lines, the buffer of the thread the WebSocket frames.
+	m_parser.SetBufferSize(nInitialSize, nMaxSize);
+	SetReadBufferSize(m_parser.GetBufferSize(), max(nMaxSize, m_parser.GetBufferSize()));
+}
+
+LPBYTE SocketService::CSocketManager::GetReadBuffer(DWORD& dwSize)
+{
+	// The command lines are parsed where they are received. The WebSocket frames are
+	// read into the buffer of the thread, their payload is copied to the parser.
+	if (m_bWebSocket)
+	{
+		return NULL;
+	}
+	return reinterpret_cast<LPBYTE>(m_parser.GetWriteBuffer(dwSize));
+}
+
+void SocketService::CSocketManager::OnDataReceived(const LPBYTE lpBuffer, DWORD dwCount)
+{
+	if (dwCount <= 0)
+	{
+		return;
+	}
+
+	// Handle the data on the I/O thread directly. The callback is responsible for 
+	// marshalling anything which touches the UI to the UI thread.
+	m_pParent->CountReceived(this, dwCount);
+
+	bool bCountAllocations = AllocationCounter::Enable(true);
+	LONGLONG llAllocations = AllocationCounter::GetThreadCount();
+	ReceiveData(reinterpret_cast<const char*>(lpBuffer), dwCount);
+	llAllocations = AllocationCounter::GetThreadCount() - llAllocations;
+	AllocationCounter::Enable(bCountAllocations);
+	if (llAllocations > 0)
+	{
+		m_pParent->CountReadAllocations(llAllocations);
+	}
+}
+
+void SocketService::CSocketManager::ReceiveData(const char* lpData, DWORD dwCount)
+{
+	if (!m_bWebSocket)
+	{
+		// In place if it was read into GetReadBuffer()
+		m_parser.Feed(lpData, dwCount, this);
+		return;
+	}
+
+	int nLength = static_cast<int>(dwCount);
+	if (m_bHandshake)
+	{
+		int nUsed = ReadHandshake(lpData, nLength);
+		if (nUsed < 0)
+		{
+			return;
+		}
+		lpData += nUsed;
+		nLength -= nUsed;
+	}
+	if (nLength > 0)
+	{
+		m_wsDecoder.Feed(lpData, nLength, this);
+	}
+}
+
+int SocketService::CSocketManager::ReadHandshake(const char* lpData, int nLength)
+{
+	static const int MAX_HANDSHAKE_LENGTH = 8192;
+
+	// Search for the end of the headers, which may straddle two reads.
+	int nPrevious = m_strHandshake.GetLength();
+	m_strHandshake.Append(lpData, nLength);
+	int nEnd = m_strHandshake.Find("\r\n\r\n", max(0, nPrevious - 3));
+	if (nEnd < 0)
+	{
+		if (m_strHandshake.GetLength() > MAX_HANDSHAKE_LENGTH)
+		{
+			static const char TOO_LARGE[] = "HTTP/1.1 431 Request Header Fields Too Large\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+			m_pParent->SetDisconnectReason(this, DISCONNECT_HANDSHAKE_REFUSED);
+			m_pParent->SendRaw(this, TOO_LARGE, sizeof(TOO_LARGE) - 1);
+			Drop();
+		}
+		return -1;
+	}
+
+	CStringA strResponse;
+	bool bDeflate = false;
+	bool bAccepted = WebSocket::Handshake(m_strHandshake.Left(nEnd), m_pParent->m_strAllowedOrigins, strResponse, bDeflate);
+	m_strHandshake.Empty();
+	if (!bAccepted)
+	{
+		m_pParent->SetDisconnectReason(this, DISCONNECT_HANDSHAKE_REFUSED);
+		m_pParent->SendRaw(this, strResponse, strResponse.GetLength());
+		Drop();
+		return -1;
+	}
+
+	m_wsDecoder.Reset(bDeflate);
+	m_pParent->CompleteHandshake(this, strResponse, bDeflate);
+	// The rest of the data already belongs to the frames.
+	return nEnd + 4 - nPrevious;
+}
+
+void SocketService::CSocketManager::OnWebSocketMessage(const char* lpData, int nLength, bool bBinary)
+{
+	// Each message is a command line, with or without the line terminator.
+	m_parser.Feed(lpData, nLength, this);
+	m_parser.Feed("\n", 1, this);
+}
+
+void SocketService::CSocketManager::OnWebSocketControl(int nOpcode, const char* lpData, int nLength)
+{
+	switch (nOpcode)
+	{
+	case WebSocket::OPCODE_PING:
+		{
+			MessageBuffer frame;
+			WebSocket::WriteFrame(WebSocket::OPCODE_PONG, false, lpData, nLength, frame);
+			m_pParent->SendRaw(this, frame.GetData(), frame.GetLength());
+		}
+		break;
+	case WebSocket::OPCODE_CLOSE:
+		{
+			// Echo the status code of the client, then close.
+			int nStatusCode = (nLength >= 2) ? ((static_cast<unsigned char>(lpData[0]) << 8) | static_cast<unsigned char>(lpData[1])) : WebSocket::STATUS_NORMAL;
+			Close(nStatusCode);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void SocketService::CSocketManager::OnWebSocketError(int nStatusCode)
+{
+	m_pParent->SetDisconnectReason(this, DISCONNECT_PROTOCOL_ERROR);
+	Close(nStatusCode);
+}
+
+void SocketService::CSocketManager::Close(int nStatusCode)
+{
+	MessageBuffer frame;
+	WebSocket::WriteClose(nStatusCode, frame);
+	m_pParent->SendRaw(this, frame.GetData(), frame.GetLength());
+	Drop();
+}
+
+void SocketService::CSocketManager::Drop()
+{
+	// The same as when the client disconnects: the socket is closed and the read loop ends.
+	OnEvent(EVT_CONDROP, NULL);
+}
+
+void SocketService::CSocketManager::OnEvent(UINT uEvent, LPVOID lpvData)
+{
+	if (uEvent == EVT_CONSUCCESS)
+	{
+		// Don't let the previous client on this slot leak a partial command to the new one.
+		m_parser.Reset();
+	}
+	m_pParent->OnEvent(uEvent, this);
+}
+
+void SocketService::CSocketManager::OnCommand(char* utf8Command, int nLength)
+{
+	if (!m_bAuthenticated)
+	{
+		// The first line must present the token, before anything is parsed as a command.
+		// The lines read along with a wrong one are ignored, the socket is closed by then.
+		if (IsOpen() && !m_pParent->Authenticate(this, utf8Command, nLength))
+		{
+			Drop();
+		}
+		return;
+	}
+	m_pParent->OnCommandReceived(m_nId, utf8Command);
 }
\ No newline at end of file
@@ -1,70 +1,340 @@
-// SocketService.h: interface for the SocketService class.
-//
-//////////////////////////////////////////////////////////////////////
-
-#pragma once
-
-#include "SocketComm.h"
-
-class SocketServiceCallback
-{
-public:
-	virtual void OnConnect() = 0;
-	virtual void OnDisconnect() = 0;
-	virtual void OnStringReceived(const char* utf8String) = 0;
-};
-
-class SocketService  
-{
-public:
-	SocketService(SocketServiceCallback* pCallback)
-		: m_bStarted(false)
-		, m_pCallback(pCallback)
-		, m_pCurServer(NULL)
-	{
-	}
-
-	virtual ~SocketService() 
-	{
-	}
-
-	void Start();
-	void Stop();
-
-	// Send message to all clients.
-	void SendString(const char* utf8String);
-
-	// Number of clients connected
-	int GetClientCount() const;
-private:
-	class CSocketManager;
-
-	void OnStringReceived(const char* utf8String);
-	void OnEvent(UINT uEvent, CSocketManager* pManager);
-
-	bool StartNewServer();
-
-	// Save port number to drvier_manager.ini
-	void SavePortNum(const CString& strPort) const;
-private:
-	class CSocketManager: public CSocketComm 
-	{
-	public:
-		CSocketManager() : m_pParent(NULL) {}
-		virtual ~CSocketManager() {}
-
-		void SetParent(SocketService* pParent) { m_pParent = pParent; }
-
-		void OnDataReceived(const LPBYTE lpBuffer, DWORD dwCount) override;
-		virtual void OnEvent(UINT uEvent, LPVOID lpvData) override;
-	private:
-		SocketService* m_pParent;
-	};
-
-	bool m_bStarted;
-	SocketServiceCallback* m_pCallback;
-	static const unsigned int MAX_CONNECTION = 2;
-	CSocketManager m_SocketManager[MAX_CONNECTION];
-	CSocketManager* m_pCurServer;
-	CCriticalSection m_csSendString;
+// SocketService.h: interface for the SocketService class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "SocketComm.h"
+#include "CommandParser.h"
+#include "MessageEncoder.h"
+#include "WebSocket.h"
+#include "SocketMetrics.h"
+
+// The transports the clients can connect through. Each enabled transport has its own
+// listening connection slot, the accepted connections are served alike.
+enum SocketTransport
+{
+	TRANSPORT_TCP,		// 127.0.0.1, the port is saved to driver_manager.ini
+	TRANSPORT_UNIX,		// Unix domain socket next to driver_manager.ini (Windows 10 1803+)
+	TRANSPORT_PIPE,		// Named pipe \\.\pipe\FirefoxOS-USB-Daemon
+	TRANSPORT_WEBSOCKET,	// WebSocket on 127.0.0.1, the port is saved as ws_port
+	TRANSPORT_COUNT
+};
+
+/**
+ * Callbacks from SocketService.
+ * Note: all the callbacks are invoked on the socket I/O threads, not on the UI thread.
+ */
+class SocketServiceCallback
+{
+public:
+	virtual void OnConnect() = 0;
+	virtual void OnDisconnect() = 0;
+	/**
+	 * A complete command line has been received from a client.
+	 * @param nClientId Identifies the client, pass it to SocketService::SendTo to reply.
+	 * @param utf8Command Points into the receive buffer of the client, only valid during
+	 *                    the call. It may be modified in place.
+	 */
+	virtual void OnCommandReceived(int nClientId, char* utf8Command) = 0;
+};
+
+class SocketService  
+{
+public:
+	SocketService(SocketServiceCallback* pCallback)
+		: m_bStarted(false)
+		, m_pCallback(pCallback)
+		, m_bAuthRequired(false)
+		, m_nEncodedMessages(0)
+		, m_llEncodedBytes(0)
+		, m_llEncodeTicks(0)
+		, m_llReads(0)
+		, m_llReadAllocations(0)
+		, m_lSendWaiting(0)
+		, m_lMaxSendWaiting(0)
+	{
+		memset(m_aDisconnects, 0, sizeof(m_aDisconnects));
+		for (int i = 0; i < TRANSPORT_COUNT; i++)
+		{
+			m_aTransportEnabled[i] = false;
+			m_pCurServer[i] = NULL;
+		}
+	}
+
+	virtual ~SocketService() 
+	{
+	}
+
+	// Start listening on the transports enabled by [socket] transports in driver_manager.ini,
+	// e.g. "tcp,unix,pipe,ws". TCP is used if none of them can be started.
+	void Start();
+
+	// Send a "shutdown" event to the clients and close the connections once they have
+	// taken it, or after STOP_TIMEOUT. Then join the I/O threads.
+	void Stop();
+
+	// Send message to all clients which have not subscribed to the device deltas.
+	void SendToAll(const Json::Value &message);
+
+	// Send message to all clients which have subscribed to the device deltas.
+	void SendToSubscribers(const Json::Value &message);
+
+	// Send message to a single client.
+	bool SendTo(int nClientId, const Json::Value &message);
+
+	/**
+	 * The session of the client on a connection slot, which changes each time a client
+	 * connects to the slot. A reply sent later, e.g. from a worker thread, gives it to
+	 * SendTo so that it can't reach the next client of the slot.
+	 */
+	UINT GetClientSession(int nClientId);
+	bool SendTo(int nClientId, UINT nSession, const Json::Value &message);
+
+	/**
+	 * Subscribe a client to the device deltas.
+	 * makeSnapshot is called with the send lock held and its result is sent to the client
+	 * before any delta, so that no delta can slip between the snapshot and the subscription.
+	 */
+	bool Subscribe(int nClientId, const std::function<Json::Value()>& makeSnapshot);
+
+	// Switch a client back to the full device list broadcasts.
+	void Unsubscribe(int nClientId);
+
+	// Change the encoding of the messages sent to a client. New clients get JSON.
+	bool SetClientFormat(int nClientId, MessageFormat format);
+
+	// Get the number of messages and bytes serialized and the time spent on it.
+	void GetSerializationStats(Json::Value &stats);
+
+	/**
+	 * Get the connection metrics: the traffic of each client and of all of them, the
+	 * command latency, the accept rate, the send lock queue and the disconnect reasons.
+	 */
+	void GetStats(Json::Value &stats);
+
+	// Write a one line summary of the metrics with OutputDebugString, in release builds too.
+	void LogStats();
+
+	// Number of clients connected
+	int GetClientCount() const;
+private:
+	class CSocketManager;
+
+	void OnCommandReceived(int nClientId, char* utf8Command);
+	void OnEvent(UINT uEvent, CSocketManager* pManager);
+
+	// Read the enabled transports, the receive buffer sizes and the client token from driver_manager.ini
+	void LoadTransports();
+
+	// Read the token from the first line of a file, empty if there is none.
+	static CStringA ReadTokenFile(LPCTSTR szFileName);
+
+	// Start listening for the transport on a free connection slot other than pExclude.
+	// Must be called with m_csServer held.
+	bool StartNewServer(SocketTransport transport, CSocketManager* pExclude = NULL);
+
+	// Create the listening TCP socket of the transport on the first available port.
+	bool CreateTcpServer(SocketTransport transport, CSocketManager* pServer);
+
+	// Whether the connection slot is listening instead of serving a client.
+	bool IsListener(const CSocketManager* pManager) const;
+
+	// Path of the Unix domain socket
+	static CString GetUnixSocketPath();
+
+	// Save port number to drvier_manager.ini
+	void SavePortNum(SocketTransport transport, const CString& strPort);
+
+	// Send message to the clients with the given subscription state.
+	void SendToClients(const Json::Value &message, bool bSubscribers);
+	// Send message to a client, if it is still in the session *pnSession unless that is NULL.
+	bool SendToClient(int nClientId, const UINT* pnSession, const Json::Value &message);
+
+	// How a message is put on the wire for a client
+	enum MessageFraming
+	{
+		FRAMING_NONE,					// The encoded message as it is
+		FRAMING_WEBSOCKET,				// A WebSocket frame
+		FRAMING_WEBSOCKET_DEFLATE,		// A WebSocket frame, compressed if it is large enough
+		FRAMING_COUNT
+	};
+
+	// Serialize a message into m_buffers[format][framing] unless it is already there.
+	// Must be called with m_csSendString held.
+	const MessageBuffer& Encode(const Json::Value &message, MessageFormat format, MessageFraming framing,
+		bool aEncoded[][FRAMING_COUNT]);
+
+	// Accept a WebSocket client once its handshake is received, called on its I/O thread.
+	// The response is sent and the client starts to receive messages atomically.
+	void CompleteHandshake(CSocketManager* pClient, const CStringA& strResponse, bool bDeflate);
+
+	// Take and release m_csSendString, counting the threads queued for it.
+	void LockSend();
+	void UnlockSend();
+
+	// Account data received from a client on its I/O thread.
+	void CountReceived(CSocketManager* pClient, DWORD dwCount);
+	// Account heap allocations made while handling a read, there should be none.
+	void CountReadAllocations(LONGLONG llAllocations);
+
+	/**
+	 * Check the first line of a client against the token, on its I/O thread. The client
+	 * gets the messages from then on if it matches, else it must be dropped.
+	 * @return false if the client presented no token or a wrong one.
+	 */
+	bool Authenticate(CSocketManager* pClient, const char* utf8Line, int nLength);
+
+	// Remember why the client is about to be dropped, unless a reason is already known.
+	void SetDisconnectReason(CSocketManager* pClient, DisconnectReason reason);
+
+	// Send data as it is to a client, e.g. an HTTP response or a WebSocket control frame.
+	bool SendRaw(CSocketManager* pClient, const char* lpData, int nLength);
+
+	// Write the whole buffer to a client within dwTimeout milliseconds, or drop the client.
+	// Must be called with m_csSendString held.
+	bool WriteAll(CSocketManager& client, const char* lpData, int nLength, DWORD dwTimeout = SEND_TIMEOUT);
+private:
+	class CSocketManager: public CSocketComm, public CommandParserCallback, public WebSocketCallback
+	{
+	public:
+		CSocketManager() : m_pParent(NULL), m_nId(-1), m_transport(TRANSPORT_TCP), m_bSubscribed(false), m_format(MESSAGE_FORMAT_JSON),
+			m_bWebSocket(false), m_bHandshake(false), m_bDeflate(false), m_bAuthenticated(true), m_nSession(0) {}
+		virtual ~CSocketManager() {}
+
+		void SetParent(SocketService* pParent, int nId) { m_pParent = pParent; m_nId = nId; }
+		int GetId() const { return m_nId; }
+		// Initial and maximum size of the receive buffers, before the thread starts.
+		void SetReceiveBufferSize(int nInitialSize, int nMaxSize);
+
+		// Access with SocketService::m_csServer held.
+		SocketTransport GetTransport() const { return m_transport; }
+		void SetTransport(SocketTransport transport) { m_transport = transport; }
+
+		// Access with SocketService::m_csSendString held.
+		bool IsSubscribed() const { return m_bSubscribed; }
+		void SetSubscribed(bool bSubscribed) { m_bSubscribed = bSubscribed; }
+		MessageFormat GetFormat() const { return m_format; }
+		void SetFormat(MessageFormat format) { m_format = format; }
+		UINT GetSession() const { return m_nSession; }
+		void NewSession() { m_nSession++; }
+		// A client receives nothing until its WebSocket handshake is complete and it has
+		// presented the token.
+		bool IsReady() const { return !m_bHandshake && m_bAuthenticated; }
+		MessageFraming GetFraming() const { return !m_bWebSocket ? FRAMING_NONE : m_bDeflate ? FRAMING_WEBSOCKET_DEFLATE : FRAMING_WEBSOCKET; }
+		void SetWebSocket(bool bWebSocket) { m_bWebSocket = m_bHandshake = bWebSocket; m_bDeflate = false; m_strHandshake.Empty(); }
+		void SetHandshakeComplete(bool bDeflate) { m_bHandshake = false; m_bDeflate = bDeflate; }
+		// Written with SocketService::m_csSendString held, read without it on the I/O thread.
+		bool IsAuthenticated() const { return m_bAuthenticated; }
+		void SetAuthenticated(bool bAuthenticated) { m_bAuthenticated = bAuthenticated; }
+
+		virtual LPBYTE GetReadBuffer(DWORD& dwSize) override;
+		virtual void OnDataReceived(const LPBYTE lpBuffer, DWORD dwCount) override;
+		virtual void OnEvent(UINT uEvent, LPVOID lpvData) override;
+
+		// Overrides CommandParserCallback
+		virtual void OnCommand(char* utf8Command, int nLength) override;
+
+		// Overrides WebSocketCallback
+		virtual void OnWebSocketMessage(const char* lpData, int nLength, bool bBinary) override;
+		virtual void OnWebSocketControl(int nOpcode, const char* lpData, int nLength) override;
+		virtual void OnWebSocketError(int nStatusCode) override;
+	private:
+		// Parse a read, directly or after unwrapping the WebSocket frames.
+		void ReceiveData(const char* lpData, DWORD dwCount);
+		// Collect the HTTP upgrade request, returns the number of bytes used or -1 if the client is refused.
+		int ReadHandshake(const char* lpData, int nLength);
+		// Close the WebSocket connection with the status code.
+		void Close(int nStatusCode);
+		// Drop the connection from the I/O thread.
+		void Drop();
+
+		SocketService* m_pParent;
+		// Index of the connection slot, used as the client ID.
+		int m_nId;
+		// The transport the slot is listening on or the client connected through
+		SocketTransport m_transport;
+		// Each connection keeps its own incomplete command line. The parser owns the
+		// receive buffer, the socket reads into it unless the client uses WebSocket.
+		CommandParser m_parser;
+		// Whether the client receives device deltas instead of full device lists
+		bool m_bSubscribed;
+		// The encoding of the messages sent to the client
+		MessageFormat m_format;
+		// Whether the client connected through the WebSocket transport, is still in
+		// the handshake, and negotiated permessage-deflate
+		bool m_bWebSocket;
+		bool m_bHandshake;
+		bool m_bDeflate;
+		// The HTTP upgrade request received so far
+		CStringA m_strHandshake;
+		WebSocketDecoder m_wsDecoder;
+		// Whether the client has presented the token, or none is required
+		bool m_bAuthenticated;
+		// Incremented for each client connecting to the slot
+		UINT m_nSession;
+	};
+
+	// Metrics of the client on a connection slot
+	class ConnectionMetrics
+	{
+	public:
+		ConnectionMetrics() : m_bConnected(false), m_dwConnectTime(0), m_reason(DISCONNECT_REASON_COUNT) {}
+
+		bool m_bConnected;
+		DWORD m_dwConnectTime;
+		// DISCONNECT_REASON_COUNT until the reason is known
+		DisconnectReason m_reason;
+		TrafficCounters m_traffic;
+	};
+
+	// A client which doesn't take a message within this time is dropped.
+	static const DWORD SEND_TIMEOUT = 5000;
+	// How long Stop waits for the clients to take the shutdown event and hang up
+	static const DWORD STOP_TIMEOUT = 1000;
+
+	bool m_bStarted;
+	SocketServiceCallback* m_pCallback;
+	// Connection slots, including one listening slot per enabled transport
+	static const unsigned int MAX_CONNECTION = 8;
+	CSocketManager m_SocketManager[MAX_CONNECTION];
+	bool m_aTransportEnabled[TRANSPORT_COUNT];
+	// The listening slot of each transport, NULL if it is not listening
+	CSocketManager* m_pCurServer[TRANSPORT_COUNT];
+	// The port of each TCP based transport last saved to driver_manager.ini
+	CString m_strPort[TRANSPORT_COUNT];
+	// Web origins allowed to open a WebSocket, [socket] ws_origins in driver_manager.ini
+	CStringA m_strAllowedOrigins;
+	// Whether the clients must present m_strToken before sending commands. No client
+	// is accepted if it is required but couldn't be read. Both are set by Start.
+	bool m_bAuthRequired;
+	CStringA m_strToken;
+	// Protects m_bStarted, m_pCurServer and the connection slots against the I/O threads.
+	CCriticalSection m_csServer;
+	CCriticalSection m_csSendString;
+
+	// Reused for every message sent, protected by m_csSendString
+	MessageBuffer m_buffers[MESSAGE_FORMAT_COUNT][FRAMING_COUNT];
+	MessageBuffer m_scratchBuffer;
+	DeflateEncoder m_deflateEncoder;
+
+	// Serialization statistics, protected by m_csSendString
+	int m_nEncodedMessages;
+	LONGLONG m_llEncodedBytes;
+	LONGLONG m_llEncodeTicks;
+
+	// Connection metrics, protected by m_csMetrics. It is taken last, with or without the other locks.
+	CCriticalSection m_csMetrics;
+	ConnectionMetrics m_aConnections[MAX_CONNECTION];
+	TrafficCounters m_totalTraffic;
+	LatencyHistogram m_commandLatency;
+	RateCounter m_accepts;
+	unsigned int m_aDisconnects[DISCONNECT_REASON_COUNT];
+	// Reads handled, and the heap allocations made handling them besides the command
+	// handlers, counted in debug builds only
+	LONGLONG m_llReads;
+	LONGLONG m_llReadAllocations;
+	// Threads waiting for m_csSendString, and the most seen at once
+	volatile LONG m_lSendWaiting;
+	volatile LONG m_lMaxSendWaiting;
 };
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include "StdAfx.h"
+#include "Task.h"
+
+// Enough for the bursts of tasks the I/O threads post when many clients come and go
+static const LONG MAX_FREE_TASK_BLOCKS = 64;
+
+BlockPool Task::s_pool(Task::POOLED_SIZE, MAX_FREE_TASK_BLOCKS);
+volatile LONG Task::s_lLargeAllocations = 0;
+
+//
+// BlockPool
+//
+
+BlockPool::BlockPool(size_t nBlockSize, LONG lMaxFree)
+	: m_nBlockSize(max(nBlockSize, sizeof(SLIST_ENTRY)))
+	, m_lMaxFree(lMaxFree)
+	, m_lHeapAllocations(0)
+{
+	::InitializeSListHead(&m_freeList);
+}
+
+BlockPool::~BlockPool(void)
+{
+	PSLIST_ENTRY pEntry = ::InterlockedFlushSList(&m_freeList);
+	while (pEntry != NULL)
+	{
+		PSLIST_ENTRY pNext = pEntry->Next;
+		::_aligned_free(pEntry);
+		pEntry = pNext;
+	}
+}
+
+void* BlockPool::Alloc()
+{
+	PSLIST_ENTRY pEntry = ::InterlockedPopEntrySList(&m_freeList);
+	if (pEntry != NULL)
+	{
+		return pEntry;
+	}
+	::InterlockedIncrement(&m_lHeapAllocations);
+	// The list entries must be aligned like the heap blocks of the platform.
+	return ::_aligned_malloc(m_nBlockSize, MEMORY_ALLOCATION_ALIGNMENT);
+}
+
+void BlockPool::Free(void* pBlock)
+{
+	if (pBlock == NULL)
+	{
+		return;
+	}
+	if (::QueryDepthSList(&m_freeList) >= m_lMaxFree)
+	{
+		::_aligned_free(pBlock);
+		return;
+	}
+	::InterlockedPushEntrySList(&m_freeList, static_cast<PSLIST_ENTRY>(pBlock));
+}
+
+//
+// Task
+//
+
+void Task::Reset()
+{
+	if (m_pOps == NULL)
+	{
+		return;
+	}
+	m_pOps->pfnDestroy(m_pFunc);
+	if (m_storage == STORAGE_POOLED)
+	{
+		s_pool.Free(m_pFunc);
+	}
+	else if (m_storage == STORAGE_HEAP)
+	{
+		::operator delete(m_pFunc);
+	}
+	m_pOps = NULL;
+	m_pFunc = NULL;
+	m_storage = STORAGE_INLINE;
+}
+
+LONG Task::GetHeapAllocations()
+{
+	return s_pool.GetHeapAllocations() + s_lLargeAllocations;
+}
+
+void Task::MoveFrom(Task& other)
+{
+	m_pOps = other.m_pOps;
+	m_storage = other.m_storage;
+	if (m_pOps != NULL && m_storage == STORAGE_INLINE)
+	{
+		m_pFunc = m_inline;
+		m_pOps->pfnMoveTo(other.m_pFunc, m_pFunc);
+	}
+	else
+	{
+		// A block changes hands as it is.
+		m_pFunc = other.m_pFunc;
+	}
+	other.m_pOps = NULL;
+	other.m_pFunc = NULL;
+	other.m_storage = STORAGE_INLINE;
+}
+
+void* Task::Allocate(size_t nSize)
+{
+	if (nSize <= POOLED_SIZE)
+	{
+		m_storage = STORAGE_POOLED;
+		return s_pool.Alloc();
+	}
+	m_storage = STORAGE_HEAP;
+	::InterlockedIncrement(&s_lLargeAllocations);
+	return ::operator new(nSize);
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <new>
+#include <utility>
+
+/**
+ * Fixed size memory blocks recycled through a lock-free list (an interlocked SList), so
+ * that any thread can take and return blocks without a lock or, once the pool is warm,
+ * a heap allocation. At most lMaxFree blocks are kept, the others go back to the heap.
+ */
+class BlockPool
+{
+public:
+	BlockPool(size_t nBlockSize, LONG lMaxFree);
+	~BlockPool(void);
+
+	void* Alloc();
+	void Free(void* pBlock);
+
+	// Blocks taken from the heap because none was free
+	LONG GetHeapAllocations() const { return m_lHeapAllocations; }
+
+private:
+	// Not copyable
+	BlockPool(const BlockPool&);
+	BlockPool& operator=(const BlockPool&);
+
+	SLIST_HEADER m_freeList;
+	size_t m_nBlockSize;
+	LONG m_lMaxFree;
+	volatile LONG m_lHeapAllocations;
+};
+
+/**
+ * A function run once or more without arguments, like std::function<void()> but move
+ * only and without a heap allocation in the common case: a functor of up to INLINE_SIZE
+ * bytes, e.g. a lambda capturing this and a CStringA, is stored in the task itself,
+ * and one of up to POOLED_SIZE bytes in a block of a BlockPool. Only larger ones are
+ * allocated on the heap.
+ */
+class Task
+{
+public:
+	static const size_t INLINE_SIZE = 8 * sizeof(void*);
+	static const size_t POOLED_SIZE = 256;
+
+	Task(void) : m_pOps(NULL), m_pFunc(NULL), m_storage(STORAGE_INLINE) {}
+
+	template <typename F>
+	Task(F func);
+
+	Task(Task&& other) { MoveFrom(other); }
+
+	~Task(void) { Reset(); }
+
+	Task& operator=(Task&& other)
+	{
+		if (this != &other)
+		{
+			Reset();
+			MoveFrom(other);
+		}
+		return *this;
+	}
+
+	void operator()() { m_pOps->pfnInvoke(m_pFunc); }
+
+	bool IsEmpty() const { return m_pOps == NULL; }
+
+	// Destroy the function, the task is empty then.
+	void Reset();
+
+	// Functors allocated on the heap, because they were too large or the pool was empty
+	static LONG GetHeapAllocations();
+
+private:
+	// Not copyable
+	Task(const Task&);
+	Task& operator=(const Task&);
+
+	enum Storage
+	{
+		STORAGE_INLINE,
+		STORAGE_POOLED,
+		STORAGE_HEAP
+	};
+
+	// What the task does with its functor, one table per functor type
+	struct Ops
+	{
+		void (*pfnInvoke)(void* pFunc);
+		// Move construct the functor at pDest and destroy it at pFunc.
+		void (*pfnMoveTo)(void* pFunc, void* pDest);
+		void (*pfnDestroy)(void* pFunc);
+	};
+
+	template <typename F>
+	struct Impl
+	{
+		static void Invoke(void* pFunc) { (*static_cast<F*>(pFunc))(); }
+		static void MoveTo(void* pFunc, void* pDest)
+		{
+			new (pDest) F(std::move(*static_cast<F*>(pFunc)));
+			static_cast<F*>(pFunc)->~F();
+		}
+		static void Destroy(void* pFunc) { static_cast<F*>(pFunc)->~F(); }
+
+		static const Ops s_ops;
+	};
+
+	void MoveFrom(Task& other);
+	// Memory for a functor which doesn't fit in the task
+	void* Allocate(size_t nSize);
+
+	const Ops* m_pOps;
+	// Points to m_inline or to the pooled or heap block
+	void* m_pFunc;
+	Storage m_storage;
+	union
+	{
+		double m_dAlign;
+		void* m_pAlign;
+		unsigned char m_inline[INLINE_SIZE];
+	};
+
+	static BlockPool s_pool;
+	static volatile LONG s_lLargeAllocations;
+};
+
+template <typename F>
+const Task::Ops Task::Impl<F>::s_ops = { &Task::Impl<F>::Invoke, &Task::Impl<F>::MoveTo, &Task::Impl<F>::Destroy };
+
+template <typename F>
+Task::Task(F func)
+	: m_pOps(&Impl<F>::s_ops)
+{
+	if (sizeof(F) <= INLINE_SIZE && __alignof(F) <= __alignof(double))
+	{
+		m_pFunc = m_inline;
+		m_storage = STORAGE_INLINE;
+	}
+	else
+	{
+		m_pFunc = Allocate(sizeof(F));
+	}
+	new (m_pFunc) F(std::move(func));
+}
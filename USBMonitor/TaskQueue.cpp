@@ -0,0 +1,111 @@
+#include "StdAfx.h"
+#include "TaskQueue.h"
+
+// Enough for the bursts of tasks the I/O threads post when many clients come and go
+static const LONG MAX_FREE_NODES = 64;
+
+BlockPool TaskQueue::s_nodePool(sizeof(TaskQueue::Node), MAX_FREE_NODES);
+
+TaskQueue::TaskQueue(void)
+	: m_pTail(&m_stub)
+	, m_lWakeRequested(0)
+	, m_pHead(&m_stub)
+	, m_pBatchEnd(NULL)
+{
+	m_stub.m_pNext = NULL;
+}
+
+TaskQueue::~TaskQueue(void)
+{
+	// Free the tasks which were never run.
+	Task task;
+	BeginBatch();
+	while (Pop(task))
+	{
+	}
+}
+
+bool TaskQueue::Push(Task task)
+{
+	Node* pNode = new (s_nodePool.Alloc()) Node;
+	pNode->m_task = std::move(task);
+	Link(pNode);
+	// After the link, so that a consumer woken by it finds the node.
+	return ::InterlockedExchange(&m_lWakeRequested, 1) == 0;
+}
+
+void TaskQueue::Link(Node* pNode)
+{
+	pNode->m_pNext = NULL;
+	Node* pPrev = static_cast<Node*>(::InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&m_pTail), pNode));
+	pPrev->m_pNext = pNode;
+}
+
+void TaskQueue::BeginBatch()
+{
+	// Before the tail is read: a task pushed after it asks for the next batch.
+	::InterlockedExchange(&m_lWakeRequested, 0);
+	Node* pTail = m_pTail;
+	// The stub may be the tail with tasks in front of it, when Pop has put it behind the
+	// last one. The batch then ends at the stub, which Pop skips. Only a stub which is
+	// both the head and the tail means that the queue is empty.
+	m_pBatchEnd = (pTail == &m_stub && m_pHead == &m_stub) ? NULL : pTail;
+}
+
+bool TaskQueue::Pop(Task& task)
+{
+	if (m_pBatchEnd == NULL)
+	{
+		return false;
+	}
+
+	Node* pHead = m_pHead;
+	Node* pNext = pHead->m_pNext;
+	if (pHead == &m_stub)
+	{
+		if (pHead == m_pBatchEnd)
+		{
+			// The tasks in front of the stub were the batch.
+			m_pBatchEnd = NULL;
+			return false;
+		}
+		if (pNext == NULL)
+		{
+			// A producer hasn't linked its node yet, it will ask for a wakeup.
+			m_pBatchEnd = NULL;
+			return false;
+		}
+		// Skip the stub.
+		m_pHead = pHead = pNext;
+		pNext = pNext->m_pNext;
+	}
+	if (pNext == NULL)
+	{
+		if (pHead != m_pTail)
+		{
+			// A producer hasn't linked its node yet, it will ask for a wakeup.
+			m_pBatchEnd = NULL;
+			return false;
+		}
+		// pHead is the last node. Put the stub behind it, so that it can be taken.
+		Link(&m_stub);
+		pNext = pHead->m_pNext;
+		if (pNext == NULL)
+		{
+			// A producer swapped the tail before the stub and hasn't linked its node yet.
+			// The next batch ends at the stub, after that node.
+			m_pBatchEnd = NULL;
+			return false;
+		}
+	}
+	m_pHead = pNext;
+
+	if (pHead == m_pBatchEnd)
+	{
+		m_pBatchEnd = NULL;
+	}
+	task = std::move(pHead->m_task);
+	pHead->~Node();
+	s_nodePool.Free(pHead);
+	return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Task.h"
+
+/**
+ * Multiple producer, single consumer queue of tasks, without locks.
+ *
+ * Posting is an exchange of the tail pointer and a store, so a producer never waits for
+ * the consumer or for the other producers. The nodes come from a BlockPool, so posting
+ * a Task which doesn't allocate doesn't allocate either. The consumer takes the tasks in batches:
+ * BeginBatch marks the tasks posted so far, Pop takes them in order, and the tasks
+ * posted meanwhile are left for the next batch. Only the first task posted after a
+ * batch begins asks for a wakeup, so the consumer is woken once per batch.
+ *
+ * The queue is the intrusive one of Dmitry Vyukov: a producer links its node after the
+ * one it swapped out of the tail, and a node briefly appears missing to the consumer
+ * until that link is written. The producer then asks for a wakeup, so the node is
+ * taken by the next batch.
+ */
+class TaskQueue
+{
+public:
+	TaskQueue(void);
+	~TaskQueue(void);
+
+	/**
+	 * Add a task, from any thread.
+	 * @return true if the consumer must be woken up to run a new batch.
+	 */
+	bool Push(Task task);
+
+	// Consumer only: mark the tasks to run in this batch.
+	void BeginBatch();
+
+	// Consumer only: take the next task of the batch, false once the batch is over.
+	bool Pop(Task& task);
+
+	// Nodes allocated on the heap because the pool was empty
+	static LONG GetHeapAllocations() { return s_nodePool.GetHeapAllocations(); }
+
+private:
+	// Not copyable
+	TaskQueue(const TaskQueue&);
+	TaskQueue& operator=(const TaskQueue&);
+
+	struct Node
+	{
+		Node* volatile m_pNext;
+		Task m_task;
+	};
+
+	// Node pool shared by the queues
+	static BlockPool s_nodePool;
+
+	// Link a node after the tail.
+	void Link(Node* pNode);
+
+	// Written by the producers
+	Node* volatile m_pTail;
+	// 1 from the first push of a batch until the consumer begins the next one
+	volatile LONG m_lWakeRequested;
+
+	// Owned by the consumer
+	Node* m_pHead;
+	// The last node of the current batch, NULL when the batch is over
+	Node* m_pBatchEnd;
+	// Stands in the queue when it is empty, so that the producers never touch m_pHead
+	Node m_stub;
+};
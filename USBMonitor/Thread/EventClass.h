@@ -1,39 +1,43 @@
-//
-// EventClass.h: header file
-//
-// Copyright (C) Walter E. Capers.  All rights reserved
-//
-// This source is free to use as you like.  If you make
-// any changes please keep me in the loop.  Email them to
-// walt.capers@comcast.net.
-//
-// PURPOSE:
-//
-//  To implement event signals as a C++ object
-//
-// REVISIONS
-// =======================================================
-// Date: 10.25.07        
-// Name: Walter E. Capers
-// Description: File creation
-//
-// Date:
-// Name:
-// Description:
-//
-//
-#pragma once
-
-class CEventClass
-{
-private:
-	ThreadId_t m_owner;
-	HANDLE m_event;
-public:
-	BOOL m_bCreated;
-	void Set();
-	BOOL Wait();
-	void Reset();
-	CEventClass(void);
-	virtual ~CEventClass(void);
+//
+// EventClass.h: header file
+//
+// Copyright (C) Walter E. Capers.  All rights reserved
+//
+// This source is free to use as you like.  If you make
+// any changes please keep me in the loop.  Email them to
+// walt.capers@comcast.net.
+//
+// PURPOSE:
+//
+//  To implement event signals as a C++ object
+//
+// REVISIONS
+// =======================================================
+// Date: 10.25.07        
+// Name: Walter E. Capers
+// Description: File creation
+//
+// Date:
+// Name:
+// Description:
+//
+//
+#pragma once
+
+// An auto-reset event built on a condition variable. Set only takes the lock
+// when a thread is waiting, and Wait doesn't sleep when the event is set already.
+class CEventClass
+{
+private:
+	volatile ThreadId_t m_owner;
+	volatile LONG m_lSignaled;
+	SRWLOCK m_lock;
+	CONDITION_VARIABLE m_signaled;
+public:
+	BOOL m_bCreated;
+	void Set();
+	BOOL Wait();
+	void Reset();
+	CEventClass(void);
+	virtual ~CEventClass(void);
 };
\ No newline at end of file
@@ -0,0 +1,177 @@
+//
+// RingQueue.cpp: implementation file
+//
+// PURPOSE:
+//
+//  A bounded queue of pointers that any number of threads can push to and pop
+//  from without a lock, see RingQueue.h
+//
+#include "StdAfx.h"
+#include <new>
+#include "RingQueue.h"
+
+CRingQueue::CRingQueue(unsigned int chCapacity)
+	:m_lEnqueuePos(0)
+	,m_lDequeuePos(0)
+	,m_pCells(NULL)
+	,m_lMask(0)
+	,m_lWaiters(0)
+	,m_pPrevious(NULL)
+{
+	LONG lCapacity = 2;
+	while( (unsigned int)lCapacity < chCapacity && lCapacity < 0x40000000 )
+		lCapacity *= 2;
+
+	InitializeSRWLock(&m_lock);
+	InitializeConditionVariable(&m_space);
+
+	// a failed allocation is reported by IsCreated
+	m_pCells = new(std::nothrow) Cell [lCapacity];
+	if( !m_pCells ) return;
+
+	m_lMask = lCapacity - 1;
+	for( LONG i=0; i<lCapacity; i++ )
+	{
+		m_pCells[i].m_lSequence = i;
+		m_pCells[i].m_lpv = NULL;
+	}
+}
+
+CRingQueue::~CRingQueue(void)
+{
+	delete [] m_pCells;
+	delete m_pPrevious;
+}
+
+/**
+*
+* Push
+* claim the cell at the enqueue position, which is free
+* once its sequence number is the position
+*
+**/
+BOOL
+	CRingQueue::Push(LPVOID lpv)
+{
+	LONG lPos = m_lEnqueuePos;
+	Cell *pCell;
+	for(;;)
+	{
+		pCell = &m_pCells[lPos & m_lMask];
+		LONG lDiff = Diff(pCell->m_lSequence,lPos);
+		if( lDiff == 0 )
+		{
+			LONG lPrev = InterlockedCompareExchange(&m_lEnqueuePos,lPos+1,lPos);
+			if( lPrev == lPos )
+				break;
+			lPos = lPrev;
+		}
+		else if( lDiff < 0 )
+		{
+			// the cell still holds the item of the previous lap
+			return FALSE;
+		}
+		else
+		{
+			lPos = m_lEnqueuePos;
+		}
+	}
+	pCell->m_lpv = lpv;
+	// a volatile store is a release: the consumer sees the item before the sequence
+	pCell->m_lSequence = lPos + 1;
+	return TRUE;
+}
+
+/**
+*
+* Pop
+* claim the cell at the dequeue position, which is full
+* once its sequence number is the position + 1
+*
+**/
+BOOL
+	CRingQueue::Pop(LPVOID *plpv)
+{
+	LONG lPos = m_lDequeuePos;
+	Cell *pCell;
+	for(;;)
+	{
+		pCell = &m_pCells[lPos & m_lMask];
+		LONG lDiff = Diff(pCell->m_lSequence,lPos+1);
+		if( lDiff == 0 )
+		{
+			LONG lPrev = InterlockedCompareExchange(&m_lDequeuePos,lPos+1,lPos);
+			if( lPrev == lPos )
+				break;
+			lPos = lPrev;
+		}
+		else if( lDiff < 0 )
+		{
+			return FALSE;
+		}
+		else
+		{
+			lPos = m_lDequeuePos;
+		}
+	}
+	*plpv = pCell->m_lpv;
+	// free the cell for the push of the next lap
+	pCell->m_lSequence = lPos + m_lMask + 1;
+
+	// a full barrier: either a waiting producer sees the free cell,
+	// or it has registered in m_lWaiters and must be woken
+	MemoryBarrier();
+	if( m_lWaiters > 0 )
+		WakeProducers();
+	return TRUE;
+}
+
+/**
+*
+* WaitForSpace
+* a producer registers as waiting before it looks at the
+* queue again, so a pop either frees a cell it sees or
+* wakes it
+*
+**/
+BOOL
+	CRingQueue::WaitForSpace(DWORD dwTimeout)
+{
+	BOOL bSpace = TRUE;
+	InterlockedIncrement(&m_lWaiters);
+	AcquireSRWLockExclusive(&m_lock);
+	if( IsFull() )
+	{
+		bSpace = SleepConditionVariableSRW(&m_space,&m_lock,dwTimeout,0);
+	}
+	ReleaseSRWLockExclusive(&m_lock);
+	InterlockedDecrement(&m_lWaiters);
+	return bSpace;
+}
+
+void
+	CRingQueue::WakeProducers()
+{
+	// a waiter holds the lock from its test until it sleeps
+	AcquireSRWLockExclusive(&m_lock);
+	ReleaseSRWLockExclusive(&m_lock);
+	WakeAllConditionVariable(&m_space);
+}
+
+unsigned int
+	CRingQueue::GetCount() const
+{
+	// the dequeue position first, so that the count isn't negative
+	LONG lDequeuePos = m_lDequeuePos;
+	LONG lCount = Diff(m_lEnqueuePos,lDequeuePos);
+	if( lCount < 0 ) return 0;
+	if( lCount > m_lMask + 1 ) return (unsigned int)m_lMask + 1;
+	return (unsigned int)lCount;
+}
+
+BOOL
+	CRingQueue::IsFull() const
+{
+	LONG lPos = m_lEnqueuePos;
+	return Diff(m_pCells[lPos & m_lMask].m_lSequence,lPos) < 0;
+}
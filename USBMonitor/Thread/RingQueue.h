@@ -0,0 +1,81 @@
+//
+// RingQueue.h: header file
+//
+// PURPOSE:
+//
+//  A bounded queue of pointers that any number of threads can push to and pop
+//  from without a lock, used as the event queue of CThread
+//
+// NOTES:
+//  This is the bounded queue of Dmitry Vyukov.  Each cell carries a sequence
+//  number telling whether it is free for the push or full for the pop of the
+//  current lap, so that a push or a pop is one compare and exchange on a position
+//  unless another thread got there first.  The capacity is rounded up to a power
+//  of two and the positions wrap around.
+//
+//  A producer may wait for space when the queue is full: the consumers only take
+//  the lock when a producer waits.
+//
+#pragma once
+
+class CRingQueue
+{
+private:
+	struct Cell
+	{
+		volatile LONG m_lSequence;
+		LPVOID m_lpv;
+	};
+
+	// written by the producers and the consumers, on separate cache lines
+	volatile LONG m_lEnqueuePos;
+	char m_enqueuePadding[64 - sizeof(LONG)];
+	volatile LONG m_lDequeuePos;
+	char m_dequeuePadding[64 - sizeof(LONG)];
+
+	Cell *m_pCells;
+	LONG m_lMask;
+
+	// producers waiting for space
+	volatile LONG m_lWaiters;
+	SRWLOCK m_lock;
+	CONDITION_VARIABLE m_space;
+
+	// lA - lB, correct across a wraparound
+	static LONG Diff(LONG lA, LONG lB)
+	{
+		return (LONG)((ULONG)lA - (ULONG)lB);
+	}
+
+	// not copyable
+	CRingQueue(const CRingQueue&);
+	CRingQueue& operator=(const CRingQueue&);
+
+public:
+	CRingQueue *m_pPrevious; // a queue this one replaced, freed with it
+
+	CRingQueue(unsigned int chCapacity);
+	~CRingQueue(void);
+
+	BOOL IsCreated() const { return m_pCells != NULL; }
+
+	// add an item, FALSE if the queue is full
+	BOOL Push(LPVOID lpv);
+
+	// take the oldest item, FALSE if the queue is empty
+	BOOL Pop(LPVOID *plpv);
+
+	// block until an item is popped from a full queue, or dwTimeout milli-seconds
+	// return FALSE on timeout
+	BOOL WaitForSpace(DWORD dwTimeout);
+
+	// wake the producers waiting for space, e.g. when the consumer stops
+	void WakeProducers();
+
+	// wait-free: the number of items, an estimate while the queue changes
+	unsigned int GetCount() const;
+
+	unsigned int GetCapacity() const { return (unsigned int)m_lMask + 1; }
+
+	BOOL IsFull() const;
+};
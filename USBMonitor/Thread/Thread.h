@@ -1,212 +1,231 @@
-//
-// Thread.h: header file
-//
-// Copyright (C) Walter E. Capers.  All rights reserved
-//
-// This source is free to use as you like.  If you make
-// any changes please keep me in the loop.  Email them to
-// walt.capers@comcast.net.
-//
-// PURPOSE:
-//
-//  To implement Win32 threading as a C++ object
-//
-// REVISIONS
-// =======================================================
-// Date: 10.24.07        
-// Name: Walter E. Capers
-// Description: File creation
-//
-// Date: 10.24.07 11:49 am
-// Name: Walter E. Capers
-// Description: Added SetIdle function to allow the idle time to be altered
-//              independent of the SetThreadType member function.
-// Date: 10.31.07
-// Name: Walter E. Capers
-// Description: Added support for beginthreadex
-//              To use compile with -DUSE_BEGIN_THREAD
-//
-//
-#pragma once
-
-typedef unsigned ThreadId_t;
-
-#include "MutexClass.h"
-#include "EventClass.h"
-
-#define QUEUE_SIZE 100
-#define DEFAULT_STACK_SIZE 0
-
-typedef enum {
-	ThreadStateBusy,               // thread is currently handling a task
-	ThreadStateWaiting,            // thread is waiting for something to do
-	ThreadStateDown,               // thread is not running
-	ThreadStateShuttingDown,       // thread is in the process of shutting down
-	ThreadStateFault               // an error has occured and the thread could not
-	// be launched
-} ThreadState_t;
-
-typedef enum {
-	ThreadTypeHomogeneous,
-	ThreadTypeSpecialized,
-	ThreadTypeIntervalDriven,
-	ThreadTypeNotDefined 
-} ThreadType_t;
-
-
-typedef enum {
-	TaskStatusNotSubmitted,
-	TaskStatusWaitingOnQueue,
-	TaskStatusBeingProcessed,
-	TaskStatusCompleted 
-} TaskStatus_t;
-
-class CTask
-{
-private:
-	TaskStatus_t m_state;
-	ThreadId_t m_dwThread;
-public:
-	CMutexClass m_mutex;
-
-	void SetTaskStatus(TaskStatus_t state) 
-	{
-		m_mutex.Lock();
-		m_state=state;
-		m_mutex.Unlock();
-	}
-
-	void SetId(ThreadId_t *pid)
-	{
-		memcpy(&m_dwThread,pid,sizeof(ThreadId_t));
-	}
-
-	/**
-	*
-	* Wait
-	* waits for upto timeoutSeconds for a task
-	* to complete
-	*
-	**/
-	BOOL Wait(int timeoutSeconds)
-	{
-		timeoutSeconds = timeoutSeconds * 1000;
-		if( Status() != TaskStatusCompleted &&
-			timeoutSeconds > 0 )
-		{
-			Sleep(100);
-			timeoutSeconds = timeoutSeconds - 100;
-		}
-		if( Status() == TaskStatusCompleted ) return TRUE;
-		return FALSE;
-	}
-
-	/**
-	*
-	* Status
-	* returns current state of a task
-	*
-	**/
-	TaskStatus_t Status()
-	{
-		TaskStatus_t state ;
-
-		m_mutex.Lock();
-		state = m_state;
-		m_mutex.Unlock();
-		return state;
-	}
-
-	void Thread(ThreadId_t *pId)
-	{
-		memcpy(pId,&m_dwThread,sizeof(ThreadId_t));
-	}
-
-	CTask(){m_state=TaskStatusNotSubmitted; memset(&m_dwThread,0,sizeof(ThreadId_t)); }
-	virtual ~CTask(){}
-	virtual BOOL Task()=0;
-};
-
-
-class CThread
-{
-private:
-	CEventClass   m_event;         // event controller
-	int           m_StopTimeout;   // specifies a timeout value for stop
-	// if a thread fails to stop within m_StopTimeout
-	// seconds an exception is thrown
-
-	BOOL		  m_bRunning;      // set to TRUE if thread is running
-	HANDLE		  m_thread;		   // thread handle
-	ThreadId_t	  m_dwId;          // id of this thread
-	LPVOID        *m_lppvQueue;    // task que
-	unsigned int  m_chQueue;       // que depth
-	unsigned int  m_queuePos;      // current que possition
-	LPVOID        m_lpvProcessor;  // data which is currently being processed
-	ThreadState_t m_state;         // current state of thread see thread state data
-	// structure.
-	DWORD         m_dwIdle;        // used for Sleep periods
-	ThreadType_t  m_type;
-	DWORD		  m_stackSize;     // thread stack size
-#define NO_ERRORS			       0
-#define MUTEX_CREATION		       0x01
-#define EVENT_CREATION		       0x02
-#define THREAD_CREATION		       0x04
-#define UNKNOWN					   0x08
-#define ILLEGAL_USE_OF_EVENT       0x10
-#define MEMORY_FAULT               0x20
-#define EVENT_AND_TYPE_DONT_MATCH  0x40
-#define STACK_OVERFLOW             0x80
-#define STACK_EMPTY                0x100
-#define STACK_FULL                 0x200
-
-	DWORD         m_dwObjectCondition;
-	BOOL		  Push(LPVOID lpv);
-	BOOL		  Pop();
-	BOOL		  Empty();
-public:
-	/**
-	*
-	* user definable member functions
-	*
-	**/
-	CMutexClass	  m_mutex;         // mutex that protects threads internal data
-
-	virtual BOOL OnTask(LPVOID lpvData);     // called when an event occurs
-	virtual BOOL OnTask();                   // called when a time interval has elapsed
-
-	CThread(void);
-	virtual ~CThread(void);
-	friend unsigned __stdcall _THKERNEL(LPVOID lpvData);
-	BOOL        FromSameThread();
-	float		PercentCapacity();
-	void        WaitTillExit();
-	BOOL		KernelProcess();
-	BOOL		Event(LPVOID lpvData=NULL);
-	BOOL        Event(CTask *pvTask);
-	void		SetOnStopTimeout(int seconds ) { m_StopTimeout = seconds; }
-	BOOL        SetQueueSize( unsigned int ch );
-	BOOL		Stop();
-	BOOL		Start();
-	void		GetId(ThreadId_t *pId) { memcpy(pId,&m_dwId,sizeof(ThreadId_t)); }      // returns thread id
-	ThreadState_t ThreadState();
-	BOOL		PingThread(DWORD dwTimeout=0);
-	BOOL        AtCapacity();
-	void		SetPriority(DWORD dwPriority=THREAD_PRIORITY_NORMAL);
-	DWORD		GetErrorFlags() { return m_dwObjectCondition; } // returns state of object
-	void		SetThreadType(ThreadType_t typ=ThreadTypeNotDefined,DWORD dwIdle=100);
-	void		SetIdle(DWORD dwIdle=100);
-	unsigned int GetEventsPending();
-	static BOOL ThreadIdsEqual(ThreadId_t *p1,
-		ThreadId_t *p2)
-	{
-		return ((*p1 == *p2)?TRUE:FALSE);
-	}
-
-	static ThreadId_t ThreadId()
-	{
-		ThreadId_t thisThreadsId ;
-		thisThreadsId = (ThreadId_t)GetCurrentThreadId();
-		return thisThreadsId;
-	}
+//
+// Thread.h: header file
+//
+// Copyright (C) Walter E. Capers.  All rights reserved
+//
+// This source is free to use as you like.  If you make
+// any changes please keep me in the loop.  Email them to
+// walt.capers@comcast.net.
+//
+// PURPOSE:
+//
+//  To implement Win32 threading as a C++ object
+//
+// REVISIONS
+// =======================================================
+// Date: 10.24.07        
+// Name: Walter E. Capers
+// Description: File creation
+//
+// Date: 10.24.07 11:49 am
+// Name: Walter E. Capers
+// Description: Added SetIdle function to allow the idle time to be altered
+//              independent of the SetThreadType member function.
+// Date: 10.31.07
+// Name: Walter E. Capers
+// Description: Added support for beginthreadex
+//              To use compile with -DUSE_BEGIN_THREAD
+//
+//
+#pragma once
+
+typedef unsigned ThreadId_t;
+
+#include "MutexClass.h"
+#include "EventClass.h"
+#include "RingQueue.h"
+
+#define QUEUE_SIZE 100
+#define DEFAULT_STACK_SIZE 0
+
+typedef enum {
+	ThreadStateBusy,               // thread is currently handling a task
+	ThreadStateWaiting,            // thread is waiting for something to do
+	ThreadStateDown,               // thread is not running
+	ThreadStateShuttingDown,       // thread is in the process of shutting down
+	ThreadStateFault               // an error has occured and the thread could not
+	// be launched
+} ThreadState_t;
+
+typedef enum {
+	ThreadTypeHomogeneous,
+	ThreadTypeSpecialized,
+	ThreadTypeIntervalDriven,
+	ThreadTypeNotDefined 
+} ThreadType_t;
+
+
+typedef enum {
+	TaskStatusNotSubmitted,
+	TaskStatusWaitingOnQueue,
+	TaskStatusBeingProcessed,
+	TaskStatusCompleted 
+} TaskStatus_t;
+
+class CTask
+{
+private:
+	// written with an interlocked exchange, read without a lock
+	volatile LONG m_state;
+	ThreadId_t m_dwThread;
+	// Wait sleeps on m_completed until the task is completed
+	SRWLOCK m_waitLock;
+	CONDITION_VARIABLE m_completed;
+public:
+	CMutexClass m_mutex;
+
+	void SetTaskStatus(TaskStatus_t state) 
+	{
+		InterlockedExchange(&m_state,state);
+		if( state == TaskStatusCompleted )
+		{
+			// a waiter holds the lock from its test until it sleeps
+			AcquireSRWLockExclusive(&m_waitLock);
+			ReleaseSRWLockExclusive(&m_waitLock);
+			WakeAllConditionVariable(&m_completed);
+		}
+	}
+
+	void SetId(ThreadId_t *pid)
+	{
+		memcpy(&m_dwThread,pid,sizeof(ThreadId_t));
+	}
+
+	/**
+	*
+	* Wait
+	* waits for upto timeoutSeconds for a task
+	* to complete
+	*
+	**/
+	BOOL Wait(int timeoutSeconds)
+	{
+		DWORD dwTimeout = timeoutSeconds * 1000;
+		DWORD dwStart = GetTickCount();
+		AcquireSRWLockExclusive(&m_waitLock);
+		while( Status() != TaskStatusCompleted )
+		{
+			DWORD dwElapsed = GetTickCount() - dwStart;
+			if( timeoutSeconds <= 0 || dwElapsed >= dwTimeout )
+				break;
+			SleepConditionVariableSRW(&m_completed,&m_waitLock,dwTimeout - dwElapsed,0);
+		}
+		ReleaseSRWLockExclusive(&m_waitLock);
+		if( Status() == TaskStatusCompleted ) return TRUE;
+		return FALSE;
+	}
+
+	/**
+	*
+	* Status
+	* returns current state of a task
+	*
+	**/
+	TaskStatus_t Status()
+	{
+		return (TaskStatus_t)m_state;
+	}
+
+	void Thread(ThreadId_t *pId)
+	{
+		memcpy(pId,&m_dwThread,sizeof(ThreadId_t));
+	}
+
+	CTask()
+	{
+		m_state=TaskStatusNotSubmitted;
+		memset(&m_dwThread,0,sizeof(ThreadId_t));
+		InitializeSRWLock(&m_waitLock);
+		InitializeConditionVariable(&m_completed);
+	}
+	virtual ~CTask(){}
+	virtual BOOL Task()=0;
+};
+
+
+class CThread
+{
+private:
+	CEventClass   m_event;         // event controller
+	int           m_StopTimeout;   // specifies a timeout value for stop
+	// if a thread fails to stop within m_StopTimeout
+	// seconds an exception is thrown
+
+	volatile BOOL m_bRunning;      // set to TRUE if thread is running
+	HANDLE		  m_thread;		   // thread handle
+	ThreadId_t	  m_dwId;          // id of this thread
+	CRingQueue * volatile m_pQueue; // task que, lock-free
+	BOOL          m_bBlockOnFull;  // Event waits for space instead of failing
+	volatile LONG m_lOverflow;     // set when an event didn't fit in the queue
+	LPVOID volatile m_lpvProcessor; // data which is currently being processed
+	// only touched by the thread itself, so it needs no m_mutex
+	volatile ThreadState_t m_state; // current state of thread see thread state data
+	// structure. written by the thread, read without m_mutex
+	DWORD         m_dwIdle;        // used for Sleep periods
+	volatile ThreadType_t m_type;
+	DWORD		  m_stackSize;     // thread stack size
+#define NO_ERRORS			       0
+#define MUTEX_CREATION		       0x01
+#define EVENT_CREATION		       0x02
+#define THREAD_CREATION		       0x04
+#define UNKNOWN					   0x08
+#define ILLEGAL_USE_OF_EVENT       0x10
+#define MEMORY_FAULT               0x20
+#define EVENT_AND_TYPE_DONT_MATCH  0x40
+#define STACK_OVERFLOW             0x80
+#define STACK_EMPTY                0x100
+#define STACK_FULL                 0x200
+
+	DWORD         m_dwObjectCondition;
+	BOOL		  Push(LPVOID lpv);
+	BOOL		  Pop();
+	void		  MoveEvents(CRingQueue *pQueue);
+	BOOL		  Empty();
+	BOOL		  PrepareEvent(ThreadType_t type);
+public:
+	/**
+	*
+	* user definable member functions
+	*
+	**/
+	CMutexClass	  m_mutex;         // mutex that protects threads internal data
+
+	virtual BOOL OnTask(LPVOID lpvData);     // called when an event occurs
+	virtual BOOL OnTask();                   // called when a time interval has elapsed
+
+	CThread(void);
+	virtual ~CThread(void);
+	friend unsigned __stdcall _THKERNEL(LPVOID lpvData);
+	BOOL        FromSameThread();
+	float		PercentCapacity();
+	void        WaitTillExit();
+	BOOL		KernelProcess();
+	BOOL		Event(LPVOID lpvData=NULL);
+	BOOL        Event(CTask *pvTask);
+	void		SetOnStopTimeout(int seconds ) { m_StopTimeout = seconds; }
+	BOOL        SetQueueSize( unsigned int ch );
+	void        SetBlockOnFull( BOOL bBlock ) { m_bBlockOnFull = bBlock; }
+	BOOL		Stop();
+	BOOL		Start();
+	void		GetId(ThreadId_t *pId) { memcpy(pId,&m_dwId,sizeof(ThreadId_t)); }      // returns thread id
+	ThreadState_t ThreadState();
+	BOOL		PingThread(DWORD dwTimeout=0);
+	BOOL        AtCapacity();
+	void		SetPriority(DWORD dwPriority=THREAD_PRIORITY_NORMAL);
+	DWORD		GetErrorFlags(); // returns state of object
+	void		SetThreadType(ThreadType_t typ=ThreadTypeNotDefined,DWORD dwIdle=100);
+	void		SetIdle(DWORD dwIdle=100);
+	unsigned int GetEventsPending();
+	static BOOL ThreadIdsEqual(ThreadId_t *p1,
+		ThreadId_t *p2)
+	{
+		return ((*p1 == *p2)?TRUE:FALSE);
+	}
+
+	static ThreadId_t ThreadId()
+	{
+		ThreadId_t thisThreadsId ;
+		thisThreadsId = (ThreadId_t)GetCurrentThreadId();
+		return thisThreadsId;
+	}
 };
\ No newline at end of file
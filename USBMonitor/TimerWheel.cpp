@@ -0,0 +1,309 @@
+#include "StdAfx.h"
+#include "TimerWheel.h"
+
+// Ticks per slot of a level
+#define LEVEL_SPAN(level)	(1ULL << (TimerWheel::SLOT_BITS * (level)))
+
+TimerWheel::TimerWheel(DWORD dwResolution)
+	: m_dwResolution(max(dwResolution, 1UL))
+	, m_ullStart(::GetTickCount64())
+	, m_ullTick(0)
+	, m_nNextId(1)
+{
+	memset(m_aSlots, 0, sizeof(m_aSlots));
+	memset(m_aLevelCounts, 0, sizeof(m_aLevelCounts));
+}
+
+TimerWheel::~TimerWheel(void)
+{
+	POSITION pos = m_timers.GetStartPosition();
+	while (pos != NULL)
+	{
+		delete m_timers.GetNextValue(pos);
+	}
+}
+
+UINT_PTR TimerWheel::Add(DWORD dwDelay, DWORD dwPeriod, const TimerFunc& func)
+{
+	m_cs.Enter();
+	UINT_PTR nTimerId = AddLocked(dwDelay, dwPeriod, func)->m_nId;
+	m_cs.Leave();
+	return nTimerId;
+}
+
+UINT_PTR TimerWheel::AddKeyed(const CStringA& strKey, DWORD dwDelay, DWORD dwPeriod, const TimerFunc& func)
+{
+	m_cs.Enter();
+	Timer* pTimer = NULL;
+	if (m_keys.Lookup(strKey, pTimer))
+	{
+		CancelLocked(pTimer);
+	}
+	pTimer = AddLocked(dwDelay, dwPeriod, func);
+	pTimer->m_strKey = strKey;
+	m_keys.SetAt(strKey, pTimer);
+	UINT_PTR nTimerId = pTimer->m_nId;
+	m_cs.Leave();
+	return nTimerId;
+}
+
+bool TimerWheel::Cancel(UINT_PTR nTimerId)
+{
+	m_cs.Enter();
+	Timer* pTimer = NULL;
+	bool bCancelled = m_timers.Lookup(nTimerId, pTimer) && !pTimer->m_bCancelled;
+	if (bCancelled)
+	{
+		CancelLocked(pTimer);
+	}
+	m_cs.Leave();
+	return bCancelled;
+}
+
+bool TimerWheel::CancelKeyed(const CStringA& strKey)
+{
+	m_cs.Enter();
+	Timer* pTimer = NULL;
+	bool bCancelled = m_keys.Lookup(strKey, pTimer) != FALSE;
+	if (bCancelled)
+	{
+		CancelLocked(pTimer);
+	}
+	m_cs.Leave();
+	return bCancelled;
+}
+
+DWORD TimerWheel::GetTimeout() const
+{
+	m_cs.Enter();
+	// The timers of the lowest level are due within a turn, those above move down at
+	// the start of their slot.
+	ULONGLONG ullNext = GetNextCascade(m_ullTick);
+	if (m_aLevelCounts[0] > 0)
+	{
+		for (int i = 0; i < SLOT_COUNT; i++)
+		{
+			if (m_aSlots[0][(m_ullTick + i) & (SLOT_COUNT - 1)] != NULL)
+			{
+				ullNext = min(ullNext, m_ullTick + i);
+				break;
+			}
+		}
+	}
+	m_cs.Leave();
+
+	if (ullNext == _UI64_MAX)
+	{
+		return INFINITE;
+	}
+	ULONGLONG ullDue = ullNext * m_dwResolution;
+	ULONGLONG ullElapsed = GetElapsed();
+	if (ullDue <= ullElapsed)
+	{
+		return 0;
+	}
+	return static_cast<DWORD>(min(ullDue - ullElapsed, static_cast<ULONGLONG>(INFINITE - 1)));
+}
+
+int TimerWheel::Expire()
+{
+	ULONGLONG ullNow = GetElapsed() / m_dwResolution;
+
+	// Take the due timers out of the wheel first, so that the timer functions can add
+	// and cancel timers.
+	Timer* pFirst = NULL;
+	Timer* pLast = NULL;
+	m_cs.Enter();
+	while (m_ullTick <= ullNow)
+	{
+		Cascade();
+
+		// The timers of a slot of the lowest level are all due at this tick.
+		Timer* pTimer;
+		while ((pTimer = m_aSlots[0][m_ullTick & (SLOT_COUNT - 1)]) != NULL)
+		{
+			Unlink(pTimer);
+			pTimer->m_bExpired = true;
+			if (pLast != NULL)
+			{
+				pLast->m_pNext = pTimer;
+			}
+			else
+			{
+				pFirst = pTimer;
+			}
+			pLast = pTimer;
+		}
+
+		// Skip the ticks with nothing to do, e.g. after a long sleep.
+		ULONGLONG ullNext = (m_aLevelCounts[0] > 0) ? m_ullTick + 1 : GetNextCascade(m_ullTick + 1);
+		m_ullTick = min(ullNext, ullNow + 1);
+	}
+	m_cs.Leave();
+
+	int nRun = 0;
+	while (pFirst != NULL)
+	{
+		Timer* pTimer = pFirst;
+		pFirst = pTimer->m_pNext;
+
+		m_cs.Enter();
+		bool bCancelled = pTimer->m_bCancelled;
+		m_cs.Leave();
+		if (!bCancelled)
+		{
+			pTimer->m_func();
+			nRun++;
+		}
+
+		m_cs.Enter();
+		pTimer->m_bExpired = false;
+		if (pTimer->m_ullPeriodTicks > 0 && !pTimer->m_bCancelled)
+		{
+			// Keep the period without drifting, but don't catch up on the missed runs.
+			pTimer->m_ullDueTick = max(pTimer->m_ullDueTick + pTimer->m_ullPeriodTicks, m_ullTick);
+			Link(pTimer);
+		}
+		else
+		{
+			Delete(pTimer);
+		}
+		m_cs.Leave();
+	}
+	return nRun;
+}
+
+int TimerWheel::GetCount() const
+{
+	m_cs.Enter();
+	int nCount = static_cast<int>(m_timers.GetCount());
+	m_cs.Leave();
+	return nCount;
+}
+
+ULONGLONG TimerWheel::GetElapsed() const
+{
+	return ::GetTickCount64() - m_ullStart;
+}
+
+TimerWheel::Timer* TimerWheel::AddLocked(DWORD dwDelay, DWORD dwPeriod, const TimerFunc& func)
+{
+	Timer* pTimer = new Timer;
+	pTimer->m_nId = m_nNextId++;
+	// Round up, a timer never fires early.
+	pTimer->m_ullDueTick = max((GetElapsed() + dwDelay + m_dwResolution - 1) / m_dwResolution, m_ullTick);
+	pTimer->m_ullPeriodTicks = (dwPeriod + m_dwResolution - 1) / m_dwResolution;
+	pTimer->m_func = func;
+	pTimer->m_bExpired = false;
+	pTimer->m_bCancelled = false;
+	Link(pTimer);
+	m_timers.SetAt(pTimer->m_nId, pTimer);
+	return pTimer;
+}
+
+void TimerWheel::CancelLocked(Timer* pTimer)
+{
+	if (!pTimer->m_strKey.IsEmpty())
+	{
+		// The key may be given to a new timer right away.
+		m_keys.RemoveKey(pTimer->m_strKey);
+		pTimer->m_strKey.Empty();
+	}
+	if (pTimer->m_bExpired)
+	{
+		// Expire owns it until the batch is over.
+		pTimer->m_bCancelled = true;
+		return;
+	}
+	Unlink(pTimer);
+	Delete(pTimer);
+}
+
+void TimerWheel::Delete(Timer* pTimer)
+{
+	if (!pTimer->m_strKey.IsEmpty())
+	{
+		m_keys.RemoveKey(pTimer->m_strKey);
+	}
+	m_timers.RemoveKey(pTimer->m_nId);
+	delete pTimer;
+}
+
+void TimerWheel::Link(Timer* pTimer)
+{
+	ULONGLONG ullDue = max(pTimer->m_ullDueTick, m_ullTick);
+	ULONGLONG ullDelta = ullDue - m_ullTick;
+	int nLevel = 0;
+	while (nLevel < LEVEL_COUNT - 1 && ullDelta >= LEVEL_SPAN(nLevel + 1))
+	{
+		nLevel++;
+	}
+	if (ullDelta >= LEVEL_SPAN(LEVEL_COUNT))
+	{
+		// Beyond the top level: wait for its last slot of this turn, and be linked
+		// again from there.
+		ullDue = m_ullTick + LEVEL_SPAN(LEVEL_COUNT) - 1;
+	}
+
+	pTimer->m_nLevel = nLevel;
+	pTimer->m_nSlot = static_cast<int>((ullDue >> (SLOT_BITS * nLevel)) & (SLOT_COUNT - 1));
+	Timer*& pHead = m_aSlots[nLevel][pTimer->m_nSlot];
+	pTimer->m_pPrev = NULL;
+	pTimer->m_pNext = pHead;
+	if (pHead != NULL)
+	{
+		pHead->m_pPrev = pTimer;
+	}
+	pHead = pTimer;
+	m_aLevelCounts[nLevel]++;
+}
+
+void TimerWheel::Unlink(Timer* pTimer)
+{
+	if (pTimer->m_pPrev != NULL)
+	{
+		pTimer->m_pPrev->m_pNext = pTimer->m_pNext;
+	}
+	else
+	{
+		m_aSlots[pTimer->m_nLevel][pTimer->m_nSlot] = pTimer->m_pNext;
+	}
+	if (pTimer->m_pNext != NULL)
+	{
+		pTimer->m_pNext->m_pPrev = pTimer->m_pPrev;
+	}
+	pTimer->m_pPrev = pTimer->m_pNext = NULL;
+	m_aLevelCounts[pTimer->m_nLevel]--;
+}
+
+void TimerWheel::Cascade()
+{
+	// A slot of a level begins when the turn of the level below is complete. The timers
+	// of the slot are due within it, so they all move to lower levels.
+	for (int nLevel = 1; nLevel < LEVEL_COUNT && (m_ullTick & (LEVEL_SPAN(nLevel) - 1)) == 0; nLevel++)
+	{
+		int nSlot = static_cast<int>((m_ullTick >> (SLOT_BITS * nLevel)) & (SLOT_COUNT - 1));
+		Timer* pTimer = m_aSlots[nLevel][nSlot];
+		m_aSlots[nLevel][nSlot] = NULL;
+		while (pTimer != NULL)
+		{
+			Timer* pNext = pTimer->m_pNext;
+			m_aLevelCounts[nLevel]--;
+			Link(pTimer);
+			pTimer = pNext;
+		}
+	}
+}
+
+ULONGLONG TimerWheel::GetNextCascade(ULONGLONG ullFrom) const
+{
+	for (int nLevel = 1; nLevel < LEVEL_COUNT; nLevel++)
+	{
+		if (m_aLevelCounts[nLevel] > 0)
+		{
+			ULONGLONG ullMask = LEVEL_SPAN(nLevel) - 1;
+			return (ullFrom + ullMask) & ~ullMask;
+		}
+	}
+	return _UI64_MAX;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+typedef std::function<void()> TimerFunc;
+
+/**
+ * Hierarchical timer wheel: LEVEL_COUNT wheels of SLOT_COUNT slots, where a slot of a
+ * level spans a whole turn of the level below. A timer is hashed into the lowest level
+ * whose turn reaches its due tick, and moves down a level each time the wheel below
+ * completes a turn, so adding and cancelling a timer are O(1) whatever the delay, and
+ * a timer is moved at most LEVEL_COUNT times. The ticks without any timer are skipped.
+ *
+ * A timer may be keyed, e.g. by a device instance ID: adding a keyed timer replaces the
+ * one with the same key, so that each device has its own timer without searching for it.
+ *
+ * Any thread can add and cancel the timers, Expire runs them on the thread which drives
+ * the wheel, e.g. that of Reactor. The timer functions run without the lock held.
+ */
+class TimerWheel
+{
+public:
+	static const int SLOT_BITS = 6;
+	static const int SLOT_COUNT = 1 << SLOT_BITS;
+	// 4 levels of 64 slots of 10 ms reach 46 hours, longer timers wait at the top level.
+	static const int LEVEL_COUNT = 4;
+
+	/**
+	 * @param dwResolution Milliseconds per tick. The timers fire up to a tick late.
+	 */
+	TimerWheel(DWORD dwResolution = 10);
+	~TimerWheel(void);
+
+	/**
+	 * Add a timer.
+	 * @param dwDelay Milliseconds until the timer fires.
+	 * @param dwPeriod Milliseconds between the next runs, 0 to run once.
+	 * @return The timer ID, never 0.
+	 */
+	UINT_PTR Add(DWORD dwDelay, DWORD dwPeriod, const TimerFunc& func);
+
+	/**
+	 * Add a timer replacing the timer with the same key, if any.
+	 * @return The timer ID, never 0.
+	 */
+	UINT_PTR AddKeyed(const CStringA& strKey, DWORD dwDelay, DWORD dwPeriod, const TimerFunc& func);
+
+	/**
+	 * Cancel a timer, also from within a timer function. Cancelled from another thread,
+	 * the timer function may be running while Cancel returns.
+	 * @return false if the timer has already fired or been cancelled.
+	 */
+	bool Cancel(UINT_PTR nTimerId);
+
+	// Cancel the timer of a key, false if there is none.
+	bool CancelKeyed(const CStringA& strKey);
+
+	// Milliseconds until the next timer is due, INFINITE if there is none.
+	DWORD GetTimeout() const;
+
+	// Run the timers which are due. Returns the number run.
+	int Expire();
+
+	int GetCount() const;
+
+private:
+	// Not copyable
+	TimerWheel(const TimerWheel&);
+	TimerWheel& operator=(const TimerWheel&);
+
+	struct Timer
+	{
+		UINT_PTR m_nId;
+		// Empty if the timer isn't keyed
+		CStringA m_strKey;
+		ULONGLONG m_ullDueTick;
+		ULONGLONG m_ullPeriodTicks;
+		TimerFunc m_func;
+		// Whether it is in the batch being run by Expire, and was cancelled meanwhile
+		bool m_bExpired;
+		bool m_bCancelled;
+		// The slot the timer is linked in
+		int m_nLevel;
+		int m_nSlot;
+		Timer* m_pPrev;
+		Timer* m_pNext;
+	};
+
+	// Milliseconds since the wheel was created
+	ULONGLONG GetElapsed() const;
+
+	// The following are called with the lock held.
+	Timer* AddLocked(DWORD dwDelay, DWORD dwPeriod, const TimerFunc& func);
+	void CancelLocked(Timer* pTimer);
+	// Delete a timer which isn't linked.
+	void Delete(Timer* pTimer);
+	// Put the timer in the slot of its due tick, at the lowest level reaching it.
+	void Link(Timer* pTimer);
+	void Unlink(Timer* pTimer);
+	// Move the timers of the slots of the levels above which begin at the current tick.
+	void Cascade();
+	// The first tick from ullFrom on at which timers move down from a level above,
+	// _UI64_MAX if there are none.
+	ULONGLONG GetNextCascade(ULONGLONG ullFrom) const;
+
+	mutable CCriticalSection m_cs;
+	DWORD m_dwResolution;
+	ULONGLONG m_ullStart;
+	// The next tick to expire
+	ULONGLONG m_ullTick;
+	UINT_PTR m_nNextId;
+	// Doubly linked lists of the timers by level and slot
+	Timer* m_aSlots[LEVEL_COUNT][SLOT_COUNT];
+	// Number of timers linked in each level
+	int m_aLevelCounts[LEVEL_COUNT];
+	CAtlMap<UINT_PTR, Timer*> m_timers;
+	CAtlMap<CStringA, Timer*, CStringElementTraits<CStringA> > m_keys;
+};
@@ -0,0 +1,464 @@
+#include "StdAfx.h"
+#include "WebSocket.h"
+#include <wincrypt.h>
+#pragma comment(lib, "crypt32")
+
+// Appended to the key of the client before hashing (RFC 6455 1.3)
+#define WEBSOCKET_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+// Check whether a comma separated header value contains the token.
+static bool HasToken(const CStringA &strList, const char* szToken)
+{
+	int curPos = 0;
+	CStringA token = strList.Tokenize(",", curPos);
+	while (!token.IsEmpty())
+	{
+		if (token.Trim().CompareNoCase(szToken) == 0)
+		{
+			return true;
+		}
+		token = strList.Tokenize(",", curPos);
+	}
+	return false;
+}
+
+//
+// WebSocket
+//
+
+bool WebSocket::Handshake(const char* szRequest, const char* szAllowedOrigins, CStringA &strResponse, bool &bDeflate)
+{
+	bDeflate = false;
+	strResponse = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+
+	CStringA strRequest = szRequest;
+	int curPos = 0;
+	CStringA strLine = strRequest.Tokenize("\r\n", curPos);
+	if (strLine.Left(4) != "GET ")
+	{
+		return false;
+	}
+
+	CStringA strUpgrade;
+	CStringA strConnection;
+	CStringA strVersion;
+	CStringA strKey;
+	CStringA strOrigin;
+	CStringA strExtensions;
+	bool bHasOrigin = false;
+	strLine = strRequest.Tokenize("\r\n", curPos);
+	while (!strLine.IsEmpty())
+	{
+		int nColon = strLine.Find(':');
+		if (nColon > 0)
+		{
+			CStringA strName = strLine.Left(nColon).Trim();
+			CStringA strValue = strLine.Mid(nColon + 1).Trim();
+			if (!strName.CompareNoCase("Upgrade"))
+			{
+				strUpgrade = strValue;
+			}
+			else if (!strName.CompareNoCase("Connection"))
+			{
+				strConnection = strValue;
+			}
+			else if (!strName.CompareNoCase("Sec-WebSocket-Version"))
+			{
+				strVersion = strValue;
+			}
+			else if (!strName.CompareNoCase("Sec-WebSocket-Key"))
+			{
+				strKey = strValue;
+			}
+			else if (!strName.CompareNoCase("Origin"))
+			{
+				strOrigin = strValue;
+				bHasOrigin = true;
+			}
+			else if (!strName.CompareNoCase("Sec-WebSocket-Extensions"))
+			{
+				// The header may be repeated.
+				if (!strExtensions.IsEmpty())
+				{
+					strExtensions += ",";
+				}
+				strExtensions += strValue;
+			}
+		}
+		strLine = strRequest.Tokenize("\r\n", curPos);
+	}
+
+	if (!HasToken(strUpgrade, "websocket") || !HasToken(strConnection, "upgrade") || strKey.IsEmpty())
+	{
+		return false;
+	}
+	if (strVersion != "13")
+	{
+		strResponse = "HTTP/1.1 426 Upgrade Required\r\nSec-WebSocket-Version: 13\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+		return false;
+	}
+	// Any web page may try to connect to a local port, only let the trusted ones in.
+	if (bHasOrigin && !IsAllowedOrigin(strOrigin, szAllowedOrigins))
+	{
+		strResponse = "HTTP/1.1 403 Forbidden\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+		return false;
+	}
+
+	CStringA strAccept;
+	if (!ComputeAcceptKey(strKey, strAccept))
+	{
+		strResponse = "HTTP/1.1 500 Internal Server Error\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+		return false;
+	}
+
+	// Accept the first permessage-deflate offer we can honor.
+	int offerPos = 0;
+	CStringA strOffer = strExtensions.Tokenize(",", offerPos);
+	while (!strOffer.IsEmpty() && !bDeflate)
+	{
+		int paramPos = 0;
+		CStringA strParam = strOffer.Tokenize(";", paramPos);
+		if (!strParam.Trim().CompareNoCase("permessage-deflate"))
+		{
+			bDeflate = true;
+			strParam = strOffer.Tokenize(";", paramPos);
+			while (!strParam.IsEmpty())
+			{
+				// We compress with a 32K window, so a smaller one can't be accepted.
+				strParam.Trim();
+				int nEquals = strParam.Find('=');
+				if (nEquals > 0 && !strParam.Left(nEquals).Trim().CompareNoCase("server_max_window_bits") &&
+					atoi(strParam.Mid(nEquals + 1).Trim(" \t\"")) < 15)
+				{
+					bDeflate = false;
+				}
+				strParam = strOffer.Tokenize(";", paramPos);
+			}
+		}
+		strOffer = strExtensions.Tokenize(",", offerPos);
+	}
+
+	strResponse.Format("HTTP/1.1 101 Switching Protocols\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Accept: %s\r\n", static_cast<LPCSTR>(strAccept));
+	if (bDeflate)
+	{
+		// Each message is compressed on its own in both directions.
+		strResponse += "Sec-WebSocket-Extensions: permessage-deflate; server_no_context_takeover; client_no_context_takeover\r\n";
+	}
+	strResponse += "\r\n";
+	return true;
+}
+
+bool WebSocket::IsAllowedOrigin(const CStringA &strOrigin, const char* szAllowedOrigins)
+{
+	// Pages of the browser itself and of its add-ons can't be impersonated by a web site,
+	// web origins have to be listed.
+	CStringA strScheme = strOrigin.Left(8);
+	strScheme.MakeLower();
+	bool bWebOrigin = strScheme.Left(7) == "http://" || strScheme == "https://" || strOrigin.CompareNoCase("null") == 0;
+	if (!bWebOrigin)
+	{
+		return true;
+	}
+	return HasToken(szAllowedOrigins, strOrigin);
+}
+
+bool WebSocket::ComputeAcceptKey(const CStringA &strKey, CStringA &strAccept)
+{
+	CStringA strInput = strKey + WEBSOCKET_GUID;
+	bool bResult = false;
+
+	HCRYPTPROV hProv = NULL;
+	if (::CryptAcquireContext(&hProv, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT))
+	{
+		HCRYPTHASH hHash = NULL;
+		if (::CryptCreateHash(hProv, CALG_SHA1, 0, 0, &hHash))
+		{
+			BYTE digest[20];
+			DWORD dwDigestLength = sizeof(digest);
+			if (::CryptHashData(hHash, reinterpret_cast<const BYTE*>(static_cast<LPCSTR>(strInput)), strInput.GetLength(), 0) &&
+				::CryptGetHashParam(hHash, HP_HASHVAL, digest, &dwDigestLength, 0))
+			{
+				char szBase64[64];
+				DWORD dwLength = sizeof(szBase64);
+				if (::CryptBinaryToStringA(digest, dwDigestLength, CRYPT_STRING_BASE64 | CRYPT_STRING_NOCRLF, szBase64, &dwLength))
+				{
+					strAccept = CStringA(szBase64, dwLength);
+					bResult = true;
+				}
+			}
+			::CryptDestroyHash(hHash);
+		}
+		::CryptReleaseContext(hProv, 0);
+	}
+	return bResult;
+}
+
+void WebSocket::WriteMessage(const char* lpData, int nLength, bool bBinary, bool bDeflate,
+	DeflateEncoder &encoder, MessageBuffer &scratch, MessageBuffer &buffer)
+{
+	int nOpcode = bBinary ? OPCODE_BINARY : OPCODE_TEXT;
+	if (bDeflate && nLength >= DEFLATE_THRESHOLD)
+	{
+		scratch.Clear();
+		encoder.Compress(lpData, nLength, scratch);
+		// Data which doesn't compress is sent as it is.
+		if (scratch.GetLength() < nLength)
+		{
+			WriteFrame(nOpcode, true, scratch.GetData(), scratch.GetLength(), buffer);
+			return;
+		}
+	}
+	WriteFrame(nOpcode, false, lpData, nLength, buffer);
+}
+
+void WebSocket::WriteFrame(int nOpcode, bool bCompressed, const char* lpData, int nLength, MessageBuffer &buffer)
+{
+	// FIN, RSV1 for compressed messages, and the opcode
+	buffer.Append(static_cast<char>(0x80 | (bCompressed ? 0x40 : 0) | nOpcode));
+
+	// The server doesn't mask its frames.
+	if (nLength < 126)
+	{
+		buffer.Append(static_cast<char>(nLength));
+	}
+	else if (nLength <= 0xffff)
+	{
+		buffer.Append(static_cast<char>(126));
+		buffer.Append(static_cast<char>(nLength >> 8));
+		buffer.Append(static_cast<char>(nLength & 0xff));
+	}
+	else
+	{
+		buffer.Append(static_cast<char>(127));
+		for (int i = 7; i >= 0; i--)
+		{
+			buffer.Append(static_cast<char>((static_cast<unsigned __int64>(nLength) >> (i * 8)) & 0xff));
+		}
+	}
+	buffer.Append(lpData, nLength);
+}
+
+void WebSocket::WriteClose(int nStatusCode, MessageBuffer &buffer)
+{
+	char status[2] = { static_cast<char>(nStatusCode >> 8), static_cast<char>(nStatusCode & 0xff) };
+	WriteFrame(OPCODE_CLOSE, false, status, sizeof(status), buffer);
+}
+
+//
+// WebSocketDecoder
+//
+
+WebSocketDecoder::WebSocketDecoder(void)
+{
+	Reset(false);
+}
+
+void WebSocketDecoder::Reset(bool bDeflate)
+{
+	m_state = STATE_HEADER;
+	m_bDeflate = bDeflate;
+	m_nHeaderLength = 0;
+	m_nOpcode = WebSocket::OPCODE_CONTINUATION;
+	m_bFinal = false;
+	m_bCompressed = false;
+	m_nPayloadLength = 0;
+	m_nPayloadRead = 0;
+	m_nMessageOpcode = WebSocket::OPCODE_CONTINUATION;
+	m_bMessageCompressed = false;
+	m_message.Clear();
+}
+
+bool WebSocketDecoder::Feed(const char* lpData, DWORD dwCount, WebSocketCallback* pCallback)
+{
+	const unsigned char* data = reinterpret_cast<const unsigned char*>(lpData);
+	while (dwCount > 0 && m_state != STATE_CLOSED)
+	{
+		if (m_state == STATE_HEADER)
+		{
+			m_header[m_nHeaderLength++] = *data++;
+			dwCount--;
+			if (m_nHeaderLength < 2)
+			{
+				continue;
+			}
+			if ((m_header[1] & 0x80) == 0)
+			{
+				// The frames of a client must be masked.
+				Fail(WebSocket::STATUS_PROTOCOL_ERROR, pCallback);
+				break;
+			}
+			int nLength7 = m_header[1] & 0x7f;
+			int nExtended = (nLength7 == 126) ? 2 : (nLength7 == 127) ? 8 : 0;
+			if (m_nHeaderLength < 2 + nExtended + 4)
+			{
+				continue;
+			}
+			if (!ParseHeader(pCallback))
+			{
+				break;
+			}
+			if (m_nPayloadLength == 0)
+			{
+				CompleteFrame(pCallback);
+			}
+			else
+			{
+				m_state = STATE_PAYLOAD;
+			}
+			continue;
+		}
+
+		// Unmask the payload in chunks
+		char chunk[256];
+		int nCount = min(min(m_nPayloadLength - m_nPayloadRead, static_cast<int>(sizeof(chunk))), static_cast<int>(dwCount));
+		for (int i = 0; i < nCount; i++)
+		{
+			chunk[i] = static_cast<char>(data[i] ^ m_mask[(m_nPayloadRead + i) & 3]);
+		}
+		if (m_nOpcode >= WebSocket::OPCODE_CLOSE)
+		{
+			memcpy(m_control + m_nPayloadRead, chunk, nCount);
+		}
+		else
+		{
+			m_message.Append(chunk, nCount);
+		}
+		m_nPayloadRead += nCount;
+		data += nCount;
+		dwCount -= nCount;
+		if (m_nPayloadRead == m_nPayloadLength)
+		{
+			CompleteFrame(pCallback);
+		}
+	}
+	return m_state != STATE_CLOSED;
+}
+
+bool WebSocketDecoder::ParseHeader(WebSocketCallback* pCallback)
+{
+	m_bFinal = (m_header[0] & 0x80) != 0;
+	m_bCompressed = (m_header[0] & 0x40) != 0;
+	m_nOpcode = m_header[0] & 0x0f;
+	if (m_header[0] & 0x30)
+	{
+		// RSV2 and RSV3 are not used by any extension we support.
+		Fail(WebSocket::STATUS_PROTOCOL_ERROR, pCallback);
+		return false;
+	}
+
+	unsigned __int64 nLength = m_header[1] & 0x7f;
+	int nMaskOffset = 2;
+	if (nLength >= 126)
+	{
+		int nBytes = (nLength == 126) ? 2 : 8;
+		nLength = 0;
+		for (int i = 0; i < nBytes; i++)
+		{
+			nLength = (nLength << 8) | m_header[2 + i];
+		}
+		nMaskOffset += nBytes;
+		// The most significant bit of a 64-bit length must be 0 (RFC 6455 5.2).
+		if (nBytes == 8 && (nLength >> 63) != 0)
+		{
+			Fail(WebSocket::STATUS_PROTOCOL_ERROR, pCallback);
+			return false;
+		}
+	}
+	memcpy(m_mask, m_header + nMaskOffset, sizeof(m_mask));
+
+	if (m_nOpcode >= WebSocket::OPCODE_CLOSE)
+	{
+		// Control frames are short, not fragmented and not compressed.
+		if (!m_bFinal || m_bCompressed || nLength > sizeof(m_control) ||
+			(m_nOpcode != WebSocket::OPCODE_CLOSE && m_nOpcode != WebSocket::OPCODE_PING && m_nOpcode != WebSocket::OPCODE_PONG))
+		{
+			Fail(WebSocket::STATUS_PROTOCOL_ERROR, pCallback);
+			return false;
+		}
+	}
+	else if (m_nOpcode == WebSocket::OPCODE_CONTINUATION)
+	{
+		if (m_nMessageOpcode == WebSocket::OPCODE_CONTINUATION || m_bCompressed)
+		{
+			Fail(WebSocket::STATUS_PROTOCOL_ERROR, pCallback);
+			return false;
+		}
+	}
+	else if (m_nOpcode == WebSocket::OPCODE_TEXT || m_nOpcode == WebSocket::OPCODE_BINARY)
+	{
+		// A new message must not start before the previous one is complete.
+		if (m_nMessageOpcode != WebSocket::OPCODE_CONTINUATION || (m_bCompressed && !m_bDeflate))
+		{
+			Fail(WebSocket::STATUS_PROTOCOL_ERROR, pCallback);
+			return false;
+		}
+		m_nMessageOpcode = m_nOpcode;
+		m_bMessageCompressed = m_bCompressed;
+		m_message.Clear();
+	}
+	else
+	{
+		Fail(WebSocket::STATUS_PROTOCOL_ERROR, pCallback);
+		return false;
+	}
+
+	// Subtract rather than add, a huge length would wrap around.
+	if (m_nOpcode < WebSocket::OPCODE_CLOSE &&
+		nLength > static_cast<unsigned __int64>(MAX_MESSAGE_LENGTH - m_message.GetLength()))
+	{
+		Fail(WebSocket::STATUS_TOO_BIG, pCallback);
+		return false;
+	}
+
+	m_nPayloadLength = static_cast<int>(nLength);
+	m_nPayloadRead = 0;
+	return true;
+}
+
+void WebSocketDecoder::CompleteFrame(WebSocketCallback* pCallback)
+{
+	m_state = STATE_HEADER;
+	m_nHeaderLength = 0;
+
+	if (m_nOpcode >= WebSocket::OPCODE_CLOSE)
+	{
+		if (m_nOpcode == WebSocket::OPCODE_CLOSE)
+		{
+			m_state = STATE_CLOSED;
+		}
+		pCallback->OnWebSocketControl(m_nOpcode, m_control, m_nPayloadLength);
+		return;
+	}
+	if (!m_bFinal)
+	{
+		return;
+	}
+
+	bool bBinary = (m_nMessageOpcode == WebSocket::OPCODE_BINARY);
+	m_nMessageOpcode = WebSocket::OPCODE_CONTINUATION;
+	if (!m_bMessageCompressed)
+	{
+		pCallback->OnWebSocketMessage(m_message.GetData(), m_message.GetLength(), bBinary);
+		return;
+	}
+
+	// Restore the end of the empty stored block which the sender removed.
+	m_message.Append("\x00\x00\xff\xff", 4);
+	m_inflated.Clear();
+	Inflater inflater(reinterpret_cast<const unsigned char*>(m_message.GetData()), m_message.GetLength());
+	if (!inflater.Inflate(m_inflated, MAX_MESSAGE_LENGTH))
+	{
+		Fail(WebSocket::STATUS_INVALID_DATA, pCallback);
+		return;
+	}
+	pCallback->OnWebSocketMessage(m_inflated.GetData(), m_inflated.GetLength(), bBinary);
+}
+
+void WebSocketDecoder::Fail(int nStatusCode, WebSocketCallback* pCallback)
+{
+	m_state = STATE_CLOSED;
+	pCallback->OnWebSocketError(nStatusCode);
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "MessageEncoder.h"
+#include "Deflate.h"
+
+/**
+ * Receives what WebSocketDecoder decodes.
+ */
+class WebSocketCallback
+{
+public:
+	/**
+	 * A complete text or binary message has been received, already decompressed.
+	 * The data is only valid during the call.
+	 */
+	virtual void OnWebSocketMessage(const char* lpData, int nLength, bool bBinary) = 0;
+
+	// A ping, pong or close frame has been received.
+	virtual void OnWebSocketControl(int nOpcode, const char* lpData, int nLength) = 0;
+
+	// The client broke the protocol, close the connection with the status code.
+	virtual void OnWebSocketError(int nStatusCode) = 0;
+};
+
+/**
+ * The server side of the WebSocket protocol (RFC 6455), with the permessage-deflate
+ * extension (RFC 7692) in its "no context takeover" form.
+ */
+class WebSocket
+{
+public:
+	enum Opcode
+	{
+		OPCODE_CONTINUATION = 0x0,
+		OPCODE_TEXT = 0x1,
+		OPCODE_BINARY = 0x2,
+		OPCODE_CLOSE = 0x8,
+		OPCODE_PING = 0x9,
+		OPCODE_PONG = 0xa
+	};
+
+	enum StatusCode
+	{
+		STATUS_NORMAL = 1000,
+		STATUS_GOING_AWAY = 1001,
+		STATUS_PROTOCOL_ERROR = 1002,
+		STATUS_INVALID_DATA = 1007,
+		STATUS_TOO_BIG = 1009
+	};
+
+	// Smaller messages are not worth compressing.
+	static const int DEFLATE_THRESHOLD = 128;
+
+	/**
+	 * Check the HTTP upgrade request of a client and build the response.
+	 * @param szRequest The request line and headers, without the terminating empty line.
+	 * @param szAllowedOrigins Comma separated list of the web origins allowed to connect.
+	 * @param strResponse "101 Switching Protocols", or the HTTP error to send before closing.
+	 * @param bDeflate Set to true if permessage-deflate has been negotiated.
+	 * @return false if the handshake is refused.
+	 */
+	static bool Handshake(const char* szRequest, const char* szAllowedOrigins, CStringA &strResponse, bool &bDeflate);
+
+	/**
+	 * Append a message as a single unmasked frame.
+	 * If bDeflate, large messages are compressed with encoder, using scratch as temporary storage.
+	 */
+	static void WriteMessage(const char* lpData, int nLength, bool bBinary, bool bDeflate,
+		DeflateEncoder &encoder, MessageBuffer &scratch, MessageBuffer &buffer);
+
+	// Append a single unmasked frame.
+	static void WriteFrame(int nOpcode, bool bCompressed, const char* lpData, int nLength, MessageBuffer &buffer);
+
+	// Append a close frame with the status code.
+	static void WriteClose(int nStatusCode, MessageBuffer &buffer);
+
+private:
+	static bool IsAllowedOrigin(const CStringA &strOrigin, const char* szAllowedOrigins);
+	static bool ComputeAcceptKey(const CStringA &strKey, CStringA &strAccept);
+};
+
+/**
+ * Streaming decoder of the frames sent by a WebSocket client.
+ * Like CommandParser, it is fed the received data in chunks of any size. Fragmented
+ * messages are reassembled, and compressed messages are inflated.
+ */
+class WebSocketDecoder
+{
+public:
+	// Longer messages are refused with STATUS_TOO_BIG.
+	static const int MAX_MESSAGE_LENGTH = 16 * 1024;
+
+	WebSocketDecoder(void);
+
+	// Start decoding a new connection.
+	void Reset(bool bDeflate);
+
+	/**
+	 * Decode a chunk of received data.
+	 * Nothing is decoded after a close frame or an error has been reported.
+	 * @return false once the connection is closing.
+	 */
+	bool Feed(const char* lpData, DWORD dwCount, WebSocketCallback* pCallback);
+
+private:
+	// Parse the header in m_header, returns false if the frame is refused.
+	bool ParseHeader(WebSocketCallback* pCallback);
+	void CompleteFrame(WebSocketCallback* pCallback);
+	void Fail(int nStatusCode, WebSocketCallback* pCallback);
+
+	enum State
+	{
+		STATE_HEADER,		// Collecting the frame header
+		STATE_PAYLOAD,		// Collecting the payload
+		STATE_CLOSED		// Closing, ignore everything
+	};
+
+	State m_state;
+	bool m_bDeflate;
+
+	// The frame being received
+	unsigned char m_header[14];
+	int m_nHeaderLength;
+	int m_nOpcode;
+	bool m_bFinal;
+	bool m_bCompressed;
+	int m_nPayloadLength;
+	int m_nPayloadRead;
+	unsigned char m_mask[4];
+
+	// Payload of a control frame, which may arrive between the fragments of a message
+	char m_control[125];
+
+	// The message being reassembled, OPCODE_CONTINUATION if none
+	int m_nMessageOpcode;
+	bool m_bMessageCompressed;
+	MessageBuffer m_message;
+	MessageBuffer m_inflated;
+};
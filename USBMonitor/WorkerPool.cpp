@@ -0,0 +1,428 @@
+#include "StdAfx.h"
+#include "WorkerPool.h"
+
+#include <process.h>
+
+// Enough for a burst of tasks on every worker
+static const LONG MAX_FREE_TASKS = 256;
+
+BlockPool WorkerPool::s_taskPool(sizeof(Task), MAX_FREE_TASKS);
+
+struct PoolWorker
+{
+	WorkerPool* m_pPool;
+	int m_nIndex;
+	HANDLE m_hThread;
+	// Picks the first victim to steal from
+	ULONG m_ulRandom;
+
+	// Written by the worker only
+	volatile LONG m_lRun;
+	volatile LONG m_lStolen;
+
+	WorkDeque m_deque;
+};
+
+// The worker running on this thread, NULL on the other threads
+static __declspec(thread) PoolWorker* t_pCurrentWorker = NULL;
+
+//
+// FutureState
+//
+
+FutureState::FutureState(void)
+	: m_lRefs(1)
+	, m_lDone(0)
+{
+	::InitializeSRWLock(&m_lock);
+	::InitializeConditionVariable(&m_doneCondition);
+}
+
+void FutureState::Release()
+{
+	if (::InterlockedDecrement(&m_lRefs) == 0)
+	{
+		delete this;
+	}
+}
+
+void FutureState::SetDone()
+{
+	::AcquireSRWLockExclusive(&m_lock);
+	m_lDone = 1;
+	::ReleaseSRWLockExclusive(&m_lock);
+	::WakeAllConditionVariable(&m_doneCondition);
+}
+
+bool FutureState::Wait(DWORD dwTimeout)
+{
+	DWORD dwStart = ::GetTickCount();
+	bool bDone = true;
+	::AcquireSRWLockExclusive(&m_lock);
+	while (m_lDone == 0)
+	{
+		DWORD dwElapsed = ::GetTickCount() - dwStart;
+		if (dwTimeout != INFINITE && dwElapsed >= dwTimeout)
+		{
+			bDone = false;
+			break;
+		}
+		::SleepConditionVariableSRW(&m_doneCondition, &m_lock,
+			dwTimeout == INFINITE ? INFINITE : dwTimeout - dwElapsed, 0);
+	}
+	::ReleaseSRWLockExclusive(&m_lock);
+	return bDone;
+}
+
+//
+// WorkFuture
+//
+
+WorkFuture::WorkFuture(const WorkFuture& other)
+	: m_pState(other.m_pState)
+{
+	if (m_pState)
+	{
+		m_pState->AddRef();
+	}
+}
+
+WorkFuture& WorkFuture::operator=(const WorkFuture& other)
+{
+	if (other.m_pState)
+	{
+		other.m_pState->AddRef();
+	}
+	if (m_pState)
+	{
+		m_pState->Release();
+	}
+	m_pState = other.m_pState;
+	return *this;
+}
+
+WorkFuture::~WorkFuture(void)
+{
+	if (m_pState)
+	{
+		m_pState->Release();
+	}
+}
+
+bool WorkFuture::Wait(DWORD dwTimeout) const
+{
+	if (m_pState->IsDone())
+	{
+		return true;
+	}
+	WorkerPool::HelpUntilDone(m_pState);
+	return m_pState->Wait(dwTimeout);
+}
+
+//
+// WorkDeque
+//
+
+bool WorkDeque::Push(Task* pTask)
+{
+	LONG lBottom = m_lBottom;
+	if (Distance(m_lTop, lBottom) >= CAPACITY)
+	{
+		return false;
+	}
+	m_apTasks[lBottom & (CAPACITY - 1)] = pTask;
+	// A volatile store is a release: the thieves see the task before the new bottom.
+	m_lBottom = lBottom + 1;
+	return true;
+}
+
+Task* WorkDeque::Pop()
+{
+	LONG lBottom = m_lBottom - 1;
+	// A full barrier: the thieves see the bottom taken before the top is read.
+	::InterlockedExchange(&m_lBottom, lBottom);
+	LONG lTop = m_lTop;
+	LONG lSize = Distance(lTop, lBottom);
+	if (lSize < 0)
+	{
+		// Empty
+		m_lBottom = lBottom + 1;
+		return NULL;
+	}
+	Task* pTask = m_apTasks[lBottom & (CAPACITY - 1)];
+	if (lSize > 0)
+	{
+		return pTask;
+	}
+	// The last task, a thief may be taking it too.
+	if (::InterlockedCompareExchange(&m_lTop, lTop + 1, lTop) != lTop)
+	{
+		pTask = NULL;
+	}
+	m_lBottom = lTop + 1;
+	return pTask;
+}
+
+Task* WorkDeque::Steal(bool& bContended)
+{
+	LONG lTop = m_lTop;
+	::MemoryBarrier();
+	LONG lBottom = m_lBottom;
+	if (Distance(lTop, lBottom) <= 0)
+	{
+		return NULL;
+	}
+	Task* pTask = m_apTasks[lTop & (CAPACITY - 1)];
+	if (::InterlockedCompareExchange(&m_lTop, lTop + 1, lTop) != lTop)
+	{
+		bContended = true;
+		return NULL;
+	}
+	return pTask;
+}
+
+//
+// WorkerPool
+//
+
+WorkerPool::WorkerPool(int nWorkers)
+	: m_lStop(0)
+	, m_lSubmittedCount(0)
+	, m_lSubmittedTotal(0)
+	, m_lSleeping(0)
+{
+	if (nWorkers <= 0)
+	{
+		SYSTEM_INFO info;
+		::GetSystemInfo(&info);
+		nWorkers = static_cast<int>(info.dwNumberOfProcessors);
+	}
+	m_hWakeSemaphore = ::CreateSemaphore(NULL, 0, MAXLONG, NULL);
+
+	// All the workers exist before any of them steals.
+	for (int i = 0; i < nWorkers; i++)
+	{
+		PoolWorker* pWorker = new PoolWorker;
+		pWorker->m_pPool = this;
+		pWorker->m_nIndex = i;
+		pWorker->m_hThread = NULL;
+		pWorker->m_ulRandom = 2463534242UL + i;
+		pWorker->m_lRun = 0;
+		pWorker->m_lStolen = 0;
+		m_aWorkers.push_back(pWorker);
+	}
+	for (int i = 0; i < nWorkers; i++)
+	{
+		m_aWorkers[i]->m_hThread = reinterpret_cast<HANDLE>(::_beginthreadex(NULL, 0, WorkerProc,
+			m_aWorkers[i], 0, NULL));
+	}
+}
+
+WorkerPool::~WorkerPool(void)
+{
+	::InterlockedExchange(&m_lStop, 1);
+	::ReleaseSemaphore(m_hWakeSemaphore, static_cast<LONG>(m_aWorkers.size()), NULL);
+	for (size_t i = 0; i < m_aWorkers.size(); i++)
+	{
+		if (m_aWorkers[i]->m_hThread)
+		{
+			::WaitForSingleObject(m_aWorkers[i]->m_hThread, INFINITE);
+			::CloseHandle(m_aWorkers[i]->m_hThread);
+		}
+	}
+	// The tasks of a worker which couldn't start
+	Task* pTask;
+	while ((pTask = TakeSubmitted()) != NULL)
+	{
+		RunTask(pTask);
+	}
+	for (size_t i = 0; i < m_aWorkers.size(); i++)
+	{
+		while ((pTask = m_aWorkers[i]->m_deque.Pop()) != NULL)
+		{
+			RunTask(pTask);
+		}
+		delete m_aWorkers[i];
+	}
+	::CloseHandle(m_hWakeSemaphore);
+}
+
+void WorkerPool::Submit(Task task)
+{
+	Task* pTask = new (s_taskPool.Alloc()) Task(std::move(task));
+	PoolWorker* pWorker = t_pCurrentWorker;
+	if (pWorker == NULL || pWorker->m_pPool != this || !pWorker->m_deque.Push(pTask))
+	{
+		m_csSubmitted.Enter();
+		m_submitted.push_back(pTask);
+		m_lSubmittedCount++;
+		m_csSubmitted.Leave();
+		::InterlockedIncrement(&m_lSubmittedTotal);
+	}
+	WakeWorker();
+}
+
+void WorkerPool::GetStats(Json::Value &stats) const
+{
+	LONG lRun = 0;
+	LONG lStolen = 0;
+	LONG lQueued = m_lSubmittedCount;
+	for (size_t i = 0; i < m_aWorkers.size(); i++)
+	{
+		lRun += m_aWorkers[i]->m_lRun;
+		lStolen += m_aWorkers[i]->m_lStolen;
+		lQueued += m_aWorkers[i]->m_deque.GetSize();
+	}
+	stats["workers"] = GetWorkerCount();
+	stats["run"] = static_cast<int>(lRun);
+	stats["stolen"] = static_cast<int>(lStolen);
+	stats["submitted"] = static_cast<int>(m_lSubmittedTotal);
+	stats["queued"] = static_cast<int>(lQueued);
+}
+
+unsigned __stdcall WorkerPool::WorkerProc(void* pParam)
+{
+	PoolWorker* pWorker = static_cast<PoolWorker*>(pParam);
+	t_pCurrentWorker = pWorker;
+	pWorker->m_pPool->Work(pWorker);
+	t_pCurrentWorker = NULL;
+	return 0;
+}
+
+void WorkerPool::Work(PoolWorker* pWorker)
+{
+	for (;;)
+	{
+		Task* pTask = FindTask(pWorker);
+		if (pTask != NULL)
+		{
+			RunTask(pTask);
+			pWorker->m_lRun++;
+			continue;
+		}
+
+		// Count the worker as sleeping before it looks again, so that a task queued
+		// meanwhile either is found or wakes it.
+		::InterlockedIncrement(&m_lSleeping);
+		pTask = FindTask(pWorker);
+		if (pTask != NULL)
+		{
+			::InterlockedDecrement(&m_lSleeping);
+			RunTask(pTask);
+			pWorker->m_lRun++;
+			continue;
+		}
+		if (m_lStop != 0)
+		{
+			::InterlockedDecrement(&m_lSleeping);
+			return;
+		}
+		::WaitForSingleObject(m_hWakeSemaphore, INFINITE);
+		::InterlockedDecrement(&m_lSleeping);
+	}
+}
+
+Task* WorkerPool::FindTask(PoolWorker* pWorker)
+{
+	Task* pTask = pWorker->m_deque.Pop();
+	if (pTask == NULL)
+	{
+		pTask = TakeSubmitted();
+	}
+	if (pTask == NULL)
+	{
+		pTask = StealTask(pWorker);
+	}
+	return pTask;
+}
+
+Task* WorkerPool::TakeSubmitted()
+{
+	if (m_lSubmittedCount == 0)
+	{
+		return NULL;
+	}
+	Task* pTask = NULL;
+	m_csSubmitted.Enter();
+	if (!m_submitted.empty())
+	{
+		pTask = m_submitted.front();
+		m_submitted.pop_front();
+		m_lSubmittedCount--;
+	}
+	m_csSubmitted.Leave();
+	return pTask;
+}
+
+Task* WorkerPool::StealTask(PoolWorker* pWorker)
+{
+	size_t nWorkers = m_aWorkers.size();
+	if (nWorkers < 2)
+	{
+		return NULL;
+	}
+	// xorshift, so that the thieves don't all start with the same victim
+	ULONG ulRandom = pWorker->m_ulRandom;
+	ulRandom ^= ulRandom << 13;
+	ulRandom ^= ulRandom >> 17;
+	ulRandom ^= ulRandom << 5;
+	pWorker->m_ulRandom = ulRandom;
+
+	bool bContended;
+	do
+	{
+		bContended = false;
+		for (size_t i = 0; i < nWorkers; i++)
+		{
+			PoolWorker* pVictim = m_aWorkers[(ulRandom + i) % nWorkers];
+			if (pVictim == pWorker)
+			{
+				continue;
+			}
+			Task* pTask = pVictim->m_deque.Steal(bContended);
+			if (pTask != NULL)
+			{
+				pWorker->m_lStolen++;
+				return pTask;
+			}
+		}
+		// Another thief took a task first, there may be more.
+	} while (bContended);
+	return NULL;
+}
+
+void WorkerPool::RunTask(Task* pTask)
+{
+	(*pTask)();
+	pTask->~Task();
+	s_taskPool.Free(pTask);
+}
+
+void WorkerPool::HelpUntilDone(FutureState* pState)
+{
+	PoolWorker* pWorker = t_pCurrentWorker;
+	if (pWorker == NULL)
+	{
+		return;
+	}
+	while (!pState->IsDone())
+	{
+		Task* pTask = pWorker->m_pPool->FindTask(pWorker);
+		if (pTask == NULL)
+		{
+			return;
+		}
+		RunTask(pTask);
+		pWorker->m_lRun++;
+	}
+}
+
+void WorkerPool::WakeWorker()
+{
+	// A full barrier: the task is queued before the sleeping workers are counted.
+	::MemoryBarrier();
+	if (m_lSleeping > 0)
+	{
+		::ReleaseSemaphore(m_hWakeSemaphore, 1, NULL);
+	}
+}
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <deque>
+#include "Task.h"
+
+/**
+ * The state a future shares with the task completing it. A waiter sleeps on a condition
+ * variable, which needs no kernel object, so a future costs one small allocation.
+ */
+class FutureState
+{
+public:
+	FutureState(void);
+	virtual ~FutureState(void) {}
+
+	void AddRef() { ::InterlockedIncrement(&m_lRefs); }
+	void Release();
+
+	// Called once by the task, after it has stored its result.
+	void SetDone();
+
+	bool IsDone() const { return m_lDone != 0; }
+
+	// Block until the task is done, false on timeout.
+	bool Wait(DWORD dwTimeout);
+
+private:
+	// Not copyable
+	FutureState(const FutureState&);
+	FutureState& operator=(const FutureState&);
+
+	volatile LONG m_lRefs;
+	volatile LONG m_lDone;
+	SRWLOCK m_lock;
+	CONDITION_VARIABLE m_doneCondition;
+};
+
+// The state of a task computing a T, which must be default constructible.
+template <typename T>
+class FutureValue : public FutureState
+{
+public:
+	T m_value;
+};
+
+/**
+ * Waits for a task run by a WorkerPool. Copies share the task.
+ */
+class WorkFuture
+{
+public:
+	WorkFuture(void) : m_pState(NULL) {}
+	// Takes over a reference of the state.
+	explicit WorkFuture(FutureState* pState) : m_pState(pState) {}
+	WorkFuture(const WorkFuture& other);
+	WorkFuture& operator=(const WorkFuture& other);
+	~WorkFuture(void);
+
+	bool IsValid() const { return m_pState != NULL; }
+
+	bool IsDone() const { return m_pState->IsDone(); }
+
+	/**
+	 * Wait for the task. On a worker thread the worker runs the queued tasks meanwhile,
+	 * so that a task waiting for the tasks it submitted can't starve the pool; the
+	 * timeout only applies once no task is left to run.
+	 * @return false on timeout.
+	 */
+	bool Wait(DWORD dwTimeout = INFINITE) const;
+
+protected:
+	FutureState* m_pState;
+};
+
+template <typename T>
+class Future : public WorkFuture
+{
+public:
+	Future(void) {}
+	explicit Future(FutureValue<T>* pState) : WorkFuture(pState) {}
+
+	// Wait for the task and return its result.
+	const T& Get() const
+	{
+		Wait();
+		return static_cast<FutureValue<T>*>(m_pState)->m_value;
+	}
+};
+
+/**
+ * A bounded double ended queue of tasks, the one of Chase and Lev: its worker pushes and
+ * pops the tasks at the bottom without a lock, the newest first while its data is hot,
+ * and the other workers steal the oldest ones at the top with a compare and exchange.
+ * The owner only races the thieves for the last task. The indexes wrap around.
+ */
+class WorkDeque
+{
+public:
+	static const LONG CAPACITY = 1024;
+
+	WorkDeque(void) : m_lTop(0), m_lBottom(0) {}
+
+	// Owner only: false if the deque is full.
+	bool Push(Task* pTask);
+
+	// Owner only: the newest task, NULL if the deque is empty.
+	Task* Pop();
+
+	// Any thread: the oldest task, NULL if the deque is empty or bContended is set
+	// because another thread took it first.
+	Task* Steal(bool& bContended);
+
+	// An estimate, the owner and the thieves may be changing it.
+	LONG GetSize() const
+	{
+		LONG lSize = Distance(m_lTop, m_lBottom);
+		return lSize > 0 ? lSize : 0;
+	}
+
+private:
+	// Not copyable
+	WorkDeque(const WorkDeque&);
+	WorkDeque& operator=(const WorkDeque&);
+
+	// lTo - lFrom, correct across a wraparound
+	static LONG Distance(LONG lFrom, LONG lTo)
+	{
+		return static_cast<LONG>(static_cast<ULONG>(lTo) - static_cast<ULONG>(lFrom));
+	}
+
+	// Written by the thieves, on another cache line than the bottom the owner writes
+	volatile LONG m_lTop;
+	char m_padding[64 - sizeof(LONG)];
+	volatile LONG m_lBottom;
+	Task* volatile m_apTasks[CAPACITY];
+};
+
+struct PoolWorker;
+
+/**
+ * A work stealing thread pool. Each worker runs the tasks of its own WorkDeque, where
+ * the tasks it submits go, then the tasks submitted by the other threads, then steals
+ * from the other workers; only then it sleeps on a semaphore. A submitter wakes a worker
+ * only if one sleeps, so a busy pool takes no kernel call.
+ *
+ * Submit may be called from any thread while the pool exists. The destructor runs the
+ * tasks left before it joins the workers.
+ */
+class WorkerPool
+{
+public:
+	/**
+	 * Start the workers.
+	 * @param nWorkers The number of workers, 0 for one per processor.
+	 */
+	WorkerPool(int nWorkers = 0);
+	~WorkerPool(void);
+
+	int GetWorkerCount() const { return static_cast<int>(m_aWorkers.size()); }
+
+	// Run a task on a worker.
+	void Submit(Task task);
+
+	// Run func() on a worker, the future tells when it has returned.
+	template <typename F>
+	WorkFuture Run(F func);
+
+	// Run func() on a worker, the future gets what it returns.
+	template <typename F>
+	auto Compute(F func) -> Future<decltype(func())>;
+
+	// {"workers", "run", "stolen", "submitted", "queued"}
+	void GetStats(Json::Value &stats) const;
+
+private:
+	// Not copyable
+	WorkerPool(const WorkerPool&);
+	WorkerPool& operator=(const WorkerPool&);
+
+	friend class WorkFuture;
+
+	static unsigned __stdcall WorkerProc(void* pParam);
+	void Work(PoolWorker* pWorker);
+
+	// The next task for a worker, NULL if there is none.
+	Task* FindTask(PoolWorker* pWorker);
+	Task* TakeSubmitted();
+	Task* StealTask(PoolWorker* pWorker);
+
+	// Run the task and return its memory.
+	static void RunTask(Task* pTask);
+
+	// On a worker thread, run tasks until the state is done or no task is left.
+	static void HelpUntilDone(FutureState* pState);
+
+	// Wake a sleeping worker after a task was queued.
+	void WakeWorker();
+
+	std::vector<PoolWorker*> m_aWorkers;
+	volatile LONG m_lStop;
+
+	// Tasks submitted by the other threads, or by a worker whose deque is full
+	CCriticalSection m_csSubmitted;
+	std::deque<Task*> m_submitted;
+	volatile LONG m_lSubmittedCount;
+	volatile LONG m_lSubmittedTotal;
+
+	// Counts the workers going to sleep on m_hWakeSemaphore
+	volatile LONG m_lSleeping;
+	HANDLE m_hWakeSemaphore;
+
+	// The memory of the queued tasks, shared by the pools
+	static BlockPool s_taskPool;
+};
+
+template <typename F>
+WorkFuture WorkerPool::Run(F func)
+{
+	FutureState* pState = new FutureState;
+	WorkFuture future(pState);
+	pState->AddRef();
+	Submit([pState, func]() mutable
+	{
+		func();
+		pState->SetDone();
+		pState->Release();
+	});
+	return future;
+}
+
+template <typename F>
+auto WorkerPool::Compute(F func) -> Future<decltype(func())>
+{
+	typedef decltype(func()) T;
+	FutureValue<T>* pState = new FutureValue<T>;
+	Future<T> future(pState);
+	pState->AddRef();
+	Submit([pState, func]() mutable
+	{
+		pState->m_value = func();
+		pState->SetDone();
+		pState->Release();
+	});
+	return future;
+}
@@ -0,0 +1,343 @@
+// LockBench.cpp: compares the mutex and event classes of USBMonitor/Thread with the
+// kernel objects they used to wrap.
+//
+// KernelMutex and KernelEvent below are the former CMutexClass and CEventClass: a
+// kernel mutex and an auto-reset kernel event, with the same ownership checks. Each
+// case runs with both, uncontended and contended, and reports the nanoseconds per
+// operation and the speedup of the current classes.
+//////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "Thread.h"
+
+//
+// The kernel object versions
+//
+
+class KernelMutex
+{
+public:
+	KernelMutex(void) : m_owner(0) { m_hMutex = ::CreateMutex(NULL, FALSE, NULL); }
+	~KernelMutex(void) { ::CloseHandle(m_hMutex); }
+
+	void Lock()
+	{
+		ThreadId_t id = CThread::ThreadId();
+		if (m_owner == id)
+		{
+			abort();
+		}
+		::WaitForSingleObject(m_hMutex, INFINITE);
+		m_owner = id;
+	}
+
+	void Unlock()
+	{
+		if (m_owner != CThread::ThreadId())
+		{
+			abort();
+		}
+		m_owner = 0;
+		::ReleaseMutex(m_hMutex);
+	}
+
+private:
+	HANDLE m_hMutex;
+	volatile ThreadId_t m_owner;
+};
+
+class KernelEvent
+{
+public:
+	KernelEvent(void) : m_owner(0) { m_hEvent = ::CreateEvent(NULL, FALSE, FALSE, NULL); }
+	~KernelEvent(void) { ::CloseHandle(m_hEvent); }
+
+	void Set() { ::SetEvent(m_hEvent); }
+
+	BOOL Wait()
+	{
+		if (m_owner != 0)
+		{
+			abort();
+		}
+		m_owner = CThread::ThreadId();
+		return ::WaitForSingleObject(m_hEvent, INFINITE) == WAIT_OBJECT_0;
+	}
+
+	void Reset() { m_owner = 0; }
+
+private:
+	HANDLE m_hEvent;
+	volatile ThreadId_t m_owner;
+};
+
+// The former CTask status: an enum behind a kernel mutex
+class KernelTaskStatus
+{
+public:
+	KernelTaskStatus(void) : m_state(TaskStatusNotSubmitted) {}
+
+	void SetTaskStatus(TaskStatus_t state)
+	{
+		m_mutex.Lock();
+		m_state = state;
+		m_mutex.Unlock();
+	}
+
+	TaskStatus_t Status()
+	{
+		m_mutex.Lock();
+		TaskStatus_t state = m_state;
+		m_mutex.Unlock();
+		return state;
+	}
+
+private:
+	KernelMutex m_mutex;
+	TaskStatus_t m_state;
+};
+
+class NullTask : public CTask
+{
+public:
+	virtual BOOL Task() { return TRUE; }
+};
+
+//
+// The cases
+//
+
+static LONGLONG Now()
+{
+	LARGE_INTEGER counter;
+	::QueryPerformanceCounter(&counter);
+	return counter.QuadPart;
+}
+
+static double ToNanoseconds(LONGLONG llTicks)
+{
+	LARGE_INTEGER frequency;
+	::QueryPerformanceFrequency(&frequency);
+	return static_cast<double>(llTicks) * 1e9 / static_cast<double>(frequency.QuadPart);
+}
+
+// Run nThreads copies of func at once and return the ticks until the last one ends.
+template <typename F>
+static LONGLONG RunThreads(int nThreads, F func)
+{
+	struct Start
+	{
+		static unsigned __stdcall Proc(void* pParam)
+		{
+			Start* pStart = static_cast<Start*>(pParam);
+			::WaitForSingleObject(pStart->m_hGo, INFINITE);
+			(*pStart->m_pFunc)();
+			return 0;
+		}
+		HANDLE m_hGo;
+		F* m_pFunc;
+	};
+	Start start;
+	start.m_hGo = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+	start.m_pFunc = &func;
+
+	HANDLE* phThreads = new HANDLE[nThreads];
+	for (int i = 0; i < nThreads; i++)
+	{
+		phThreads[i] = reinterpret_cast<HANDLE>(::_beginthreadex(NULL, 0, Start::Proc, &start, 0, NULL));
+	}
+	LONGLONG llStart = Now();
+	::SetEvent(start.m_hGo);
+	for (int i = 0; i < nThreads; i++)
+	{
+		::WaitForSingleObject(phThreads[i], INFINITE);
+		::CloseHandle(phThreads[i]);
+	}
+	LONGLONG llTicks = Now() - llStart;
+	delete [] phThreads;
+	::CloseHandle(start.m_hGo);
+	return llTicks;
+}
+
+// Lock and unlock from one thread
+template <typename Mutex>
+static LONGLONG LockUncontended(int nIterations)
+{
+	Mutex mutex;
+	LONGLONG llStart = Now();
+	for (int i = 0; i < nIterations; i++)
+	{
+		mutex.Lock();
+		mutex.Unlock();
+	}
+	return Now() - llStart;
+}
+
+// nThreads threads increment a counter under the lock, nIterations times in all
+template <typename Mutex>
+static LONGLONG LockContended(int nIterations, int nThreads)
+{
+	Mutex mutex;
+	volatile LONG lCounter = 0;
+	int nEach = nIterations / nThreads;
+	LONGLONG llTicks = RunThreads(nThreads, [&mutex, &lCounter, nEach]()
+	{
+		for (int i = 0; i < nEach; i++)
+		{
+			mutex.Lock();
+			lCounter++;
+			mutex.Unlock();
+		}
+	});
+	if (lCounter != nEach * nThreads)
+	{
+		fprintf(stderr, "lost increments: %ld of %d\n", lCounter, nEach * nThreads);
+	}
+	return llTicks;
+}
+
+// Set an event and wait for it on the same thread, the event is never waited for
+template <typename Event>
+static LONGLONG EventUncontended(int nIterations)
+{
+	Event event;
+	LONGLONG llStart = Now();
+	for (int i = 0; i < nIterations; i++)
+	{
+		event.Set();
+		event.Wait();
+		event.Reset();
+	}
+	return Now() - llStart;
+}
+
+// Two threads hand a token back and forth, each round trip is two wakeups
+template <typename Event>
+static LONGLONG EventPingPong(int nRoundTrips)
+{
+	Event ping;
+	Event pong;
+	struct Ponger
+	{
+		static unsigned __stdcall Proc(void* pParam)
+		{
+			Ponger* pPonger = static_cast<Ponger*>(pParam);
+			for (int i = 0; i < pPonger->m_nRoundTrips; i++)
+			{
+				pPonger->m_pPing->Wait();
+				pPonger->m_pPing->Reset();
+				pPonger->m_pPong->Set();
+			}
+			return 0;
+		}
+		Event* m_pPing;
+		Event* m_pPong;
+		int m_nRoundTrips;
+	};
+	Ponger ponger = { &ping, &pong, nRoundTrips };
+	HANDLE hThread = reinterpret_cast<HANDLE>(::_beginthreadex(NULL, 0, Ponger::Proc, &ponger, 0, NULL));
+
+	LONGLONG llStart = Now();
+	for (int i = 0; i < nRoundTrips; i++)
+	{
+		ping.Set();
+		pong.Wait();
+		pong.Reset();
+	}
+	LONGLONG llTicks = Now() - llStart;
+	::WaitForSingleObject(hThread, INFINITE);
+	::CloseHandle(hThread);
+	return llTicks;
+}
+
+// Write then read the status of a task, as CThread and its callers do
+template <typename Task>
+static LONGLONG TaskStatus(int nIterations, int nThreads)
+{
+	Task task;
+	int nEach = nIterations / nThreads;
+	return RunThreads(nThreads, [&task, nEach]()
+	{
+		for (int i = 0; i < nEach; i++)
+		{
+			task.SetTaskStatus(TaskStatusBeingProcessed);
+			if (task.Status() == TaskStatusNotSubmitted)
+			{
+				abort();
+			}
+		}
+	});
+}
+
+static void PrintCase(const char* szName, int nOperations, LONGLONG llBefore, LONGLONG llAfter)
+{
+	double dBefore = ToNanoseconds(llBefore) / nOperations;
+	double dAfter = ToNanoseconds(llAfter) / nOperations;
+	printf("%-28s %12.1f %12.1f %9.1fx\n", szName, dBefore, dAfter, dAfter > 0 ? dBefore / dAfter : 0.0);
+}
+
+static void PrintUsage()
+{
+	printf(
+		"Usage: lock_bench [options]\n"
+		"  --iterations N    lock operations in each case (1000000)\n"
+		"  --round-trips N   event round trips between two threads (100000)\n"
+		"  --threads N       threads of the contended cases (number of processors)\n");
+}
+
+int main(int argc, char* argv[])
+{
+	SYSTEM_INFO info;
+	::GetSystemInfo(&info);
+	int nIterations = 1000000;
+	int nRoundTrips = 100000;
+	int nThreads = static_cast<int>(info.dwNumberOfProcessors);
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 >= argc)
+		{
+			PrintUsage();
+			return 2;
+		}
+		const char* szName = argv[i];
+		int nValue = atoi(argv[++i]);
+		if (strcmp(szName, "--iterations") == 0)
+		{
+			nIterations = nValue;
+		}
+		else if (strcmp(szName, "--round-trips") == 0)
+		{
+			nRoundTrips = nValue;
+		}
+		else if (strcmp(szName, "--threads") == 0)
+		{
+			nThreads = nValue;
+		}
+		else
+		{
+			PrintUsage();
+			return 2;
+		}
+	}
+	if (nIterations <= 0 || nRoundTrips <= 0 || nThreads <= 0)
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	printf("%d iterations, %d round trips, %d threads\n", nIterations, nRoundTrips, nThreads);
+	printf("%-28s %12s %12s %10s\n", "nanoseconds per operation", "kernel", "user mode", "speedup");
+	PrintCase("mutex uncontended", nIterations,
+		LockUncontended<KernelMutex>(nIterations), LockUncontended<CMutexClass>(nIterations));
+	PrintCase("mutex contended", nIterations,
+		LockContended<KernelMutex>(nIterations, nThreads), LockContended<CMutexClass>(nIterations, nThreads));
+	PrintCase("event set and wait", nIterations,
+		EventUncontended<KernelEvent>(nIterations), EventUncontended<CEventClass>(nIterations));
+	PrintCase("event ping-pong round trip", nRoundTrips,
+		EventPingPong<KernelEvent>(nRoundTrips), EventPingPong<CEventClass>(nRoundTrips));
+	PrintCase("task status uncontended", nIterations,
+		TaskStatus<KernelTaskStatus>(nIterations, 1), TaskStatus<NullTask>(nIterations, 1));
+	PrintCase("task status contended", nIterations,
+		TaskStatus<KernelTaskStatus>(nIterations, nThreads), TaskStatus<NullTask>(nIterations, nThreads));
+	return 0;
+}
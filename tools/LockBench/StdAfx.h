@@ -0,0 +1,13 @@
+// StdAfx.h: the build of the lock benchmark.
+//
+// The benchmark compiles the mutex and event classes of USBMonitor/Thread as they are.
+// This header stands in for USBMonitor/stdafx.h, which they only need for windows.h.
+//////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <windows.h>
+#include <process.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
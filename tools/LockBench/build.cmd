@@ -0,0 +1,4 @@
+@rem Build of the lock benchmark, from a Visual Studio command prompt: build && lock_bench --help
+@rem
+@rem The mutex and event classes of USBMonitor\Thread are compiled from the source tree.
+cl /nologo /O2 /EHsc /MT /W3 /I. /I..\..\USBMonitor\Thread LockBench.cpp ..\..\USBMonitor\Thread\MutexClass.cpp ..\..\USBMonitor\Thread\EventClass.cpp user32.lib /Fe:lock_bench.exe
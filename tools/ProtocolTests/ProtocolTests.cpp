@@ -0,0 +1,158 @@
+// ProtocolTests.cpp: regression tests of the protocol code of USBMonitor.
+//
+// Each test feeds frames built by hand to a WebSocketDecoder and checks what it
+// reports. Run under a memory checker, e.g. CXXFLAGS="-g -fsanitize=address", so that
+// an out of bounds access fails the test too.
+//////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "WebSocket.h"
+
+// Records what the decoder reports
+class RecordingCallback : public WebSocketCallback
+{
+public:
+	RecordingCallback(void) : m_nMessages(0), m_nStatusCode(0) {}
+
+	virtual void OnWebSocketMessage(const char* lpData, int nLength, bool /*bBinary*/)
+	{
+		m_nMessages++;
+		m_strMessage.assign(lpData, nLength);
+	}
+
+	virtual void OnWebSocketControl(int /*nOpcode*/, const char* /*lpData*/, int /*nLength*/)
+	{
+	}
+
+	virtual void OnWebSocketError(int nStatusCode)
+	{
+		m_nStatusCode = nStatusCode;
+	}
+
+	int m_nMessages;
+	std::string m_strMessage;
+	int m_nStatusCode;
+};
+
+// Append the header of a masked client frame, with a zero mask.
+static void AppendHeader(std::string &frame, int nOpcode, bool bFinal, unsigned long long nLength)
+{
+	frame += static_cast<char>((bFinal ? 0x80 : 0) | nOpcode);
+	if (nLength < 126)
+	{
+		frame += static_cast<char>(0x80 | nLength);
+	}
+	else if (nLength <= 0xffff)
+	{
+		frame += static_cast<char>(0x80 | 126);
+		frame += static_cast<char>(nLength >> 8);
+		frame += static_cast<char>(nLength & 0xff);
+	}
+	else
+	{
+		frame += static_cast<char>(0x80 | 127);
+		for (int i = 7; i >= 0; i--)
+		{
+			frame += static_cast<char>((nLength >> (i * 8)) & 0xff);
+		}
+	}
+	frame.append(4, '\0');
+}
+
+static void AppendFrame(std::string &frame, int nOpcode, bool bFinal, const std::string &strPayload)
+{
+	AppendHeader(frame, nOpcode, bFinal, strPayload.size());
+	frame += strPayload;
+}
+
+static int s_nFailures = 0;
+
+static void Check(bool bCondition, const char* szTest, const char* szWhat)
+{
+	if (!bCondition)
+	{
+		printf("FAIL %s: %s\n", szTest, szWhat);
+		s_nFailures++;
+	}
+}
+
+// A fragmented message is reassembled.
+static void TestFragmentedMessage()
+{
+	std::string data;
+	AppendFrame(data, WebSocket::OPCODE_TEXT, false, "hello ");
+	AppendFrame(data, WebSocket::OPCODE_CONTINUATION, true, "world");
+
+	WebSocketDecoder decoder;
+	RecordingCallback callback;
+	Check(decoder.Feed(data.data(), static_cast<DWORD>(data.size()), &callback), "fragmented message", "refused");
+	Check(callback.m_nMessages == 1 && callback.m_strMessage == "hello world", "fragmented message", "not reassembled");
+	Check(callback.m_nStatusCode == 0, "fragmented message", "error reported");
+}
+
+// A continuation frame whose 64-bit length would wrap the message length around
+// is refused before any of its payload is read.
+static void TestOversizedContinuation()
+{
+	std::string data;
+	AppendFrame(data, WebSocket::OPCODE_TEXT, false, std::string(100, 'a'));
+	AppendHeader(data, WebSocket::OPCODE_CONTINUATION, true, 0xffffffffffffffffULL - 50);
+	data.append(300, 'b');
+
+	WebSocketDecoder decoder;
+	RecordingCallback callback;
+	Check(!decoder.Feed(data.data(), static_cast<DWORD>(data.size()), &callback), "oversized continuation", "accepted");
+	Check(callback.m_nStatusCode == WebSocket::STATUS_PROTOCOL_ERROR, "oversized continuation", "not reported a protocol error");
+	Check(callback.m_nMessages == 0, "oversized continuation", "message delivered");
+}
+
+// A continuation frame taking the message over the limit is refused.
+static void TestContinuationOverLimit()
+{
+	const unsigned long long lengths[] = { WebSocketDecoder::MAX_MESSAGE_LENGTH - 1000 + 1, 0x7fffffffffffffffULL };
+	for (int i = 0; i < 2; i++)
+	{
+		std::string data;
+		AppendFrame(data, WebSocket::OPCODE_BINARY, false, std::string(1000, 'a'));
+		AppendHeader(data, WebSocket::OPCODE_CONTINUATION, true, lengths[i]);
+
+		WebSocketDecoder decoder;
+		RecordingCallback callback;
+		Check(!decoder.Feed(data.data(), static_cast<DWORD>(data.size()), &callback), "continuation over the limit", "accepted");
+		Check(callback.m_nStatusCode == WebSocket::STATUS_TOO_BIG, "continuation over the limit", "not reported too big");
+	}
+}
+
+// A compressed message made of a fixed Huffman block is inflated.
+static void TestCompressedMessage()
+{
+	// "hello hello hello world" deflated, without the trailing 00 00 ff ff
+	static const unsigned char payload[] =
+	{
+		0xca, 0x48, 0xcd, 0xc9, 0xc9, 0x57, 0xc8, 0x40, 0x22, 0xcb, 0xf3, 0x8b, 0x72, 0x52, 0x00, 0x00
+	};
+	std::string data;
+	AppendFrame(data, WebSocket::OPCODE_TEXT, true, std::string(reinterpret_cast<const char*>(payload), sizeof(payload)));
+	data[0] |= 0x40;
+
+	WebSocketDecoder decoder;
+	decoder.Reset(true);
+	RecordingCallback callback;
+	Check(decoder.Feed(data.data(), static_cast<DWORD>(data.size()), &callback), "compressed message", "refused");
+	Check(callback.m_nMessages == 1 && callback.m_strMessage == "hello hello hello world", "compressed message", "not inflated");
+}
+
+int main()
+{
+	TestFragmentedMessage();
+	TestOversizedContinuation();
+	TestContinuationOverLimit();
+	TestCompressedMessage();
+	if (s_nFailures > 0)
+	{
+		printf("%d failures\n", s_nFailures);
+		return 1;
+	}
+	printf("all tests passed\n");
+	return 0;
+}
@@ -0,0 +1,163 @@
+// StdAfx.h: the Linux build of the protocol tests.
+//
+// The tests compile the protocol code of USBMonitor as it is. This header stands in
+// for USBMonitor/stdafx.h and maps the few Windows, ATL and MSVC names that code uses.
+// The handshake hashes with CryptoAPI, which is not available here: the stubs below
+// fail, so only the frame decoding and the compression are tested.
+//////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+typedef uint32_t DWORD;
+typedef int64_t LONGLONG;
+typedef unsigned char BYTE;
+typedef const char* LPCSTR;
+typedef char* LPSTR;
+
+using std::max;
+using std::min;
+
+#define _I8_MIN		INT8_MIN
+#define _I16_MIN	INT16_MIN
+#define _I32_MIN	INT32_MIN
+#define _UI8_MAX	UINT8_MAX
+#define _UI16_MAX	UINT16_MAX
+#define _UI32_MAX	UINT32_MAX
+#define _TRUNCATE	((size_t)-1)
+
+inline int _stricmp(const char* a, const char* b)
+{
+	return strcasecmp(a, b);
+}
+
+inline void _i64toa_s(long long value, char* buffer, size_t size, int /*radix*/)
+{
+	snprintf(buffer, size, "%lld", value);
+}
+
+inline void _ui64toa_s(unsigned long long value, char* buffer, size_t size, int /*radix*/)
+{
+	snprintf(buffer, size, "%llu", value);
+}
+
+inline int _finite(double d)
+{
+	return isfinite(d);
+}
+
+#define _snprintf_s(buffer, size, count, ...) snprintf(buffer, size, __VA_ARGS__)
+
+#define __int64 long long
+
+// The part of the ATL CStringA the handshake uses
+class CStringA
+{
+public:
+	CStringA(void) {}
+	CStringA(const char* sz) : m_str(sz ? sz : "") {}
+	CStringA(const char* lpData, int nLength) : m_str(lpData, nLength) {}
+
+	operator const char*() const { return m_str.c_str(); }
+	int GetLength() const { return static_cast<int>(m_str.size()); }
+	bool IsEmpty() const { return m_str.empty(); }
+
+	CStringA& operator+=(const char* sz) { m_str += sz; return *this; }
+	friend CStringA operator+(const CStringA& a, const char* b) { return CStringA((a.m_str + b).c_str()); }
+	friend bool operator==(const CStringA& a, const char* b) { return a.m_str == b; }
+	friend bool operator!=(const CStringA& a, const char* b) { return a.m_str != b; }
+
+	int CompareNoCase(const char* sz) const { return strcasecmp(m_str.c_str(), sz); }
+	int Find(char ch) const
+	{
+		size_t nPos = m_str.find(ch);
+		return nPos == std::string::npos ? -1 : static_cast<int>(nPos);
+	}
+	CStringA Left(int nCount) const { return CStringA(m_str.substr(0, min<size_t>(nCount, m_str.size())).c_str()); }
+	CStringA Mid(int nFirst) const { return CStringA(m_str.substr(min<size_t>(nFirst, m_str.size())).c_str()); }
+	CStringA& MakeLower()
+	{
+		for (size_t i = 0; i < m_str.size(); i++)
+		{
+			m_str[i] = static_cast<char>(tolower(static_cast<unsigned char>(m_str[i])));
+		}
+		return *this;
+	}
+	CStringA& Trim(const char* szChars = " \t\r\n")
+	{
+		size_t nFirst = m_str.find_first_not_of(szChars);
+		size_t nLast = m_str.find_last_not_of(szChars);
+		m_str = (nFirst == std::string::npos) ? std::string() : m_str.substr(nFirst, nLast - nFirst + 1);
+		return *this;
+	}
+	CStringA Tokenize(const char* szTokens, int& iStart) const
+	{
+		if (iStart < 0)
+		{
+			return CStringA();
+		}
+		size_t nFirst = m_str.find_first_not_of(szTokens, iStart);
+		if (nFirst == std::string::npos)
+		{
+			iStart = -1;
+			return CStringA();
+		}
+		size_t nLast = m_str.find_first_of(szTokens, nFirst);
+		if (nLast == std::string::npos)
+		{
+			nLast = m_str.size();
+		}
+		iStart = static_cast<int>(nLast);
+		return CStringA(m_str.substr(nFirst, nLast - nFirst).c_str());
+	}
+	void Format(const char* szFormat, ...)
+	{
+		char buffer[1024];
+		va_list args;
+		va_start(args, szFormat);
+		vsnprintf(buffer, sizeof(buffer), szFormat, args);
+		va_end(args);
+		m_str = buffer;
+	}
+
+private:
+	std::string m_str;
+};
+
+// CryptoAPI, always failing
+typedef void* HCRYPTPROV;
+typedef void* HCRYPTHASH;
+#define PROV_RSA_FULL			1
+#define CRYPT_VERIFYCONTEXT		0xF0000000
+#define CALG_SHA1				0x8004
+#define HP_HASHVAL				2
+#define CRYPT_STRING_BASE64		1
+#define CRYPT_STRING_NOCRLF		0x40000000
+
+inline bool CryptAcquireContext(HCRYPTPROV*, const void*, const void*, DWORD, DWORD) { return false; }
+inline bool CryptCreateHash(HCRYPTPROV, DWORD, uintptr_t, DWORD, HCRYPTHASH*) { return false; }
+inline bool CryptHashData(HCRYPTHASH, const BYTE*, DWORD, DWORD) { return false; }
+inline bool CryptGetHashParam(HCRYPTHASH, DWORD, BYTE*, DWORD*, DWORD) { return false; }
+inline bool CryptBinaryToStringA(const BYTE*, DWORD, DWORD, LPSTR, DWORD*) { return false; }
+inline bool CryptDestroyHash(HCRYPTHASH) { return true; }
+inline bool CryptReleaseContext(HCRYPTPROV, DWORD) { return true; }
+
+// Debugging macros of debug.h, the tests have no use for them.
+#define _T(x) x
+#define TRACE(...) ((void)0)
+
+// JsonCpp library
+#include "json/json.h"
@@ -0,0 +1,2 @@
+// wincrypt.h: CryptoAPI is stubbed in StdAfx.h.
+#pragma once
@@ -0,0 +1,63 @@
+#include "StdAfx.h"
+#include "AllocationCounter.h"
+
+#include <new>
+
+static thread_local bool t_bCountAllocations = false;
+static thread_local long long t_llAllocations = 0;
+
+bool AllocationCounter::Enable(bool bEnable)
+{
+	bool bPrevious = t_bCountAllocations;
+	t_bCountAllocations = bEnable;
+	return bPrevious;
+}
+
+long long AllocationCounter::GetThreadCount()
+{
+	return t_llAllocations;
+}
+
+static void* Allocate(size_t nSize)
+{
+	if (t_bCountAllocations)
+	{
+		t_llAllocations++;
+	}
+	void* p = malloc(nSize ? nSize : 1);
+	if (p == NULL)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new(size_t nSize)
+{
+	return Allocate(nSize);
+}
+
+void* operator new[](size_t nSize)
+{
+	return Allocate(nSize);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	free(p);
+}
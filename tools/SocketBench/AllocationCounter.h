@@ -0,0 +1,16 @@
+#pragma once
+
+/**
+ * Counts the heap allocations of the calling thread, like AllocationCounter of
+ * USBMonitor, by replacing the global operator new. Used to check that the mock
+ * daemon receives and parses without allocating, as SocketService does.
+ */
+class AllocationCounter
+{
+public:
+	// Count the allocations of this thread or not. Returns the previous setting, to restore it.
+	static bool Enable(bool bEnable);
+
+	// The allocations counted on this thread so far
+	static long long GetThreadCount();
+};
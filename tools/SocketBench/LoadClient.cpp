@@ -0,0 +1,319 @@
+#include "StdAfx.h"
+#include "LoadClient.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+static double ToMicroseconds(BenchClock::duration duration)
+{
+	return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+//
+// LatencySamples
+//
+
+void LatencySamples::Merge(const LatencySamples &other)
+{
+	m_aSamples.insert(m_aSamples.end(), other.m_aSamples.begin(), other.m_aSamples.end());
+}
+
+void LatencySamples::Print(const char* szName)
+{
+	if (m_aSamples.empty())
+	{
+		printf("%-16s %8d %10s %10s %10s %10s %10s\n", szName, 0, "-", "-", "-", "-", "-");
+		return;
+	}
+
+	std::sort(m_aSamples.begin(), m_aSamples.end());
+	double dSum = 0;
+	for (size_t i = 0; i < m_aSamples.size(); i++)
+	{
+		dSum += m_aSamples[i];
+	}
+	size_t count = m_aSamples.size();
+	// Nearest rank
+	size_t p50 = (count * 50 + 99) / 100 - 1;
+	size_t p90 = (count * 90 + 99) / 100 - 1;
+	size_t p99 = (count * 99 + 99) / 100 - 1;
+	printf("%-16s %8zu %10.1f %10.1f %10.1f %10.1f %10.1f\n", szName, count, dSum / count,
+		m_aSamples[p50], m_aSamples[p90], m_aSamples[p99], m_aSamples[count - 1]);
+}
+
+//
+// LoadClient
+//
+
+LoadClient::LoadClient(const BenchOptions &options, BenchShared &shared)
+	: m_options(options)
+	, m_shared(shared)
+	, m_fd(-1)
+	, m_bClosed(false)
+	, m_nSent(0)
+	, m_nAnswered(0)
+	, m_nVersion(-1)
+	, m_nErrors(0)
+	, m_nEvents(0)
+	, m_nBroadcasts(0)
+	, m_nMissed(0)
+{
+	m_aSendTimes.resize(options.m_nRequests);
+}
+
+LoadClient::~LoadClient()
+{
+	if (m_fd >= 0)
+	{
+		close(m_fd);
+	}
+}
+
+void LoadClient::Run()
+{
+	{
+		std::unique_lock<std::mutex> lock(m_shared.m_gateLock);
+		while (!m_shared.m_bGo)
+		{
+			m_shared.m_gate.wait(lock);
+		}
+	}
+
+	if (!Connect())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_shared.m_results.m_lock);
+			m_shared.m_results.m_nFailedConnections++;
+		}
+		m_shared.m_nReady++;
+		return;
+	}
+
+	if (!m_options.m_strToken.empty())
+	{
+		Send("auth\t" + m_options.m_strToken + "\n");
+	}
+	if (m_options.m_bSubscribe)
+	{
+		Send("#subscribe\tsubscribe\n");
+	}
+	else
+	{
+		m_shared.m_nReady++;
+	}
+	while (m_nSent < m_options.m_nRequests && m_nSent < m_options.m_nPipeline)
+	{
+		SendRequest();
+	}
+
+	char buffer[16 * 1024];
+	while (!m_bClosed)
+	{
+		// Give up on the requests which are still unanswered a while after the deadline.
+		BenchClock::time_point now = BenchClock::now();
+		BenchClock::time_point deadline = m_shared.GetDeadline();
+		if (now >= deadline &&
+			(m_nAnswered >= m_options.m_nRequests || now >= deadline + std::chrono::seconds(10)))
+		{
+			break;
+		}
+		ssize_t nRead = recv(m_fd, buffer, sizeof(buffer), 0);
+		if (nRead < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			// The receive timeout, check the deadline.
+			continue;
+		}
+		if (nRead <= 0)
+		{
+			break;
+		}
+		m_parser.Feed(buffer, static_cast<DWORD>(nRead), this);
+	}
+
+	if (m_nAnswered < m_options.m_nRequests)
+	{
+		// The daemon hung up before answering everything.
+		m_nErrors += m_options.m_nRequests - m_nAnswered;
+	}
+	MergeResults();
+}
+
+bool LoadClient::Connect()
+{
+	m_connectStart = BenchClock::now();
+	m_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (m_fd < 0)
+	{
+		return false;
+	}
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(static_cast<uint16_t>(m_shared.m_nPort));
+	if (connect(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+	{
+		return false;
+	}
+	double dConnect = ToMicroseconds(BenchClock::now() - m_connectStart);
+
+	int on = 1;
+	setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	timeval timeout = { 0, 50 * 1000 };
+	setsockopt(m_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	std::lock_guard<std::mutex> lock(m_shared.m_results.m_lock);
+	m_shared.m_results.m_connect.Add(dConnect);
+	return true;
+}
+
+bool LoadClient::SendRequest()
+{
+	char szId[16];
+	snprintf(szId, sizeof(szId), "#%d\t", m_nSent);
+	m_aSendTimes[m_nSent++] = BenchClock::now();
+	return Send(szId + m_options.m_strCommand + "\n");
+}
+
+bool LoadClient::Send(const std::string &strLine)
+{
+	const char* lpData = strLine.data();
+	size_t nLength = strLine.size();
+	while (nLength > 0)
+	{
+		ssize_t nWritten = send(m_fd, lpData, nLength, MSG_NOSIGNAL);
+		if (nWritten < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (nWritten <= 0)
+		{
+			m_bClosed = true;
+			return false;
+		}
+		lpData += nWritten;
+		nLength -= nWritten;
+	}
+	return true;
+}
+
+void LoadClient::OnCommand(char* utf8Command, int nLength)
+{
+	BenchClock::time_point now = BenchClock::now();
+	Json::Value message;
+	if (!m_reader.parse(utf8Command, utf8Command + nLength, message, false))
+	{
+		m_nErrors++;
+		return;
+	}
+
+	if (message.isArray())
+	{
+		// The full device list pushed to the connections which haven't subscribed
+		m_nBroadcasts++;
+	}
+	else if (message.isMember("command"))
+	{
+		OnResponse(message, now);
+	}
+	else if (message["event"] == "devices")
+	{
+		OnDeviceEvent(message, now);
+	}
+	else if (message["event"] == "shutdown")
+	{
+		m_bClosed = true;
+	}
+}
+
+void LoadClient::OnResponse(const Json::Value &response, BenchClock::time_point now)
+{
+	if (response["status"] != "ok")
+	{
+		m_nErrors++;
+	}
+
+	if (response["command"] == "auth")
+	{
+		return;
+	}
+
+	std::string strId = response["id"].asString();
+	if (strId == "subscribe")
+	{
+		m_nVersion = response["result"]["version"].asInt();
+		m_shared.m_nReady++;
+		return;
+	}
+
+	char* pEnd = NULL;
+	long nId = strtol(strId.c_str(), &pEnd, 10);
+	if (strId.empty() || *pEnd || nId < 0 || nId >= m_nSent)
+	{
+		m_nErrors++;
+		return;
+	}
+
+	double dRoundTrip = ToMicroseconds(now - m_aSendTimes[nId]);
+	if (m_nAnswered++ == 0)
+	{
+		std::lock_guard<std::mutex> lock(m_shared.m_results.m_lock);
+		m_shared.m_results.m_firstResponse.Add(ToMicroseconds(now - m_connectStart));
+	}
+	m_roundTrip.Add(dRoundTrip);
+
+	// Keep the pipeline full.
+	if (m_nSent < m_options.m_nRequests)
+	{
+		SendRequest();
+	}
+}
+
+void LoadClient::OnDeviceEvent(const Json::Value &event, BenchClock::time_point now)
+{
+	int nBase = event["base"].asInt();
+	int nVersion = event["version"].asInt();
+	if (m_nVersion < 0 || nVersion <= m_nVersion)
+	{
+		// Not subscribed yet, or already included in the snapshot.
+		return;
+	}
+	if (nBase > m_nVersion)
+	{
+		m_nMissed += nBase - m_nVersion;
+	}
+	m_nVersion = nVersion;
+	m_nEvents++;
+
+	BenchClock::time_point injected;
+	if (m_shared.m_pDaemon && m_shared.m_pDaemon->GetInjectTime(nVersion, injected))
+	{
+		m_fanOut.Add(ToMicroseconds(now - injected));
+	}
+
+	std::lock_guard<std::mutex> lock(m_shared.m_results.m_lock);
+	BenchResults::Arrival &arrival = m_shared.m_results.m_arrivals[nVersion];
+	if (arrival.m_nCount++ == 0)
+	{
+		arrival.m_first = now;
+	}
+	arrival.m_last = now;
+}
+
+void LoadClient::MergeResults()
+{
+	BenchResults &results = m_shared.m_results;
+	std::lock_guard<std::mutex> lock(results.m_lock);
+	results.m_roundTrip.Merge(m_roundTrip);
+	results.m_fanOut.Merge(m_fanOut);
+	results.m_nRequests += m_nAnswered;
+	results.m_nErrors += m_nErrors;
+	results.m_nEvents += m_nEvents;
+	results.m_nBroadcasts += m_nBroadcasts;
+	results.m_nMissed += m_nMissed;
+}
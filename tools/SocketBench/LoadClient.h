@@ -0,0 +1,179 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "MockDaemon.h"
+
+class BenchOptions
+{
+public:
+	BenchOptions()
+		: m_nConnections(16)
+		, m_nPipeline(8)
+		, m_nRequests(1000)
+		, m_dDuration(5)
+		, m_dChurnRate(50)
+		, m_nMaxDevices(8)
+		, m_nPort(0)
+		, m_bSubscribe(true)
+		, m_strCommand("devices")
+	{
+	}
+
+	// Concurrent connections, each with its own thread
+	int m_nConnections;
+	// Requests in flight on each connection
+	int m_nPipeline;
+	// Requests sent on each connection
+	int m_nRequests;
+	// Seconds the device churn runs, the connections stay until it is over
+	double m_dDuration;
+	// Device changes injected per second
+	double m_dChurnRate;
+	// Devices the mock may have plugged at once
+	int m_nMaxDevices;
+	// Port of a daemon already listening on 127.0.0.1, 0 to run the mock in process
+	int m_nPort;
+	// Whether the connections subscribe to the device deltas
+	bool m_bSubscribe;
+	// The command line sent as the requests, without the request ID
+	std::string m_strCommand;
+	// Presented first by each connection if not empty, for a daemon which requires it
+	std::string m_strToken;
+};
+
+/**
+ * Latency samples in microseconds. Exact percentiles, as a run has few enough samples.
+ */
+class LatencySamples
+{
+public:
+	void Add(double dMicroseconds) { m_aSamples.push_back(dMicroseconds); }
+	void Merge(const LatencySamples &other);
+	size_t GetCount() const { return m_aSamples.size(); }
+
+	// One line: count, mean, p50, p90, p99 and max
+	void Print(const char* szName);
+
+private:
+	std::vector<double> m_aSamples;
+};
+
+/**
+ * What the connections measured, merged when each of them is done.
+ */
+class BenchResults
+{
+public:
+	BenchResults() : m_nRequests(0), m_nErrors(0), m_nEvents(0), m_nBroadcasts(0), m_nMissed(0), m_nFailedConnections(0) {}
+
+	// Time from the connect() call until it returns
+	LatencySamples m_connect;
+	// Time from the connect() call until the response to the first request
+	LatencySamples m_firstResponse;
+	// Time from sending a request until its response, with the pipeline full
+	LatencySamples m_roundTrip;
+	// Time from injecting a device change until a subscriber receives its delta
+	LatencySamples m_fanOut;
+
+	long m_nRequests;
+	long m_nErrors;
+	// Device deltas received by the subscribers
+	long m_nEvents;
+	// Full device lists received by the other connections
+	long m_nBroadcasts;
+	// Deltas a subscriber noticed it didn't get
+	long m_nMissed;
+	long m_nFailedConnections;
+
+	// When each version of the device list reached its first and its last subscriber.
+	// Protected by m_lock, updated for every delta.
+	class Arrival
+	{
+	public:
+		Arrival() : m_nCount(0) {}
+		BenchClock::time_point m_first;
+		BenchClock::time_point m_last;
+		int m_nCount;
+	};
+	std::map<int, Arrival> m_arrivals;
+
+	std::mutex m_lock;
+};
+
+/**
+ * State shared by the connections of a run.
+ */
+class BenchShared
+{
+public:
+	BenchShared() : m_pDaemon(NULL), m_nPort(0), m_bGo(false), m_nReady(0), m_deadline(BenchClock::duration::max().count()) {}
+
+	// The connections leave once their requests are done and this time has passed.
+	BenchClock::time_point GetDeadline() const { return BenchClock::time_point(BenchClock::duration(m_deadline.load())); }
+	void SetDeadline(BenchClock::time_point deadline) { m_deadline = deadline.time_since_epoch().count(); }
+
+	// The in process mock, NULL when loading another daemon
+	MockDaemon* m_pDaemon;
+	int m_nPort;
+
+	// The connections start together once m_bGo is set
+	std::mutex m_gateLock;
+	std::condition_variable m_gate;
+	bool m_bGo;
+	// Connections which have subscribed, or failed to connect. The churn starts when all have.
+	std::atomic<int> m_nReady;
+	std::atomic<BenchClock::rep> m_deadline;
+
+	BenchResults m_results;
+};
+
+/**
+ * One benchmark connection: connects, subscribes, keeps m_nPipeline requests in flight
+ * until m_nRequests have been answered, and receives the device changes until the
+ * deadline. Run it on its own thread.
+ */
+class LoadClient: public CommandParserCallback
+{
+public:
+	LoadClient(const BenchOptions &options, BenchShared &shared);
+	virtual ~LoadClient();
+
+	void Run();
+
+	// Overrides CommandParserCallback
+	virtual void OnCommand(char* utf8Command, int nLength) override;
+
+private:
+	bool Connect();
+	bool SendRequest();
+	bool Send(const std::string &strLine);
+	void OnResponse(const Json::Value &response, BenchClock::time_point now);
+	void OnDeviceEvent(const Json::Value &event, BenchClock::time_point now);
+	void MergeResults();
+
+	const BenchOptions& m_options;
+	BenchShared& m_shared;
+
+	int m_fd;
+	bool m_bClosed;
+	CommandParser m_parser;
+	Json::Reader m_reader;
+
+	BenchClock::time_point m_connectStart;
+	// When each request was sent, indexed by request ID
+	std::vector<BenchClock::time_point> m_aSendTimes;
+	int m_nSent;
+	int m_nAnswered;
+	// Version of the device list this connection holds, -1 until subscribed
+	int m_nVersion;
+
+	// Kept per connection and merged at the end, so that measuring doesn't contend.
+	LatencySamples m_roundTrip;
+	LatencySamples m_fanOut;
+	long m_nErrors;
+	long m_nEvents;
+	long m_nBroadcasts;
+	long m_nMissed;
+};
@@ -0,0 +1,528 @@
+#include "StdAfx.h"
+#include "MockDaemon.h"
+#include "AllocationCounter.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+// Catalog entries the fake devices are made of, as in devices.json
+static const char* const MOCK_DEVICE_NAMES[][3] =
+{
+	{ "Alcatel One Touch Fire", "MSM7627A", "05c6:9025" },
+	{ "ZTE Open", "roamer2", "19d2:1350" },
+	{ "Geeksphone Keon", "keon", "05c6:8013" },
+	{ "LG Fireweb", "D300", "1004:6300" },
+};
+
+static const int MOCK_DEVICE_KINDS = sizeof(MOCK_DEVICE_NAMES) / sizeof(MOCK_DEVICE_NAMES[0]);
+
+// CM_INSTALL_STATE_INSTALLED and CM_INSTALL_STATE_FAILED_INSTALL
+static const int INSTALL_STATE_INSTALLED = 0;
+static const int INSTALL_STATE_FAILED_INSTALL = 2;
+
+//
+// MockDeviceSource
+//
+
+MockDeviceSource::MockDeviceSource(int nMaxDevices)
+	: m_nMaxDevices(max(nMaxDevices, 1))
+	, m_nVersion(0)
+	, m_nNextSerial(1)
+	, m_seed(12345)
+	, m_deviceList(Json::arrayValue)
+{
+}
+
+Json::Value MockDeviceSource::MakeDevice(int nSerial) const
+{
+	const char* const* names = MOCK_DEVICE_NAMES[nSerial % MOCK_DEVICE_KINDS];
+	char szHardwareId[64];
+	snprintf(szHardwareId, sizeof(szHardwareId), "USB\\VID_%.4s&PID_%.4s&MI_01", names[2], names[2] + 5);
+	char szInstanceId[64];
+	snprintf(szInstanceId, sizeof(szInstanceId), "USB\\VID_%.4s&PID_%.4s\\MOCK%08d", names[2], names[2] + 5, nSerial);
+
+	Json::Value device;
+	device["display_name"] = names[0];
+	device["device_name"] = names[1];
+	device["hardware_id"] = szHardwareId;
+	device["vendor_id"] = names[2];
+	device["InstallState"] = INSTALL_STATE_INSTALLED;
+	device["InstanceId"] = szInstanceId;
+	return device;
+}
+
+unsigned int MockDeviceSource::Random(unsigned int nRange)
+{
+	m_seed = m_seed * 1103515245 + 12345;
+	return (m_seed >> 16) % nRange;
+}
+
+Json::Value MockDeviceSource::Churn()
+{
+	Json::Value added(Json::arrayValue);
+	Json::Value removed(Json::arrayValue);
+	Json::Value changed(Json::arrayValue);
+
+	int count = m_deviceList.size();
+	// 0: plug, 1: unplug, 2: the driver installation changes
+	unsigned int action = (count == 0) ? 0 : (count >= m_nMaxDevices) ? 1 + Random(2) : Random(3);
+	if (action == 0)
+	{
+		Json::Value device = MakeDevice(m_nNextSerial++);
+		m_deviceList.append(device);
+		added.append(device);
+	}
+	else
+	{
+		int index = Random(count);
+		if (action == 1)
+		{
+			removed.append(m_deviceList[index]["InstanceId"]);
+			Json::Value deviceList(Json::arrayValue);
+			for (int i = 0; i < count; i++)
+			{
+				if (i != index)
+				{
+					deviceList.append(m_deviceList[i]);
+				}
+			}
+			m_deviceList.swap(deviceList);
+		}
+		else
+		{
+			Json::Value &device = m_deviceList[index];
+			device["InstallState"] = (device["InstallState"].asInt() == INSTALL_STATE_INSTALLED) ?
+				INSTALL_STATE_FAILED_INSTALL : INSTALL_STATE_INSTALLED;
+			changed.append(device);
+		}
+	}
+
+	Json::Value delta(Json::objectValue);
+	delta["added"] = added;
+	delta["removed"] = removed;
+	delta["changed"] = changed;
+	delta["base"] = m_nVersion;
+	delta["version"] = ++m_nVersion;
+	return delta;
+}
+
+bool MockDeviceSource::GetDevice(const char* szInstanceId, Json::Value &device) const
+{
+	int count = m_deviceList.size();
+	for (int i = 0; i < count; i++)
+	{
+		if (!_stricmp(m_deviceList[i]["InstanceId"].asCString(), szInstanceId))
+		{
+			device = m_deviceList[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+//
+// MockDaemon
+//
+
+MockDaemon::MockDaemon(int nMaxDevices)
+	: m_listenFd(-1)
+	, m_bRunning(false)
+	, m_devices(nMaxDevices)
+	, m_lCommandCount(0)
+	, m_lReads(0)
+	, m_llReadAllocations(0)
+	, m_dChurnRate(0)
+{
+	m_aInjectTimes.push_back(BenchClock::now());
+}
+
+MockDaemon::~MockDaemon()
+{
+	Stop();
+}
+
+int MockDaemon::Start(int nPort)
+{
+	m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+	if (m_listenFd < 0)
+	{
+		return -1;
+	}
+	int on = 1;
+	setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(static_cast<uint16_t>(nPort));
+	socklen_t addrLength = sizeof(addr);
+	if (bind(m_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+		listen(m_listenFd, SOMAXCONN) != 0 ||
+		getsockname(m_listenFd, reinterpret_cast<sockaddr*>(&addr), &addrLength) != 0)
+	{
+		close(m_listenFd);
+		m_listenFd = -1;
+		return -1;
+	}
+
+	m_bRunning = true;
+	m_acceptThread = std::thread(&MockDaemon::AcceptLoop, this);
+	m_churnThread = std::thread(&MockDaemon::ChurnLoop, this);
+	return ntohs(addr.sin_port);
+}
+
+void MockDaemon::Stop()
+{
+	if (!m_bRunning.exchange(false))
+	{
+		return;
+	}
+
+	// Unblock accept() and the reads of the clients.
+	shutdown(m_listenFd, SHUT_RDWR);
+	m_acceptThread.join();
+	close(m_listenFd);
+	m_listenFd = -1;
+
+	m_churnChanged.notify_all();
+	m_churnThread.join();
+
+	// No client is added any more. The locks are taken in the order of the senders,
+	// and released before joining, as the client threads may still be sending.
+	{
+		std::lock_guard<std::mutex> sendLock(m_sendLock);
+		std::lock_guard<std::mutex> clientsLock(m_clientsLock);
+		for (std::list<Client*>::iterator it = m_clients.begin(); it != m_clients.end(); ++it)
+		{
+			if ((*it)->m_fd >= 0)
+			{
+				shutdown((*it)->m_fd, SHUT_RDWR);
+			}
+		}
+	}
+	for (std::list<Client*>::iterator it = m_clients.begin(); it != m_clients.end(); ++it)
+	{
+		(*it)->m_thread.join();
+	}
+
+	std::lock_guard<std::mutex> clientsLock(m_clientsLock);
+	for (std::list<Client*>::iterator it = m_clients.begin(); it != m_clients.end(); ++it)
+	{
+		delete *it;
+	}
+	m_clients.clear();
+}
+
+void MockDaemon::SetChurnRate(double dChangesPerSecond)
+{
+	std::lock_guard<std::mutex> lock(m_churnLock);
+	m_dChurnRate = dChangesPerSecond;
+	m_churnChanged.notify_all();
+}
+
+void MockDaemon::InjectChange()
+{
+	std::lock_guard<std::mutex> lock(m_sendLock);
+	Json::Value delta = m_devices.Churn();
+	{
+		std::lock_guard<std::mutex> injectLock(m_injectLock);
+		m_aInjectTimes.push_back(BenchClock::now());
+	}
+	// The same pair of messages as MainFrame::OnDeviceChanged
+	SendToClients(m_devices.GetDeviceList(), false);
+	Json::Value event = delta;
+	event["event"] = "devices";
+	SendToClients(event, true);
+}
+
+bool MockDaemon::GetInjectTime(int nVersion, BenchClock::time_point &time)
+{
+	std::lock_guard<std::mutex> lock(m_injectLock);
+	if (nVersion < 0 || nVersion >= static_cast<int>(m_aInjectTimes.size()))
+	{
+		return false;
+	}
+	time = m_aInjectTimes[nVersion];
+	return true;
+}
+
+void MockDaemon::ChurnLoop()
+{
+	// Changes are scheduled on a fixed grid, so that a slow broadcast doesn't lower the rate.
+	BenchClock::time_point next = BenchClock::now();
+	std::unique_lock<std::mutex> lock(m_churnLock);
+	while (m_bRunning)
+	{
+		if (m_dChurnRate <= 0)
+		{
+			m_churnChanged.wait(lock);
+			next = BenchClock::now();
+			continue;
+		}
+		next += std::chrono::duration_cast<BenchClock::duration>(std::chrono::duration<double>(1.0 / m_dChurnRate));
+		if (m_churnChanged.wait_until(lock, next) != std::cv_status::timeout)
+		{
+			// The rate changed or we are stopping.
+			next = BenchClock::now();
+			continue;
+		}
+		lock.unlock();
+		InjectChange();
+		lock.lock();
+	}
+}
+
+void MockDaemon::AcceptLoop()
+{
+	while (m_bRunning)
+	{
+		int fd = accept(m_listenFd, NULL, NULL);
+		if (fd < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+			{
+				continue;
+			}
+			break;
+		}
+		int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+		Client* pClient = new Client(this, fd);
+		std::lock_guard<std::mutex> lock(m_clientsLock);
+		if (!m_bRunning)
+		{
+			close(fd);
+			delete pClient;
+			break;
+		}
+		m_clients.push_back(pClient);
+		pClient->m_thread = std::thread(&MockDaemon::ServeClient, this, pClient);
+	}
+}
+
+void MockDaemon::ServeClient(Client* pClient)
+{
+	{
+		// Like MainFrame::OnConnect, the clients get the device list if there is one.
+		std::lock_guard<std::mutex> lock(m_sendLock);
+		if (m_devices.GetDeviceList().size() > 0)
+		{
+			SendToClients(m_devices.GetDeviceList(), false);
+		}
+	}
+
+	for (;;)
+	{
+		// Receive into the parser and parse in place, as SocketService does.
+		DWORD dwSize = 0;
+		char* lpBuffer = pClient->m_parser.GetWriteBuffer(dwSize);
+		ssize_t nRead = recv(pClient->m_fd, lpBuffer, dwSize, 0);
+		if (nRead < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (nRead <= 0)
+		{
+			break;
+		}
+
+		bool bCountAllocations = AllocationCounter::Enable(true);
+		long long llAllocations = AllocationCounter::GetThreadCount();
+		pClient->m_parser.Feed(lpBuffer, static_cast<DWORD>(nRead), pClient);
+		m_llReadAllocations += AllocationCounter::GetThreadCount() - llAllocations;
+		AllocationCounter::Enable(bCountAllocations);
+		m_lReads++;
+	}
+
+	std::lock_guard<std::mutex> lock(m_sendLock);
+	close(pClient->m_fd);
+	pClient->m_fd = -1;
+}
+
+void MockDaemon::HandleCommand(Client* pClient, const char* utf8Command)
+{
+	// [#<id>\t]<command>[\t<argument>]...
+	std::vector<std::string> tokens;
+	const char* p = utf8Command;
+	while (*p)
+	{
+		const char* pEnd = strchr(p, '\t');
+		if (pEnd == NULL)
+		{
+			pEnd = p + strlen(p);
+		}
+		if (pEnd > p)
+		{
+			tokens.push_back(std::string(p, pEnd));
+		}
+		p = *pEnd ? pEnd + 1 : pEnd;
+	}
+
+	Json::Value response;
+	size_t index = 0;
+	if (index < tokens.size() && tokens[index][0] == '#')
+	{
+		response["id"] = tokens[index++].substr(1);
+	}
+	if (index >= tokens.size())
+	{
+		return;
+	}
+	m_lCommandCount++;
+	std::string strName = tokens[index++];
+	const char* szArg = (index < tokens.size()) ? tokens[index].c_str() : "";
+	response["command"] = strName;
+
+	std::lock_guard<std::mutex> lock(m_sendLock);
+	Json::Value result;
+	const char* szError = NULL;
+	if (strName == "devices")
+	{
+		result = m_devices.GetDeviceList();
+	}
+	else if (strName == "device")
+	{
+		if (!*szArg)
+		{
+			szError = "missing device instance ID";
+		}
+		else if (!m_devices.GetDevice(szArg, result))
+		{
+			szError = "device not connected";
+		}
+	}
+	else if (strName == "subscribe" || strName == "resync")
+	{
+		pClient->m_bSubscribed = true;
+		result["devices"] = m_devices.GetDeviceList();
+		result["version"] = m_devices.GetVersion();
+	}
+	else if (strName == "unsubscribe")
+	{
+		pClient->m_bSubscribed = false;
+	}
+	else if (strName == "format")
+	{
+		MessageFormat format;
+		if (!MessageEncoder::ParseFormat(szArg, format))
+		{
+			szError = "unknown format";
+		}
+		else
+		{
+			pClient->m_format = format;
+		}
+	}
+	else if (strName == "stats")
+	{
+		int nClients = 0;
+		std::lock_guard<std::mutex> clientsLock(m_clientsLock);
+		for (std::list<Client*>::iterator it = m_clients.begin(); it != m_clients.end(); ++it)
+		{
+			if ((*it)->m_fd >= 0)
+			{
+				nClients++;
+			}
+		}
+		result["clients"] = nClients;
+		result["devices"] = m_devices.GetDeviceList().size();
+		result["commands"] = static_cast<int>(m_lCommandCount);
+	}
+	else
+	{
+		szError = "unknown command";
+	}
+
+	if (szError)
+	{
+		response["status"] = "error";
+		response["error"] = szError;
+	}
+	else
+	{
+		response["status"] = "ok";
+		response["result"] = result;
+	}
+	SendTo(pClient, response);
+}
+
+bool MockDaemon::SendTo(Client* pClient, const Json::Value &message)
+{
+	if (pClient->m_fd < 0)
+	{
+		return false;
+	}
+	MessageBuffer& buffer = m_buffers[pClient->m_format];
+	buffer.Clear();
+	MessageEncoder::Encode(message, pClient->m_format, buffer);
+	return WriteAll(pClient->m_fd, buffer.GetData(), buffer.GetLength());
+}
+
+void MockDaemon::SendToClients(const Json::Value &message, bool bSubscribers)
+{
+	bool aEncoded[MESSAGE_FORMAT_COUNT] = { false };
+	std::lock_guard<std::mutex> lock(m_clientsLock);
+	for (std::list<Client*>::iterator it = m_clients.begin(); it != m_clients.end(); ++it)
+	{
+		Client* pClient = *it;
+		if (pClient->m_fd < 0 || pClient->m_bSubscribed != bSubscribers)
+		{
+			continue;
+		}
+		MessageBuffer& buffer = m_buffers[pClient->m_format];
+		if (!aEncoded[pClient->m_format])
+		{
+			buffer.Clear();
+			MessageEncoder::Encode(message, pClient->m_format, buffer);
+			aEncoded[pClient->m_format] = true;
+		}
+		WriteAll(pClient->m_fd, buffer.GetData(), buffer.GetLength());
+	}
+}
+
+bool MockDaemon::WriteAll(int fd, const char* lpData, int nLength)
+{
+	while (nLength > 0)
+	{
+		ssize_t nWritten = send(fd, lpData, nLength, MSG_NOSIGNAL);
+		if (nWritten < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (nWritten <= 0)
+		{
+			// The reader thread notices and cleans up.
+			shutdown(fd, SHUT_RDWR);
+			return false;
+		}
+		lpData += nWritten;
+		nLength -= static_cast<int>(nWritten);
+	}
+	return true;
+}
+
+//
+// MockDaemon::Client
+//
+
+MockDaemon::Client::Client(MockDaemon* pDaemon, int fd)
+	: m_pDaemon(pDaemon)
+	, m_fd(fd)
+	, m_bSubscribed(false)
+	, m_format(MESSAGE_FORMAT_JSON)
+{
+}
+
+void MockDaemon::Client::OnCommand(char* utf8Command, int /*nLength*/)
+{
+	// What the command allocates belongs to the command, not to the read.
+	bool bCountAllocations = AllocationCounter::Enable(false);
+	m_pDaemon->HandleCommand(this, utf8Command);
+	AllocationCounter::Enable(bCountAllocations);
+}
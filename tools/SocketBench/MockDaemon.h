@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+
+#include "CommandParser.h"
+#include "MessageEncoder.h"
+
+typedef std::chrono::steady_clock BenchClock;
+
+/**
+ * Stands in for DeviceMonitor: a list of fake Firefox OS devices which changes on
+ * demand. The list, its version and the deltas have the shape of the real ones.
+ * Not thread safe, MockDaemon protects it.
+ */
+class MockDeviceSource
+{
+public:
+	MockDeviceSource(int nMaxDevices);
+
+	/**
+	 * Plug, unplug or change the driver state of a device, whichever the list allows.
+	 * @return The delta: {"base","version","added","removed","changed"}
+	 */
+	Json::Value Churn();
+
+	const Json::Value& GetDeviceList() const { return m_deviceList; }
+	int GetVersion() const { return m_nVersion; }
+
+	// Find a device by its instance ID.
+	bool GetDevice(const char* szInstanceId, Json::Value &device) const;
+
+private:
+	Json::Value MakeDevice(int nSerial) const;
+	// Deterministic, so that runs with the same options inject the same changes.
+	unsigned int Random(unsigned int nRange);
+
+	int m_nMaxDevices;
+	int m_nVersion;
+	int m_nNextSerial;
+	unsigned int m_seed;
+	Json::Value m_deviceList;
+};
+
+/**
+ * A loopback server speaking the socket protocol of USBMonitor (see SocketProtocol.h)
+ * on top of MockDeviceSource, so that the socket path can be loaded on Linux.
+ *
+ * Like SocketService, each client is served by its own thread, the messages are
+ * written under one send lock, and a broadcast is serialized once per format.
+ */
+class MockDaemon
+{
+public:
+	MockDaemon(int nMaxDevices);
+	~MockDaemon();
+
+	/**
+	 * Listen on 127.0.0.1.
+	 * @param nPort The port, 0 to let the system pick one.
+	 * @return The port listened on, or -1 on failure.
+	 */
+	int Start(int nPort);
+
+	// Close all the connections and join the threads.
+	void Stop();
+
+	// Inject device changes at the given rate until Stop, 0 to stop injecting.
+	void SetChurnRate(double dChangesPerSecond);
+
+	// Apply one device change and push it to the clients right away.
+	void InjectChange();
+
+	// When the change producing the given version was injected. False if unknown.
+	bool GetInjectTime(int nVersion, BenchClock::time_point &time);
+
+	// Reads handled, and the heap allocations made handling them besides the commands.
+	long GetReadCount() const { return m_lReads; }
+	long long GetReadAllocations() const { return m_llReadAllocations; }
+
+private:
+	class Client: public CommandParserCallback
+	{
+	public:
+		Client(MockDaemon* pDaemon, int fd);
+		virtual ~Client() {}
+
+		// Overrides CommandParserCallback
+		virtual void OnCommand(char* utf8Command, int nLength) override;
+
+		MockDaemon* m_pDaemon;
+		int m_fd;
+		CommandParser m_parser;
+		// Protected by MockDaemon::m_sendLock, m_fd is -1 once the client is gone.
+		bool m_bSubscribed;
+		MessageFormat m_format;
+		std::thread m_thread;
+	};
+
+	void AcceptLoop();
+	void ServeClient(Client* pClient);
+	void ChurnLoop();
+	void HandleCommand(Client* pClient, const char* utf8Command);
+
+	// Send to one client, or to the clients with the subscription state.
+	// Must be called with m_sendLock held.
+	bool SendTo(Client* pClient, const Json::Value &message);
+	void SendToClients(const Json::Value &message, bool bSubscribers);
+	static bool WriteAll(int fd, const char* lpData, int nLength);
+
+	int m_listenFd;
+	std::atomic<bool> m_bRunning;
+	std::thread m_acceptThread;
+
+	// Taken after m_sendLock when both are needed
+	std::mutex m_clientsLock;
+	std::list<Client*> m_clients;
+
+	// Taken to send, and by the churn to change the devices and push the change
+	// atomically, as DeviceMonitor and SocketService do.
+	std::mutex m_sendLock;
+	MockDeviceSource m_devices;
+	MessageBuffer m_buffers[MESSAGE_FORMAT_COUNT];
+	std::atomic<long> m_lCommandCount;
+	std::atomic<long> m_lReads;
+	std::atomic<long long> m_llReadAllocations;
+
+	// Indexed by version
+	std::mutex m_injectLock;
+	std::vector<BenchClock::time_point> m_aInjectTimes;
+
+	std::mutex m_churnLock;
+	std::condition_variable m_churnChanged;
+	double m_dChurnRate;
+	std::thread m_churnThread;
+};
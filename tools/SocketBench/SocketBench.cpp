@@ -0,0 +1,213 @@
+// SocketBench.cpp: load generator and benchmark of the daemon socket server.
+//
+// Opens many loopback connections at once, pipelines requests on each of them and
+// subscribes them to the device deltas, while a mock device source injects device
+// changes at a controlled rate. Reports the connect latency, the request round trip
+// and the fan-out latency of the device changes.
+//////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include "LoadClient.h"
+
+static void PrintUsage()
+{
+	printf(
+		"Usage: socket_bench [options]\n"
+		"  --connections N   concurrent connections (16)\n"
+		"  --pipeline N      requests in flight on each connection (8)\n"
+		"  --requests N      requests sent on each connection (1000)\n"
+		"  --command LINE    the request sent, tab separated (devices)\n"
+		"  --duration S      seconds the device churn runs (5)\n"
+		"  --churn R         device changes injected per second (50)\n"
+		"  --devices N       devices plugged at most (8)\n"
+		"  --no-subscribe    don't subscribe to the device deltas\n"
+		"  --port P          load the daemon listening on 127.0.0.1:P instead of the\n"
+		"                    in process mock, no device changes are injected then\n"
+		"  --token T         present the token a daemon started with [socket] token\n"
+		"                    requires, with --port\n");
+}
+
+static bool ParseOptions(int argc, char* argv[], BenchOptions &options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string strName = argv[i];
+		if (strName == "--no-subscribe")
+		{
+			options.m_bSubscribe = false;
+			continue;
+		}
+		if (i + 1 >= argc)
+		{
+			return false;
+		}
+		const char* szValue = argv[++i];
+		if (strName == "--connections")
+		{
+			options.m_nConnections = atoi(szValue);
+		}
+		else if (strName == "--pipeline")
+		{
+			options.m_nPipeline = atoi(szValue);
+		}
+		else if (strName == "--requests")
+		{
+			options.m_nRequests = atoi(szValue);
+		}
+		else if (strName == "--command")
+		{
+			options.m_strCommand = szValue;
+		}
+		else if (strName == "--duration")
+		{
+			options.m_dDuration = atof(szValue);
+		}
+		else if (strName == "--churn")
+		{
+			options.m_dChurnRate = atof(szValue);
+		}
+		else if (strName == "--devices")
+		{
+			options.m_nMaxDevices = atoi(szValue);
+		}
+		else if (strName == "--port")
+		{
+			options.m_nPort = atoi(szValue);
+		}
+		else if (strName == "--token")
+		{
+			options.m_strToken = szValue;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return options.m_nConnections > 0 && options.m_nPipeline > 0 && options.m_nRequests >= 0 &&
+		options.m_dDuration >= 0 && options.m_dChurnRate >= 0 && !options.m_strCommand.empty();
+}
+
+// How much later than the first subscriber the last one got each device change
+static void PrintFanOutSpread(BenchResults &results, int nSubscribers)
+{
+	LatencySamples spread;
+	int nIncomplete = 0;
+	for (std::map<int, BenchResults::Arrival>::const_iterator it = results.m_arrivals.begin(); it != results.m_arrivals.end(); ++it)
+	{
+		if (it->second.m_nCount < nSubscribers)
+		{
+			nIncomplete++;
+			continue;
+		}
+		spread.Add(std::chrono::duration<double, std::micro>(it->second.m_last - it->second.m_first).count());
+	}
+	spread.Print("fan-out spread");
+	if (nIncomplete > 0)
+	{
+		printf("%d device changes didn't reach every subscriber\n", nIncomplete);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	BenchOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	BenchShared shared;
+	MockDaemon* pDaemon = NULL;
+	if (options.m_nPort == 0)
+	{
+		pDaemon = new MockDaemon(options.m_nMaxDevices);
+		shared.m_nPort = pDaemon->Start(0);
+		if (shared.m_nPort < 0)
+		{
+			fprintf(stderr, "Failed to start the mock daemon\n");
+			delete pDaemon;
+			return 1;
+		}
+		shared.m_pDaemon = pDaemon;
+	}
+	else
+	{
+		shared.m_nPort = options.m_nPort;
+	}
+
+	std::vector<LoadClient*> clients;
+	std::vector<std::thread> threads;
+	for (int i = 0; i < options.m_nConnections; i++)
+	{
+		clients.push_back(new LoadClient(options, shared));
+		threads.push_back(std::thread(&LoadClient::Run, clients.back()));
+	}
+
+	// Let all the connections go at once.
+	BenchClock::time_point start = BenchClock::now();
+	{
+		std::lock_guard<std::mutex> lock(shared.m_gateLock);
+		shared.m_bGo = true;
+	}
+	shared.m_gate.notify_all();
+
+	// Inject the changes once every connection has subscribed, so that all of them
+	// get all the changes, and stop in time for the last ones to arrive before they leave.
+	while (shared.m_nReady < options.m_nConnections && BenchClock::now() < start + std::chrono::seconds(10))
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	BenchClock::time_point churnStart = BenchClock::now();
+	BenchClock::duration duration = std::chrono::duration_cast<BenchClock::duration>(std::chrono::duration<double>(options.m_dDuration));
+	shared.SetDeadline(churnStart + duration + std::chrono::milliseconds(250));
+	if (pDaemon)
+	{
+		pDaemon->SetChurnRate(options.m_dChurnRate);
+		std::this_thread::sleep_until(churnStart + duration);
+		pDaemon->SetChurnRate(0);
+	}
+
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+		delete clients[i];
+	}
+	double dElapsed = std::chrono::duration<double>(BenchClock::now() - start).count();
+	long nReads = 0;
+	long long llReadAllocations = 0;
+	if (pDaemon)
+	{
+		pDaemon->Stop();
+		nReads = pDaemon->GetReadCount();
+		llReadAllocations = pDaemon->GetReadAllocations();
+		delete pDaemon;
+	}
+
+	BenchResults &results = shared.m_results;
+	int nConnected = options.m_nConnections - static_cast<int>(results.m_nFailedConnections);
+	printf("%d connections (%ld failed), pipeline %d, \"%s\" x %d, churn %.0f/s for %.1f s on 127.0.0.1:%d%s\n",
+		options.m_nConnections, results.m_nFailedConnections, options.m_nPipeline, options.m_strCommand.c_str(),
+		options.m_nRequests, pDaemon ? options.m_dChurnRate : 0.0, options.m_dDuration, shared.m_nPort,
+		pDaemon ? " (mock)" : "");
+	printf("%-16s %8s %10s %10s %10s %10s %10s\n", "microseconds", "count", "mean", "p50", "p90", "p99", "max");
+	results.m_connect.Print("connect");
+	results.m_firstResponse.Print("first response");
+	results.m_roundTrip.Print("round trip");
+	if (options.m_bSubscribe)
+	{
+		results.m_fanOut.Print("fan-out");
+		PrintFanOutSpread(results, nConnected);
+	}
+	printf("%ld requests answered in %.2f s, %.0f requests/s, %ld errors\n",
+		results.m_nRequests, dElapsed, results.m_nRequests / dElapsed, results.m_nErrors);
+	printf("%ld device deltas, %ld device list broadcasts received, %ld deltas missed\n",
+		results.m_nEvents, results.m_nBroadcasts, results.m_nMissed);
+	if (pDaemon)
+	{
+		// The receive path must not allocate, the command handlers aside.
+		printf("%ld reads by the daemon, %lld allocations receiving them\n", nReads, llReadAllocations);
+	}
+	return (results.m_nFailedConnections > 0 || results.m_nErrors > 0 || results.m_nMissed > 0 ||
+		llReadAllocations > 0) ? 1 : 0;
+}
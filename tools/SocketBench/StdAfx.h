@@ -0,0 +1,65 @@
+// StdAfx.h: the Linux build of the socket benchmark.
+//
+// The benchmark compiles the protocol code of USBMonitor as it is, so that the mock
+// daemon parses and serializes exactly like the real one. This header stands in for
+// USBMonitor/stdafx.h and maps the few Windows and MSVC names that code uses.
+//////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+typedef uint32_t DWORD;
+typedef int64_t LONGLONG;
+
+using std::max;
+using std::min;
+
+#define _I8_MIN		INT8_MIN
+#define _I16_MIN	INT16_MIN
+#define _I32_MIN	INT32_MIN
+#define _UI8_MAX	UINT8_MAX
+#define _UI16_MAX	UINT16_MAX
+#define _UI32_MAX	UINT32_MAX
+#define _TRUNCATE	((size_t)-1)
+
+inline int _stricmp(const char* a, const char* b)
+{
+	return strcasecmp(a, b);
+}
+
+inline void _i64toa_s(long long value, char* buffer, size_t size, int /*radix*/)
+{
+	snprintf(buffer, size, "%lld", value);
+}
+
+inline void _ui64toa_s(unsigned long long value, char* buffer, size_t size, int /*radix*/)
+{
+	snprintf(buffer, size, "%llu", value);
+}
+
+inline int _finite(double d)
+{
+	return isfinite(d);
+}
+
+#define _snprintf_s(buffer, size, count, ...) snprintf(buffer, size, __VA_ARGS__)
+
+#define __int64 long long
+
+// Debugging macros of debug.h, the benchmark has no use for them.
+#define _T(x) x
+#define TRACE(...) ((void)0)
+
+// JsonCpp library
+#include "json/json.h"
@@ -0,0 +1,111 @@
+# startup_bench.ps1: compares the startup time of the daemon in headless and windowed mode.
+#
+# Starts USBMonitor.exe Runs times in each mode, asks each instance for its "stats" on the
+# TCP port of driver_manager.ini and reads "startup_ms", the time from the process creation
+# until the daemon was ready, then stops it with "shutdown". A [socket] token is presented,
+# a token_file isn't read. The windowed mode only creates the window with [app] show_ui=1.
+# Run it from the bin directory, with no other instance running:
+#     powershell -ExecutionPolicy Bypass -File ..\tools\StartupBench\startup_bench.ps1 -Runs 20
+##########################################################################################
+
+param(
+	[string]$Exe = ".\USBMonitor.exe",
+	[int]$Runs = 10,
+	[int]$TimeoutSeconds = 10
+)
+
+$ErrorActionPreference = "Stop"
+
+$iniFile = Join-Path (Split-Path -Parent (Resolve-Path $Exe)) "driver_manager.ini"
+$port = 8000
+$token = ""
+foreach ($line in Get-Content $iniFile)
+{
+	if ($line -match '^\s*port\s*=\s*(\d+)') { $port = [int]$Matches[1] }
+	elseif ($line -match '^\s*token\s*=\s*(.*)$') { $token = $Matches[1].Trim() }
+}
+
+# Send the command lines and return the response of the last one.
+function Invoke-Daemon([string[]]$lines)
+{
+	$deadline = [DateTime]::Now.AddSeconds($TimeoutSeconds)
+	while ($true)
+	{
+		try
+		{
+			$client = New-Object System.Net.Sockets.TcpClient("127.0.0.1", $port)
+			break
+		}
+		catch
+		{
+			if ([DateTime]::Now -gt $deadline) { throw "The daemon isn't listening on port $port" }
+			Start-Sleep -Milliseconds 20
+		}
+	}
+	try
+	{
+		$stream = $client.GetStream()
+		$reader = New-Object System.IO.StreamReader($stream)
+		$writer = New-Object System.IO.StreamWriter($stream)
+		$writer.NewLine = "`n"
+		if ($token -ne "")
+		{
+			$writer.WriteLine("auth`t$token")
+		}
+		foreach ($line in $lines)
+		{
+			$writer.WriteLine("#bench`t$line")
+		}
+		$writer.Flush()
+		$remaining = $lines.Count
+		while ($remaining -gt 0)
+		{
+			$response = $reader.ReadLine()
+			if ($response -eq $null) { throw "The daemon closed the connection" }
+			# Skip the device lists and the auth answer, which have no request ID.
+			if ($response -match '"id"\s*:\s*"bench"')
+			{
+				$remaining--
+				$last = $response
+			}
+		}
+		return $last | ConvertFrom-Json
+	}
+	finally
+	{
+		$client.Close()
+	}
+}
+
+function Measure-Startup([string]$mode, [string]$arguments)
+{
+	$times = @()
+	for ($i = 0; $i -lt $Runs; $i++)
+	{
+		$process = Start-Process -FilePath $Exe -ArgumentList $arguments -PassThru
+		try
+		{
+			$stats = (Invoke-Daemon @("stats")).result
+			if ([bool]$stats.headless -ne ($mode -eq "headless"))
+			{
+				throw "The daemon didn't start in $mode mode, check [app] headless"
+			}
+			$times += [int]$stats.startup_ms
+			Invoke-Daemon @("shutdown") | Out-Null
+			if (-not $process.WaitForExit($TimeoutSeconds * 1000)) { throw "The daemon didn't exit" }
+		}
+		finally
+		{
+			if (-not $process.HasExited) { $process.Kill() }
+		}
+	}
+	$sorted = $times | Sort-Object
+	$measure = $times | Measure-Object -Average -Minimum -Maximum
+	"{0,-10} {1,6} {2,10:N1} {3,8} {4,8} {5,8}" -f $mode, $Runs, $measure.Average,
+		$measure.Minimum, $sorted[[int][Math]::Floor(($Runs - 1) / 2)], $measure.Maximum
+}
+
+"{0,-10} {1,6} {2,10} {3,8} {4,8} {5,8}" -f "mode", "runs", "mean_ms", "min_ms", "p50_ms", "max_ms"
+Measure-Startup "headless" "headless"
+# Any other first parameter runs the window, as without parameter.
+Measure-Startup "windowed" "windowed"
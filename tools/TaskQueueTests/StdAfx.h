@@ -0,0 +1,120 @@
+// StdAfx.h: the Linux build of the task queue tests.
+//
+// The tests compile the task code of USBMonitor as it is. This header stands in for
+// USBMonitor/stdafx.h and maps the interlocked functions that code uses. The SList of
+// BlockPool is stood in for by a list behind a mutex: the pool is not what is tested.
+// The pointer exchange can yield to the other threads before and after it, so that the
+// windows the queue must handle are hit on any number of processors.
+//////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+typedef int32_t LONG;
+typedef void* PVOID;
+
+using std::max;
+using std::min;
+
+#define MEMORY_ALLOCATION_ALIGNMENT 16
+
+inline LONG InterlockedExchange(volatile LONG* pTarget, LONG value)
+{
+	return __atomic_exchange_n(pTarget, value, __ATOMIC_SEQ_CST);
+}
+
+// Set by the stress tests
+extern volatile bool g_bYieldAroundExchange;
+
+inline PVOID InterlockedExchangePointer(PVOID volatile* pTarget, PVOID value)
+{
+	if (g_bYieldAroundExchange)
+	{
+		std::this_thread::yield();
+	}
+	PVOID pPrevious = __atomic_exchange_n(pTarget, value, __ATOMIC_SEQ_CST);
+	if (g_bYieldAroundExchange)
+	{
+		std::this_thread::yield();
+	}
+	return pPrevious;
+}
+
+inline LONG InterlockedIncrement(volatile LONG* pTarget)
+{
+	return __atomic_add_fetch(pTarget, 1, __ATOMIC_SEQ_CST);
+}
+
+inline void* _aligned_malloc(size_t nSize, size_t nAlignment)
+{
+	void* p = NULL;
+	return (posix_memalign(&p, nAlignment, nSize) == 0) ? p : NULL;
+}
+
+inline void _aligned_free(void* p)
+{
+	free(p);
+}
+
+typedef struct _SLIST_ENTRY
+{
+	struct _SLIST_ENTRY* Next;
+} SLIST_ENTRY, *PSLIST_ENTRY;
+
+typedef struct _SLIST_HEADER
+{
+	PSLIST_ENTRY pFirst;
+	unsigned short nDepth;
+	std::mutex* pMutex;
+} SLIST_HEADER, *PSLIST_HEADER;
+
+// The headers live as long as the process, in static pools.
+inline void InitializeSListHead(PSLIST_HEADER pHead)
+{
+	pHead->pFirst = NULL;
+	pHead->nDepth = 0;
+	pHead->pMutex = new std::mutex;
+}
+
+inline PSLIST_ENTRY InterlockedFlushSList(PSLIST_HEADER pHead)
+{
+	std::lock_guard<std::mutex> lock(*pHead->pMutex);
+	PSLIST_ENTRY pEntry = pHead->pFirst;
+	pHead->pFirst = NULL;
+	pHead->nDepth = 0;
+	return pEntry;
+}
+
+inline PSLIST_ENTRY InterlockedPopEntrySList(PSLIST_HEADER pHead)
+{
+	std::lock_guard<std::mutex> lock(*pHead->pMutex);
+	PSLIST_ENTRY pEntry = pHead->pFirst;
+	if (pEntry != NULL)
+	{
+		pHead->pFirst = pEntry->Next;
+		pHead->nDepth--;
+	}
+	return pEntry;
+}
+
+inline PSLIST_ENTRY InterlockedPushEntrySList(PSLIST_HEADER pHead, PSLIST_ENTRY pEntry)
+{
+	std::lock_guard<std::mutex> lock(*pHead->pMutex);
+	PSLIST_ENTRY pFirst = pHead->pFirst;
+	pEntry->Next = pFirst;
+	pHead->pFirst = pEntry;
+	pHead->nDepth++;
+	return pFirst;
+}
+
+inline unsigned short QueryDepthSList(PSLIST_HEADER pHead)
+{
+	std::lock_guard<std::mutex> lock(*pHead->pMutex);
+	return pHead->nDepth;
+}
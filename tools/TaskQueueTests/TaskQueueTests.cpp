@@ -0,0 +1,169 @@
+// TaskQueueTests.cpp: stress tests of the task queue of the UI thread.
+//
+// Producer threads push tasks while a consumer thread runs the batches, as the reactor
+// does. A push which asks for a wakeup counts as a posted message, and the consumer
+// begins one batch per wakeup. Once the consumer has handled every wakeup the pushes
+// asked for, each task pushed must have run: a task left behind would wait for an
+// unrelated push.
+//////////////////////////////////////////////////////////////////////
+
+#include "StdAfx.h"
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include "TaskQueue.h"
+
+volatile bool g_bYieldAroundExchange = false;
+
+// Stands in for the reactor of the UI thread
+class Consumer
+{
+public:
+	Consumer(void) : m_nWakeups(0), m_bBusy(false), m_bQuit(false), m_nRun(0)
+	{
+		m_thread = std::thread([this]() { Run(); });
+	}
+
+	~Consumer(void)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_bQuit = true;
+		}
+		m_cv.notify_all();
+		m_thread.join();
+	}
+
+	// From a producer
+	void Push(Task task)
+	{
+		if (m_queue.Push(std::move(task)))
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_nWakeups++;
+			m_cv.notify_all();
+		}
+	}
+
+	// Wait until the consumer has handled every wakeup, and return the number of tasks run.
+	long WaitIdle()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cv.wait(lock, [this]() { return m_nWakeups == 0 && !m_bBusy; });
+		return m_nRun;
+	}
+
+private:
+	void Run()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;)
+		{
+			m_cv.wait(lock, [this]() { return m_nWakeups > 0 || m_bQuit; });
+			if (m_nWakeups == 0)
+			{
+				break;
+			}
+			m_nWakeups--;
+			m_bBusy = true;
+			lock.unlock();
+
+			long nRun = 0;
+			Task task;
+			m_queue.BeginBatch();
+			while (m_queue.Pop(task))
+			{
+				task();
+				nRun++;
+			}
+
+			lock.lock();
+			m_nRun += nRun;
+			m_bBusy = false;
+			m_cv.notify_all();
+		}
+	}
+
+	TaskQueue m_queue;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	int m_nWakeups;
+	bool m_bBusy;
+	bool m_bQuit;
+	long m_nRun;
+	std::thread m_thread;
+};
+
+static const int ROUNDS = 20000;
+static const int PRODUCERS = 3;
+static const int TASKS_PER_PRODUCER = 2;
+
+// Short bursts from several producers released together, so that pushes often race
+// with the consumer taking the last task of a batch. Yielding around the exchange of the
+// tail lets a push happen between the consumer reading the tail and putting the stub
+// behind the last task, and lets the consumer run before a producer links its node.
+static bool TestEveryTaskRunsAfterItsWakeup()
+{
+	g_bYieldAroundExchange = true;
+	Consumer consumer;
+	volatile LONG lExecuted = 0;
+	volatile LONG lRound = 0;
+	volatile LONG lDone = 0;
+	std::vector<std::thread> producers;
+	for (int i = 0; i < PRODUCERS; i++)
+	{
+		producers.push_back(std::thread([&]()
+		{
+			for (LONG round = 1; round <= ROUNDS; round++)
+			{
+				while (lRound < round)
+				{
+					std::this_thread::yield();
+				}
+				for (int j = 0; j < TASKS_PER_PRODUCER; j++)
+				{
+					consumer.Push([&lExecuted]() { InterlockedIncrement(&lExecuted); });
+				}
+				InterlockedIncrement(&lDone);
+			}
+		}));
+	}
+
+	bool bResult = true;
+	for (LONG round = 1; round <= ROUNDS && bResult; round++)
+	{
+		InterlockedExchange(&lRound, round);
+		while (lDone < round * PRODUCERS)
+		{
+			std::this_thread::yield();
+		}
+		long nPushed = round * PRODUCERS * TASKS_PER_PRODUCER;
+		long nRun = consumer.WaitIdle();
+		if (nRun != nPushed)
+		{
+			printf("FAIL round %d: %ld tasks pushed, %ld run after the last wakeup\n", static_cast<int>(round), nPushed, nRun);
+			bResult = false;
+		}
+	}
+
+	// Let the producers finish, the consumer runs what is left of a failed round.
+	InterlockedExchange(&lRound, ROUNDS);
+	for (size_t i = 0; i < producers.size(); i++)
+	{
+		producers[i].join();
+	}
+	consumer.WaitIdle();
+	g_bYieldAroundExchange = false;
+	return bResult;
+}
+
+int main()
+{
+	if (!TestEveryTaskRunsAfterItsWakeup())
+	{
+		printf("1 failure\n");
+		return 1;
+	}
+	printf("all tests passed\n");
+	return 0;
+}